@@ -152,6 +152,9 @@ class OBConversion; //used only as pointer
       //! Electronic transition data (e.g., UV/Vis, excitation energies, etc.)
       ElectronicTransitionData = 29,
 
+      //! Data items of an SD file not parsed yet (see OBPropertyBlockData)
+      PropertyBlockData = 30,
+
       // space for up to 2^14 more entries...
 
       //! Custom (user-defined data)
@@ -287,6 +290,13 @@ class OBConversion; //used only as pointer
       virtual void  SetTitle(const char *) {}
 
       //! \name Generic data handling methods (via OBGenericData)
+      //! The lookups by attribute and those of the type
+      //! OBGenericDataType::PairData (HasData(), GetData(), GetAllData(),
+      //! DeleteData()) first turn the items of an OBPropertyBlockData into
+      //! OBPairData. They therefore modify the data of the object even when
+      //! nothing is deleted: iterators from BeginData() or GetData() may be
+      //! invalidated, and the object must not be read by several threads at
+      //! the same time.
       //@{
       //! \return whether the generic attribute/value pair exists
       bool                              HasData(const std::string &);
@@ -338,6 +348,11 @@ class OBConversion; //used only as pointer
     protected:
       std::vector<OBGenericData*> _vdata; //!< Custom data
 
+    private:
+      //! Turn the item \p attr of an OBPropertyBlockData and the items
+      //! before it into OBPairData, or all of its items if \p attr is NULL
+      //! \return the new OBPairData for \p attr, or NULL
+      OBGenericData* ExpandPropertyBlock(const char *attr);
     };
 
 } //namespace OpenBabel
@@ -42,7 +42,7 @@ namespace OpenBabel
   class OBAPI OBBuilder {
     public:
 
-      OBBuilder(): _keeprings(false) {}
+      OBBuilder(): _keeprings(false), _randomSeed(0) {}
 
       ///@name Call the build algorithm
       //@{
@@ -67,6 +67,14 @@ namespace OpenBabel
        */
       void SetKeepRings() { _keeprings = true; }
       void UnsetKeepRings() { _keeprings = false; }
+      /*! Set the seed of the random directions used by Build() when the
+       *  position of an atom is not determined by its neighbours. Each call
+       *  to Build() starts again from the seed, so that the coordinates do
+       *  not depend on the molecules built before, or on other threads.
+       *  \param seed The seed, 0 (default) uses the shared time-seeded generator.
+       *  \since version 3.1
+       */
+      void SetRandomSeed(unsigned int seed) { _randomSeed = seed; }
       //@}
 
 
@@ -179,6 +187,7 @@ namespace OpenBabel
       static void AddRingNbrs(OBBitVec &fragment, OBAtom *atom, OBMol &mol);
       static bool SwapWithVector(OBMol &mol, int a, int b, int c, const vector3 &newlocation);
       bool _keeprings;
+      unsigned int _randomSeed;
   }; // class OBBuilder
 
 }// namespace OpenBabel
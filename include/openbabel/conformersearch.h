@@ -165,6 +165,25 @@ namespace OpenBabel {
        */
       virtual double Score(OBMol &mol, unsigned int index, const RotorKeys &keys,
           const std::vector<double*> &conformers) = 0;
+      /**
+       * Can Score() be called from several threads at the same time? Each
+       * thread then passes its own copy of the molecule.
+       * @since 3.1
+       */
+      virtual bool HasThreadSafeScore() { return false; }
+      /**
+       * Score all conformers at once using up to @p nthreads threads.
+       * Scores which can share work between the conformers override this.
+       * @return False if not implemented, Score() is then called for each
+       * conformer.
+       * @since 3.1
+       */
+      virtual bool ScoreAll(OBMol &/*mol*/, const RotorKeys &/*keys*/,
+          const std::vector<double*> &/*conformers*/, std::vector<double> &/*scores*/,
+          int /*nthreads*/)
+      {
+        return false;
+      }
       virtual ~OBConformerScore() = 0;
   };
 
@@ -183,6 +202,13 @@ namespace OpenBabel {
       Convergence GetConvergence() { return Average; }
       double Score(OBMol &mol, unsigned int index, const RotorKeys &keys,
           const std::vector<double*> &conformers);
+      bool HasThreadSafeScore() { return true; }
+      /**
+       * Compute the RMSD of all pairs of conformers once with OBRMSDMatrix.
+       */
+      bool ScoreAll(OBMol &mol, const RotorKeys &keys,
+          const std::vector<double*> &conformers, std::vector<double> &scores,
+          int nthreads);
   };
 
   /**
@@ -204,6 +230,7 @@ namespace OpenBabel {
       Convergence GetConvergence() { return Lowest; }
       double Score(OBMol &mol, unsigned int index, const RotorKeys &keys,
           const std::vector<double*> &conformers);
+      bool HasThreadSafeScore() { return true; }
     private:
       mapRotorEnergy energy_map;
       long unsigned int energy_ncompute;
@@ -229,6 +256,7 @@ namespace OpenBabel {
       Convergence GetConvergence() { return Lowest; }
       double Score(OBMol &mol, unsigned int index, const RotorKeys &keys,
           const std::vector<double*> &conformers);
+      bool HasThreadSafeScore() { return true; }
     private:
       mapRotorEnergy energy_map;
       long unsigned int energy_ncompute;
@@ -251,6 +279,7 @@ namespace OpenBabel {
       Convergence GetConvergence() { return Average; }
       double Score(OBMol &mol, unsigned int index, const RotorKeys &keys,
           const std::vector<double*> &conformers);
+      bool HasThreadSafeScore() { return true; }
   };
 
   //////////////////////////////////////////////////////////
@@ -400,6 +429,21 @@ namespace OpenBabel {
       
       /* @brief Set the local optimization rate */
       void SetLocalOptRate (int value) {local_opt_rate = value;}
+
+      /* @brief Set the number of threads scoring the conformers of a generation
+         (default 1). Each thread scores its own block of conformers with a
+         copy of the molecule, if the score supports it (see
+         OBConformerScore::HasThreadSafeScore()). The result does not depend
+         on the number of threads. */
+      void SetNumThreads (int value) {m_nthreads = value > 0 ? value : 1;}
+
+      /* @brief Get the number of threads scoring the conformers */
+      int GetNumThreads () {return m_nthreads;}
+
+      /* @brief Set the seed of the random numbers used by the search. With the
+         same seed and score, the search finds the same conformers. 0 seeds
+         from the current time (default). */
+      void SetRandomSeed (unsigned int seed);
       
       /* @brief Get the local optimization rate*/
       int  SetLocalOptRate() {return local_opt_rate;}
@@ -434,6 +478,8 @@ namespace OpenBabel {
       int share_fitness ();
       //! @brief Perform one generation with fitness sharing
       double sharing_generation ();
+      //! @brief Score the conformers of m_rotorKeys, on m_nthreads threads
+      void ScoreConformers(const std::vector<double*> &conformers, std::vector<double> &scores);
 
       unsigned int m_numConformers; //!< The desired number of conformers. This is also the population size.
       int m_numChildren; //!< The number of children generated each generation
@@ -454,6 +500,7 @@ namespace OpenBabel {
       double p_crossover;	//!< Crossover probability
       double niche_mating;	//!< Probability of forcing the second parent in the first parent
       int local_opt_rate;       //!< Perform a random local optimization every local_opt_rate generations. Disabled if set to 
+      int m_nthreads;           //!< The number of threads scoring the conformers
       OBBitVec      m_fixedBonds; //!< Bonds that are fixed
       OBMol         m_mol; //!< The molecule with starting coordinates
       OBRotorList   m_rotorList; //!< The OBRotorList for the molecule
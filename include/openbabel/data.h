@@ -220,9 +220,20 @@ namespace OpenBabel
       std::string GetToType();
     };
 
+#ifndef THREAD_LOCAL
+#ifdef SWIG
+# define THREAD_LOCAL
+# elif (__cplusplus >= 201103L)
+#  define THREAD_LOCAL thread_local
+# else
+#  define THREAD_LOCAL
+# endif
+#endif
+
   //! Global OBTypeTable for translating between different atom types
-  //! (e.g., Sybyl <-> MM2)
-  EXTERN  OBTypeTable      ttab;
+  //! (e.g., Sybyl <-> MM2). One for each thread, as the
+  //! translation state is kept in the table.
+  THREAD_LOCAL EXTERN  OBTypeTable      ttab;
 
   /** \class OBResidueData data.h <openbabel/data.h>
       \brief Table of common biomolecule residues (for PDB or other files).
@@ -264,6 +275,16 @@ namespace OpenBabel
       //! Assign bond orders, atom types and residues for the supplied OBMol
       //! based on the residue information assigned to atoms
       bool AssignBonds(OBMol &);
+      //! Bond the atoms of the residues in the table from their templates,
+      //! link consecutive amino acids of a chain and bond the other atoms
+      //! (ligands, water, hydrogens and atoms with unknown names, and
+      //! cysteine SG) by distance, as OBMol::ConnectTheDots() does. Bond
+      //! orders are perceived for the atoms not in a template only, so this
+      //! is much faster than ConnectTheDots() and PerceiveBondOrders() for
+      //! large biomolecules. Atom IDs are compared without white space.
+      //! \param bondOrders if false, all the bonds are single bonds
+      //! \return the number of atoms bonded from a template
+      unsigned int AssignTemplateBonds(OBMol &, bool bondOrders = true);
     };
 
   //! Global OBResidueData biomolecule residue database
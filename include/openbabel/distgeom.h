@@ -38,6 +38,7 @@ namespace OpenBabel {
 
   class DistanceGeometryPrivate;
   class OBCisTransStereo;
+  class OBRandom;
 
   class TetrahedralInfo {
     int c;
@@ -82,8 +83,40 @@ namespace OpenBabel {
 
     void Generate();
     void AddConformer();
+    /**
+     * Generate conformers from independent random starts and add the ones
+     * which meet the stereo and distance constraints, until there are
+     * @p numConformers new conformers or @p maxStarts starts have been tried.
+     *
+     * All starts share the bounds matrix from Setup(). They are run in
+     * parallel if several threads are set with SetNumThreads(), and the
+     * conformers are added in the order of the starts, so with a random
+     * seed the result does not depend on the number of threads.
+     *
+     * @param numConformers The number of conformers to add
+     * @param maxStarts The maximum number of starts (0 means NumAtoms() per
+     * conformer, as for AddConformer())
+     *
+     * \return The number of conformers added
+     * \since version 3.1
+     */
+    unsigned int AddConformers(unsigned int numConformers, unsigned int maxStarts = 0);
+    /**
+     * Copy the conformers generated since Setup() to @p mol.
+     */
     void GetConformers(OBMol &mol);
 
+    //! Set the number of threads used by AddConformers() \since version 3.1
+    void SetNumThreads(int n) { _nthreads = n > 0 ? n : 1; }
+    int GetNumThreads() const { return _nthreads; }
+    /**
+     * Set the seed of the random starts. Start k of AddConformers() (or the
+     * trials of AddConformer()) then uses seed + k.
+     * \param seed The seed, 0 (default) seeds from the time.
+     * \since version 3.1
+     */
+    void SetRandomSeed(unsigned int seed) { _randomSeed = seed; }
+
     /**
      * Convenience method to set up this molecule, generate a geometry and return it
      *
@@ -106,14 +139,23 @@ namespace OpenBabel {
     OBMol                     _mol;
     std::vector<OBGenericData*> _vdata;
     DistanceGeometryPrivate  *_d;    //!< Internal private data, including bounds matrix
-    Eigen::VectorXd _coord;          // one-dimensional vector containing coordinates of atoms
     std::string input_smiles;
 
     unsigned int dim;
-
-    bool generateInitialCoords();
-    bool firstMinimization();
-    bool minimizeFourthDimension();
+    int _nthreads;
+    unsigned int _randomSeed;
+    int _firstConformer;             //!< The first conformer generated after Setup()
+
+    // Each random start works on its own coordinates (dim values per atom)
+    bool generateInitialCoords(OBRandom &generator, Eigen::VectorXd &coord);
+    bool firstMinimization(Eigen::VectorXd &coord);
+    bool minimizeFourthDimension(Eigen::VectorXd &coord);
+    //! \brief Embed from one random start and check the result
+    //! @param mol A copy of the molecule which is given the coordinates
+    //! \return True if the stereo and distance constraints are met
+    bool Embed(unsigned int seed, Eigen::VectorXd &coord, OBMol &mol);
+    //! \return The seed of the first start
+    unsigned int FirstSeed();
     
     //! \brief Set the default upper bounds for the constraint matrix
     //! Upper bounds = maximum length of the molecule, or 1/2 the body diagonal in a unit cell
@@ -144,10 +186,10 @@ namespace OpenBabel {
     void CorrectStereoConstraints(double scale = 1.0);
     //! \brief Check that the double bond and atom stereo constraints are met
     //! \return True if all constraints are valid
-    bool CheckStereoConstraints();
+    bool CheckStereoConstraints(OBMol &mol);
 
     //! \return True if the bounds are met
-    bool CheckBounds();
+    bool CheckBounds(OBMol &mol);
   };
   class DistGeomFunc {
     OBDistanceGeometry* const owner;
@@ -32,6 +32,7 @@ GNU General Public License for more details.
 namespace OpenBabel
 {
   class OBGridData;
+  class OBConversion;
 
   // log levels
 #define OBFF_LOGLVL_NONE	0   //!< no output
@@ -410,9 +411,74 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
     double _factor;
   };
 
+  //! \class OBFFTrajectoryWriter forcefield.h <openbabel/forcefield.h>
+  //! \brief Streams molecular dynamics frames to an output format
+  //!
+  //! The atoms and bonds of the molecule are copied once, every frame only
+  //! replaces the coordinates before the frame is passed to
+  //! OBConversion::Write(). The output stream and format have to be set on
+  //! the OBConversion object. Binary trajectory formats (e.g. XTC) avoid
+  //! the text formatting of every frame.
+  //! \code
+  //! std::ofstream ofs("traj.xtc", std::ios::binary);
+  //! OBConversion conv;
+  //! conv.SetOutFormat("xtc");
+  //! conv.SetOutStream(&ofs);
+  //! OBFFTrajectoryWriter writer(&conv);
+  //! pFF->SetTrajectoryWriter(&writer, 50);
+  //! \endcode
+  //! \since version 3.1
+  class OBFPRT OBFFTrajectoryWriter
+  {
+  public:
+    /*! \param conv Conversion object with the output format and stream set.
+     *  It is not owned by the writer.
+     */
+    OBFFTrajectoryWriter(OBConversion *conv) : _conv(conv), _numFrames(0) {}
+    virtual ~OBFFTrajectoryWriter() {}
+    /*! Write a frame.
+     *  \param mol The molecule the frame belongs to. Only used for the first frame.
+     *  \param coords The 3N coordinates of the frame.
+     *  \return False if the output format failed to write the frame.
+     */
+    virtual bool WriteFrame(const OBMol &mol, const double *coords);
+    //! \return The number of frames written so far.
+    unsigned int GetNumFrames() const { return _numFrames; }
+
+  protected:
+    OBConversion *_conv; //!< Output conversion
+    OBMol _frame; //!< Copy of the molecule, only the coordinates are updated for each frame
+    unsigned int _numFrames; //!< Number of frames written
+  };
+
+  /*! \class OBForceFieldBase forcefield.h <openbabel/forcefield.h>
+   *  \brief Base class of OBForceField holding the variables its constructor sets
+   *
+   *  The constructor of OBForceField comes from MAKE_PLUGIN(), so the
+   *  variables which must have a defined value in every instance, including
+   *  those made with MakeNewInstance(), are set here.
+   *  \since version 3.1
+   */
+  class OBFPRT OBForceFieldBase : public OBPlugin
+  {
+    protected:
+      OBForceFieldBase() : _gradientPtr(NULL), _logos(NULL), _loglvl(OBFF_LOGLVL_NONE),
+        _origLogLevel(OBFF_LOGLVL_NONE), _nthreads(1), _randomSeed(0), _grad1(NULL),
+        _trajWriter(NULL) {}
+
+      double	*_gradientPtr; //!< pointer to the gradients (used by AddGradient(), minimization functions, ...)
+      std::ostream* _logos; //!< Output for logfile
+      int 	_loglvl; //!< Log level for output
+      int 	_origLogLevel;
+      int 	_nthreads; //!< Number of threads for batched energy evaluations (see SetNumThreads())
+      unsigned int _randomSeed; //!< Seed for RandomRotorSearch() and WeightedRotorSearch(), 0 = time
+      double 	*_grad1; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
+      OBFFTrajectoryWriter *_trajWriter; //!< trajectory output, NULL if not set
+  };
+
   // Class OBForceField
   // class introduction in forcefield.cpp
-  class OBFPRT OBForceField : public OBPlugin
+  class OBFPRT OBForceField : public OBForceFieldBase
   {
     MAKE_PLUGIN(OBForceField)
 
@@ -523,30 +589,94 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
      */
     bool IsInSameRing(OBAtom* a, OBAtom* b);
 
+    /*! Calculate the energy (including the constraint energy) and the forces
+     *  (negative gradient) at the current coordinates. Forces on fixed atoms
+     *  and fixed coordinates are set to zero. Used by LBFGSTakeNSteps() and
+     *  FIRETakeNSteps().
+     *  \param forces Array of size 3N to store the forces in (may be _gradientPtr).
+     *  \param maxforce2 If not NULL, set to the largest squared atomic force.
+     *  \return The energy.
+     */
+    double EnergyAndForces(double *forces, double *maxforce2 = NULL);
+    /*! Line search along the L-BFGS direction _lbfgsDir starting at origCoords.
+     *  On success the coordinates, _lbfgsGrad and energy are updated to the new point.
+     *  \return False if no lower energy was found.
+     */
+    bool LBFGSLineSearch(const double *origCoords, double step, double &energy);
+    /*! Apply the SHAKE bond constraints to the current coordinates after the
+     *  velocity Verlet position update. The velocities are corrected for the
+     *  constraint displacements.
+     *  \param oldCoords The coordinates before the position update.
+     *  \return False if the constraints did not converge.
+     */
+    bool ShakePositions(const double *oldCoords);
+    /*! Remove the velocity components along the constrained bonds (RATTLE).
+     *  \return False if the constraints did not converge.
+     */
+    bool RattleVelocities();
+    //! Rebuild the non-bonded pairs with a buffer of MD_PAIR_SKIN around the cut-off distances
+    void UpdateMDPairs();
+    /*! Minimize nconf coordinate sets stored contiguously in coords ([nconf][N][3])
+     *  with L-BFGS. All coordinate sets are advanced in lock-step and the energy
+     *  and forces for each (line search) step are computed with a single call to
+     *  EnergyBatch().
+     *  \param coords The coordinate sets, replaced by the minimized coordinates.
+     *  \param nconf The number of coordinate sets.
+     *  \param steps The maximum number of steps.
+     *  \param econv Energy convergence criteria.
+     *  \param energies Array of size nconf to store the final energies in.
+     */
+    void MinimizeBatch(double *coords, unsigned int nconf, int steps, double econv,
+                       double *energies);
+    /*! Minimize all conformers of _mol with MinimizeBatch(), select the one with
+     *  the lowest energy and store the energies in _energies. Used by the rotor searches.
+     */
+    void MinimizeRotorSearchConformers(unsigned int geomSteps);
+    /*! Same as EnergyBatch(), but the coordinate sets are divided over
+     *  GetNumThreads() threads if HasThreadSafeEnergyBatch() is true. The
+     *  result does not depend on the number of threads.
+     */
+    void EnergyBatchThreaded(const double *coords, unsigned int nconf,
+                             double *energies, double *forces);
+
     // general variables
     OBMol 	_mol; //!< Molecule to be evaluated or minimized
     bool 	_init; //!< Used to make sure we only parse the parameter file once, when needed
     std::string	_parFile; //! < parameter file name
     bool 	_validSetup; //!< was the last call to Setup succesfull
-    double	*_gradientPtr; //!< pointer to the gradients (used by AddGradient(), minimization functions, ...)
     // logging variables
-    std::ostream* _logos; //!< Output for logfile
     char 	_logbuf[BUFF_SIZE+1]; //!< Temporary buffer for logfile output
-    int 	_loglvl; //!< Log level for output
-    int 	_origLogLevel;
     // conformer genereation (rotor search) variables
     int 	_current_conformer; //!< used to hold i for current conformer (needed by UpdateConformers)
     std::vector<double> _energies; //!< used to hold the energies for all conformers
+    std::vector<std::vector<double> > _rotorWeights; //!< Rotor setting weights at the end of WeightedRotorSearch()
     // minimization variables
     double 	_econv, _gconv, _e_n1; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
     int 	_cstep, _nsteps; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
-    double 	*_grad1; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
     unsigned int _ncoords; //!< Number of coordinates for conjugate gradients
     int         _linesearch; //!< LineSearch type
+    int         _lbfgsk, _lbfgsEnd; //!< Number of stored L-BFGS correction pairs and next slot to overwrite
+    std::vector<double> _lbfgsS, _lbfgsY; //!< L-BFGS history of coordinate and gradient differences
+    std::vector<double> _lbfgsYS, _lbfgsAlpha; //!< L-BFGS s'y values and two-loop recursion scratch space
+    std::vector<double> _lbfgsGrad, _lbfgsDir; //!< L-BFGS gradient and search direction
+    double      _fireDt, _fireAlpha; //!< FIRE time step and velocity mixing factor
+    int         _fireNPos; //!< Number of FIRE steps since the power P = F.v was last negative
+    std::vector<double> _fireVel; //!< FIRE velocities
     // molecular dynamics variables
     double 	_timestep; //!< Molecular dynamics time step in picoseconds
     double 	_temp; //!< Molecular dynamics temperature in Kelvin
     double 	*_velocityPtr; //!< pointer to the velocities
+    std::vector<double> _mdVel; //!< velocity Verlet velocities (A ps^-1), empty if not initialized
+    std::vector<double> _mdAccel; //!< velocity Verlet accelerations (A ps^-2)
+    std::vector<double> _mdInvMass; //!< inverse atomic masses (amu^-1), 0 for fixed atoms
+    std::vector<double> _mdPairCoords; //!< coordinates at the last non-bonded pair update
+    std::vector<unsigned int> _mdBonds; //!< coordinate offsets of the constrained X-H bonds (pairs)
+    std::vector<double> _mdBondLength2; //!< squared lengths of the constrained X-H bonds
+    double 	_mdTau; //!< Berendsen thermostat coupling time in picoseconds (0 = no thermostat)
+    double 	_mdUnit; //!< conversion factor from the energy unit to amu A^2 ps^-2
+    double 	_mdNdf; //!< number of degrees of freedom
+    int 	_mdStep; //!< number of velocity Verlet steps taken
+    int 	_trajFreq; //!< write a frame every _trajFreq steps
     // contraint varibles
     static OBFFConstraints _constraints; //!< Constraints
     static unsigned int _fixAtom; //!< SetFixAtom()/UnsetFixAtom()
@@ -603,6 +733,17 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
     {
       return FindType(ID);
     }
+    /*! The force field plugin instances hold the molecule they are set up
+     *  for, so code which can run in several threads at once uses an
+     *  instance of its own thread instead. It is made with MakeNewInstance()
+     *  on first use, keeps its parameters for later molecules, and is
+     *  deleted when the thread ends.
+     *  \param ID forcefield id (Ghemical, MMFF94, UFF, ...).
+     *  \return The force field instance of the calling thread, or NULL if
+     *  not available.
+     *  \since version 3.1
+     */
+    static OBForceField* GetThreadInstance(const char *ID);
     /*
      *
      */
@@ -621,6 +762,13 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
      * \return True if all analytical gradients are implemented.
      */
     virtual bool HasAnalyticalGradients() { return false; }
+    /*! Can EnergyBatch() be called from several threads at the same time? The
+     *  default implementation copies the coordinates into the molecule and is not
+     *  thread safe.
+     *  \return True if EnergyBatch() only reads the force field and molecule data.
+     *  \since version 3.1
+     */
+    virtual bool HasThreadSafeEnergyBatch() { return false; }
     /*! Setup the forcefield for mol (assigns atom types, charges, etc.). Keep current constraints.
      *  \param mol The OBMol object that contains the atoms and bonds.
      *  \return True if succesfull.
@@ -960,6 +1108,27 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
      *	  see Energy()
      */
     virtual double E_Electrostatic(bool UNUSED(gradients) = true) { return 0.0f; }
+    /*! Calculate the energy and forces for several coordinate sets at once.
+     *  The coordinate sets are stored contiguously ([nconf][N][3], same atom
+     *  order as the molecule used in Setup()). The energies include the
+     *  constraint energy, forces on fixed atoms are set to zero (see
+     *  EnergyAndForces()). The current coordinates are not changed.
+     *
+     *  The default implementation evaluates the coordinate sets one after the
+     *  other. Force fields can override this to make a single pass over their
+     *  interaction terms, computing each term for all coordinate sets before
+     *  moving on to the next (MMFF94). The non-bonded cut-off is not used for
+     *  batched evaluations.
+     *
+     *  \param coords The coordinate sets (nconf * N * 3 doubles).
+     *  \param nconf The number of coordinate sets.
+     *  \param energies Array of size nconf to store the energies in.
+     *  \param forces Array of size nconf * N * 3 to store the forces in. If
+     *  NULL, only the energies are calculated.
+     *  \since version 3.1
+     */
+    virtual void EnergyBatch(const double *coords, unsigned int nconf,
+                             double *energies, double *forces);
     //@}
 
     /////////////////////////////////////////////////////////////////////////
@@ -1042,6 +1211,42 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
 
     //! \name Methods for structure generation
     //@{
+    /*! Set the number of threads used by the rotor searches. Each thread
+     *  evaluates the energies and gradients of its own block of conformers
+     *  (see EnergyBatch()) while the force field parameters are shared. The
+     *  generated conformers do not depend on the number of threads. Only
+     *  used if Open Babel was compiled with OpenMP support and the force field
+     *  supports it (see HasThreadSafeEnergyBatch()).
+     *  \param n The number of threads (default is 1).
+     *  \since version 3.1
+     */
+    void SetNumThreads(int n)
+    {
+      _nthreads = n > 0 ? n : 1;
+    }
+    /*! \return The number of threads used by the rotor searches.
+     *  \since version 3.1
+     */
+    int GetNumThreads()
+    {
+      return _nthreads;
+    }
+    /*! Set the random seed for RandomRotorSearch() and WeightedRotorSearch().
+     *  With the same seed, these searches generate the same conformers.
+     *  \param seed The seed, 0 (default) seeds the random number generator from the current time.
+     *  \since version 3.1
+     */
+    void SetRandomSeed(unsigned int seed)
+    {
+      _randomSeed = seed;
+    }
+    /*! \return The random seed for RandomRotorSearch() and WeightedRotorSearch().
+     *  \since version 3.1
+     */
+    unsigned int GetRandomSeed()
+    {
+      return _randomSeed;
+    }
     //! Generate coordinates for the molecule (distance geometry)
     //! \deprecated Use OBDistanceGeometry class instead
     void DistanceGeometry();
@@ -1162,6 +1367,15 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
      */
     void WeightedRotorSearch(unsigned int conformers, unsigned int geomSteps,
                              bool sampleRingBonds = false);
+    /*! \return The weights of the rotor settings at the end of the last
+     *  WeightedRotorSearch(), indexed by rotor (from 1) and setting. With 0
+     *  conformers, these are the initial weights.
+     *  \since version 3.1
+     */
+    const std::vector<std::vector<double> >& GetRotorWeights() const
+    {
+      return _rotorWeights;
+    }
     /**
      * @brief A fast rotor search to find low energy conformations
      *
@@ -1189,7 +1403,10 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
     int FastRotorSearch(bool permute = true);
 
 #ifdef HAVE_EIGEN
-    //! \since version 2.4
+    /*! Generate a diverse set of low energy conformers (Confab). The energies
+     *  of the rotamers are computed in batches, on GetNumThreads() threads.
+     *  \since version 2.4
+     */
     int DiverseConfGen(double rmsd, unsigned int nconfs = 0, double energy_gap = 50, bool verbose = false);
 #endif
 
@@ -1368,6 +1585,90 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
      *  OBFF_LOGLVL_HIGH:   see note above \n
     */
     bool ConjugateGradientsTakeNSteps(int n);
+    /*! Perform limited-memory BFGS optimization for steps steps or until convergence criteria is reached.
+     *  L-BFGS builds an approximation of the inverse Hessian from the last few
+     *  steps and usually needs far fewer energy and gradient evaluations than
+     *  ConjugateGradients() to converge.
+     *
+     *  \param steps The number of steps.
+     *  \param econv Energy convergence criteria. (default is 1e-6)
+     *
+     *  \par Output to log:
+     *  This function should only be called with the log level set to OBFF_LOGLVL_NONE or OBFF_LOGLVL_LOW. Otherwise
+     *  too much information about the energy calculations needed for the minimization will interfere with the list
+     *  of energies for succesive steps. \n\n
+     *  OBFF_LOGLVL_NONE:   none \n
+     *  OBFF_LOGLVL_LOW:    information about the progress of the minimization \n
+     *  OBFF_LOGLVL_MEDIUM: see note above \n
+     *  OBFF_LOGLVL_HIGH:   see note above \n
+     *  \since version 3.1
+     */
+    void LBFGS(int steps, double econv = 1e-6f);
+    /*! Initialize L-BFGS optimization, to be used in combination with LBFGSTakeNSteps().
+     *
+     *  example:
+     *  \code
+     *  // pFF is a pointer to a OBForceField class
+     *  pFF->LBFGSInitialize(100, 1e-5f);
+     *  while (pFF->LBFGSTakeNSteps(5)) {
+     *    // do some updating in your program (redraw structure, ...)
+     *  }
+     *  \endcode
+     *
+     *  If you don't need any updating in your program, LBFGS() is recommended.
+     *
+     *  \param steps The number of steps.
+     *  \param econv Energy convergence criteria. (default is 1e-6)
+     *  \since version 3.1
+     */
+    void LBFGSInitialize(int steps = 1000, double econv = 1e-6f);
+    /*! Take n steps in a L-BFGS optimization that was previously initialized with LBFGSInitialize().
+     *  The line search along the L-BFGS direction is the backtracking line search
+     *  of the L-BFGS solver also used by OBDistanceGeometry (LineSearchType is ignored).
+     *
+     *  \param n The number of steps to take.
+     *  \return False if convergence or the number of steps given by LBFGSInitialize() has been reached.
+     *  \since version 3.1
+     */
+    bool LBFGSTakeNSteps(int n);
+    /*! Perform FIRE (Fast Inertial Relaxation Engine) optimization for steps steps
+     *  or until convergence criteria is reached. FIRE is a damped dynamics minimizer
+     *  which needs only one energy and gradient evaluation per step.
+     *
+     *  E. Bitzek, P. Koskinen, F. Gaehler, M. Moseler, P. Gumbsch,
+     *  Phys. Rev. Lett. 97, 170201 (2006)
+     *
+     *  \param steps The number of steps.
+     *  \param econv Energy convergence criteria. (default is 1e-6)
+     *  \since version 3.1
+     */
+    void FIRE(int steps, double econv = 1e-6f);
+    /*! Initialize FIRE optimization, to be used in combination with FIRETakeNSteps().
+     *
+     *  \param steps The number of steps.
+     *  \param econv Energy convergence criteria. (default is 1e-6)
+     *  \since version 3.1
+     */
+    void FIREInitialize(int steps = 1000, double econv = 1e-6f);
+    /*! Take n steps in a FIRE optimization that was previously initialized with FIREInitialize().
+     *
+     *  \param n The number of steps to take.
+     *  \return False if convergence or the number of steps given by FIREInitialize() has been reached.
+     *  \since version 3.1
+     */
+    bool FIRETakeNSteps(int n);
+    /*! Minimize all conformers of the molecule (see SetConformers()) with
+     *  L-BFGS. The conformers are kept in one contiguous buffer and minimized
+     *  together: each step evaluates the energy and gradients of all
+     *  conformers that have not converged yet with a single call to
+     *  EnergyBatch(). The minimized conformers and their energies can be
+     *  retrieved with GetConformers().
+     *
+     *  \param steps The maximum number of steps for each conformer.
+     *  \param econv Energy convergence criteria. (default is 1e-6)
+     *  \since version 3.1
+     */
+    void MinimizeConformers(int steps = 2500, double econv = 1e-6f);
     //@}
 
     /////////////////////////////////////////////////////////////////////////
@@ -1400,6 +1701,12 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
      */
     void CorrectVelocities();
     /*! Take n steps at temperature T. If no velocities are set, they will be generated.
+     *
+     *  Since version 3.1 this is a velocity Verlet run with a Berendsen
+     *  thermostat (coupling time 10 * timestep), see VelocityVerletInitialize()
+     *  and VelocityVerletTakeNSteps(). The run is initialized again when T or
+     *  timestep change. The forces are always analytical gradients, so method
+     *  is ignored.
      *
      *  example:
      *  \code
@@ -1412,9 +1719,63 @@ const double GAS_CONSTANT = 8.31446261815324e-3 / KCAL_TO_KJ;  //!< kcal mol^-1
      *  \param n The number of steps to take.
      *  \param T Absolute temperature in Kelvin.
      *  \param timestep The time step in picoseconds. (10e-12 s)
-     *  \param method OBFF_ANALYTICAL_GRADIENTS (default) or OBFF_NUMERICAL_GRADIENTS
+     *  \param method Ignored since version 3.1 (was OBFF_ANALYTICAL_GRADIENTS or
+     *  OBFF_NUMERICAL_GRADIENTS).
      */
     void MolecularDynamicsTakeNSteps(int n, double T, double timestep = 0.001, int method = OBFF_ANALYTICAL_GRADIENT);
+    /*! Initialize a velocity Verlet molecular dynamics run. The velocities
+     *  are taken from a Maxwell-Boltzmann distribution at temperature T (see
+     *  SetRandomSeed()) and the center of mass motion is removed.
+     *
+     *  If cut-offs are enabled, the non-bonded pairs are kept in a neighbor
+     *  list with a buffer of 1 A around the cut-off distances that is only
+     *  rebuilt when an atom has moved more than half the buffer.
+     *
+     *  example:
+     *  \code
+     *  // 2 fs time step with the bonds to hydrogen constrained
+     *  pFF->VelocityVerletInitialize(300.0, 0.002, 0.1, true);
+     *  pFF->SetTrajectoryWriter(&writer, 50);
+     *  pFF->VelocityVerletTakeNSteps(5000);
+     *  \endcode
+     *
+     *  \param T Absolute temperature in Kelvin.
+     *  \param timestep The time step in picoseconds.
+     *  \param tau The coupling time of the Berendsen thermostat in picoseconds.
+     *  Use 0 to run without thermostat (constant energy).
+     *  \param constrainH Keep the bonds to hydrogen at their current length (SHAKE/RATTLE).
+     *  \since version 3.1
+     */
+    void VelocityVerletInitialize(double T, double timestep = 0.001, double tau = 0.1,
+                                  bool constrainH = false);
+    /*! Take n steps in a velocity Verlet molecular dynamics run that was
+     *  previously initialized with VelocityVerletInitialize().
+     *  \param n The number of steps to take.
+     *  \return False if the run is not initialized, the constraints failed to
+     *  converge or the trajectory writer failed.
+     *  \since version 3.1
+     */
+    bool VelocityVerletTakeNSteps(int n);
+    /*! \return The kinetic energy of the velocity Verlet run in the energy unit
+     *  of the force field (see GetUnit()).
+     *  \since version 3.1
+     */
+    double GetKineticEnergy();
+    /*! \return The instantaneous temperature of the velocity Verlet run in Kelvin.
+     *  \since version 3.1
+     */
+    double GetTemperature();
+    /*! Write a frame of the velocity Verlet run to writer every frequency steps.
+     *  \param writer The trajectory writer, NULL to stop writing frames. The
+     *  writer is not owned by the force field.
+     *  \param frequency The number of steps between frames.
+     *  \since version 3.1
+     */
+    void SetTrajectoryWriter(OBFFTrajectoryWriter *writer, int frequency = 100)
+    {
+      _trajWriter = writer;
+      _trajFreq = frequency > 0 ? frequency : 1;
+    }
     //@}
 
     /////////////////////////////////////////////////////////////////////////
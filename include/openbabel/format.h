@@ -37,6 +37,8 @@ namespace OpenBabel
 #define WRITEBINARY     0x40
 #define READXML         0x80
 #define DEPICTION2D     0x100
+#define WRITETHREADSAFE 0x200
+#define NOTEXTNUMBERS   0x400
 #define DEFAULTFORMAT   0x4000
 
   /// @brief Base class for file formats.
@@ -116,6 +118,11 @@ std::cerr << "Not a valid input format"; return false;}
     /// Currently, can be a bitwise OR of any of the following
     /// NOTREADABLE READONEONLY NOTWRITABLE WRITEONEONLY DEFAULTFORMAT
     /// READBINARY WRITEBINARY READXML
+    /// WRITETHREADSAFE means that WriteMolecule() can be called from several
+    /// threads at once, each with its own OBConversion and output stream.
+    /// NOTEXTNUMBERS means that the format reads and writes no numbers as
+    /// text, so the C numeric locale is not set around ReadMolecule() and
+    /// WriteMolecule().
     virtual unsigned int Flags() { return 0;};
 
     /// @brief Skip past first n objects in input stream (or current one with n=0)
@@ -123,6 +123,53 @@ namespace OpenBabel
     {      return(_value);    }
   };
 
+  //! \class OBPropertyBlockData generic.h <openbabel/generic.h>
+  //! \brief The data items of an SD file record, kept as text until they are used
+  //!
+  //! Stored instead of one OBPairData per item when an SD file is read with
+  //! the option -aL. OBBase::GetData(const std::string&) and HasData() turn
+  //! the item they look for into an OBPairData, and the functions that return
+  //! all OBPairData of an object (e.g. GetAllData(OBGenericDataType::PairData))
+  //! turn all of them. The MDL format writes the remaining items from the text.
+  //! \since version 3.1
+  class OBAPI OBPropertyBlockData : public OBGenericData
+  {
+  protected:
+    //! Position of an item in the text
+    struct Item
+    {
+      std::string::size_type attrBegin, attrEnd, valueBegin, valueEnd;
+      bool extracted;
+    };
+    std::string _block; //!< The lines after the connection table, up to "$$$$"
+    std::vector<Item> _items;
+    bool _indexed;
+    void Index();
+  public:
+    OBPropertyBlockData();
+    virtual OBGenericData* Clone(OBBase* /*parent*/) const
+      {return new OBPropertyBlockData(*this);}
+    //! The text, to which lines (each ending with '\n') can be appended
+    //! before any item is used
+    std::string &GetBlock()              { return _block; }
+    //! \return the number of items in the text, extracted or not
+    unsigned int NumItems();
+    //! \return whether item \p i has been turned into an OBPairData
+    bool IsExtracted(unsigned int i);
+    std::string GetItemAttribute(unsigned int i);
+    //! \return the value of item \p i, as it would be in an OBPairData
+    std::string GetItemValue(unsigned int i);
+    //! \return the items not extracted yet up to the first one with the
+    //! attribute \p attr, as new OBPairData owned by the caller in the order
+    //! of the file, or none if there is no such item. The extracted items are
+    //! therefore always the first ones, so that the OBPairData placed before
+    //! the block keep the order of the file.
+    std::vector<OBPairData*> ExtractThrough(const char *attr);
+    //! \return the items not extracted yet as new OBPairData, in the order
+    //! of the file. They are then all extracted.
+    std::vector<OBPairData*> ExtractAll();
+  };
+
   //! \class OBPairTemplate generic.h <openbabel/generic.h>
   //! \brief Used to store arbitrary attribute/value relationsips of any type.
   // More detailed description in generic.cpp
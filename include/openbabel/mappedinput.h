@@ -0,0 +1,192 @@
+/**********************************************************************
+mappedinput.h - Memory-mapped input files and line-by-line reading
+                without copying
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OB_MAPPEDINPUT_H
+#define OB_MAPPEDINPUT_H
+
+#include <openbabel/babelconfig.h>
+
+#include <cstddef>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifndef OBCONV
+  #define OBCONV
+#endif
+
+namespace OpenBabel
+{
+  /** \class OBLineRef mappedinput.h <openbabel/mappedinput.h>
+      \brief A reference to characters owned by someone else
+
+      A minimal string view: a pointer and a length. The characters are not
+      null-terminated, so use Str() or the conversion functions rather than
+      passing Data() to C functions.
+  */
+  class OBCONV OBLineRef
+  {
+  public:
+    OBLineRef() : _data(""), _size(0) {}
+    OBLineRef(const char *data, std::size_t size) : _data(data), _size(size) {}
+
+    const char* Data() const { return _data; }
+    std::size_t Size() const { return _size; }
+    bool Empty() const { return _size == 0; }
+    char operator[](std::size_t i) const { return _data[i]; }
+    //! \return A copy of the characters
+    std::string Str() const { return std::string(_data, _size); }
+
+    //! \return The characters from \p pos (at most \p n of them); empty if
+    //! \p pos is past the end
+    OBLineRef Substr(std::size_t pos, std::size_t n = std::string::npos) const;
+    //! \return The position of the first of \p chars at or after \p pos, or std::string::npos
+    std::size_t FindFirstOf(const char *chars, std::size_t pos = 0) const;
+    bool StartsWith(const char *prefix) const;
+    //! \return The reference without leading and trailing white space
+    OBLineRef Trim() const;
+    //! Split at any of \p delimiters; empty tokens are skipped
+    void Tokenize(std::vector<OBLineRef> &tokens, const char *delimiters = " \t\n\r") const;
+
+    //! Convert with strtod().
+    //! \return false if the characters do not start with a number
+    bool ToDouble(double &value) const;
+    //! Convert with strtol().
+    //! \return false if the characters do not start with a number
+    bool ToInt(int &value) const;
+
+  private:
+    const char *_data;
+    std::size_t _size;
+  };
+
+  /** \class OBMappedStreambuf mappedinput.h <openbabel/mappedinput.h>
+      \brief A read-only stream buffer over a memory-mapped file
+
+      The whole file is the get area, so reading through an istream never
+      copies it into a buffer and seeking is a pointer assignment. Lines can
+      also be taken straight from the mapping with GetLine().
+
+      Mapping needs mmap() (\<sys/mman.h\>); elsewhere, and for empty or
+      special files, Open() fails and the caller should use an ifstream.
+  */
+  class OBCONV OBMappedStreambuf : public std::streambuf
+  {
+  public:
+    OBMappedStreambuf();
+    virtual ~OBMappedStreambuf();
+
+    //! Map \p filename.
+    //! \return false if the file could not be mapped
+    bool Open(const std::string &filename);
+    void Close();
+    bool IsOpen() const { return _data != NULL; }
+    std::size_t Size() const { return _size; }
+
+    //! Take the next line from the current position. The line ends at
+    //! "\n", "\r\n" or "\r", which is not part of \p line.
+    //! \param terminated set to false if the line ended at the end of the file
+    //! \return false at the end of the file
+    bool GetLine(OBLineRef &line, bool &terminated);
+
+  protected:
+    virtual std::streampos seekoff(std::streamoff off, std::ios_base::seekdir way,
+      std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+    virtual std::streampos seekpos(std::streampos sp,
+      std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+
+  private:
+    OBMappedStreambuf(const OBMappedStreambuf&);
+    OBMappedStreambuf& operator=(const OBMappedStreambuf&);
+
+    char *_data;
+    std::size_t _size;
+  };
+
+  /** \class OBMappedInStream mappedinput.h <openbabel/mappedinput.h>
+      \brief An istream that reads a memory-mapped file
+
+      OBConversion reads input files through one of these when the file can
+      be mapped, and through an ifstream otherwise.
+  */
+  class OBCONV OBMappedInStream : public std::istream
+  {
+  public:
+    OBMappedInStream();
+    explicit OBMappedInStream(const std::string &filename);
+
+    //! Map \p filename; the stream is in a failed state if that is not possible
+    bool Open(const std::string &filename);
+    void Close();
+    bool IsOpen() const { return _buf.IsOpen(); }
+
+  private:
+    OBMappedStreambuf _buf;
+  };
+
+  /** \class OBLineReader mappedinput.h <openbabel/mappedinput.h>
+      \brief Reads lines from an input stream without copying them when possible
+
+      When \p is reads (directly or through OBConversion's line ending
+      filter) from an OBMappedStreambuf, the lines are references into the
+      mapped file and the per-character work of the istream is skipped.
+      Otherwise std::getline() is used, or for a stream without the line
+      ending filter (e.g. std::cin) a loop which also ends lines at "\r" and
+      "\r\n". Either way the line endings are normalised as by
+      LineEndingExtractor and the stream state is set as std::getline()
+      would set it, so the reader can be mixed with other reads from \p is.
+
+      \code
+      OBLineReader reader(*pConv->GetInStream());
+      OBLineRef line;
+      while (reader.GetLine(line) && !line.StartsWith("$$$$"))
+        ...
+      \endcode
+  */
+  class OBCONV OBLineReader
+  {
+  public:
+    explicit OBLineReader(std::istream &is);
+
+    //! \return Whether the lines are read from a memory-mapped file
+    bool IsMapped() const { return _mapped != NULL; }
+
+    //! Read the next line; \p line stays valid until the next call (or for
+    //! as long as the mapping when IsMapped())
+    //! \return false at the end of the input
+    bool GetLine(OBLineRef &line);
+    //! Read the next line into \p line, like std::getline()
+    bool GetLine(std::string &line);
+    //! Read the next line into \p buffer, like istream::getline(); a line
+    //! with \p size or more characters is truncated and sets failbit
+    bool GetLine(char *buffer, std::size_t size);
+
+  private:
+    std::istream &_is;
+    OBMappedStreambuf *_mapped;
+    std::streambuf *_filter; //!< the line ending filter between _is and _mapped
+    bool _raw; //!< _is is neither mapped nor filtered: line endings are normalised here
+    std::string _line;
+  };
+
+} // end namespace OpenBabel
+
+#endif // OB_MAPPEDINPUT_H
+
+//! \file mappedinput.h
+//! \brief Memory-mapped input files and line-by-line reading without copying
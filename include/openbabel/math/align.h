@@ -107,6 +107,22 @@ namespace OpenBabel
      * Reference Molecule).
      */
     void SetTargetMol(const OBMol &targetmol);
+    /**
+     * Set the Reference from the coordinates (x1, y1, z1, x2, ...) of
+     * @p numAtoms atoms. The coordinates are copied into storage which is
+     * reused by later calls, so this is the fastest way to perform many
+     * alignments.
+     * @since version 3.1
+     */
+    void SetRef(const double *coords, unsigned int numAtoms);
+    void SetRef(const float *coords, unsigned int numAtoms);
+    /**
+     * Set the Target from the coordinates (x1, y1, z1, x2, ...) of
+     * @p numAtoms atoms.
+     * @since version 3.1
+     */
+    void SetTarget(const double *coords, unsigned int numAtoms);
+    void SetTarget(const float *coords, unsigned int numAtoms);
     //@}
 
     ///@name Execute the alignment
@@ -189,7 +205,9 @@ namespace OpenBabel
     std::vector<vector3> _targetmol_coords;
     Eigen::MatrixXd _result;
     Eigen::MatrixXd _mref, _mtarget;
+    Eigen::MatrixXd _mtarget_perm; // _mtarget permuted by the best automorphism
     void VectorsToMatrix(const std::vector<vector3> *pcoords, Eigen::MatrixXd &coords);
+    template<typename T> void ArrayToMatrix(const T *coords, unsigned int numAtoms, Eigen::MatrixXd &mcoords);
     Eigen::Vector3d MoveToOrigin(Eigen::MatrixXd &coords);
     void SimpleAlign(const Eigen::MatrixXd &mtarget);
     void TheobaldAlign(const Eigen::MatrixXd &mtarget);
@@ -200,6 +218,140 @@ namespace OpenBabel
     // If the atom with Idx=3 is not in the fragment, it will be
     // converted to newidx(10X243) instead.
     std::vector<unsigned int> _newidx;
+    // For each automorphism, the column of _mtarget that corresponds to
+    // each column of _mref (computed once by SetRefMol)
+    std::vector<std::vector<unsigned int> > _autcols;
+    double PermutedSquaredDeviation(const std::vector<unsigned int> &cols);
+  };
+
+  /**
+   * \class OBRMSDMatrix align.h <openbabel/math/align.h>
+   * \brief Compute the pairwise RMSD of an ensemble of conformers
+   *
+   * This class computes the RMSD of every pair of conformers after a
+   * least-squares alignment. The coordinates of all conformers are copied
+   * into a single buffer and moved to the origin once, when they are added.
+   * Each pair is then handled with the QCP method (Theobald) on this buffer
+   * without further copies or memory allocation, so this is much faster than
+   * calling OBAlign for each pair.
+   *
+   * The conformers must all have the same number of atoms in the same order.
+   * By default, the atoms are compared one to one. Atom permutations (for
+   * example, the automorphisms of the molecule) may be added with
+   * AddPermutation() in which case the RMSD of a pair is the minimum over
+   * the permutations.
+   *
+   * \code
+   * OBRMSDMatrix ensemble;
+   * ensemble.AddConformers(mol); // heavy atoms only
+   * std::vector<double> rmsd;
+   * ensemble.GetMatrix(rmsd);
+   * // rmsd[OBRMSDMatrix::CondensedIndex(ensemble.NumConformers(), i, j)]
+   * \endcode
+   *
+   * @since version 3.1
+   */
+  class OBAPI OBRMSDMatrix {
+  public:
+    /**
+     * Constructor. The number of atoms is taken from the first conformer
+     * if @p numAtoms is 0.
+     */
+    OBRMSDMatrix(unsigned int numAtoms = 0);
+
+    /**
+     * Remove all conformers and permutations.
+     */
+    void Clear();
+    /**
+     * Add a conformer with 3 * NumAtoms() coordinates (x1, y1, z1, x2, ...).
+     * @return The index of the conformer.
+     */
+    unsigned int AddConformer(const double *coords);
+    /**
+     * Add a conformer. The size of @p coords must equal NumAtoms() unless
+     * this is the first conformer.
+     * @return The index of the conformer.
+     */
+    unsigned int AddConformer(const std::vector<vector3> &coords);
+    /**
+     * Add all conformers of @p mol. By default, only the heavy atoms are
+     * used (set @p includeH to true to include the hydrogens).
+     */
+    void AddConformers(OBMol &mol, bool includeH = false);
+    /**
+     * Remove the last conformer that was added.
+     */
+    void RemoveLastConformer();
+    /**
+     * Add a permutation of the atoms. When comparing conformers i and j,
+     * atom k of conformer i is then also matched with atom perm[k] of
+     * conformer j. The identity is always tried.
+     */
+    void AddPermutation(const std::vector<unsigned int> &perm);
+
+    unsigned int NumConformers() const
+    {
+      return _numConformers;
+    }
+    unsigned int NumAtoms() const
+    {
+      return _numAtoms;
+    }
+
+    /**
+     * Set the number of threads used by GetMatrix(). The result does not
+     * depend on the number of threads. This has no effect if Open Babel
+     * was compiled without OpenMP.
+     */
+    void SetNumThreads(int n)
+    {
+      _nthreads = n > 0 ? n : 1;
+    }
+    int GetNumThreads() const
+    {
+      return _nthreads;
+    }
+
+    /**
+     * @return The RMSD of conformers @p i and @p j after alignment.
+     */
+    double GetRMSD(unsigned int i, unsigned int j) const;
+    /**
+     * Compute the RMSD of all pairs of conformers. The result is stored as
+     * a condensed matrix with the NumConformers() * (NumConformers() - 1) / 2
+     * elements above the diagonal, row by row (see CondensedIndex()).
+     *
+     * If a @p threshold is given, pairs which are known to be further apart
+     * than the threshold from the radii of gyration are not aligned. The
+     * value stored for these pairs is a lower bound of their RMSD which is
+     * larger than the threshold.
+     */
+    void GetMatrix(std::vector<double> &condensed, double threshold = HUGE_VAL) const;
+    /**
+     * @return The index of the pair @p i, @p j (i != j) in the condensed
+     * matrix of @p n conformers.
+     */
+    static std::size_t CondensedIndex(unsigned int n, unsigned int i, unsigned int j)
+    {
+      if (i > j)
+        std::swap(i, j);
+      return (std::size_t)i * (2 * n - i - 1) / 2 + j - i - 1;
+    }
+
+  private:
+    double SquaredDeviation(unsigned int i, unsigned int j) const;
+
+    unsigned int _numAtoms;
+    unsigned int _numConformers;
+    //! Conformer i starts at _coords[3 * _stride * i] as _stride x, y
+    //! and z coordinates (zero padded) relative to its centroid
+    unsigned int _stride;
+    std::vector<double> _coords;
+    //! The sum of the squared coordinates of each conformer
+    std::vector<double> _innerprod;
+    std::vector<std::vector<unsigned int> > _perms;
+    int _nthreads;
   };
 }
 
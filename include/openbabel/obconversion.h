@@ -53,6 +53,15 @@ namespace OpenBabel {
 
   OBERROR extern  OBMessageHandler obErrorLog;
 
+  /// @brief Base class of the state an input format keeps for one OBConversion
+  /// (see OBConversion::SetReaderState()). It is deleted with the OBConversion.
+  /// \since version 3.1
+  class OBCONV OBReaderState
+  {
+  public:
+    virtual ~OBReaderState() {}
+  };
+
   //*************************************************
   /// @brief Class to convert from one format to another.
   // Class introduction in obconversion.cpp
@@ -142,6 +151,11 @@ namespace OpenBabel {
       ///@brief Extension method: deleted in ~OBConversion()
       OBConversion* GetAuxConv() const {return pAuxConv;};
       void          SetAuxConv(OBConversion* pConv) {pAuxConv=pConv;};
+      ///@brief State kept by the input format for this conversion, or NULL.
+      ///Not copied with the OBConversion.
+      OBReaderState* GetReaderState() const {return pReaderState;};
+      ///Takes ownership of \p pState, deleting the previous state
+      void          SetReaderState(OBReaderState* pState);
       //@}
       /** @name Option handling
        Three types of Option provide information and control instructions to the
@@ -413,6 +427,7 @@ protected:
       size_t rInlen; ///<length in the input stream of the object being read
 
       OBConversion* pAuxConv;///<Way to extend OBConversion
+      OBReaderState* pReaderState;///<Owned, see SetReaderState()
 
       std::vector<std::string> SupportedInputFormat; ///< list of supported input format
       std::vector<std::string> SupportedOutputFormat; ///< list of supported output format
@@ -85,6 +85,7 @@ public:
       OBConversion::RegisterOptionParam("j",         this, 0, OBConversion::GENOPTIONS);
       OBConversion::RegisterOptionParam("join",      this, 0, OBConversion::GENOPTIONS);
       OBConversion::RegisterOptionParam("separate",  this, 0, OBConversion::GENOPTIONS);
+      OBConversion::RegisterOptionParam("threads",   this, 1, OBConversion::GENOPTIONS);
 
       //The follow are OBMol options, which should not be in OBConversion.
       //But here isn't entirely appropriate either, since one could have
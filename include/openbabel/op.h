@@ -50,6 +50,13 @@ public:
   /// Do something with an array of objects. Used a a callback routine in OpSort, etc.
   virtual bool ProcessVec(std::vector<OBBase*>& /* vec */){ return false; }
 
+  /// Called with --threads in a reading thread, for each object as soon as it
+  /// has been read and before Do() is called for it. An op can compute here
+  /// what Do() will need and attach it to the object. Must be thread safe.
+  /// \p pConv is the OBConversion of the reading thread.
+  /// \return false if nothing was done
+  virtual bool Prepare(OBBase* /* pOb */, const char* /* OptionText */, OBConversion* /* pConv */){ return false; }
+
   /// \return string describing options, for display with -H and to make checkboxes in GUI
   static std::string OpOptions(OBBase* pOb)
   {
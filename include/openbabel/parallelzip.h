@@ -0,0 +1,259 @@
+/**********************************************************************
+parallelzip.h - Multi-threaded gzip streams: read-ahead decompression,
+                parallel block compression and BGZF random access
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OB_PARALLELZIP_H
+#define OB_PARALLELZIP_H
+
+#include <openbabel/babelconfig.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef OBCONV
+  #define OBCONV
+#endif
+
+// The classes are only available when Open Babel is built with zlib
+#ifdef HAVE_LIBZ
+
+namespace OpenBabel
+{
+  /** \class OBReadAheadStreambuf parallelzip.h <openbabel/parallelzip.h>
+      \brief Reads a source stream on a separate thread, ahead of the reader
+
+      A reader thread fills a bounded queue of blocks from the source while
+      the characters already read are consumed. With a decompressing source
+      (zlib_stream::zip_istream) inflation then overlaps parsing.
+
+      The thread is started by the first read and stopped by Stop(), by a
+      seek outside the current block and by the destructor. The source must
+      not be used by anyone else while the thread runs. Positions are those
+      of the source.
+  */
+  class OBCONV OBReadAheadStreambuf : public std::streambuf
+  {
+  public:
+    OBReadAheadStreambuf(std::istream &source, std::size_t blockSize = 256 * 1024,
+                         std::size_t maxBlocks = 4);
+    virtual ~OBReadAheadStreambuf();
+
+    //! Stop the reader thread, e.g. before the source is closed. Reading
+    //! after this restarts it.
+    void Stop();
+
+  protected:
+    virtual int_type underflow();
+    virtual std::streampos seekoff(std::streamoff off, std::ios_base::seekdir way,
+      std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+    virtual std::streampos seekpos(std::streampos sp,
+      std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+
+  private:
+    OBReadAheadStreambuf(const OBReadAheadStreambuf&);
+    OBReadAheadStreambuf& operator=(const OBReadAheadStreambuf&);
+
+    void Run();
+    void Discard(std::streamoff pos);
+
+    std::istream &_source;
+    const std::size_t _blockSize, _maxBlocks;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _filled, _emptied;
+    std::deque<std::vector<char> > _queue; //!< blocks read ahead
+    bool _started, _end, _stop;
+    std::vector<char> _current;            //!< the get area, after a putback area
+    std::streamoff _start;                 //!< source position of the get area data
+  };
+
+  /** \class OBReadAheadInStream parallelzip.h <openbabel/parallelzip.h>
+      \brief An istream that reads ahead from another istream on a separate thread
+  */
+  class OBCONV OBReadAheadInStream : public std::istream
+  {
+  public:
+    explicit OBReadAheadInStream(std::istream &source) : std::istream(NULL), _buf(source)
+    {
+      rdbuf(&_buf);
+    }
+    void Stop() { _buf.Stop(); }
+
+  private:
+    OBReadAheadStreambuf _buf;
+  };
+
+  /** \class OBParallelZipStreambuf parallelzip.h <openbabel/parallelzip.h>
+      \brief Compresses blocks of the output concurrently, as pigz does
+
+      The output is buffered in blocks which are deflated in batches, one
+      block per thread (with OpenMP). Two layouts are written:
+
+      - gzip: a single gzip member. Each block is primed with the last 32KB
+        of the previous one and ends on a byte boundary, so the compression
+        ratio is close to that of a single deflate stream and any gzip
+        reader can read the result.
+      - BGZF: one gzip member per block of at most 64KB, with the block
+        size in an extra header field (as written by bgzip/samtools). This
+        compresses less well, but a reader can start at any block: see
+        OBBgzfStreambuf. The offsets of the blocks are kept and can be
+        saved as a .gzi index with WriteIndex().
+
+      Compression finishes in Finish() or the destructor; sync() does not
+      end a block, so flushing often does not hurt the compression.
+  */
+  class OBCONV OBParallelZipStreambuf : public std::streambuf
+  {
+  public:
+    //! \param level zlib compression level, or -1 for the default
+    OBParallelZipStreambuf(std::ostream &dest, bool bgzf = false, int level = -1);
+    virtual ~OBParallelZipStreambuf();
+
+    //! Compress the remaining output and write the gzip trailer (or the
+    //! BGZF end-of-file block). Nothing can be written after this.
+    //! \return false if writing to the destination failed
+    bool Finish();
+    //! The .gzi index is also written to \p filename by Finish() (BGZF only)
+    void SetIndexFile(const std::string &filename) { _indexFile = filename; }
+    //! Write the .gzi index of the blocks finished so far: the number of
+    //! entries and, for each block after the first, its compressed and
+    //! uncompressed offsets, all as 64-bit little-endian integers.
+    void WriteIndex(std::ostream &os) const;
+
+  protected:
+    virtual int_type overflow(int_type c);
+    virtual int sync();
+
+  private:
+    OBParallelZipStreambuf(const OBParallelZipStreambuf&);
+    OBParallelZipStreambuf& operator=(const OBParallelZipStreambuf&);
+
+    void QueueBlock();
+    void CompressBlocks(bool last);
+
+    std::ostream &_dest;
+    const bool _bgzf;
+    const int _level;
+    const std::size_t _blockSize;
+    std::vector<char> _block;               //!< the put area
+    std::vector<std::vector<char> > _pending; //!< full blocks, not yet compressed
+    std::string _dictionary;                //!< the end of the previous block (gzip)
+    unsigned long _crc, _size;              //!< of all the uncompressed data (gzip)
+    unsigned long long _compressedPos, _uncompressedPos;
+    std::vector<std::pair<unsigned long long, unsigned long long> > _index;
+    std::string _indexFile;
+    bool _finished;
+  };
+
+  /** \class OBParallelZipOutStream parallelzip.h <openbabel/parallelzip.h>
+      \brief An ostream that writes gzip or BGZF compressed data with several threads
+  */
+  class OBCONV OBParallelZipOutStream : public std::ostream
+  {
+  public:
+    explicit OBParallelZipOutStream(std::ostream &dest, bool bgzf = false, int level = -1)
+      : std::ostream(NULL), _buf(dest, bgzf, level)
+    {
+      rdbuf(&_buf);
+    }
+    bool Finish() { return _buf.Finish(); }
+    void SetIndexFile(const std::string &filename) { _buf.SetIndexFile(filename); }
+    void WriteIndex(std::ostream &os) const { _buf.WriteIndex(os); }
+
+  private:
+    OBParallelZipStreambuf _buf;
+  };
+
+  /** \class OBBgzfStreambuf parallelzip.h <openbabel/parallelzip.h>
+      \brief Reads BGZF compressed data, inflating batches of blocks concurrently
+
+      Since each BGZF block is a separate gzip member, a batch of blocks is
+      read from the source and inflated with one block per thread (with
+      OpenMP). Positions are offsets in the uncompressed data, and seeking
+      starts inflating at the block containing the position, found in the
+      .gzi index given to LoadIndex() or, without one, by scanning the
+      block headers once. The source must be seekable for that.
+  */
+  class OBCONV OBBgzfStreambuf : public std::streambuf
+  {
+  public:
+    explicit OBBgzfStreambuf(std::istream &source);
+
+    //! Read a .gzi index written by OBParallelZipStreambuf or bgzip -i
+    //! \return false if \p is does not contain an index
+    bool LoadIndex(std::istream &is);
+    //! \return Whether \p is, at its current position, starts with a BGZF
+    //! block. The position is not changed; false if \p is is not seekable.
+    static bool IsBGZF(std::istream &is);
+
+  protected:
+    virtual int_type underflow();
+    virtual std::streampos seekoff(std::streamoff off, std::ios_base::seekdir way,
+      std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+    virtual std::streampos seekpos(std::streampos sp,
+      std::ios_base::openmode which = std::ios_base::in | std::ios_base::out);
+
+  private:
+    OBBgzfStreambuf(const OBBgzfStreambuf&);
+    OBBgzfStreambuf& operator=(const OBBgzfStreambuf&);
+
+    bool ReadBlocks();
+    bool ScanIndex();
+
+    std::istream &_source;
+    std::vector<char> _current;             //!< the get area, after a putback area
+    std::streamoff _start;                  //!< uncompressed offset of the get area data
+    std::streamoff _sourcePos;              //!< compressed offset of the next block
+    std::streamoff _sourceOrigin;           //!< where the BGZF data starts in the source
+    bool _end;
+    //! (compressed, uncompressed) offsets of the blocks, starting with (0, 0)
+    std::vector<std::pair<unsigned long long, unsigned long long> > _index;
+    bool _indexComplete;                    //!< _index has every block, and ends with the total sizes
+  };
+
+  /** \class OBBgzfInStream parallelzip.h <openbabel/parallelzip.h>
+      \brief An istream that reads BGZF compressed data from another istream
+  */
+  class OBCONV OBBgzfInStream : public std::istream
+  {
+  public:
+    explicit OBBgzfInStream(std::istream &source) : std::istream(NULL), _buf(source)
+    {
+      rdbuf(&_buf);
+    }
+    bool LoadIndex(std::istream &is) { return _buf.LoadIndex(is); }
+
+  private:
+    OBBgzfStreambuf _buf;
+  };
+
+} // end namespace OpenBabel
+
+#endif // HAVE_LIBZ
+
+#endif // OB_PARALLELZIP_H
+
+//! \file parallelzip.h
+//! \brief Multi-threaded gzip streams: read-ahead decompression, parallel
+//! block compression and BGZF random access
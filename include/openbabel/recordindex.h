@@ -0,0 +1,137 @@
+/**********************************************************************
+recordindex.h - Sidecar index of record offsets for random access to
+                multi-molecule text files
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OB_RECORDINDEX_H
+#define OB_RECORDINDEX_H
+
+#include <openbabel/babelconfig.h>
+#include <openbabel/mappedinput.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+
+#ifndef OBCONV
+  #define OBCONV
+#endif
+
+namespace OpenBabel
+{
+  class OBFormat;
+
+  /** \class OBRecordReader recordindex.h <openbabel/recordindex.h>
+      \brief Splits SDF, SMILES, MOL2 and XYZ input into the text of its records
+
+      The record boundaries of these formats are found from single lines
+      ("$$$$", a newline, "@<TRIPOS>MOLECULE" and the atom count line), so
+      the records can be handed to separate readers without parsing them.
+      Used to build an OBRecordIndex and to parse records concurrently.
+
+      The offsets count the bytes read from the stream, so they are file
+      positions only for a stream opened in binary mode (and not read through
+      a memory mapping, where the line endings are removed by OBLineReader).
+  */
+  class OBCONV OBRecordReader
+  {
+  public:
+    OBRecordReader(std::istream &is, OBFormat *pFormat);
+
+    //! \return Whether records of this format can be split
+    static bool IsSupportedFormat(OBFormat *pFormat);
+
+    //! Read the next record and, if \p text is not NULL, store its lines
+    //! (without carriage returns) in it.
+    //! \return false at the end of the input
+    bool ReadRecord(std::string *text = NULL);
+    //! \return The offset of the last record read
+    std::streamoff GetRecordStart() const { return _recordStart; }
+    //! \return The number of bytes read from the stream
+    std::streamoff GetPosition() const { return _pos; }
+    //! \return The title of the last record read
+    const std::string& GetTitle() const { return _title; }
+
+  private:
+    bool GetLine(std::string &line, std::streamoff &start);
+
+    std::istream &_is;
+    OBLineReader _reader;
+    int _type;
+    std::streamoff _pos, _recordStart;
+    std::string _title;
+    std::string _pending; //!< the first line of the next MOL2 record
+    std::streamoff _pendingStart;
+    bool _hasPending;
+  };
+
+  /** \class OBRecordIndex recordindex.h <openbabel/recordindex.h>
+      \brief Offsets of the records in an SDF, SMILES, MOL2 or XYZ file
+
+      The index is stored next to the data file as \<datafile\>.obidx and
+      holds the byte offset and the title of every record. It is built once
+      with Build() and is only used by Load() while the size and modification
+      time of the data file are unchanged, so a stale index is never used.
+
+      Only the header is read by Load(). GetOffset() reads a single entry
+      from the index file, so seeking to record N takes constant time however
+      large the data file is. The titles are read on the first FindTitle().
+
+      OBConversion uses the index for the -f option, for \--seektitle and in
+      NumInputObjects() when a valid index exists; the \--index option builds
+      or refreshes it first.
+  */
+  class OBCONV OBRecordIndex
+  {
+  public:
+    OBRecordIndex();
+
+    //! \return The name of the index file for \p datafile
+    static std::string IndexFilename(const std::string &datafile);
+    //! Scan \p datafile and write its index file.
+    //! \return true if the index was written and loaded
+    bool Build(const std::string &datafile, OBFormat *pFormat);
+    //! Open the index of \p datafile.
+    //! \return false if there is no index, or it is stale or for another format
+    bool Load(const std::string &datafile, OBFormat *pFormat);
+
+    //! \return true after a successful Build() or Load()
+    bool IsValid() const { return _valid; }
+    //! \return The number of records in the data file
+    unsigned int NumRecords() const { return _numRecords; }
+    //! \return The byte offset of record \p n (1 to NumRecords(); NumRecords()+1
+    //! gives the end of the last record) or -1 if \p n is out of range
+    std::streamoff GetOffset(unsigned int n);
+    //! \return The number (from 1) of the first record titled \p title or 0
+    unsigned int FindTitle(const std::string &title);
+
+  private:
+    bool ReadTitles();
+
+    std::ifstream _ifs;
+    bool _valid;
+    unsigned int _numRecords;
+    std::streamoff _offsetsStart; //!< position of the offsets in the index file
+    std::map<std::string, unsigned int> _titles;
+    bool _titlesRead;
+  };
+
+} // end namespace OpenBabel
+
+#endif // OB_RECORDINDEX_H
+
+//! \file recordindex.h
+//! \brief Sidecar index of record offsets for random access to files
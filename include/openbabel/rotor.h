@@ -105,6 +105,10 @@ namespace OpenBabel
     std::vector<double>        _sp3sp3; //!< Default dihedral angles to check for generic sp3 - sp3 hybridized rotatable bonds (in radians)
     std::vector<double>        _sp3sp2; //!< Default dihedral angles to check for generic sp3 - sp2 hybridized rotatable bonds (in radians)
     std::vector<double>        _sp2sp2; //!< Default dihedral angles to check for generic sp2 - sp2 hybridized rotatable bonds (in radians)
+    bool                       _shared; //!< The rules of the default file, which are shared (and not owned)
+
+    //! Read the rules, or share the ones of the default file
+    void InitRules();
   public:
     OBRotorRules();
     ~OBRotorRules();
@@ -124,6 +128,29 @@ namespace OpenBabel
     //! \param delta potential dihedral angle steps (in degrees)
     void GetRotorIncrements(OBMol& mol,OBBond* bond,int refs[4],
                             std::vector<double> &vals,double &delta);
+    /**
+     * Find the first matching rule for each of the @p bonds. Each SMARTS
+     * pattern is matched once for all the bonds, instead of once for every
+     * bond as with GetRotorIncrements(). If the dihedral of a rule ends in a
+     * hydrogen, the matched atoms and the angles of the rule are returned;
+     * SetHeavyAtomReference() then gives the results of GetRotorIncrements()
+     * for the current geometry.
+     * \param refs set to the atom indexes (in mol) of the dihedral of each bond
+     * \param vals set to the angles to evaluate for each bond (in radians)
+     * \param deltas set to the dihedral angle step of each bond (in degrees)
+     * \since version 3.1
+     */
+    void FindRules(OBMol &mol, const std::vector<OBBond*> &bonds,
+                   std::vector<std::vector<int> > &refs,
+                   std::vector<std::vector<double> > &vals,
+                   std::vector<double> &deltas);
+    /**
+     * Replace a hydrogen at one end of the dihedral @p refs (as matched by a
+     * rule) by a heavy atom bonded to the same atom, and shift the angles
+     * @p vals by the current torsion between the two.
+     * \since version 3.1
+     */
+    static void SetHeavyAtomReference(OBMol &mol, int refs[4], std::vector<double> &vals);
     //! Turn off debugging output from GetRotorIncrements()
     void Quiet()                           { _quiet=true;      }
   };
@@ -459,6 +486,7 @@ namespace OpenBabel
     bool _quiet;                    //!< Control debugging output
     bool _removesym;                //!< Control removal of symmetric rotations
     bool _ringRotors;               //!< Are there ring rotors
+    bool _customRules;              //!< The rules are not read from the default file (see Init())
     OBBitVec _fixedatoms, _fixedbonds; //!< Bit vector of fixed (i.e., invariant) atoms
     OBRotorRules _rr;               //!< Database of rotatable bonds and dihedral angles to test
     std::vector<int> _dffv;         //!< Distance from fixed
@@ -467,6 +495,16 @@ namespace OpenBabel
     std::vector<std::pair<OBSmartsPattern*,std::pair<int,int> > > _vsym2;
     //!
     std::vector<std::pair<OBSmartsPattern*,std::pair<int,int> > > _vsym3;
+
+    //! Set the torsion values, dihedral and rotated atoms of the rotors from
+    //! the rules found by OBRotorRules::FindRules()
+    void SetTorVals(OBMol &mol, const std::vector<std::vector<int> > &refs,
+                    const std::vector<std::vector<double> > &vals,
+                    const std::vector<double> &deltas);
+    //! The n-fold symmetry of each rotor (1 if none), see RemoveSymVals()
+    void FindSymmetryFolds(OBMol &mol, std::vector<int> &folds);
+    //! Remove the symmetric torsion values for the folds of FindSymmetryFolds()
+    void RemoveSymTorsionValues(const std::vector<int> &folds);
   public:
     /**
      * Constructor.
@@ -518,6 +556,12 @@ namespace OpenBabel
     /**
      * Setup this rotor list for the supplied molecule. This method calls
      * FindRotors(), SetEvalAtoms(), and AssignTorVals().
+     *
+     * The rotatable bonds, their torsion rules and symmetry only depend on the
+     * molecular graph, and are kept as perceived data on @p mol. Another rotor
+     * list set up for the same molecule (e.g. for the next conformer search)
+     * reuses them as long as the atoms, bonds and bond orders are unchanged.
+     * They aren't kept with fixed atoms or bonds, or with rules read by Init().
      * @param mol The molecule.
      * @param sampleRings Whether to sample ring conformers - default = false
      * @return True if rotatable bonds were found.
@@ -536,6 +580,7 @@ namespace OpenBabel
      */
     void Init(std::string &fname)
     {
+      _customRules = true;
       _rr.SetFilename(fname);
       _rr.Init();
     }
@@ -107,7 +107,7 @@ namespace OpenBabel
   extern THREAD_LOCAL OBAromaticTyper  aromtyper;
   extern THREAD_LOCAL OBAtomTyper      atomtyper;
   extern THREAD_LOCAL OBPhModel        phmodel;
-  EXTERN OBTypeTable      ttab;
+  THREAD_LOCAL EXTERN OBTypeTable      ttab;
   
   //
   // OBAtom member functions
@@ -21,6 +21,7 @@ GNU General Public License for more details.
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/base.h>
+#include <openbabel/generic.h>
 
 using namespace std;
 
@@ -100,7 +101,7 @@ namespace OpenBabel
       if ((*i)->GetAttribute() == s)
         return(true);
 
-    return(false);
+    return(ExpandPropertyBlock(s.c_str()) != NULL);
   }
 
   bool OBBase::HasData(const char *s)
@@ -115,6 +116,8 @@ namespace OpenBabel
   {
     if (_vdata.empty())
       return(false);
+    if (dt == OBGenericDataType::PairData)
+      ExpandPropertyBlock(NULL);
 
     OBDataIterator i;
 
@@ -134,7 +137,7 @@ namespace OpenBabel
       if ((*i)->GetAttribute() == s)
         return *i;
 
-    return (OBGenericData*)0;
+    return ExpandPropertyBlock(s.c_str());
   }
 
   //! \return the value given an attribute name
@@ -146,11 +149,13 @@ namespace OpenBabel
       if (strcmp((*i)->GetAttribute().c_str(), s)==0)
         return *i;
 
-    return (OBGenericData*)0;
+    return ExpandPropertyBlock(s);
   }
 
   OBGenericData *OBBase::GetData(const unsigned int dt)
   {
+    if (dt == OBGenericDataType::PairData)
+      ExpandPropertyBlock(NULL);
     OBDataIterator i;
     for (i = _vdata.begin();i != _vdata.end();++i)
       if ((*i)->GetDataType() == dt)
@@ -161,6 +166,8 @@ namespace OpenBabel
   std::vector<OBGenericData *> OBBase::GetAllData(const unsigned int dt)
   {
     std::vector<OBGenericData *> matches;
+    if (dt == OBGenericDataType::PairData)
+      ExpandPropertyBlock(NULL);
 
     // return all values matching this type
     OBDataIterator i;
@@ -174,6 +181,7 @@ namespace OpenBabel
   std::vector<OBGenericData*>  OBBase::GetData(DataOrigin source)
   {
     std::vector<OBGenericData*> filtered; // filtered data only from source
+    ExpandPropertyBlock(NULL);
 
     OBDataIterator i;
     for (i = _vdata.begin();i != _vdata.end();++i)
@@ -199,6 +207,8 @@ namespace OpenBabel
 
   void OBBase::DeleteData(unsigned int dt)
   {
+    if (dt == OBGenericDataType::PairData)
+      ExpandPropertyBlock(NULL);
     vector<OBGenericData*> vdata;
     OBDataIterator i;
     for (i = _vdata.begin();i != _vdata.end();++i)
@@ -256,9 +266,38 @@ namespace OpenBabel
           return true;
       }
     }
+    OBGenericData *gd = ExpandPropertyBlock(s.c_str());
+    if (gd) {
+      DeleteData(gd);
+      return true;
+    }
     return false;//not found
   }
 
+  OBGenericData *OBBase::ExpandPropertyBlock(const char *attr)
+  {
+    OBDataIterator i;
+    for (i = _vdata.begin();i != _vdata.end();++i)
+      if ((*i)->GetDataType() == OBGenericDataType::PropertyBlockData)
+      {
+        OBPropertyBlockData *block = static_cast<OBPropertyBlockData*>(*i);
+        if (attr) {
+          // before the block, which stands for the items after them
+          vector<OBPairData*> items = block->ExtractThrough(attr);
+          if (items.empty())
+            return NULL;
+          _vdata.insert(i, items.begin(), items.end());
+          return items.back();
+        }
+        vector<OBPairData*> items = block->ExtractAll();
+        delete block;
+        i = _vdata.erase(i);
+        _vdata.insert(i, items.begin(), items.end());
+        return NULL;
+      }
+    return NULL;
+  }
+
 
   /// @addtogroup main Getting Started
   ///@{
@@ -37,6 +37,8 @@ GNU General Public License for more details.
 #include <openbabel/stereo/cistrans.h>
 #include <openbabel/stereo/tetrahedral.h>
 #include <openbabel/stereo/squareplanar.h>
+
+#include "rand.h"
 /* OBBuilder::GetNewBondVector():
  * - is based on OBAtom::GetNewBondVector()
  * - but: when extending a long chain all the bonds are trans
@@ -75,6 +77,155 @@ namespace OpenBabel
   std::map<std::string, std::vector<vector3> > OBBuilder::_rigid_fragments_cache;
   std::vector<std::pair<OBSmartsPattern*, std::vector<vector3> > > OBBuilder::_ring_fragments;
 
+  // The seeded generator of the Build() running in this thread, if any
+  static THREAD_LOCAL OBRandom* buildRandom = NULL;
+
+  // Makes the generator used by Build() when a seed is set, for its duration
+  class BuildRandomScope
+  {
+  public:
+    BuildRandomScope(unsigned int seed) : _previous(buildRandom)
+    {
+      if (seed) {
+        _generator.Seed(seed);
+        buildRandom = &_generator;
+      }
+    }
+    ~BuildRandomScope() { buildRandom = _previous; }
+  private:
+    OBRandom _generator;
+    OBRandom *_previous;
+  };
+
+  // A random unit vector, from the generator of Build() if it has a seed
+  static void RandomUnitVector(vector3 &v)
+  {
+    if (!buildRandom) {
+      v.randomUnitVector();
+      return;
+    }
+    double l;
+    do {
+      v.Set(buildRandom->NextFloat() - 0.5, buildRandom->NextFloat() - 0.5,
+            buildRandom->NextFloat() - 0.5);
+      l = v.length_2();
+    } while (l > 1.0 || l < 1e-4);
+    v.normalize();
+  }
+
+  // Counts of the atoms and bonds in the cycles of a ring fragment. The
+  // fragment can only match a molecule fragment with at least as many ring
+  // atoms, aromatic ('a') and aliphatic ('A'), and ring bonds.
+  struct RingFragmentKey
+  {
+    unsigned int aromatic, aliphatic, bonds;
+  };
+  // One key for each of the _ring_fragments
+  static vector<RingFragmentKey> ringFragmentKeys;
+  // Element signatures of the rigid fragments, sorted
+  static vector<unsigned int> rigidFragmentSignatures;
+
+  // A signature of the heavy atoms of a fragment which does not depend on
+  // their order: equal canonical SMILES have equal signatures
+  static unsigned int ElementTerm(unsigned int element)
+  {
+    unsigned int h = element * 0x9e3779b9U;
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    return h;
+  }
+
+  static unsigned int ElementSignature(OBMol &mol)
+  {
+    unsigned int signature = 0;
+    FOR_ATOMS_OF_MOL(a, mol)
+      if (a->GetAtomicNum() > 1)
+        signature += ElementTerm(a->GetAtomicNum());
+    return signature;
+  }
+
+  // 'a' or 'A' for each atom of the SMARTS pattern, '*' if it may be either
+  static string AtomAromaticity(const string &smarts, unsigned int numAtoms)
+  {
+    string result;
+    for (string::size_type i = 0; i < smarts.size(); ++i) {
+      char c = smarts[i];
+      if (c == '[') {
+        string::size_type end = smarts.find(']', i);
+        if (end == string::npos)
+          break;
+        // 'A' or 'a' but not an element such as Al or as
+        char first = smarts[i + 1], next = smarts[i + 2];
+        if ((first == 'A' || first == 'a') && !islower(next))
+          result += first;
+        else
+          result += '*';
+        i = end;
+      } else if (c == 'A' || c == 'a') {
+        result += c;
+      } else if (isalpha(c) || c == '*') {
+        if ((c == 'C' && i + 1 < smarts.size() && smarts[i + 1] == 'l') ||
+            (c == 'B' && i + 1 < smarts.size() && smarts[i + 1] == 'r'))
+          ++i;
+        result += '*';
+      }
+    }
+    if (result.size() != numAtoms)
+      return string(numAtoms, '*');
+    return result;
+  }
+
+  static RingFragmentKey GetRingFragmentKey(OBSmartsPattern &sp, const string &smarts)
+  {
+    RingFragmentKey key = {0, 0, 0};
+    unsigned int numAtoms = sp.NumAtoms();
+    vector<pair<int, int> > bonds(sp.NumBonds());
+    vector<vector<int> > nbrs(numAtoms);
+    for (unsigned int b = 0; b < bonds.size(); ++b) {
+      int order;
+      sp.GetBond(bonds[b].first, bonds[b].second, order, b);
+      nbrs[bonds[b].first].push_back(b);
+      nbrs[bonds[b].second].push_back(b);
+    }
+
+    // A bond is in a cycle if its atoms stay connected without it
+    vector<bool> cyclic(numAtoms, false);
+    for (unsigned int b = 0; b < bonds.size(); ++b) {
+      vector<bool> seen(numAtoms, false);
+      vector<int> todo(1, bonds[b].first);
+      seen[bonds[b].first] = true;
+      while (!todo.empty() && !seen[bonds[b].second]) {
+        int atom = todo.back();
+        todo.pop_back();
+        for (unsigned int n = 0; n < nbrs[atom].size(); ++n) {
+          int other = nbrs[atom][n];
+          if ((unsigned int)other == b)
+            continue;
+          other = bonds[other].first == atom ? bonds[other].second : bonds[other].first;
+          if (!seen[other]) {
+            seen[other] = true;
+            todo.push_back(other);
+          }
+        }
+      }
+      if (seen[bonds[b].second]) {
+        key.bonds++;
+        cyclic[bonds[b].first] = cyclic[bonds[b].second] = true;
+      }
+    }
+
+    string aromaticity = AtomAromaticity(smarts, numAtoms);
+    for (unsigned int a = 0; a < numAtoms; ++a)
+      if (cyclic[a]) {
+        if (aromaticity[a] == 'a')
+          key.aromatic++;
+        else if (aromaticity[a] == 'A')
+          key.aliphatic++;
+      }
+    return key;
+  }
+
   void OBBuilder::LoadFragments()  {
     // open data/fragments.txt
     ifstream ifs;
@@ -94,6 +245,46 @@ namespace OpenBabel
       _rigid_fragments_index[smiles] = index;
     }
 
+    // The coordinates of the rigid fragments are all read now, so that
+    // Build() does not need the file. The offsets in the index are those of
+    // the first coordinate line of each fragment.
+    ifstream rigid;
+    if (OpenDatafile(rigid, "rigid-fragments.txt").length() == 0) {
+      obErrorLog.ThrowError(__FUNCTION__, "Cannot open rigid-fragments.txt", obError);
+    } else {
+      map<int, pair<vector<vector3>, unsigned int> > blocks; // by offset
+      pair<vector<vector3>, unsigned int> *block = NULL;
+      char buffer[BUFF_SIZE];
+      vector<string> vs;
+      for (int lineOffset = static_cast<int>(streamoff(rigid.tellg()));
+           rigid.getline(buffer, BUFF_SIZE);
+           lineOffset = static_cast<int>(streamoff(rigid.tellg()))) {
+        tokenize(vs, buffer);
+        if (vs.size() == 4) { // atomic number and XYZ coordinates
+          if (block == NULL) {
+            block = &blocks[lineOffset];
+            block->second = 0;
+          }
+          block->first.push_back(vector3(atof(vs[1].c_str()), atof(vs[2].c_str()), atof(vs[3].c_str())));
+          unsigned int element = atoi(vs[0].c_str());
+          if (element > 1)
+            block->second += ElementTerm(element);
+        } else if (vs.size() == 1) { // SMILES
+          block = NULL;
+        }
+      }
+
+      map<string, int>::iterator entry;
+      for (entry = _rigid_fragments_index.begin(); entry != _rigid_fragments_index.end(); ++entry) {
+        map<int, pair<vector<vector3>, unsigned int> >::iterator found = blocks.find(entry->second);
+        if (found == blocks.end())
+          continue;
+        _rigid_fragments_cache[entry->first] = found->second.first;
+        rigidFragmentSignatures.push_back(found->second.second);
+      }
+      sort(rigidFragmentSignatures.begin(), rigidFragmentSignatures.end());
+    }
+
     if (OpenDatafile(ifs, "ring-fragments.txt").length() == 0) {
       obErrorLog.ThrowError(__FUNCTION__, "Cannot open ring-fragments.txt", obError);
       return;
@@ -102,6 +293,7 @@ namespace OpenBabel
     char buffer[BUFF_SIZE];
     vector<string> vs;
     OBSmartsPattern *sp = NULL;
+    RingFragmentKey key = {0, 0, 0};
     vector<vector3> coords;
     while (ifs.getline(buffer, BUFF_SIZE)) {
       if (buffer[0] == '#') // skip comment line (at the top)
@@ -110,8 +302,10 @@ namespace OpenBabel
       tokenize(vs, buffer);
 
       if (vs.size() == 1) { // SMARTS pattern
-        if (sp != NULL)
+        if (sp != NULL) {
           _ring_fragments.push_back(pair<OBSmartsPattern*, vector<vector3> > (sp, coords));
+          ringFragmentKeys.push_back(key);
+        }
 
         coords.clear();
         sp = new OBSmartsPattern;
@@ -119,6 +313,8 @@ namespace OpenBabel
           delete sp;
           sp = NULL;
           obErrorLog.ThrowError(__FUNCTION__, " Could not parse SMARTS from contribution data file", obInfo);
+        } else {
+          key = GetRingFragmentKey(*sp, vs[0]);
         }
       } else if (vs.size() == 3) { // XYZ coordinates
         vector3 coord(atof(vs[0].c_str()), atof(vs[1].c_str()), atof(vs[2].c_str()));
@@ -126,6 +322,7 @@ namespace OpenBabel
       }
     }
     _ring_fragments.push_back(pair<OBSmartsPattern*, vector<vector3> > (sp, coords));
+    ringFragmentKeys.push_back(key);
 
     // return the locale to the original one
     obLocale.RestoreLocale();
@@ -142,35 +339,16 @@ namespace OpenBabel
   }
 
   std::vector<vector3> OBBuilder::GetFragmentCoord(std::string smiles) {
-    if (_rigid_fragments_cache.count(smiles) > 0) {
-      return _rigid_fragments_cache[smiles];
-    }
-
-    std::vector<vector3> coords;
-    if (_rigid_fragments_index.count(smiles) == 0) {
-      return coords;
-    }
-
-    ifstream ifs;
-    if (OpenDatafile(ifs, "rigid-fragments.txt").length() == 0) {
-      obErrorLog.ThrowError(__FUNCTION__, "Cannot open rigid-fragments.txt", obError);
-      return coords;
-    }
+#ifdef _OPENMP
+    #pragma omp critical (obbuilder_fragments)
+#endif
+    if(_rigid_fragments.empty())
+      LoadFragments();
 
-    ifs.clear();
-    ifs.seekg(_rigid_fragments_index[smiles]);
-    char buffer[BUFF_SIZE];
-    vector<string> vs;
-    while (ifs.getline(buffer, BUFF_SIZE)) {
-      tokenize(vs, buffer);
-      if (vs.size() == 4) { // XYZ coordinates
-        vector3 coord(atof(vs[1].c_str()), atof(vs[2].c_str()), atof(vs[3].c_str()));
-        coords.push_back(coord);
-      } else if (vs.size() == 1) { // SMARTS pattern
-        break;
-      }
-    }
-    return coords;
+    map<string, vector<vector3> >::const_iterator found = _rigid_fragments_cache.find(smiles);
+    if (found == _rigid_fragments_cache.end())
+      return std::vector<vector3>();
+    return found->second;
   }
 
   vector3 GetCorrectedBondVector(OBAtom *atom1, OBAtom *atom2, int bondOrder = 1)
@@ -277,10 +455,10 @@ namespace OpenBabel
         v1 = cross(bond1, bond2);
         if (bond2 == VZero || v1 == VZero) {
           vector3 vrand;
-          vrand.randomUnitVector();
+          RandomUnitVector(vrand);
           double angle = fabs(acos(dot(bond1, vrand)) * RAD_TO_DEG);
           while (angle < 45.0 || angle > 135.0) {
-            vrand.randomUnitVector();
+            RandomUnitVector(vrand);
             angle = fabs(acos(dot(bond1, vrand)) * RAD_TO_DEG);
           }
           // there is no a-2 atom
@@ -348,10 +526,10 @@ namespace OpenBabel
           /* is atom order correct?  I don't think it matters, but I might have to ask a chemist
            * whether PClF4 would be more likely to have an equatorial or axial Cl-P bond */
           vector3 vrand;
-          vrand.randomUnitVector();
+          RandomUnitVector(vrand);
           double angle = fabs(acos(dot(bond1, vrand)) * RAD_TO_DEG);
           while (angle < 45.0 || angle > 135.0) {
-            vrand.randomUnitVector();
+            RandomUnitVector(vrand);
             angle = fabs(acos(dot(bond1, vrand)) * RAD_TO_DEG);
           }
           v1 = cross(bond1, vrand);
@@ -550,7 +728,7 @@ namespace OpenBabel
       }
 
       // Undefined case -- return a random vector of length specified
-      newbond.randomUnitVector();
+      RandomUnitVector(newbond);
       newbond *= length;
       newbond += atom->GetVector();
       return newbond;
@@ -702,7 +880,7 @@ namespace OpenBabel
       }
 
       // Undefined case -- return a random vector of length specified
-      newbond.randomUnitVector();
+      RandomUnitVector(newbond);
       newbond.z() = 0.0;
       newbond.normalize();
       newbond *= length;
@@ -776,11 +954,11 @@ namespace OpenBabel
         if (secondAtom)
           secondDir = secondAtom->GetVector() - b->GetVector();
         else
-          secondDir.randomUnitVector(); // pick something at random
+          RandomUnitVector(secondDir); // pick something at random
         // but not too shallow, or the cross product won't work well
         double angle = fabs(acos(dot(firstDir, secondDir)) * RAD_TO_DEG);
         while (angle < 45.0 || angle > 135.0) {
-          secondDir.randomUnitVector();
+          RandomUnitVector(secondDir);
           angle = fabs(acos(dot(firstDir, secondDir)) * RAD_TO_DEG);
         }
         // Now we find a perpendicular vector to the fragment
@@ -1040,6 +1218,7 @@ namespace OpenBabel
   //                                           b) Not first atom: Find position and place atom
   bool OBBuilder::Build(OBMol &mol, bool stereoWarnings)
   {
+    BuildRandomScope randomScope(_randomSeed);
     OBBitVec vdone; // Atoms that are done, need no further manipulation.
     OBBitVec vfrag; // Atoms that are part of a fragment found in the database.
                     // These atoms have coordinates, but the fragment still has
@@ -1100,16 +1279,31 @@ namespace OpenBabel
     // Separate each disconnected fragments as different molecules
     vector<OBMol> fragments = mol_copy.Separate();
 
-    // datafile is read only on first use of Build()
+    // datafile is read only on first use of Build(), and then only read
+#ifdef _OPENMP
+    #pragma omp critical (obbuilder_fragments)
+#endif
     if(_rigid_fragments.empty())
       LoadFragments();
 
 
+    // Count the number of ring atoms.
+    unsigned int ratoms = 0;
+    FOR_ATOMS_OF_MOL(a, mol) {
+      if (a->IsInRing()) {
+        ratoms++;
+      }
+    }
+
     for(vector<OBMol>::iterator f = fragments.begin(); f != fragments.end(); ++f) {
-      std::string fragment_smiles = conv.WriteString(&*f, true);
       bool isMatchRigid = false;
-      // if rigid fragment is in database
-      if (_rigid_fragments_index.count(fragment_smiles) > 0) {
+      // if rigid fragment is in database: the canonical SMILES is only
+      // written for the fragments with the elements of a rigid fragment
+      map<string, vector<vector3> >::const_iterator rigid = _rigid_fragments_cache.end();
+      if (binary_search(rigidFragmentSignatures.begin(), rigidFragmentSignatures.end(), ElementSignature(*f)))
+        rigid = _rigid_fragments_cache.find(conv.WriteString(&*f, true));
+      if (rigid != _rigid_fragments_cache.end()) {
+        const std::string &fragment_smiles = rigid->first;
         OBSmartsPattern sp;
         if (!sp.Init(fragment_smiles)) {
           obErrorLog.ThrowError(__FUNCTION__, " Could not parse SMARTS from fragment", obInfo);
@@ -1130,7 +1324,7 @@ namespace OpenBabel
               vfrag.SetBitOn(*k); // Set vfrag for all atoms of fragment
 
             int counter;
-            std::vector<vector3> coords = GetFragmentCoord(fragment_smiles);
+            const std::vector<vector3> &coords = rigid->second;
             for (k = j->begin(), counter=0; k != j->end(); ++k, ++counter) { // for all atoms of the fragment
               // set coordinates for atoms
               OBAtom *atom = workMol.GetAtom(*k);
@@ -1152,14 +1346,22 @@ namespace OpenBabel
         }
       }
       if(!isMatchRigid) {    // if rigid fragment is not in database
-        // Count the number of ring atoms.
-        unsigned int ratoms = 0;
-        FOR_ATOMS_OF_MOL(a, mol) {
+        if (ratoms < 3) continue; // Smallest ring fragment has 3 atoms
+
+        // The ring atoms and bonds of this fragment
+        RingFragmentKey fkey = {0, 0, 0};
+        FOR_ATOMS_OF_MOL(a, *f) {
           if (a->IsInRing()) {
-            ratoms++;
+            if (a->IsAromatic())
+              fkey.aromatic++;
+            else
+              fkey.aliphatic++;
           }
         }
-        if (ratoms < 3) continue; // Smallest ring fragment has 3 atoms
+        FOR_BONDS_OF_MOL(b, *f) {
+          if (b->IsInRing())
+            fkey.bonds++;
+        }
 
         vector<pair<OBSmartsPattern*, vector<vector3 > > >::iterator i;
         // Skip all fragments that are too big to match
@@ -1171,9 +1373,13 @@ namespace OpenBabel
         // the first (most complex) fragment.
         // Stop if there are no unassigned ring atoms (ratoms).
         for (; i != _ring_fragments.end() && ratoms; ++i) {
-          if (i->first != NULL && i->first->Match(*f)) { // if match to fragment
-            i->first->Match(mol);                        // match over mol
-            mlist = i->first->GetUMapList();
+          // skip the patterns with more ring atoms or bonds than the fragment
+          const RingFragmentKey &key = ringFragmentKeys[i - _ring_fragments.begin()];
+          if (key.aromatic > fkey.aromatic || key.aliphatic > fkey.aliphatic || key.bonds > fkey.bonds)
+            continue;
+          // the patterns are shared by the threads building molecules
+          if (i->first != NULL && i->first->HasMatch(*f)) { // if match to fragment
+            i->first->Match(mol, mlist, OBSmartsPattern::AllUnique); // match over mol
             for (j = mlist.begin();j != mlist.end();++j) { // for all matches
               // Have any atoms of this match already been added?
               bool alreadydone = false;
@@ -1254,7 +1460,7 @@ namespace OpenBabel
         // (or in exactly the same direction)
         // So we'll add a slight tweak -- fixes problem reported by Kasper Thofte
         vector3 randomOffset;
-        randomOffset.randomUnitVector();
+        RandomUnitVector(randomOffset);
         molvec = VX + 0.1 * randomOffset;
         moldir = VX + 0.01 * randomOffset;
       }
@@ -125,6 +125,9 @@
 /* have <time.h> */
 #cmakedefine HAVE_TIME_H 1
 
+/* have <sys/mman.h> */
+#cmakedefine HAVE_SYS_MMAN_H 1
+
 /* have <sstream> */
 #cmakedefine HAVE_SSTREAM 1
 
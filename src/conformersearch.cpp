@@ -103,58 +103,93 @@ namespace OpenBabel {
 
   OBConformerScore::~OBConformerScore() {}
 
+  // The force field of this thread for the energy scores: MMFF94, or UFF if
+  // MMFF94 cannot be set up for the molecule. The plugin instances are not
+  // used, so that several threads can score conformers at the same time.
+  static OBForceField* ScoreForceField(OBMol &mol)
+  {
+    OBForceField *mmff94 = OBForceField::GetThreadInstance("MMFF94");
+    if (mmff94 && mmff94->Setup(mol))
+      return mmff94;
+    OBForceField *uff = OBForceField::GetThreadInstance("UFF");
+    if (uff && uff->Setup(mol))
+      return uff;
+    return NULL;
+  }
+
   double OBRMSDConformerScore::Score(OBMol &mol, unsigned int index,
                                      const RotorKeys &keys, const std::vector<double*> &conformers)
   {
-    unsigned int numAtoms = mol.NumAtoms();
-
-    // create the reference vector3 for conformer with index
-    double *conformer_i = conformers[index];
-    std::vector<vector3> vi;
-    for (unsigned int a = 0; a < numAtoms; ++a)
-      vi.push_back(vector3(conformer_i[a*3], conformer_i[a*3+1], conformer_i[a*3+2]));
-
-    OBAlign align(mol, mol, false, false);
-    align.SetRef(vi);
+    // Only the row of the conformer is needed: each other conformer is
+    // added after it in turn (ScoreAll() computes the whole matrix once)
+    OBRMSDMatrix pair(mol.NumAtoms());
+    pair.AddConformer(conformers[index]);
 
+    // return the lowest RMSD
     double score_min = 10e10;
     for (unsigned int j = 0; j < conformers.size(); ++j) {
       if (index == j)
         continue;
-      double *conformer_j = conformers[j];
-      // create vector3 conformer
-      std::vector<vector3> vj;
-      for (unsigned int a = 0; a < numAtoms; ++a)
-        vj.push_back(vector3(conformer_j[a*3], conformer_j[a*3+1], conformer_j[a*3+2]));
-
-      // perform Kabsch alignment
-      align.SetTarget(vj);
-      align.Align();
-
-      // get the RMSD
-      double rmsd = align.GetRMSD();
-      // store the rmsd if it is lower than any of the previous
+      pair.AddConformer(conformers[j]);
+      double rmsd = pair.GetRMSD(0, 1);
+      pair.RemoveLastConformer();
       if (rmsd < score_min)
         score_min = rmsd;
     }
-
-    // return the lowest RMSD
     return score_min;
   }
 
+  bool OBRMSDConformerScore::ScoreAll(OBMol &mol, const RotorKeys &keys,
+                                      const std::vector<double*> &conformers,
+                                      std::vector<double> &scores, int nthreads)
+  {
+    const unsigned int n = conformers.size();
+    OBRMSDMatrix ensemble(mol.NumAtoms());
+    ensemble.SetNumThreads(nthreads);
+    for (unsigned int j = 0; j < n; ++j)
+      ensemble.AddConformer(conformers[j]);
+    std::vector<double> rmsd;
+    ensemble.GetMatrix(rmsd);
+
+    // the score of each conformer is the RMSD to the closest conformer
+    scores.assign(n, 10e10);
+    std::size_t ij = 0;
+    for (unsigned int i = 0; i < n; ++i)
+      for (unsigned int j = i + 1; j < n; ++j, ++ij) {
+        if (rmsd[ij] < scores[i])
+          scores[i] = rmsd[ij];
+        if (rmsd[ij] < scores[j])
+          scores[j] = rmsd[ij];
+      }
+    return true;
+  }
+
   double OBEnergyConformerScore::Score(OBMol &mol, unsigned int index,
                                        const RotorKeys &keys, const std::vector<double*> &conformers)
   {
-    energy_nrequest++;
     RotorKey cur_key = keys[index];
-    if (energy_map.size () > 0)
-      {
-        // Check that we haven't already computed this energy);
-        mapRotorEnergy::iterator it = energy_map.find (cur_key);
-        if (it != energy_map.end ())
-          return it->second;
-      }
-    energy_ncompute++;
+    // the energies are shared by the threads scoring conformers
+    bool found = false;
+    double score = 0.0;
+#ifdef _OPENMP
+    #pragma omp critical (conformer_energy_map)
+#endif
+    {
+      energy_nrequest++;
+      if (energy_map.size () > 0)
+        {
+          // Check that we haven't already computed this energy);
+          mapRotorEnergy::iterator it = energy_map.find (cur_key);
+          if (it != energy_map.end ()) {
+            found = true;
+            score = it->second;
+          }
+        }
+      if (!found)
+        energy_ncompute++;
+    }
+    if (found)
+      return score;
 
     double *origCoords = mol.GetCoordinates();
     // copy the original coordinates to coords
@@ -165,19 +200,20 @@ namespace OpenBabel {
       origCoords[i] = conformers[index][i];
     }
 
-    OBForceField *ff = OBForceField::FindType("MMFF94");
-    if (!ff->Setup(mol)) {
-      ff = OBForceField::FindType("UFF");
-      if (!ff->Setup(mol))
-        return 10e10;
+    OBForceField *ff = ScoreForceField(mol);
+    score = 10e10;
+    if (ff) {
+      score = ff->Energy(false); // no gradients
     }
-    double score = ff->Energy(false); // no gradients
 
     // copy original coordinates back
     for (unsigned int i = 0; i < mol.NumAtoms() * 3; ++i)
       origCoords[i] = coords[i];
 
     // Save that in the map
+#ifdef _OPENMP
+    #pragma omp critical (conformer_energy_map)
+#endif
     if (energy_map.size () < 50000)
       energy_map[cur_key] = score;
 
@@ -187,16 +223,29 @@ namespace OpenBabel {
   double OBMinimizingEnergyConformerScore::Score(OBMol &mol, unsigned int index,
                                                  const RotorKeys &keys, const std::vector<double*> &conformers)
   {
-    energy_nrequest++;
     RotorKey cur_key = keys[index];
-    if (energy_map.size () > 0)
-      {
-        // Check that we haven't already computed this energy);
-        mapRotorEnergy::iterator it = energy_map.find (cur_key);
-        if (it != energy_map.end ())
-          return it->second;
-      }
-    energy_ncompute++;
+    // the energies are shared by the threads scoring conformers
+    bool found = false;
+    double score = 0.0;
+#ifdef _OPENMP
+    #pragma omp critical (conformer_energy_map)
+#endif
+    {
+      energy_nrequest++;
+      if (energy_map.size () > 0)
+        {
+          // Check that we haven't already computed this energy);
+          mapRotorEnergy::iterator it = energy_map.find (cur_key);
+          if (it != energy_map.end ()) {
+            found = true;
+            score = it->second;
+          }
+        }
+      if (!found)
+        energy_ncompute++;
+    }
+    if (found)
+      return score;
 
     double *origCoords = mol.GetCoordinates();
     // copy the original coordinates to coords
@@ -207,20 +256,21 @@ namespace OpenBabel {
       origCoords[i] = conformers[index][i];
     }
 
-    OBForceField *ff = OBForceField::FindType("MMFF94");
-    if (!ff->Setup(mol)) {
-      ff = OBForceField::FindType("UFF");
-      if (!ff->Setup(mol))
-        return 10e10;
+    OBForceField *ff = ScoreForceField(mol);
+    score = 10e10;
+    if (ff) {
+      ff->ConjugateGradients(50);
+      score = ff->Energy(false); // no gradients
     }
-    ff->ConjugateGradients(50);
-    double score = ff->Energy(false); // no gradients
 
     // copy original coordinates back
     for (unsigned int i = 0; i < mol.NumAtoms() * 3; ++i)
       origCoords[i] = coords[i];
 
     // Save that in the map
+#ifdef _OPENMP
+    #pragma omp critical (conformer_energy_map)
+#endif
     if (energy_map.size () < 50000)
       energy_map[cur_key] = score;
 
@@ -240,11 +290,11 @@ namespace OpenBabel {
       origCoords[i] = conformers[index][i];
     }
 
-    OBForceField *ff = OBForceField::FindType("MMFF94");
-    if (!ff->Setup(mol)) {
-      ff = OBForceField::FindType("UFF");
-      if (!ff->Setup(mol))
-        return 10e10;
+    OBForceField *ff = ScoreForceField(mol);
+    if (!ff) {
+      for (unsigned int i = 0; i < mol.NumAtoms() * 3; ++i)
+        origCoords[i] = coords[i];
+      return 10e10;
     }
     ff->ConjugateGradients(50);
     double score = ff->Energy(false); // no gradients
@@ -253,26 +303,16 @@ namespace OpenBabel {
     for (unsigned int i = 0; i < mol.NumAtoms() * 3; ++i)
       origCoords[i] = coords[i];
 
-    double *conformer_i = conformers[index];
-    std::vector<vector3> vi;
-    for (unsigned int a = 0; a < numAtoms; ++a)
-      vi.push_back(vector3(conformer_i[a*3], conformer_i[a*3+1], conformer_i[a*3+2]));
-
     OBAlign align(mol, mol, false, false);
-    align.SetRef(vi);
+    align.SetRef(conformers[index], numAtoms);
 
     double score_min = 10e10;
     for (unsigned int j = 0; j < conformers.size(); ++j) {
       if (index == j)
         continue;
-      double *conformer_j = conformers[j];
-      // create vector3 conformer
-      std::vector<vector3> vj;
-      for (unsigned int a = 0; a < numAtoms; ++a)
-        vj.push_back(vector3(conformer_j[a*3], conformer_j[a*3+1], conformer_j[a*3+2]));
 
       // perform Kabsch alignment
-      align.SetTarget(vj);
+      align.SetTarget(conformers[j], numAtoms);
       align.Align();
 
       // get the RMSD
@@ -310,6 +350,7 @@ namespace OpenBabel {
     p_crossover = 0.7;
     niche_mating = 0.7;
     local_opt_rate = 3;
+    m_nthreads = 1;
     // For the moment 'd' is an opaque pointer to an instance of OBRandom*.
     // In future, it could be a pointer to a structure storing all of the
     // private variables.
@@ -329,6 +370,14 @@ namespace OpenBabel {
   }
 
 
+  void OBConformerSearch::SetRandomSeed(unsigned int seed)
+  {
+    if (seed)
+      ((OBRandom*)d)->Seed(seed);
+    else
+      ((OBRandom*)d)->TimeSeed();
+  }
+
   bool OBConformerSearch::Setup(const OBMol &mol, int numConformers, int numChildren, int mutability, int convergence)
   {
     int nb_rotors = 0;
@@ -390,9 +439,8 @@ namespace OpenBabel {
       return false;
     }
 
-    // create initial population
-    OBRandom generator;
-    generator.TimeSeed();
+    // create initial population (see SetRandomSeed())
+    OBRandom &generator = *(OBRandom*)d;
 
     RotorKey rotorKey(m_rotorList.Size() + 1, 0); // indexed from 1
     if (IsGood(rotorKey))
@@ -457,8 +505,7 @@ namespace OpenBabel {
   void OBConformerSearch::NextGeneration()
   {
     // create next generation population
-    OBRandom generator;
-    generator.TimeSeed();
+    OBRandom &generator = *(OBRandom*)d;
 
     // generate the children
     int numConformers = m_rotorKeys.size();
@@ -509,6 +556,33 @@ namespace OpenBabel {
   };
 
 
+  // Each thread scores a contiguous block of conformers with its own copy of
+  // the molecule. The scores are stored by index, so that the selection does
+  // not depend on the number of threads.
+  void OBConformerSearch::ScoreConformers(const std::vector<double*> &conformers,
+                                          std::vector<double> &scores)
+  {
+    if (m_score->ScoreAll(m_mol, m_rotorKeys, conformers, scores, m_nthreads))
+      return;
+    scores.resize(conformers.size());
+#ifdef _OPENMP
+    const int nthreads = std::min<int>(m_nthreads, conformers.size());
+    if (nthreads > 1 && m_score->HasThreadSafeScore()) {
+      std::vector<OBMol> mols(nthreads, m_mol);
+      #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+      for (int t = 0; t < nthreads; ++t) {
+        const unsigned int begin = conformers.size() * t / nthreads;
+        const unsigned int end = conformers.size() * (t + 1) / nthreads;
+        for (unsigned int i = begin; i < end; ++i)
+          scores[i] = m_score->Score(mols[t], i, m_rotorKeys, conformers);
+      }
+      return;
+    }
+#endif
+    for (unsigned int i = 0; i < conformers.size(); ++i)
+      scores[i] = m_score->Score(m_mol, i, m_rotorKeys, conformers);
+  }
+
   double OBConformerSearch::MakeSelection()
   {
     OBRotamerList rotamers;
@@ -525,11 +599,11 @@ namespace OpenBabel {
     rotamers.ExpandConformerList(m_mol, conformers);
 
     // Score each conformer
+    std::vector<double> scores;
+    ScoreConformers(conformers, scores);
     std::vector<ConformerScore> conformer_scores;
-    for (unsigned int i = 0; i < conformers.size(); ++i) {
-      double score = m_score->Score(m_mol, i, m_rotorKeys, conformers);
-      conformer_scores.push_back(ConformerScore(m_rotorKeys[i], score));
-    }
+    for (unsigned int i = 0; i < conformers.size(); ++i)
+      conformer_scores.push_back(ConformerScore(m_rotorKeys[i], scores[i]));
 
     // delete the conformers
     for (unsigned int i = 0; i < conformers.size(); ++i) {
@@ -919,7 +993,6 @@ namespace OpenBabel {
   {
     bool max_flag = (m_score->GetPreferred() == OBConformerScore::HighScore);
     unsigned int i = 0, pop_size = 0;
-    double score = 0.0;
     std::vector<double*> conformers;
     std::vector<double>::iterator dit;
     OBRotamerList rotamers;
@@ -936,11 +1009,10 @@ namespace OpenBabel {
     rotamers.ExpandConformerList(m_mol, conformers);
 
     // Score each conformer
+    std::vector<double> scores;
+    ScoreConformers(conformers, scores);
     for (i = 0; i < conformers.size(); ++i)
-      {
-        score = m_score->Score(m_mol, i, m_rotorKeys, conformers);
-        conformer_scores.push_back(ConformerScore(m_rotorKeys[i], score));
-      }
+      conformer_scores.push_back(ConformerScore(m_rotorKeys[i], scores[i]));
 
     // delete the conformers
     for (i = 0; i < conformers.size(); ++i)
@@ -96,10 +96,14 @@ namespace OpenBabel
       bool AddPose(double* coords, double energy);
       bool AddPose(std::vector<vector3> coords, double energy);
       typedef std::pair<std::vector<vector3>, double> PosePair;
-      typedef tree<PosePair> Tree;
+      // The nodes of the tree hold indices into the list of poses
+      typedef tree<unsigned int> Tree;
       Tree* GetTree() { return &poses; }
-      typedef tree<PosePair>::iterator Tree_it;
-      typedef tree<PosePair>::sibling_iterator Tree_sit;
+      typedef tree<unsigned int>::iterator Tree_it;
+      typedef tree<unsigned int>::sibling_iterator Tree_sit;
+      const PosePair& GetPose(unsigned int idx) const {
+        return _poses[idx];
+      }
       size_t GetSize();
       inline int GetNRMSD() {
         return n_rmsd;
@@ -110,9 +114,16 @@ namespace OpenBabel
 
     private:
       bool _percise;
-      std::vector<vector3> GetHeavyAtomCoords(const std::vector<vector3> &all_coords);
+      void GetHeavyAtomCoords(const std::vector<vector3> &all_coords, std::vector<double> &hvy_coords);
       unsigned int natoms;
       Tree poses;
+      std::vector<PosePair> _poses;
+      unsigned int nheavy;
+      // The heavy-atom coordinates of the poses (x1, y1, z1, x2, ...) when
+      // symmetry is taken into account...
+      std::vector<double> _heavy;
+      // ...or else the ensemble of the poses and the pose being added
+      OBRMSDMatrix _ensemble;
       std::vector<double> levels;
       OBAlign* palign;
       const double cutoff;
@@ -135,14 +146,15 @@ namespace OpenBabel
     vec.push_back(cutoff);
 
     levels = vec;
-    std::vector<vector3> pdummy;
-    poses.insert(poses.begin(), PosePair(pdummy, 0.0)); // Add a dummy top node
+    poses.insert(poses.begin(), UINT_MAX); // Add a dummy top node
 
     // Remember the hydrogens
     hydrogens.Resize(natoms);
     for (unsigned int i=1; i<=natoms; i++)
       if (ref.GetAtom(i)->GetAtomicNum() == OBElements::Hydrogen)
         hydrogens.SetBitOn(i - 1);
+    nheavy = natoms - hydrogens.CountBits();
+    _ensemble = OBRMSDMatrix(nheavy);
   }
 
   bool OBDiversePoses::AddPose(double* coords, double energy) {
@@ -160,9 +172,15 @@ namespace OpenBabel
     // Convert coords to vector<vector3>
 
     // Only use the heavy-atom coords for the alignment, but store
-    // the full set of coordinates in the tree
-    std::vector<vector3> vcoords_hvy = GetHeavyAtomCoords(vcoords);
-    palign->SetRef(vcoords_hvy);
+    // the full set of coordinates in the list of poses
+    std::vector<double> vcoords_hvy;
+    GetHeavyAtomCoords(vcoords, vcoords_hvy);
+    const double *hvy = nheavy ? &vcoords_hvy[0] : NULL;
+    const unsigned int index = _poses.size();
+    if (_percise)
+      palign->SetRef(hvy, nheavy);
+    else
+      _ensemble.AddConformer(hvy);
 
     std::vector<Tree_it> nodes, min_nodes;
     std::vector<double> min_nodes_rmsds;
@@ -171,7 +189,6 @@ namespace OpenBabel
     stack_levels.push_back(level);
 
     std::vector<Tree_it> insert_pt;
-    std::vector<PosePair> insert_data;
     std::vector<int> insert_level;
 
     while(nodes.size() > 0) { // Using stack-based recursion
@@ -194,16 +211,19 @@ namespace OpenBabel
       if (!first_time)
         ++sib;
       for (; sib != poses.end(node); ++sib) { // Iterate over children of node
-        std::vector<vector3> tcoords = (*sib).first;
-        std::vector<vector3> tcoords_hvy = GetHeavyAtomCoords(tcoords);
-        palign->SetTarget(tcoords_hvy);
-
-        palign->Align();
-        rmsd = palign->GetRMSD();
+        if (_percise) {
+          palign->SetTarget(nheavy ? &_heavy[3 * nheavy * *sib] : NULL, nheavy);
+          palign->Align();
+          rmsd = palign->GetRMSD();
+        } else
+          rmsd = _ensemble.GetRMSD(index, *sib);
         n_rmsd++;
         if (rmsd < levels.at(level)) {
-          if (rmsd < cutoff)
+          if (rmsd < cutoff) {
+            if (!_percise)
+              _ensemble.RemoveLastConformer();
             return false;
+          }
 
           min_nodes.push_back(sib);
           min_nodes_rmsds.push_back(rmsd);
@@ -221,7 +241,6 @@ namespace OpenBabel
         // could still be rejected for addition to the tree.
         insert_pt.push_back(node);
         insert_level.push_back(level);
-        insert_data.push_back(PosePair(vcoords, energy));
         continue;
       }
 
@@ -246,12 +265,14 @@ namespace OpenBabel
 
 
     // If we get here, then the molecule has been accepted for addition to the tree
-    std::vector<PosePair>::iterator b = insert_data.begin();
+    _poses.push_back(PosePair(vcoords, energy));
+    if (_percise)
+      _heavy.insert(_heavy.end(), vcoords_hvy.begin(), vcoords_hvy.end());
     std::vector<int>::iterator c = insert_level.begin();
-    for (std::vector<Tree_it>::iterator a = insert_pt.begin(); a != insert_pt.end(); ++a, ++b, ++c) {
+    for (std::vector<Tree_it>::iterator a = insert_pt.begin(); a != insert_pt.end(); ++a, ++c) {
       node = *a;
       for (unsigned int k = *c; k < levels.size(); ++k) {
-        node = poses.append_child(node, *b);
+        node = poses.append_child(node, index);
       }
     }
 
@@ -262,12 +283,15 @@ namespace OpenBabel
     return poses.size() - 1; // Remove the dummy
   }
 
-  std::vector<vector3> OBDiversePoses::GetHeavyAtomCoords(const std::vector<vector3> &all_coords) {
-    std::vector<vector3> v_hvyatoms;
+  void OBDiversePoses::GetHeavyAtomCoords(const std::vector<vector3> &all_coords, std::vector<double> &hvy_coords) {
+    hvy_coords.clear();
+    hvy_coords.reserve(3 * nheavy);
     for (unsigned int a = 0; a < natoms; ++a)
-      if (!hydrogens.BitIsSet(a))
-        v_hvyatoms.push_back(all_coords[a]);
-    return v_hvyatoms;
+      if (!hydrogens.BitIsSet(a)) {
+        hvy_coords.push_back(all_coords[a].x());
+        hvy_coords.push_back(all_coords[a].y());
+        hvy_coords.push_back(all_coords[a].z());
+      }
   }
 
   //bool sortpred(const OBDiversePoses::PosePair *a, const OBDiversePoses::PosePair *b) {
@@ -294,8 +318,8 @@ void UpdateConformersFromTree(OBMol* mol, std::vector<double> &energies, OBDiver
 
   // The leaf iterator will (in effect) iterate over the nodes just at the loweset level
   for (OBDiversePoses::Tree::leaf_iterator node = poses->begin(); node != poses->end(); ++node)
-    if (node->first.size() > 0) // Don't include the dummy head node
-      confs.push_back(*node);
+    if (*node != UINT_MAX) // Don't include the dummy head node
+      confs.push_back(divposes->GetPose(*node));
 
   // Sort the confs by energy (lowest first)
   sort(confs.begin(), confs.end(), sortpred_b);
@@ -408,30 +432,46 @@ int OBForceField::DiverseConfGen(double rmsd, unsigned int nconfs, double energy
     std::vector<int> my_rotorkey(rotor_sizes.size() + 1, 0);
     unsigned int counter = 0;
 
-    // Main loop over rotamers
+    // Main loop over rotamers. The energies of a batch of rotamers are
+    // computed together, on GetNumThreads() threads, and the poses are then
+    // added in the order of the LFSR: the result does not depend on the
+    // number of threads. The constant part of the energy (energy_offset) is
+    // subtracted from the total energies.
+    const unsigned int numCoords = _mol.NumAtoms() * 3;
+    const unsigned int batchSize = 64 * _nthreads;
+    std::vector<double> batchCoords(batchSize * numCoords), batchEnergies(batchSize);
     unsigned int N_low_energy = 0;
-    do {
-      _mol.SetCoordinates(store_initial);
-
-      combination = lfsr.GetNext();
-      unsigned int t = combination;
-      // Convert the combination number into a rotorkey
-      for (unsigned int i = 0 ; i < rotor_sizes.size(); ++i) {
-        my_rotorkey[i + 1] = t % rotor_sizes[i];
-        t /= rotor_sizes[i];
-      }
+    bool done = false;
+    while (!done) {
+      unsigned int n = 0;
+      for (; n < batchSize && !done; ++n) {
+        _mol.SetCoordinates(store_initial);
+
+        combination = lfsr.GetNext();
+        unsigned int t = combination;
+        // Convert the combination number into a rotorkey
+        for (unsigned int i = 0 ; i < rotor_sizes.size(); ++i) {
+          my_rotorkey[i + 1] = t % rotor_sizes[i];
+          t /= rotor_sizes[i];
+        }
 
-      rotamerlist.SetCurrentCoordinates(_mol, my_rotorkey);
-      SetupPointers();
-      double currentE = E_VDW(false) + E_Torsion(false) + E_Electrostatic(false);
-      if (currentE < lowest_energy + energy_gap) { // Don't retain high energy poses
-        divposes.AddPose(_mol.GetCoordinates(), currentE);
-        N_low_energy++;
-        if (currentE < lowest_energy)
-          lowest_energy = currentE;
+        rotamerlist.SetCurrentCoordinates(_mol, my_rotorkey);
+        memcpy(&batchCoords[n * numCoords], _mol.GetCoordinates(), sizeof(double) * numCoords);
+        counter++;
+        done = combination == 1 || counter >= nconfs; // The LFSR always terminates with a 1
       }
-      counter++;
-    } while (combination != 1 && counter < nconfs); // The LFSR always terminates with a 1
+      EnergyBatchThreaded(&batchCoords[0], n, &batchEnergies[0], NULL);
+
+      for (unsigned int i = 0; i < n; ++i) {
+        double currentE = batchEnergies[i] - energy_offset;
+        if (currentE < lowest_energy + energy_gap) { // Don't retain high energy poses
+          divposes.AddPose(&batchCoords[i * numCoords], currentE);
+          N_low_energy++;
+          if (currentE < lowest_energy)
+            lowest_energy = currentE;
+        }
+      }
+    }
     std::cout << "..tot confs tested = " << counter << "\n..below energy threshold = " << N_low_energy << "\n";
 
     // Reset the coordinates to those of the initial structure
@@ -21,6 +21,9 @@ GNU General Public License for more details.
 #pragma warning (disable : 4786)
 #endif
 #include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <set>
 #include <openbabel/babelconfig.h>
 #include <openbabel/data.h>
 #include <openbabel/data_utilities.h>
@@ -30,6 +33,8 @@ GNU General Public License for more details.
 #include <openbabel/locale.h>
 #include <openbabel/oberror.h>
 #include <openbabel/elements.h>
+#include <openbabel/obiter.h>
+#include <openbabel/bitvec.h>
 
 // data headers with default parameters
 #include "types.h"
@@ -45,7 +50,7 @@ using namespace std;
 namespace OpenBabel
 {
   // Initialize the globals (declared in data.h)
-  OBTypeTable ttab;
+  THREAD_LOCAL OBTypeTable ttab;
   OBResidueData resdat;
 
   OBAtomicHeatOfFormationTable::OBAtomicHeatOfFormationTable(void)
@@ -555,6 +560,200 @@ namespace OpenBabel
     return(true);
   }
 
+  // As in OBMol::ConnectTheDots(): bonded if closer than the sum of the
+  // covalent radii plus 0.45A, but not closer than 0.4A
+  static bool BondingDistance(OBAtom *a, OBAtom *b)
+  {
+    double d2 = (a->GetVector() - b->GetVector()).length_2();
+    double cutoff = OBElements::GetCovalentRad(a->GetAtomicNum())
+      + OBElements::GetCovalentRad(b->GetAtomicNum()) + 0.45;
+    return d2 >= 0.16 && d2 <= cutoff * cutoff;
+  }
+
+  // Atoms skipped by OBMol::ConnectTheDots()
+  static bool HasFullValence(OBAtom *atom)
+  {
+    if (atom->GetExplicitValence() >= OBElements::GetMaxBonds(atom->GetAtomicNum()))
+      return true;
+    return atom->GetAtomicNum() == OBElements::Nitrogen && atom->GetFormalCharge() == 0
+      && atom->GetExplicitValence() >= 3;
+  }
+
+  // As validAdditionalBond() in mol.cpp: only F and Cl make a sixth bond to P
+  static bool ValidAdditionalBond(OBAtom *a, OBAtom *n)
+  {
+    if (a->GetExplicitValence() == 5 && a->GetAtomicNum() == OBElements::Phosphorus)
+      return n->GetAtomicNum() == OBElements::Fluorine || n->GetAtomicNum() == OBElements::Chlorine;
+    return true;
+  }
+
+  // Key of the cubic grid cell containing v
+  static unsigned long long GridCell(const vector3 &v, double size, int dx = 0, int dy = 0, int dz = 0)
+  {
+    const long long offset = 1 << 20;
+    unsigned long long x = static_cast<unsigned long long>(static_cast<long long>(floor(v.x() / size)) + dx + offset);
+    unsigned long long y = static_cast<unsigned long long>(static_cast<long long>(floor(v.y() / size)) + dy + offset);
+    unsigned long long z = static_cast<unsigned long long>(static_cast<long long>(floor(v.z() / size)) + dz + offset);
+    return (x << 42) | (y << 21) | z;
+  }
+
+  static bool CellLess(const pair<unsigned long long, OBAtom*> &a, unsigned long long b)
+  {
+    return a.first < b;
+  }
+
+  unsigned int OBResidueData::AssignTemplateBonds(OBMol &mol, bool bondOrders)
+  {
+    if (!_init)
+      Init();
+    if (mol.Empty())
+      return 0;
+
+    OBBitVec templated(mol.NumAtoms() + 1); // bonded from a template
+    OBBitVec query(mol.NumAtoms() + 1);     // to be bonded by distance
+    unsigned int count = 0;
+
+    // bonds within the residues, and peptide bonds between them
+    OBResidue *prev = NULL;
+    OBAtom *prevC = NULL; // the carbonyl C of the previous amino acid
+    vector<string> ids;
+    string type;
+    int hyb, bo;
+    vector<OBResidue*>::iterator r;
+    for (OBResidue *res = mol.BeginResidue(r); res; res = mol.NextResidue(r))
+      {
+        vector<OBAtom*> atoms = res->GetAtoms();
+        OBAtom *n = NULL, *ca = NULL, *c = NULL;
+        if (SetResName(res->GetName()))
+          {
+            ids.resize(atoms.size());
+            for (unsigned int i = 0; i < atoms.size(); ++i)
+              {
+                ids[i] = res->GetAtomID(atoms[i]);
+                Trim(ids[i]);
+                if (!LookupType(ids[i], type, hyb))
+                  continue;
+                templated.SetBitOn(atoms[i]->GetIdx());
+                ++count;
+                if (ids[i] == "N")
+                  n = atoms[i];
+                else if (ids[i] == "CA")
+                  ca = atoms[i];
+                else if (ids[i] == "C")
+                  c = atoms[i];
+                else if (ids[i] == "SG") // may be in a disulfide bond
+                  query.SetBitOn(atoms[i]->GetIdx());
+
+                for (unsigned int j = 0; j < i; ++j)
+                  if (templated.BitIsSet(atoms[j]->GetIdx())
+                      && (bo = LookupBO(ids[i], ids[j]))
+                      && !atoms[i]->IsConnected(atoms[j])
+                      && BondingDistance(atoms[i], atoms[j])) // e.g. not alternate locations
+                    mol.AddBond(atoms[i]->GetIdx(), atoms[j]->GetIdx(), bondOrders ? bo : 1);
+              }
+          }
+
+        if (prevC && n && prev->GetChain() == res->GetChain()
+            && prev->GetChainNum() == res->GetChainNum()
+            && !prevC->IsConnected(n) && BondingDistance(prevC, n))
+          mol.AddBond(prevC->GetIdx(), n->GetIdx(), 1);
+        prev = res;
+        prevC = (n && ca) ? c : NULL;
+      }
+
+    // the other atoms are bonded by distance to any atom, found on a grid
+    vector<pair<unsigned long long, OBAtom*> > cells;
+    double maxrad = 0.0;
+    OBAtom *atom;
+    vector<OBAtom*>::iterator i;
+    for (atom = mol.BeginAtom(i); atom; atom = mol.NextAtom(i))
+      {
+        if (!templated.BitIsSet(atom->GetIdx()))
+          query.SetBitOn(atom->GetIdx());
+        if (HasFullValence(atom))
+          continue;
+        maxrad = std::max(maxrad, OBElements::GetCovalentRad(atom->GetAtomicNum()));
+        cells.push_back(make_pair(0ULL, atom));
+      }
+    const double size = 2.0 * maxrad + 0.45;
+    for (unsigned int k = 0; k < cells.size(); ++k)
+      cells[k].first = GridCell(cells[k].second->GetVector(), size);
+    sort(cells.begin(), cells.end());
+
+    set<OBBond*> added;
+    for (unsigned int k = 0; k < cells.size(); ++k)
+      {
+        atom = cells[k].second;
+        if (!query.BitIsSet(atom->GetIdx()))
+          continue;
+        for (int dx = -1; dx <= 1; ++dx)
+          for (int dy = -1; dy <= 1; ++dy)
+            for (int dz = -1; dz <= 1; ++dz)
+              {
+                unsigned long long key = GridCell(atom->GetVector(), size, dx, dy, dz);
+                vector<pair<unsigned long long, OBAtom*> >::iterator c
+                  = lower_bound(cells.begin(), cells.end(), key, CellLess);
+                for (; c != cells.end() && c->first == key; ++c)
+                  {
+                    OBAtom *nbr = c->second;
+                    if (nbr == atom || (query.BitIsSet(nbr->GetIdx()) && nbr->GetIdx() < atom->GetIdx()))
+                      continue; // each pair once
+                    if (atom->IsConnected(nbr) || !BondingDistance(atom, nbr))
+                      continue;
+                    if (!ValidAdditionalBond(atom, nbr) || !ValidAdditionalBond(nbr, atom))
+                      continue;
+                    mol.AddBond(atom->GetIdx(), nbr->GetIdx(), 1);
+                    added.insert(mol.GetBond(mol.NumBonds() - 1));
+                  }
+              }
+      }
+
+    // as in ConnectTheDots(), delete the longest of the bonds added to an
+    // atom which exceeds its valence or has too small a bond angle
+    vector<OBAtom*> bonded;
+    for (set<OBBond*>::iterator b = added.begin(); b != added.end(); ++b)
+      {
+        bonded.push_back((*b)->GetBeginAtom());
+        bonded.push_back((*b)->GetEndAtom());
+      }
+    for (unsigned int k = 0; k < bonded.size(); ++k)
+      {
+        atom = bonded[k];
+        while (atom->GetExplicitValence() > static_cast<unsigned int>(OBElements::GetMaxBonds(atom->GetAtomicNum()))
+               || atom->SmallestBondAngle() < 45.0)
+          {
+            OBBond *longest = NULL;
+            FOR_BONDS_OF_ATOM(bond, atom)
+              if (added.count(&*bond) && (!longest || bond->GetLength() > longest->GetLength()))
+                longest = &*bond;
+            if (!longest)
+              break;
+            added.erase(longest);
+            mol.DeleteBond(longest);
+          }
+      }
+
+    // bond orders of the atoms not bonded from a template
+    if (bondOrders)
+      {
+        OBBitVec others(mol.NumAtoms() + 1);
+        for (atom = mol.BeginAtom(i); atom; atom = mol.NextAtom(i))
+          if (!templated.BitIsSet(atom->GetIdx()))
+            others.SetBitOn(atom->GetIdx());
+        if (others.CountBits())
+          {
+            OBMol fragment;
+            vector<unsigned int> bondorder;
+            mol.CopySubstructure(fragment, &others, NULL, 0, NULL, &bondorder);
+            fragment.PerceiveBondOrders();
+            FOR_BONDS_OF_MOL(bond, fragment)
+              mol.GetBond(bondorder[bond->GetIdx()])->SetBondOrder(bond->GetBondOrder());
+          }
+      }
+
+    return count;
+  }
+
   void OBResidueData::ParseLine(const char *buffer)
   {
     int bo;
@@ -40,8 +40,12 @@ GNU General Public License for more details.
 #include <sstream>
 #include <string>
 #include <cmath>
+#include <algorithm>
+#include <functional>
+#include <queue>
 #include <Eigen/Core>
 #include <Eigen/Eigenvalues>
+#include <Eigen/QR>
 
 using namespace std;
 
@@ -105,9 +109,11 @@ namespace OpenBabel {
     bool debug; double maxBoxSize; };
 
 
-  OBDistanceGeometry::OBDistanceGeometry(): _d(NULL) {}
+  OBDistanceGeometry::OBDistanceGeometry(): _d(NULL), _nthreads(1), _randomSeed(0),
+    _firstConformer(0) {}
 
-  OBDistanceGeometry::OBDistanceGeometry(const OBMol &mol, bool useCurrentGeometry): _d(NULL)
+  OBDistanceGeometry::OBDistanceGeometry(const OBMol &mol, bool useCurrentGeometry): _d(NULL),
+    _nthreads(1), _randomSeed(0), _firstConformer(0)
   {
     Setup(mol, useCurrentGeometry);
   }
@@ -140,6 +146,7 @@ namespace OpenBabel {
     _mol.SetDimension(3);
     _vdata = _mol.GetAllData(OBGenericDataType::StereoData);
     _d = new DistanceGeometryPrivate(mol.NumAtoms());
+    _stereo.clear();
 
     SetUpperBounds();
     // Do we use the current geometry for default 1-2 and 1-3 bounds?
@@ -180,15 +187,14 @@ namespace OpenBabel {
         OBTetrahedralStereo::Config config = ts->GetConfig();
         vector<unsigned long> nbrs;
 
-        nbrs.push_back(_mol.GetAtomById(config.from)->GetIdx()-1);
-        for(size_t i=0; i<config.refs.size(); i++) {
-          nbrs.push_back(_mol.GetAtomById(config.refs[i])->GetIdx()-1);
-        }
-
-        // This is required to avoid segfault (why?)
+        // An implicit reference (e.g., the lone pair of a stereo N) has no
+        // atom and is placed at the center
         unsigned long centerIdx = _mol.GetAtomById(config.center)->GetIdx()-1;
-        for(size_t i=0; i<nbrs.size(); i++) {
-          if (nbrs[i] > _mol.NumAtoms()) nbrs[i] = centerIdx;
+        OBAtom *nbr = _mol.GetAtomById(config.from);
+        nbrs.push_back(nbr ? nbr->GetIdx()-1 : centerIdx);
+        for(size_t i=0; i<config.refs.size(); i++) {
+          nbr = _mol.GetAtomById(config.refs[i]);
+          nbrs.push_back(nbr ? nbr->GetIdx()-1 : centerIdx);
         }
 
         if(config.winding == OBStereo::Clockwise) {
@@ -223,6 +229,7 @@ namespace OpenBabel {
         }
       }
     }
+    _firstConformer = _mol.NumConformers();
     return true;
   }
 
@@ -817,66 +824,105 @@ namespace OpenBabel {
   //! Dress, AWM, Havel TF; Discrete Applied Mathematics (1988) v. 19 pp. 129-144
   //! "Shortest Path Problems and Molecular Conformation"
   //! https://doi.org/10.1016/0166-218X(88)90009-1
+  //!
+  //! The smoothed upper bound u'(i,j) is the shortest path from i to j over the
+  //! upper bounds, and the smoothed lower bound is the largest
+  //! l(k,l) - u'(i,k) - u'(l,j). Only the upper bounds below the default maximum
+  //! can shorten a path, so the graph is sparse (1-2 to 1-5 bounds) and is
+  //! searched from each atom with Dijkstra's algorithm. A lower bound term can
+  //! only be positive if u'(i,k) is less than the largest lower bound, so only
+  //! the atoms within that distance are used for the lower bounds. The cost is
+  //! O(N^2 log N) for a molecule of N atoms instead of O(N^3).
   void OBDistanceGeometry::TriangleSmooth()
   {
-    int a, b, c;
-
+    const int N = _mol.NumAtoms();
     _d->maxBoxSize = 0.0; // size of surrounding space
+    if (N < 2)
+      return;
 
-    float u_ab, u_bc, u_ac; // upper limits
-    float l_ab, l_bc, l_ac; // lower limits
-    FOR_ATOMS_OF_MOL (_a, _mol) {
-      a = _a->GetIdx() - 1;
-      FOR_ATOMS_OF_MOL (_b, _mol) {
-        if (&*_b == &*_a)
-          continue;
-        b = _b->GetIdx() - 1;
-
-        // Get upper and lower bounds for ab
-        u_ab = _d->GetUpperBounds(a, b);
-        l_ab = _d->GetLowerBounds(a, b);
-        FOR_ATOMS_OF_MOL (_c, _mol) {
-          if (_c->GetIdx() <= _b->GetIdx())
-            continue;
-          if (&*_c == &*_a)
-            continue;
-
-          c = _c->GetIdx() - 1;
-
-          // get the upper and lower limits for bc and ac
-          u_bc = _d->GetUpperBounds(b, c);
-          l_bc = _d->GetLowerBounds(b, c);
-          u_ac = _d->GetUpperBounds(a, c);
-          l_ac = _d->GetLowerBounds(a, c);
-
-          // Triangle rule: length can't be longer than the sum of the two other legs
-          //   here "a" is the vertex
-          if (u_bc > (u_ab + u_ac)) { // u_bc <= u_ab + u_bc
-            u_bc = u_ab + u_ac;
-            _d->SetUpperBounds(b, c, u_bc);
-          }
+    // Symmetric copies of the upper and lower bounds
+    Eigen::MatrixXf U(N, N), L(N, N);
+    float maxUpper = 0.0f, maxLower = 0.0f;
+    for (int j = 0; j < N; ++j) {
+      U(j, j) = L(j, j) = 0.0f;
+      for (int i = 0; i < j; ++i) {
+        U(i, j) = U(j, i) = _d->bounds(i, j);
+        L(i, j) = L(j, i) = _d->bounds(j, i);
+        maxUpper = std::max(maxUpper, U(i, j));
+        maxLower = std::max(maxLower, L(i, j));
+      }
+    }
 
-          // Triangle rule: length can't be shorter than the difference between the legs
-          if (l_bc < (l_ab - l_ac)) {
-            l_bc = l_ab - l_ac;
-            _d->SetLowerBounds(b, c, l_bc);
-          } else if (l_bc < (l_ac - l_ab)) {
-            l_bc = l_ac - l_ab;
-            _d->SetLowerBounds(b, c, l_bc);
-          }
+    // The graph of upper bounds, without the edges of the default maximum
+    // (a path through them can't be shorter than any upper bound)
+    vector<int> first(N + 1, 0), nbrs;
+    vector<float> weights;
+    for (int i = 0; i < N; ++i) {
+      for (int j = 0; j < N; ++j)
+        if (j != i && U(j, i) < maxUpper) {
+          nbrs.push_back(j);
+          weights.push_back(U(j, i));
+        }
+      first[i + 1] = nbrs.size();
+    }
 
-          if (u_bc < l_bc) {
-            _d->SetUpperBounds(b, c, l_bc);
-            //obErrorLog.ThrowError(__FUNCTION__, "Triagle Smoothing: Erroneous Bounds.", obWarning);
+    // Upper bounds: shortest paths from each atom
+    typedef std::pair<float, int> QueueItem;
+    vector<float> dist(N);
+    for (int s = 0; s < N; ++s) {
+      std::priority_queue<QueueItem, vector<QueueItem>, std::greater<QueueItem> > queue;
+      std::fill(dist.begin(), dist.end(), maxUpper);
+      dist[s] = 0.0f;
+      queue.push(QueueItem(0.0f, s));
+      while (!queue.empty()) {
+        const QueueItem item = queue.top();
+        queue.pop();
+        const int a = item.second;
+        if (item.first > dist[a])
+          continue; // already reached by a shorter path
+        for (int e = first[a]; e < first[a + 1]; ++e) {
+          const float d = item.first + weights[e];
+          if (d < dist[nbrs[e]]) {
+            dist[nbrs[e]] = d;
+            queue.push(QueueItem(d, nbrs[e]));
           }
-
-        } // loop(c)
-
-        // Update boxSize after all "c" updates for this pair
-        if (_d->GetUpperBounds(a, b) > _d->maxBoxSize)
-          _d->maxBoxSize = _d->GetUpperBounds(a, b);
-      } // loop(b)
-    } // loop(a)
+        }
+      }
+      for (int j = 0; j < N; ++j)
+        U(j, s) = dist[j];
+    }
+    // the paths in both directions may differ by rounding
+    Eigen::MatrixXf T = U.transpose();
+    U = U.cwiseMin(T);
+
+    // The atoms k with u'(i,k) below the largest lower bound
+    vector<vector<int> > near(N);
+    for (int i = 0; i < N; ++i)
+      for (int k = 0; k < N; ++k)
+        if (k != i && U(k, i) < maxLower)
+          near[i].push_back(k);
+
+    // T(k,j) = max over l of l(k,l) - u'(l,j)
+    T = L;
+    for (int j = 0; j < N; ++j)
+      for (vector<int>::iterator l = near[j].begin(); l != near[j].end(); ++l)
+        T.col(j) = T.col(j).cwiseMax((L.col(*l).array() - U(*l, j)).matrix());
+    // l'(i,j) = max over k of T(k,j) - u'(i,k), stored in column i of T
+    L = T.transpose();
+    T = L;
+    for (int i = 0; i < N; ++i)
+      for (vector<int>::iterator k = near[i].begin(); k != near[i].end(); ++k)
+        T.col(i) = T.col(i).cwiseMax((L.col(*k).array() - U(*k, i)).matrix());
+
+    for (int j = 0; j < N; ++j)
+      for (int i = 0; i < j; ++i) {
+        float lower = std::max(T(i, j), T(j, i));
+        float upper = std::max(U(i, j), lower); // erroneous bounds
+        _d->SetLowerBounds(i, j, lower);
+        _d->SetUpperBounds(i, j, upper);
+        if (upper > _d->maxBoxSize)
+          _d->maxBoxSize = upper;
+      }
   }
 
   void OBDistanceGeometry::SetLowerBounds()
@@ -909,13 +955,13 @@ namespace OpenBabel {
     }
   }
 
-  bool OBDistanceGeometry::CheckStereoConstraints()
+  bool OBDistanceGeometry::CheckStereoConstraints(OBMol &mol)
   {
     // Check stereo by canonical SMILES
-    StereoFrom3D(&_mol, true);
+    StereoFrom3D(&mol, true);
     OBConversion conv;
     conv.SetOutFormat("can");
-    std::string predicted_smiles = conv.WriteString(&_mol, true);
+    std::string predicted_smiles = conv.WriteString(&mol, true);
     return input_smiles == predicted_smiles;
 
     // Check all stereo constraints
@@ -993,13 +1039,60 @@ namespace OpenBabel {
       return false;
   }
 
-  bool OBDistanceGeometry::generateInitialCoords(void) {
+  // The k largest eigenvalues (in decreasing order) and eigenvectors of the
+  // symmetric matrix T. Only the top of the spectrum is needed for the
+  // coordinates, so large matrices use subspace iteration instead of a full
+  // decomposition.
+  static void LargestEigenpairs(const Eigen::MatrixXd &T, unsigned int k, OBRandom &generator,
+                                Eigen::VectorXd &vals, Eigen::MatrixXd &vecs)
+  {
+    const unsigned int N = T.rows();
+    vals.resize(k);
+    vecs.resize(N, k);
+
+    if (N <= 4 * k) {
+      Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(T);
+      for (unsigned int j = 0; j < k; ++j) {
+        vals(j) = es.eigenvalues()(N - 1 - j);
+        vecs.col(j) = es.eigenvectors().col(N - 1 - j);
+      }
+      return;
+    }
+
+    // A few extra vectors take up eigenvalues of large magnitude that are
+    // negative, and speed up convergence
+    const unsigned int m = k + 4;
+    Eigen::MatrixXd Q(N, m), Z;
+    for (unsigned int i = 0; i < N; ++i)
+      for (unsigned int j = 0; j < m; ++j)
+        Q(i, j) = generator.NextFloat() - 0.5;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> ritz;
+    Eigen::VectorXd previous = Eigen::VectorXd::Zero(m);
+    for (unsigned int iter = 0; iter < 50; ++iter) {
+      Eigen::HouseholderQR<Eigen::MatrixXd> qr(Q);
+      Q = qr.householderQ() * Eigen::MatrixXd::Identity(N, m);
+      Z = T * Q;
+      // Rayleigh-Ritz projection on the subspace
+      ritz.compute(Q.transpose() * Z);
+      const Eigen::VectorXd &values = ritz.eigenvalues();
+      double scale = std::max(fabs(values(0)), fabs(values(m - 1)));
+      if (iter && (values - previous).cwiseAbs().maxCoeff() <= 1.0e-4 * scale)
+        break;
+      previous = values;
+      Q = Z;
+    }
+    for (unsigned int j = 0; j < k; ++j) {
+      vals(j) = ritz.eigenvalues()(m - 1 - j);
+      vecs.col(j) = Q * ritz.eigenvectors().col(m - 1 - j);
+    }
+  }
+
+  bool OBDistanceGeometry::generateInitialCoords(OBRandom &generator, Eigen::VectorXd &coord) {
     // place atoms randomly
     unsigned int N = _mol.NumAtoms();
     // random distance matrix
     Eigen::MatrixXd distMat = Eigen::MatrixXd::Zero(N, N);
-    OBRandom generator;
-    generator.TimeSeed();
     for (size_t i=0; i<N; ++i) {
       for(size_t j=0; j<i; ++j) {
         double lb = _d->GetLowerBounds(i, j);
@@ -1040,50 +1133,29 @@ namespace OpenBabel {
         T(j, i) = v;
       }
     }
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(T);
-    Eigen::VectorXd eigVals = es.eigenvalues();
-    Eigen::MatrixXd eigVecs = es.eigenvectors();
 
-    for (size_t i = 0; i < N; i++) {
-      if(eigVals(i) > 0) eigVals(i) = sqrt(eigVals(i));
-      else eigVals(i) *= -1;
+    // Only the largest dim eigenvalues are used
+    const unsigned int k = std::min(dim, N);
+    Eigen::VectorXd eigVals;
+    Eigen::MatrixXd eigVecs;
+    LargestEigenpairs(T, k, generator, eigVals, eigVecs);
+
+    for (size_t j = 0; j < k; j++) {
+      if(eigVals(j) > 0) eigVals(j) = sqrt(eigVals(j));
+      else eigVals(j) *= -1;
     }
 
-    _coord.resize(N * dim);
+    coord.resize(N * dim);
     for (size_t i = 0; i < N; i++) {
       for (size_t j = 0; j < dim; j++) {
-        if(N-1-j >= 0) _coord(i*dim + j) = eigVals(N-1-j) * eigVecs(i, N-1-j);
-        else _coord(i*dim + j) = 0;
-      }
-    }
-    Eigen::MatrixXd distMat2(N, N);
-    for (size_t i = 0; i < N; i++) {
-      for (size_t j = 0; j < N; j++) {
-        for(size_t k = 0; k < dim; k++)
-          distMat2(i, j) += pow(_coord(i*dim + k)-_coord(j*dim + k), 2.0);
-        distMat2(i, j) = sqrt(distMat2(i, j));
-      }
-    }
-
-    for(size_t i=0; i<N; i++) {
-      for (size_t j=0; j<N; j++) {
-        double lb = _d->GetLowerBounds(i, j);
-        double ub = _d->GetUpperBounds(i, j);
-        //cout << "(" << i << ", " << j << ")" << lb << " < " << distMat2(i, j) << " (" << distMat(i, j) << ")" << " < " << ub << endl;
+        if (j < k) coord(i*dim + j) = eigVals(j) * eigVecs(i, j);
+        else coord(i*dim + j) = 0;
       }
     }
     return true;
   }
 
-  bool OBDistanceGeometry::firstMinimization(void) {
-    unsigned int N = _mol.NumAtoms();
-    for(size_t i=0; i<N; ++i) {
-      vector3 v(_coord(i*dim), _coord(i*dim+1), _coord(i*dim+2));
-      OBAtom* a = _mol.GetAtom(i+1);
-      a->SetVector(v);
-    }
-    DistGeomFunc f(this);
-
+  bool OBDistanceGeometry::firstMinimization(Eigen::VectorXd &coord) {
     LBFGSpp::LBFGSParam<double> param;
     param.epsilon = 1e-6;
     param.max_iterations = 1000;
@@ -1093,43 +1165,11 @@ namespace OpenBabel {
     DistGeomFunc fun(this);
 
     double fx;
-    int niter = solver.minimize(fun, _coord, fx);
-    //std::cout << niter << " iterations" << std::endl;
-    //std::cout << "f(x) = " << fx << std::endl;
-
-    for(size_t i=0; i<N; ++i) {
-      vector3 v(_coord(i*dim), _coord(i*dim+1), _coord(i*dim+2));
-      OBAtom* a = _mol.GetAtom(i+1);
-      a->SetVector(v);
-    }
-
-    Eigen::MatrixXd distMat2(N, N);
-    for (size_t i = 0; i < N; i++) {
-      for (size_t j = 0; j < N; j++) {
-        for(size_t k = 0; k < dim; k++)
-          distMat2(i, j) += pow(_coord(i*dim + k)-_coord(j*dim + k), 2.0);
-        distMat2(i, j) = sqrt(distMat2(i, j));
-      }
-    }
-
-    for(size_t i=0; i<N; i++) {
-      for (size_t j=0; j<N; j++) {
-        double lb = _d->GetLowerBounds(i, j);
-        double ub = _d->GetUpperBounds(i, j);
-        //cout << "(" << i << ", " << j << ")" << lb << " < " << distMat2(i, j) << " < " << ub << endl;
-      }
-    }
+    solver.minimize(fun, coord, fx);
     return true;
   }
 
-  bool OBDistanceGeometry::minimizeFourthDimension(void) {
-    unsigned int N = _mol.NumAtoms();
-    for(size_t i=0; i<N; ++i) {
-      vector3 v(_coord(i*dim), _coord(i*dim+1), _coord(i*dim+2));
-      OBAtom* a = _mol.GetAtom(i+1);
-      a->SetVector(v);
-    }
-
+  bool OBDistanceGeometry::minimizeFourthDimension(Eigen::VectorXd &coord) {
     LBFGSpp::LBFGSParam<double> param;
     param.epsilon = 1e-6;
     param.max_iterations = 2000;
@@ -1138,39 +1178,48 @@ namespace OpenBabel {
     DistGeomFunc4D fun(this);
 
     double fx;
-    int niter = solver.minimize(fun, _coord, fx);
-    //std::cout << niter << " iterations" << std::endl;
-    //std::cout << "f(x) = " << fx << std::endl;
-
-    for(size_t i=0; i<N; ++i) {
-      vector3 v(_coord(i*dim), _coord(i*dim+1), _coord(i*dim+2));
-      OBAtom* a = _mol.GetAtom(i+1);
-      a->SetVector(v);
-    }
+    solver.minimize(fun, coord, fx);
     return true;
   }
 
-  void OBDistanceGeometry::AddConformer()
+  bool OBDistanceGeometry::Embed(unsigned int seed, Eigen::VectorXd &coord, OBMol &mol)
   {
-    // We should use Eigen here, and cast to double*
-    double *confCoord = new double [_mol.NumAtoms() * 3]; // initial state (random)
-    _mol.AddConformer(confCoord);
-    _mol.SetConformer(_mol.NumConformers());
+    OBRandom generator;
+    generator.Seed(seed);
+
+    generateInitialCoords(generator, coord);
+    firstMinimization(coord);
+    if (dim == 4) minimizeFourthDimension(coord);
+
+    for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+      mol.GetAtom(i + 1)->SetVector(coord(i*dim), coord(i*dim+1), coord(i*dim+2));
+    return CheckStereoConstraints(mol) && CheckBounds(mol);
+  }
 
-    OBRandom generator(true); // Use system rand() functions
+  unsigned int OBDistanceGeometry::FirstSeed()
+  {
+    if (_randomSeed)
+      return _randomSeed;
+    OBRandom generator;
     generator.TimeSeed();
+    return generator.NextInt();
+  }
 
+  void OBDistanceGeometry::AddConformer()
+  {
     if (_d->debug) {
       cerr << " max box size: " << _d->maxBoxSize << endl;
     }
 
+    const unsigned int N = _mol.NumAtoms();
+    const unsigned int seed = FirstSeed();
+    Eigen::VectorXd coord;
+    OBMol mol = _mol;
+
     bool success = false;
-    unsigned int maxIter = 1 * _mol.NumAtoms();
+    unsigned int maxIter = 1 * N;
     for (unsigned int trial = 0; trial < maxIter; trial++) {
-      generateInitialCoords();
-      firstMinimization();
-      if (dim == 4) minimizeFourthDimension();
-      if (CheckStereoConstraints() && CheckBounds()) {
+      if (Embed(seed + trial, coord, mol)) {
         success = true;
         break;
       }
@@ -1180,19 +1229,71 @@ namespace OpenBabel {
     if(!success) {
       obErrorLog.ThrowError(__FUNCTION__, "Distance Geometry failed.", obWarning);
     }
+
+    // Add the coordinates of the last trial
+    double *confCoord = new double [N * 3];
+    for (unsigned int i = 0; i < N; ++i)
+      for (unsigned int k = 0; k < 3; ++k)
+        confCoord[i*3 + k] = coord.size() ? coord(i*dim + k) : 0.0;
+    _mol.AddConformer(confCoord);
+    _mol.SetConformer(_mol.NumConformers() - 1);
+  }
+
+  unsigned int OBDistanceGeometry::AddConformers(unsigned int numConformers, unsigned int maxStarts)
+  {
+    if (_d == NULL)
+      return 0;
+    const unsigned int N = _mol.NumAtoms();
+    if (!maxStarts)
+      maxStarts = numConformers * N;
+    const unsigned int seed = FirstSeed();
+
+    // Each start in a batch has its own coordinates and copy of the molecule
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = std::max(1, std::min<int>(_nthreads, maxStarts));
+#endif
+    std::vector<OBMol> mols(nthreads, _mol);
+    std::vector<Eigen::VectorXd> coords(nthreads);
+    std::vector<char> passed(nthreads);
+
+    unsigned int added = 0;
+    for (unsigned int start = 0; start < maxStarts && added < numConformers; start += nthreads) {
+      const int nbatch = std::min<unsigned int>(nthreads, maxStarts - start);
+#ifdef _OPENMP
+      #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+#endif
+      for (int b = 0; b < nbatch; ++b)
+        passed[b] = Embed(seed + start + b, coords[b], mols[b]);
+
+      // Add the conformers in the order of the starts
+      for (int b = 0; b < nbatch && added < numConformers; ++b) {
+        if (!passed[b])
+          continue;
+        double *confCoord = new double [N * 3];
+        for (unsigned int i = 0; i < N; ++i)
+          for (unsigned int k = 0; k < 3; ++k)
+            confCoord[i*3 + k] = coords[b](i*dim + k);
+        _mol.AddConformer(confCoord);
+        added++;
+      }
+    }
+    if (added)
+      _mol.SetConformer(_mol.NumConformers() - 1);
+    return added;
   }
 
-  bool OBDistanceGeometry::CheckBounds()
+  bool OBDistanceGeometry::CheckBounds(OBMol &mol)
   {
     // remember atom indexes from 1
     OBAtom *a, *b;
     double dist, aRad, bRad, minDist, uBounds;
 
-    for (unsigned int i = 1; i <= _mol.NumAtoms(); ++i) {
-      a = _mol.GetAtom(i);
+    for (unsigned int i = 1; i <= mol.NumAtoms(); ++i) {
+      a = mol.GetAtom(i);
       aRad = OBElements::GetVdwRad(a->GetAtomicNum());
-      for (unsigned int j = i + 1; j <= _mol.NumAtoms(); ++j) {
-          b = _mol.GetAtom(j);
+      for (unsigned int j = i + 1; j <= mol.NumAtoms(); ++j) {
+          b = mol.GetAtom(j);
 
           // Compare the current distance to the lower and upper bounds
           dist = a->GetDistance(b);
@@ -1205,7 +1306,7 @@ namespace OpenBabel {
             return false;
           }
           // now lower.. if the two atoms aren't bonded
-          if (_mol.GetBond(a, b))
+          if (mol.GetBond(a, b))
             continue;
 
           bRad = OBElements::GetVdwRad(b->GetAtomicNum());
@@ -1238,12 +1339,12 @@ namespace OpenBabel {
 
     mol.SetDimension(3);
 
-    //Copy conformer information
-    if (_mol.NumConformers() > 0) {
+    //Copy the generated conformers
+    if (_mol.NumConformers() > _firstConformer) {
       int k,l;
       vector<double*> conf;
       double* xyz = NULL;
-      for (k=0 ; k<_mol.NumConformers() ; ++k) {
+      for (k=_firstConformer ; k<_mol.NumConformers() ; ++k) {
         xyz = new double [3*_mol.NumAtoms()];
         for (l=0 ; l<(int) (3*_mol.NumAtoms()) ; ++l)
           xyz[l] = _mol.GetConformer(k)[l];
@@ -20,6 +20,7 @@ GNU General Public License for more details.
 #include <openbabel/babelconfig.h>
 
 #include <set>
+#include <algorithm>
 
 #include <openbabel/forcefield.h>
 
@@ -34,8 +35,13 @@ GNU General Public License for more details.
 #include <openbabel/grid.h>
 #include <openbabel/griddata.h>
 #include <openbabel/elements.h>
+#include <openbabel/obconversion.h>
 #include "rand.h"
 
+#ifdef HAVE_EIGEN
+#include <LBFGS.h>
+#endif
+
 using namespace std;
 
 namespace OpenBabel
@@ -333,6 +339,29 @@ namespace OpenBabel
     return NULL;
   }
 
+  // Owns the force fields made by GetThreadInstance(), deleted when the thread ends
+  struct OBFFThreadInstances
+  {
+    ~OBFFThreadInstances()
+    {
+      for (map<string, OBForceField*>::iterator i = instances.begin(); i != instances.end(); ++i)
+        delete i->second;
+    }
+    map<string, OBForceField*> instances;
+  };
+
+  OBForceField* OBForceField::GetThreadInstance(const char *ID)
+  {
+    static THREAD_LOCAL OBFFThreadInstances owned;
+    OBForceField *&pFF = owned.instances[ID];
+    if (!pFF) {
+      OBForceField *pPlugin = FindForceField(ID);
+      if (pPlugin)
+        pFF = pPlugin->MakeNewInstance();
+    }
+    return pFF;
+  }
+
   //////////////////////////////////////////////////////////////////////////////////
   //
   // Constraints
@@ -1280,7 +1309,7 @@ namespace OpenBabel
   void OBForceField::SystematicRotorSearch(unsigned int geomSteps, bool sampleRingBonds)
   {
     if (SystematicRotorSearchInitialize(geomSteps, sampleRingBonds))
-      while (SystematicRotorSearchNextConformer(geomSteps)) {}
+      MinimizeRotorSearchConformers(geomSteps);
   }
 
   int OBForceField::FastRotorSearch(bool permute)
@@ -1324,11 +1353,11 @@ namespace OpenBabel
     double *minconf = new double [_mol.NumAtoms() * 3];  // store the best conformer for the current rotor
     memcpy((char*)bestconf,(char*)_mol.GetCoordinates(),sizeof(double)*3*_mol.NumAtoms());
 
-    double energy_offset;
-    // Can take shortcut later, as 4 components of the energy will be constant
     rotamerlist.SetCurrentCoordinates(_mol, rotorKey);
     SetupPointers();
-    energy_offset = E_Bond(false) + E_Angle(false) + E_StrBnd(false) + E_OOP(false);
+
+    const unsigned int numCoords = _mol.NumAtoms() * 3;
+    std::vector<double> batchCoords, batchEnergies;
 
     // This function relies on the fact that Rotors are ordered from the most
     // central to the most peripheral (due to CompareRotors in rotor.cpp)
@@ -1373,21 +1402,28 @@ namespace OpenBabel
 
         minE = DBL_MAX;
 
-        for (j = 0; j < rotor->GetResolution().size(); j++) { // For each rotor position
+        // Evaluate all positions of this rotor together
+        const unsigned int positions = rotor->GetResolution().size();
+        batchCoords.resize(positions * numCoords);
+        batchEnergies.resize(positions);
+        for (j = 0; j < positions; j++) { // For each rotor position
           // Note: we could do slightly better by skipping the rotor position we already
           //       tested in the last loop (position 0 at the moment). Note that this
           //       isn't as simple as just changing the loop starting point to j = 1.
           _mol.SetCoordinates(bestconf);
           rotorKey[idx + 1] = j;
           rotamerlist.SetCurrentCoordinates(_mol, rotorKey);
-          SetupPointers();
+          memcpy(&batchCoords[j * numCoords], _mol.GetCoordinates(), sizeof(double) * numCoords);
+        }
+        EnergyBatchThreaded(&batchCoords[0], positions, &batchEnergies[0], NULL);
 
-          currentE = E_VDW(false) + E_Torsion(false) + E_Electrostatic(false);
+        for (j = 0; j < positions; j++) {
+          currentE = batchEnergies[j];
 
           if (currentE < minE) {
             minE = currentE;
             minj = j;
-            memcpy((char*)minconf,(char*)_mol.GetCoordinates(),sizeof(double)*3*_mol.NumAtoms());
+            memcpy((char*)minconf,(char*)&batchCoords[j * numCoords],sizeof(double)*3*_mol.NumAtoms());
           }
         } // Finished testing all positions of this rotor
         rotorKey[idx + 1] = minj;
@@ -1438,7 +1474,10 @@ namespace OpenBabel
     OBRotor *rotor;
 
     OBRandom generator;
-    generator.TimeSeed();
+    if (_randomSeed)
+      generator.Seed(_randomSeed);
+    else
+      generator.TimeSeed();
     _origLogLevel = _loglvl;
 
     if (_mol.GetCoordinates() == NULL)
@@ -1547,7 +1586,7 @@ namespace OpenBabel
                                        bool sampleRingBonds)
   {
     RandomRotorSearchInitialize(conformers, geomSteps, sampleRingBonds);
-    while (RandomRotorSearchNextConformer(geomSteps)) {}
+    MinimizeRotorSearchConformers(geomSteps);
   }
 
   void Reweight(std::vector< std::vector <double> > &rotorWeights,
@@ -1608,7 +1647,10 @@ namespace OpenBabel
     OBRotor *rotor;
 
     OBRandom generator;
-    generator.TimeSeed();
+    if (_randomSeed)
+      generator.Seed(_randomSeed);
+    else
+      generator.TimeSeed();
     int origLogLevel = _loglvl;
 
     if (_mol.GetCoordinates() == NULL)
@@ -1644,6 +1686,7 @@ namespace OpenBabel
 
 
     _energies.clear(); // Wipe any energies from previous conformer generators
+    _rotorWeights.clear();
 
     if (!rl.Size()) { // only one conformer
       IF_OBFF_LOGLVL_LOW
@@ -1681,23 +1724,30 @@ namespace OpenBabel
       rotorKey[i] = -1; // no rotation (new in 2.2)
     }
 
+    const unsigned int N = _mol.NumAtoms() * 3;
+    std::vector<double> batchCoords;
+
     rotor = rl.BeginRotor(ri);
 
     for (unsigned int i = 1; i < rl.Size() + 1; ++i, rotor = rl.NextRotor(ri)) {
       // foreach rotor
-      energies.clear();
-      for (unsigned int j = 0; j < rotor->GetResolution().size(); j++) {
+      const unsigned int positions = rotor->GetResolution().size();
+      batchCoords.resize(positions * N);
+      for (unsigned int j = 0; j < positions; j++) {
         // foreach rotor position
         _mol.SetCoordinates(initialCoord);
         rotorKey[i] = j;
         rotamers.SetCurrentCoordinates(_mol, rotorKey);
-        SetupPointers(); // update pointers to atom positions in the OBFFCalculation objects
+        memcpy(&batchCoords[j * N], _mol.GetCoordinates(), sizeof(double) * N);
+      }
 
-        _loglvl = OBFF_LOGLVL_NONE;
-        ConjugateGradients(geomSteps); // energy minimization for conformer
-        _loglvl = origLogLevel;
-        currentE = Energy(false);
+      // minimize all rotor positions together
+      energies.resize(positions);
+      MinimizeBatch(&batchCoords[0], positions, geomSteps, 1.0e-6, &energies[0]);
+      memcpy(_mol.GetCoordinates(), &batchCoords[(positions - 1) * N], sizeof(double) * N);
 
+      for (unsigned int j = 0; j < positions; j++) {
+        currentE = energies[j];
         if (j == 0)
           bestE = worstE = currentE;
         else {
@@ -1706,7 +1756,6 @@ namespace OpenBabel
           else if (currentE < bestE)
             bestE = currentE;
         }
-        energies.push_back(currentE);
       }
       rotorKey[i] = -1; // back to the previous setting before we go to another rotor
 
@@ -1746,71 +1795,84 @@ namespace OpenBabel
       OBFFLog("--------------------\n");
     }
 
+    // Reweight() changes the weights used to choose the next rotor keys, so
+    // only a small batch of keys is chosen and minimized together before the
+    // weights are updated. The batch size doesn't depend on the number of
+    // threads to give the same conformers for any number of threads.
     double defaultRotor = 1.0/sqrt((double)rl.Size());
-    unsigned c = 0;
-    while (c < conformers) {
-      _mol.SetCoordinates(initialCoord);
+    const unsigned int batchSize = 4;
+    std::vector<std::vector<int> > rotorKeys;
+    for (unsigned int first = 1; first <= conformers; first += batchSize) {
+      const unsigned int count = std::min(batchSize, conformers - first + 1);
+      rotorKeys.clear();
+      batchCoords.resize(count * N);
+      for (unsigned int b = 0; b < count; ++b) {
+        _mol.SetCoordinates(initialCoord);
 
-      // Choose the rotor key based on current weightings
-      rotor = rl.BeginRotor(ri);
-      for (unsigned int i = 1; i < rl.Size() + 1; ++i, rotor = rl.NextRotor(ri)) {
-        // foreach rotor
-        rotorKey[i] = -1; // default = don't change dihedral
-        randFloat = generator.NextFloat();
-        if (randFloat < defaultRotor) // should we just leave this rotor with default setting?
-          continue;
+        // Choose the rotor key based on current weightings
+        rotor = rl.BeginRotor(ri);
+        for (unsigned int i = 1; i < rl.Size() + 1; ++i, rotor = rl.NextRotor(ri)) {
+          // foreach rotor
+          rotorKey[i] = -1; // default = don't change dihedral
+          randFloat = generator.NextFloat();
+          if (randFloat < defaultRotor) // should we just leave this rotor with default setting?
+            continue;
 
-        randFloat = generator.NextFloat();
-        total = 0.0;
-        for (unsigned int j = 0; j < rotor->GetResolution().size(); j++) {
-          if (randFloat > total && randFloat < (total+ rotorWeights[i][j])) {
-            rotorKey[i] = j;
-            break;
+          randFloat = generator.NextFloat();
+          total = 0.0;
+          for (unsigned int j = 0; j < rotor->GetResolution().size(); j++) {
+            if (randFloat > total && randFloat < (total+ rotorWeights[i][j])) {
+              rotorKey[i] = j;
+              break;
+            }
+            else
+              total += rotorWeights[i][j];
           }
-          else
-            total += rotorWeights[i][j];
         }
-      }
 
-      //FIXME: for now, allow even invalid ring conformers
-      rotamers.SetCurrentCoordinates(_mol, rotorKey);
-      ++c;
+        //FIXME: for now, allow even invalid ring conformers
+        rotamers.SetCurrentCoordinates(_mol, rotorKey);
+        memcpy(&batchCoords[b * N], _mol.GetCoordinates(), sizeof(double) * N);
+        rotorKeys.push_back(rotorKey);
+      }
 
-      SetupPointers(); // update pointers to atom positions in the OBFFCalculation objects
+      energies.resize(count);
+      MinimizeBatch(&batchCoords[0], count, geomSteps, 1.0e-6, &energies[0]);
 
-      _loglvl = OBFF_LOGLVL_NONE;
-      ConjugateGradients(geomSteps); // energy minimization for conformer
-      _loglvl = origLogLevel;
-      currentE = Energy(false);
-      _energies.push_back(currentE);
-      double *confCoord = new double [_mol.NumAtoms() * 3]; // initial state
-      memcpy((char*)confCoord,(char*)_mol.GetCoordinates(),sizeof(double)*3*_mol.NumAtoms());
-      _mol.AddConformer(confCoord);
+      for (unsigned int b = 0; b < count; ++b) {
+        const unsigned int c = first + b;
+        currentE = energies[b];
+        _energies.push_back(currentE);
+        double *confCoord = new double [_mol.NumAtoms() * 3]; // initial state
+        memcpy((char*)confCoord,(char*)&batchCoords[b * N],sizeof(double)*3*_mol.NumAtoms());
+        _mol.AddConformer(confCoord);
 
-      IF_OBFF_LOGLVL_LOW {
-        snprintf(_logbuf, BUFF_SIZE, "   %3d      %8.3f\n", c + 1, currentE);
-        OBFFLog(_logbuf);
-      }
+        IF_OBFF_LOGLVL_LOW {
+          snprintf(_logbuf, BUFF_SIZE, "   %3d      %8.3f\n", c + 1, currentE);
+          OBFFLog(_logbuf);
+        }
 
-      if (!isfinite(currentE))
-        continue;
+        if (!isfinite(currentE))
+          continue;
 
-      if (currentE < bestE) {
-        bestE = currentE;
-        best_conformer = c;
+        if (currentE < bestE) {
+          bestE = currentE;
+          best_conformer = c;
 
-        // improve this rotorKey
-        Reweight(rotorWeights, rotorKey, +0.11);
-      } else if (currentE > worstE) { // horrible!
-        worstE = currentE;
+          // improve this rotorKey
+          Reweight(rotorWeights, rotorKeys[b], +0.11);
+        } else if (currentE > worstE) { // horrible!
+          worstE = currentE;
 
-        // penalize this rotorKey
-        Reweight(rotorWeights, rotorKey, -0.11);
-      } else {
-        double slope = -0.2 / (worstE - bestE);
-        Reweight(rotorWeights, rotorKey, (currentE - bestE)*slope);
+          // penalize this rotorKey
+          Reweight(rotorWeights, rotorKeys[b], -0.11);
+        } else {
+          double slope = -0.2 / (worstE - bestE);
+          Reweight(rotorWeights, rotorKeys[b], (currentE - bestE)*slope);
+        }
       }
     }
+    _rotorWeights = rotorWeights;
 
     IF_OBFF_LOGLVL_LOW {
       snprintf(_logbuf, BUFF_SIZE, "\n  LOWEST ENERGY: %8.3f\n\n",
@@ -3074,6 +3136,711 @@ namespace OpenBabel
       ConjugateGradientsTakeNSteps(steps);
   }
 
+  double OBForceField::EnergyAndForces(double *forces, double *maxforce2)
+  {
+    double energy = Energy(HasAnalyticalGradients()) + _constraints.GetConstraintEnergy();
+    double maxf = 0.0;
+    vector3 dir;
+
+    FOR_ATOMS_OF_MOL (a, _mol) {
+      unsigned int idx = a->GetIdx();
+      unsigned int coordIdx = (idx - 1) * 3;
+
+      if (_constraints.IsFixed(idx) || (_fixAtom == idx) || (_ignoreAtom == idx)) {
+        forces[coordIdx] = 0.0;
+        forces[coordIdx+1] = 0.0;
+        forces[coordIdx+2] = 0.0;
+        continue;
+      }
+
+      if (!HasAnalyticalGradients()) {
+        // use numerical gradients
+        dir = NumericalDerivative(&*a) + _constraints.GetGradient(idx);
+      } else {
+        // use analytical gradients
+        dir = GetGradient(&*a) + _constraints.GetGradient(idx);
+      }
+
+      forces[coordIdx] = _constraints.IsXFixed(idx) ? 0.0 : dir.x();
+      forces[coordIdx+1] = _constraints.IsYFixed(idx) ? 0.0 : dir.y();
+      forces[coordIdx+2] = _constraints.IsZFixed(idx) ? 0.0 : dir.z();
+
+      double f2 = forces[coordIdx] * forces[coordIdx]
+        + forces[coordIdx+1] * forces[coordIdx+1]
+        + forces[coordIdx+2] * forces[coordIdx+2];
+      if (f2 > maxf)
+        maxf = f2;
+    }
+
+    if (maxforce2)
+      *maxforce2 = maxf;
+    return energy;
+  }
+
+  // L-BFGS
+  //
+  // Nocedal & Wright, Numerical Optimization, 2nd ed., Algorithm 7.4 (two-loop
+  // recursion). Only the last LBFGS_HISTORY coordinate (s) and gradient (y)
+  // differences are kept. The step length along the L-BFGS direction is found
+  // with the backtracking line search of the LBFGSpp solver (include/LBFGS), the
+  // same code used by OBDistanceGeometry. The quasi-Newton direction is already
+  // well scaled, so usually the first trial step (one energy evaluation) is
+  // accepted.
+  static const int LBFGS_HISTORY = 8;      // number of correction pairs
+  static const double LBFGS_MAX_MOVE = 0.3; // don't move a coordinate more than 0.3 A per step
+
+  // L-BFGS two-loop recursion, d = -H g. The k most recent correction pairs
+  // are stored in the ring buffers S, Y (LBFGS_HISTORY * N) and YS, the next
+  // pair will be stored at position end.
+  static void LBFGSDirection(const double *g, double *d, const double *S,
+                             const double *Y, const double *YS, double *alpha,
+                             int k, int end, unsigned int N)
+  {
+    for (unsigned int c = 0; c < N; ++c)
+      d[c] = -g[c];
+    int j = end;
+    for (int h = 0; h < k; ++h) {
+      j = (j + LBFGS_HISTORY - 1) % LBFGS_HISTORY;
+      const double *s = &S[j * N];
+      const double *y = &Y[j * N];
+      double sd = 0.0;
+      for (unsigned int c = 0; c < N; ++c)
+        sd += s[c] * d[c];
+      alpha[j] = sd / YS[j];
+      for (unsigned int c = 0; c < N; ++c)
+        d[c] -= alpha[j] * y[c];
+    }
+    if (k) {
+      // initial Hessian H0 = (s'y / y'y) I using the most recent pair
+      const int last = (end + LBFGS_HISTORY - 1) % LBFGS_HISTORY;
+      const double *y = &Y[last * N];
+      double yy = 0.0;
+      for (unsigned int c = 0; c < N; ++c)
+        yy += y[c] * y[c];
+      const double gamma = YS[last] / yy;
+      for (unsigned int c = 0; c < N; ++c)
+        d[c] *= gamma;
+    }
+    for (int h = 0; h < k; ++h) {
+      const double *s = &S[j * N];
+      const double *y = &Y[j * N];
+      double yd = 0.0;
+      for (unsigned int c = 0; c < N; ++c)
+        yd += y[c] * d[c];
+      const double beta = yd / YS[j];
+      for (unsigned int c = 0; c < N; ++c)
+        d[c] += (alpha[j] - beta) * s[c];
+      j = (j + 1) % LBFGS_HISTORY;
+    }
+  }
+
+  bool OBForceField::LBFGSLineSearch(const double *origCoords, double step, double &energy)
+  {
+    const unsigned int N = _ncoords;
+
+#ifdef HAVE_EIGEN
+    // objective function for the LBFGSpp line search: E(x) and dE/dx
+    struct Objective {
+      OBForceField *ff;
+      double operator()(const Eigen::VectorXd &x, Eigen::VectorXd &grad)
+      {
+        memcpy(ff->_mol.GetCoordinates(), x.data(), sizeof(double) * x.size());
+        double e = ff->EnergyAndForces(grad.data());
+        grad = -grad;
+        return e;
+      }
+    };
+
+    Objective f = { this };
+    Eigen::VectorXd x(N);
+    Eigen::VectorXd xp = Eigen::Map<const Eigen::VectorXd>(origCoords, N);
+    Eigen::VectorXd grad = Eigen::Map<const Eigen::VectorXd>(&_lbfgsGrad[0], N);
+    Eigen::VectorXd drt = Eigen::Map<const Eigen::VectorXd>(&_lbfgsDir[0], N);
+    double fx = _e_n1;
+
+    LBFGSpp::LBFGSParam<double> param; // Armijo backtracking
+    try {
+      LBFGSpp::LineSearchBacktracking<double>::LineSearch(f, fx, x, grad, step, drt, xp, param);
+    } catch (std::exception &) {
+      return false;
+    }
+    if (!isfinite(fx) || fx > _e_n1)
+      return false;
+
+    // the coordinates are those of the last function evaluation
+    memcpy(&_lbfgsGrad[0], grad.data(), sizeof(double) * N);
+    energy = fx;
+    return true;
+#else
+    // no Eigen: use the numerical Newton line search along the direction
+    Newton2NumLineSearch(&_lbfgsDir[0]);
+    energy = EnergyAndForces(&_lbfgsGrad[0]);
+    for (unsigned int c = 0; c < N; ++c)
+      _lbfgsGrad[c] = -_lbfgsGrad[c];
+    return energy < _e_n1;
+#endif
+  }
+
+  void OBForceField::LBFGSInitialize(int steps, double econv)
+  {
+    if (!_validSetup || steps == 0)
+      return;
+
+    _cstep = 0;
+    _nsteps = steps;
+    _econv = econv;
+    _gconv = 1.0e-2; // gradient convergence (0.1) squared
+    _ncoords = _mol.NumAtoms() * 3;
+
+    if (_cutoff)
+      UpdatePairsSimple(); // Update the non-bonded pairs (Cut-off)
+
+    _lbfgsk = 0;
+    _lbfgsEnd = 0;
+    _lbfgsS.assign(LBFGS_HISTORY * _ncoords, 0.0);
+    _lbfgsY.assign(LBFGS_HISTORY * _ncoords, 0.0);
+    _lbfgsYS.assign(LBFGS_HISTORY, 0.0);
+    _lbfgsAlpha.assign(LBFGS_HISTORY, 0.0);
+    _lbfgsGrad.assign(_ncoords, 0.0);
+    _lbfgsDir.assign(_ncoords, 0.0);
+
+    // the minimizer works with gradients, the force field gives forces
+    _e_n1 = EnergyAndForces(&_lbfgsGrad[0]);
+    for (unsigned int c = 0; c < _ncoords; ++c)
+      _lbfgsGrad[c] = -_lbfgsGrad[c];
+
+    IF_OBFF_LOGLVL_LOW {
+      OBFFLog("\nL - B F G S\n\n");
+      snprintf(_logbuf, BUFF_SIZE, "STEPS = %d\n\n",  steps);
+      OBFFLog(_logbuf);
+      OBFFLog("STEP n     E(n)       E(n-1)    \n");
+      OBFFLog("--------------------------------\n");
+    }
+  }
+
+  bool OBForceField::LBFGSTakeNSteps(int n)
+  {
+    if (!_validSetup)
+      return false;
+
+    if (_ncoords != _mol.NumAtoms() * 3 || _lbfgsGrad.size() != _ncoords)
+      return false;
+
+    const unsigned int N = _ncoords;
+    double *x = _mol.GetCoordinates();
+    double *g = &_lbfgsGrad[0];
+    double *d = &_lbfgsDir[0];
+    std::vector<double> xp(N), gp(N);
+    double e_n2, maxgrad;
+
+    for (int i = 1; i <= n; i++) {
+      _cstep++;
+
+      // two-loop recursion: d = -H * g
+      LBFGSDirection(g, d, &_lbfgsS[0], &_lbfgsY[0], &_lbfgsYS[0], &_lbfgsAlpha[0],
+                     _lbfgsk, _lbfgsEnd, N);
+
+      // make sure we go downhill, otherwise restart from steepest descent
+      double dg = 0.0;
+      for (unsigned int c = 0; c < N; ++c)
+        dg += d[c] * g[c];
+      if (!(dg < 0.0)) {
+        _lbfgsk = 0;
+        dg = 0.0;
+        for (unsigned int c = 0; c < N; ++c) {
+          d[c] = -g[c];
+          dg -= g[c] * g[c];
+        }
+        if (dg == 0.0)
+          return false; // zero gradient, nothing to do
+      }
+
+      // initial step: 1.0 for a quasi-Newton direction, but don't move too far at once
+      double dmax = 0.0;
+      for (unsigned int c = 0; c < N; ++c)
+        if (fabs(d[c]) > dmax)
+          dmax = fabs(d[c]);
+      double step = 1.0;
+      if (step * dmax > LBFGS_MAX_MOVE)
+        step = LBFGS_MAX_MOVE / dmax;
+
+      memcpy(&xp[0], x, sizeof(double) * N);
+      memcpy(&gp[0], g, sizeof(double) * N);
+
+      bool accepted = LBFGSLineSearch(&xp[0], step, e_n2);
+      if (!accepted) {
+        // restore the last point
+        memcpy(x, &xp[0], sizeof(double) * N);
+        memcpy(g, &gp[0], sizeof(double) * N);
+        e_n2 = _e_n1;
+        if (_lbfgsk == 0) {
+          // no progress possible along the steepest descent direction
+          IF_OBFF_LOGLVL_LOW
+            OBFFLog("    L-BFGS HAS CONVERGED\n");
+          return false;
+        }
+        _lbfgsk = 0; // drop the history and retry with steepest descent
+        continue;
+      }
+
+      // store the correction pair
+      double *s = &_lbfgsS[_lbfgsEnd * N];
+      double *y = &_lbfgsY[_lbfgsEnd * N];
+      double ys = 0.0;
+      maxgrad = 0.0;
+      for (unsigned int c = 0; c < N; ++c) {
+        s[c] = x[c] - xp[c];
+        y[c] = g[c] - gp[c];
+        ys += s[c] * y[c];
+      }
+      for (unsigned int c = 0; c < N; c += 3) {
+        double g2 = g[c] * g[c] + g[c+1] * g[c+1] + g[c+2] * g[c+2];
+        if (g2 > maxgrad)
+          maxgrad = g2;
+      }
+      if (ys > 1.0e-10) { // skip the update if the curvature condition fails
+        _lbfgsYS[_lbfgsEnd] = ys;
+        _lbfgsEnd = (_lbfgsEnd + 1) % LBFGS_HISTORY;
+        if (_lbfgsk < LBFGS_HISTORY)
+          _lbfgsk++;
+      }
+
+      if ((_cstep % _pairfreq == 0) && _cutoff)
+        UpdatePairsSimple(); // Update the non-bonded pairs (Cut-off)
+
+      if (IsNear(e_n2, _e_n1, _econv)
+          && (maxgrad < _gconv)) { // gradient criteria (0.1) squared
+        IF_OBFF_LOGLVL_LOW {
+          snprintf(_logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", _cstep, e_n2, _e_n1);
+          OBFFLog(_logbuf);
+          OBFFLog("    L-BFGS HAS CONVERGED\n");
+        }
+        return false;
+      }
+
+      IF_OBFF_LOGLVL_LOW {
+        if (_cstep % 10 == 0) {
+          snprintf(_logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", _cstep, e_n2, _e_n1);
+          OBFFLog(_logbuf);
+        }
+      }
+
+      if (_nsteps == _cstep)
+        return false;
+
+      _e_n1 = e_n2;
+    }
+
+    return true; // no convergence reached
+  }
+
+  void OBForceField::LBFGS(int steps, double econv)
+  {
+    LBFGSInitialize(steps, econv);
+    if (steps > 0)
+      LBFGSTakeNSteps(steps);
+  }
+
+  void OBForceField::EnergyBatch(const double *coords, unsigned int nconf,
+                                 double *energies, double *forces)
+  {
+    const unsigned int N = _mol.NumAtoms() * 3;
+    double *x = _mol.GetCoordinates();
+    if (x == NULL)
+      return;
+
+    std::vector<double> orig(x, x + N);
+    for (unsigned int k = 0; k < nconf; ++k) {
+      memcpy(x, coords + k * N, sizeof(double) * N);
+      if (forces)
+        energies[k] = EnergyAndForces(forces + k * N);
+      else
+        energies[k] = Energy(false) + _constraints.GetConstraintEnergy();
+    }
+    memcpy(x, &orig[0], sizeof(double) * N);
+  }
+
+  void OBForceField::EnergyBatchThreaded(const double *coords, unsigned int nconf,
+                                         double *energies, double *forces)
+  {
+#ifdef _OPENMP
+    const int nthreads = std::min<int>(_nthreads, nconf);
+    if (nthreads > 1 && HasThreadSafeEnergyBatch()) {
+      const unsigned int N = _mol.NumAtoms() * 3;
+      // one contiguous block of coordinate sets for each thread
+      #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+      for (int t = 0; t < nthreads; ++t) {
+        const unsigned int begin = nconf * t / nthreads;
+        const unsigned int end = nconf * (t + 1) / nthreads;
+        EnergyBatch(coords + begin * N, end - begin, energies + begin,
+                    forces ? forces + begin * N : NULL);
+      }
+      return;
+    }
+#endif
+    EnergyBatch(coords, nconf, energies, forces);
+  }
+
+  // Batched L-BFGS
+  //
+  // Same algorithm as LBFGSTakeNSteps() with separate correction pairs for
+  // each coordinate set. The line search is a backtracking line search with
+  // the Armijo condition (as used by LineSearchBacktracking) where all
+  // coordinate sets that still need a trial step are evaluated together.
+  static const double LBFGS_ARMIJO = 1.0e-4;
+  static const int LBFGS_MAX_TRIALS = 10;
+
+  void OBForceField::MinimizeBatch(double *coords, unsigned int nconf, int steps,
+                                   double econv, double *energies)
+  {
+    const unsigned int N = _mol.NumAtoms() * 3;
+    const double gconv = 1.0e-2; // gradient convergence (0.1) squared
+    if (!nconf || !N)
+      return;
+
+    // coordinates that are allowed to move
+    std::vector<double> movable(N, 1.0);
+    FOR_ATOMS_OF_MOL (a, _mol) {
+      unsigned int idx = a->GetIdx();
+      unsigned int coordIdx = (idx - 1) * 3;
+      if (_constraints.IsFixed(idx) || (_fixAtom == idx) || (_ignoreAtom == idx)) {
+        movable[coordIdx] = movable[coordIdx+1] = movable[coordIdx+2] = 0.0;
+        continue;
+      }
+      if (_constraints.IsXFixed(idx))
+        movable[coordIdx] = 0.0;
+      if (_constraints.IsYFixed(idx))
+        movable[coordIdx+1] = 0.0;
+      if (_constraints.IsZFixed(idx))
+        movable[coordIdx+2] = 0.0;
+    }
+
+    std::vector<double> grad(nconf * N), dir(nconf * N);
+    std::vector<double> S(nconf * LBFGS_HISTORY * N), Y(nconf * LBFGS_HISTORY * N);
+    std::vector<double> YS(nconf * LBFGS_HISTORY), alpha(LBFGS_HISTORY);
+    std::vector<int> histk(nconf, 0), histEnd(nconf, 0);
+    std::vector<double> step(nconf), dg(nconf);
+    // trial coordinates, energies and forces for the conformers in the line search
+    std::vector<double> trialCoords(nconf * N), trialForces(nconf * N), trialE(nconf);
+
+    // the minimizer works with gradients, the force field gives forces
+    EnergyBatchThreaded(coords, nconf, energies, &grad[0]);
+    for (unsigned int c = 0; c < nconf * N; ++c)
+      grad[c] = -grad[c] * movable[c % N];
+
+    std::vector<unsigned int> active, pending, rejected;
+    for (unsigned int k = 0; k < nconf; ++k)
+      active.push_back(k);
+
+    for (int cstep = 1; cstep <= steps && !active.empty(); ++cstep) {
+      // L-BFGS direction and initial step for each conformer
+      pending.clear();
+      for (unsigned int i = 0; i < active.size(); ++i) {
+        const unsigned int k = active[i];
+        const double *g = &grad[k * N];
+        double *d = &dir[k * N];
+        LBFGSDirection(g, d, &S[k * LBFGS_HISTORY * N], &Y[k * LBFGS_HISTORY * N],
+                       &YS[k * LBFGS_HISTORY], &alpha[0], histk[k], histEnd[k], N);
+
+        dg[k] = 0.0;
+        for (unsigned int c = 0; c < N; ++c)
+          dg[k] += d[c] * g[c];
+        if (!(dg[k] < 0.0)) {
+          histk[k] = 0;
+          dg[k] = 0.0;
+          for (unsigned int c = 0; c < N; ++c) {
+            d[c] = -g[c];
+            dg[k] -= g[c] * g[c];
+          }
+          if (dg[k] == 0.0)
+            continue; // zero gradient, this conformer is done
+        }
+
+        double dmax = 0.0;
+        for (unsigned int c = 0; c < N; ++c)
+          if (fabs(d[c]) > dmax)
+            dmax = fabs(d[c]);
+        step[k] = 1.0;
+        if (step[k] * dmax > LBFGS_MAX_MOVE)
+          step[k] = LBFGS_MAX_MOVE / dmax;
+
+        pending.push_back(k);
+      }
+      active.clear();
+
+      // backtracking line search, one batched evaluation per trial step
+      for (int trial = 0; trial < LBFGS_MAX_TRIALS && !pending.empty(); ++trial) {
+        for (unsigned int i = 0; i < pending.size(); ++i) {
+          const unsigned int k = pending[i];
+          const double *x = &coords[k * N];
+          const double *d = &dir[k * N];
+          double *xt = &trialCoords[i * N];
+          for (unsigned int c = 0; c < N; ++c)
+            xt[c] = x[c] + step[k] * d[c];
+        }
+
+        EnergyBatchThreaded(&trialCoords[0], pending.size(), &trialE[0], &trialForces[0]);
+
+        rejected.clear();
+        for (unsigned int i = 0; i < pending.size(); ++i) {
+          const unsigned int k = pending[i];
+          if (!isfinite(trialE[i]) ||
+              trialE[i] > energies[k] + LBFGS_ARMIJO * step[k] * dg[k]) {
+            step[k] *= 0.5;
+            rejected.push_back(k);
+            continue;
+          }
+
+          // accepted: store the correction pair and move to the new point
+          double *x = &coords[k * N];
+          double *g = &grad[k * N];
+          const double *xt = &trialCoords[i * N];
+          const double *ft = &trialForces[i * N];
+          double *s = &S[(k * LBFGS_HISTORY + histEnd[k]) * N];
+          double *y = &Y[(k * LBFGS_HISTORY + histEnd[k]) * N];
+          double ys = 0.0, maxgrad = 0.0;
+          for (unsigned int c = 0; c < N; ++c) {
+            const double gt = -ft[c] * movable[c];
+            s[c] = xt[c] - x[c];
+            y[c] = gt - g[c];
+            ys += s[c] * y[c];
+            x[c] = xt[c];
+            g[c] = gt;
+          }
+          for (unsigned int c = 0; c < N; c += 3) {
+            double g2 = g[c] * g[c] + g[c+1] * g[c+1] + g[c+2] * g[c+2];
+            if (g2 > maxgrad)
+              maxgrad = g2;
+          }
+          if (ys > 1.0e-10) { // skip the update if the curvature condition fails
+            YS[k * LBFGS_HISTORY + histEnd[k]] = ys;
+            histEnd[k] = (histEnd[k] + 1) % LBFGS_HISTORY;
+            if (histk[k] < LBFGS_HISTORY)
+              histk[k]++;
+          }
+
+          const bool converged = IsNear(trialE[i], energies[k], econv) && (maxgrad < gconv);
+          energies[k] = trialE[i];
+          if (!converged)
+            active.push_back(k);
+        }
+        pending.swap(rejected);
+      }
+
+      // line search failed: drop the history and retry with steepest descent
+      for (unsigned int i = 0; i < pending.size(); ++i) {
+        const unsigned int k = pending[i];
+        if (histk[k] == 0)
+          continue; // no progress possible along the steepest descent direction
+        histk[k] = 0;
+        active.push_back(k);
+      }
+
+      // keep the conformers in order, the batches are then reproducible
+      std::sort(active.begin(), active.end());
+    }
+  }
+
+  void OBForceField::MinimizeConformers(int steps, double econv)
+  {
+    if (!_validSetup || _mol.GetCoordinates() == NULL)
+      return;
+
+    const unsigned int N = _mol.NumAtoms() * 3;
+    const unsigned int K = _mol.NumConformers();
+    if (!K)
+      return;
+
+    // copy all conformers into one [K][N][3] buffer
+    std::vector<double> coords(K * N);
+    for (unsigned int k = 0; k < K; ++k)
+      memcpy(&coords[k * N], _mol.GetConformer(k), sizeof(double) * N);
+
+    IF_OBFF_LOGLVL_LOW {
+      OBFFLog("\nB A T C H E D   L - B F G S\n\n");
+      snprintf(_logbuf, BUFF_SIZE, "CONFORMERS = %d   STEPS = %d\n\n", K, steps);
+      OBFFLog(_logbuf);
+    }
+
+    _energies.resize(K);
+    MinimizeBatch(&coords[0], K, steps, econv, &_energies[0]);
+
+    for (unsigned int k = 0; k < K; ++k)
+      memcpy(_mol.GetConformer(k), &coords[k * N], sizeof(double) * N);
+  }
+
+  void OBForceField::MinimizeRotorSearchConformers(unsigned int geomSteps)
+  {
+    if (!_validSetup || _mol.GetCoordinates() == NULL || !_mol.NumConformers())
+      return;
+
+    _loglvl = OBFF_LOGLVL_NONE;
+    MinimizeConformers(geomSteps); // energy minimization for all conformers
+    _loglvl = _origLogLevel;
+
+    // Select conformer with lowest energy
+    int best_conformer = 0;
+    for (int i = 0; i < _mol.NumConformers(); i++) {
+      IF_OBFF_LOGLVL_LOW {
+        snprintf(_logbuf, BUFF_SIZE, "   %3d      %8.3f\n", (i + 1), _energies[i]);
+        OBFFLog(_logbuf);
+      }
+      if (_energies[i] < _energies[best_conformer])
+        best_conformer = i;
+    }
+
+    IF_OBFF_LOGLVL_LOW {
+      snprintf(_logbuf, BUFF_SIZE, "\n  CONFORMER %d HAS THE LOWEST ENERGY\n\n",  best_conformer + 1);
+      OBFFLog(_logbuf);
+    }
+
+    _mol.SetConformer(best_conformer);
+    SetupPointers(); // update pointers to atom positions in the OBFFCalculation objects
+    _current_conformer = best_conformer;
+  }
+
+  // FIRE
+  //
+  // E. Bitzek, P. Koskinen, F. Gaehler, M. Moseler, P. Gumbsch,
+  // "Structural Relaxation Made Simple", Phys. Rev. Lett. 97, 170201 (2006)
+  //
+  // Damped dynamics with unit masses: the velocity is mixed towards the force
+  // direction and the time step grows as long as the power P = F.v stays
+  // positive. When the system moves uphill (P <= 0) it is stopped and the time
+  // step is reduced. One energy/gradient evaluation per step.
+  static const double FIRE_DT_START = 0.01;
+  static const double FIRE_DT_MAX = 0.1;
+  static const double FIRE_ALPHA_START = 0.1;
+  static const double FIRE_F_ALPHA = 0.99;
+  static const double FIRE_F_INC = 1.1;
+  static const double FIRE_F_DEC = 0.5;
+  static const int FIRE_N_MIN = 5;
+  static const double FIRE_MAX_MOVE = 0.2; // don't move an atom more than 0.2 A per step
+
+  void OBForceField::FIREInitialize(int steps, double econv)
+  {
+    if (!_validSetup || steps == 0)
+      return;
+
+    _cstep = 0;
+    _nsteps = steps;
+    _econv = econv;
+    _gconv = 1.0e-2; // gradient convergence (0.1) squared
+    _ncoords = _mol.NumAtoms() * 3;
+
+    if (_cutoff)
+      UpdatePairsSimple(); // Update the non-bonded pairs (Cut-off)
+
+    _fireDt = FIRE_DT_START;
+    _fireAlpha = FIRE_ALPHA_START;
+    _fireNPos = 0;
+    _fireVel.assign(_ncoords, 0.0);
+
+    _e_n1 = EnergyAndForces(_gradientPtr);
+
+    IF_OBFF_LOGLVL_LOW {
+      OBFFLog("\nF I R E\n\n");
+      snprintf(_logbuf, BUFF_SIZE, "STEPS = %d\n\n",  steps);
+      OBFFLog(_logbuf);
+      OBFFLog("STEP n     E(n)       E(n-1)    \n");
+      OBFFLog("--------------------------------\n");
+    }
+  }
+
+  bool OBForceField::FIRETakeNSteps(int n)
+  {
+    if (!_validSetup)
+      return false;
+
+    if (_ncoords != _mol.NumAtoms() * 3 || _fireVel.size() != _ncoords)
+      return false;
+
+    const unsigned int N = _ncoords;
+    double *x = _mol.GetCoordinates();
+    double *f = _gradientPtr; // forces at the current coordinates
+    double *v = &_fireVel[0];
+    double e_n2, maxgrad;
+
+    for (int i = 1; i <= n; i++) {
+      _cstep++;
+
+      double P = 0.0, vv = 0.0, ff = 0.0;
+      for (unsigned int c = 0; c < N; ++c) {
+        P += f[c] * v[c];
+        vv += v[c] * v[c];
+        ff += f[c] * f[c];
+      }
+
+      if (P > 0.0) {
+        // v = (1 - alpha) v + alpha |v| F/|F|
+        const double scale = (ff > 0.0) ? _fireAlpha * sqrt(vv / ff) : 0.0;
+        for (unsigned int c = 0; c < N; ++c)
+          v[c] = (1.0 - _fireAlpha) * v[c] + scale * f[c];
+        if (++_fireNPos > FIRE_N_MIN) {
+          _fireDt = std::min(_fireDt * FIRE_F_INC, FIRE_DT_MAX);
+          _fireAlpha *= FIRE_F_ALPHA;
+        }
+      } else {
+        // going uphill: freeze the system and slow down
+        memset(v, '\0', sizeof(double) * N);
+        _fireNPos = 0;
+        _fireDt *= FIRE_F_DEC;
+        _fireAlpha = FIRE_ALPHA_START;
+      }
+
+      // semi-implicit Euler step
+      double maxmove2 = 0.0;
+      for (unsigned int c = 0; c < N; ++c)
+        v[c] += _fireDt * f[c];
+      for (unsigned int c = 0; c < N; c += 3) {
+        double m2 = (v[c] * v[c] + v[c+1] * v[c+1] + v[c+2] * v[c+2]) * _fireDt * _fireDt;
+        if (m2 > maxmove2)
+          maxmove2 = m2;
+      }
+      double scale = _fireDt;
+      if (maxmove2 > FIRE_MAX_MOVE * FIRE_MAX_MOVE)
+        scale *= FIRE_MAX_MOVE / sqrt(maxmove2);
+      for (unsigned int c = 0; c < N; ++c)
+        x[c] += scale * v[c];
+
+      e_n2 = EnergyAndForces(f, &maxgrad);
+
+      if ((_cstep % _pairfreq == 0) && _cutoff)
+        UpdatePairsSimple(); // Update the non-bonded pairs (Cut-off)
+
+      if (IsNear(e_n2, _e_n1, _econv)
+          && (maxgrad < _gconv)) { // gradient criteria (0.1) squared
+        IF_OBFF_LOGLVL_LOW {
+          snprintf(_logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", _cstep, e_n2, _e_n1);
+          OBFFLog(_logbuf);
+          OBFFLog("    FIRE HAS CONVERGED\n");
+        }
+        return false;
+      }
+
+      IF_OBFF_LOGLVL_LOW {
+        if (_cstep % 10 == 0) {
+          snprintf(_logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", _cstep, e_n2, _e_n1);
+          OBFFLog(_logbuf);
+        }
+      }
+
+      if (_nsteps == _cstep)
+        return false;
+
+      _e_n1 = e_n2;
+    }
+
+    return true; // no convergence reached
+  }
+
+  void OBForceField::FIRE(int steps, double econv)
+  {
+    FIREInitialize(steps, econv);
+    if (steps > 0)
+      FIRETakeNSteps(steps);
+  }
+
   //
   //         f(1) - f(0)
   // f'(0) = -----------      f(1) = f(0+h)
@@ -3514,68 +4281,375 @@ namespace OpenBabel
     //cout << "E_{kin_corr} = sum( m_i * v_i^2 ) = " << E_kin2 << endl;
   }
 
-  void OBForceField::MolecularDynamicsTakeNSteps(int n, double T, double timestep, int method)
+  void OBForceField::MolecularDynamicsTakeNSteps(int n, double T, double timestep, int /* method */)
   {
     if (!_validSetup)
       return;
 
-    int coordIdx;
-    double timestep2;
-    vector3 force, pos, accel;
-    _timestep = timestep;
+    // The velocity Verlet integrator evaluates the forces once per step. The
+    // Berendsen thermostat replaces the velocity rescaling every 10 steps.
+    if (_mdVel.size() != _mol.NumAtoms() * 3 || T != _temp || timestep != _timestep)
+      VelocityVerletInitialize(T, timestep, 10.0 * timestep);
+    VelocityVerletTakeNSteps(n);
+  }
+
+  // Velocity Verlet molecular dynamics
+  //
+  // Units are A, ps and amu. The forces (energy unit A^-1) are converted to
+  // accelerations (A ps^-2) with _mdUnit: 1 kJ mol^-1 = 100 amu A^2 ps^-2.
+  //
+  // Bonds to hydrogen are constrained with SHAKE (positions) and RATTLE
+  // (velocities), see Andersen, J. Comput. Phys. 52 (1983) 24-34. Fixed atoms
+  // have an inverse mass of zero, fixed coordinates have zero force and
+  // velocity.
+  //
+  // With cut-offs enabled, the non-bonded pairs are collected for the cut-off
+  // distances plus MD_PAIR_SKIN (Verlet neighbor list). The list only has to be
+  // rebuilt when an atom has moved more than half the skin.
+  static const double MD_PAIR_SKIN = 1.0;    // neighbor list buffer (A)
+  static const double MD_SHAKE_TOL = 1.0e-8; // relative tolerance for the squared bond lengths
+  static const int MD_SHAKE_MAXITER = 500;
+  static const double MD_GAS_CONSTANT = GAS_CONSTANT * KCAL_TO_KJ * 100.0; // amu A^2 ps^-2 K^-1
+
+  bool OBFFTrajectoryWriter::WriteFrame(const OBMol &mol, const double *coords)
+  {
+    if (!_conv)
+      return false;
+
+    if (_numFrames == 0 || _frame.NumAtoms() != mol.NumAtoms()) {
+      _frame = mol;
+      // keep a single conformer, formats like XTC write all conformers
+      std::vector<double*> conf(1, new double [mol.NumAtoms() * 3]);
+      _frame.SetConformers(conf);
+    }
+    memcpy(_frame.GetCoordinates(), coords, sizeof(double) * mol.NumAtoms() * 3);
+
+    // every frame is an output object
+    _conv->SetOutputIndex(_numFrames + 1);
+    if (!_conv->Write(&_frame))
+      return false;
+    ++_numFrames;
+    return true;
+  }
+
+  void OBForceField::UpdateMDPairs()
+  {
+    const double rvdw = _rvdw, rele = _rele;
+    _rvdw += MD_PAIR_SKIN;
+    _rele += MD_PAIR_SKIN;
+    UpdatePairsSimple();
+    _rvdw = rvdw;
+    _rele = rele;
+
+    const double *x = _mol.GetCoordinates();
+    _mdPairCoords.assign(x, x + _mol.NumAtoms() * 3);
+  }
+
+  bool OBForceField::ShakePositions(const double *oldCoords)
+  {
+    double *x = _mol.GetCoordinates();
+    const unsigned int nbonds = _mdBondLength2.size();
+
+    for (int iter = 0; iter < MD_SHAKE_MAXITER; ++iter) {
+      bool converged = true;
+      for (unsigned int b = 0; b < nbonds; ++b) {
+        const unsigned int i = _mdBonds[2 * b], j = _mdBonds[2 * b + 1];
+        const double wi = _mdInvMass[i / 3], wj = _mdInvMass[j / 3];
+        const double d2 = _mdBondLength2[b];
+        double r[3], r0[3];
+        for (int k = 0; k < 3; ++k) {
+          r[k] = x[i + k] - x[j + k];
+          r0[k] = oldCoords[i + k] - oldCoords[j + k];
+        }
+
+        const double diff = d2 - (r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+        if (fabs(diff) < MD_SHAKE_TOL * d2)
+          continue;
+        converged = false;
+
+        const double rr0 = r[0] * r0[0] + r[1] * r0[1] + r[2] * r0[2];
+        if (rr0 < 1.0e-6 * d2)
+          return false; // the bond has rotated too far in one step
+
+        // move both atoms along the old bond vector
+        const double g = diff / (2.0 * rr0 * (wi + wj));
+        for (int k = 0; k < 3; ++k) {
+          x[i + k] += g * wi * r0[k];
+          x[j + k] -= g * wj * r0[k];
+          _mdVel[i + k] += g * wi * r0[k] / _timestep;
+          _mdVel[j + k] -= g * wj * r0[k] / _timestep;
+        }
+      }
+      if (converged)
+        return true;
+    }
+
+    return false;
+  }
+
+  bool OBForceField::RattleVelocities()
+  {
+    const double *x = _mol.GetCoordinates();
+    const unsigned int nbonds = _mdBondLength2.size();
+
+    for (int iter = 0; iter < MD_SHAKE_MAXITER; ++iter) {
+      bool converged = true;
+      for (unsigned int b = 0; b < nbonds; ++b) {
+        const unsigned int i = _mdBonds[2 * b], j = _mdBonds[2 * b + 1];
+        const double wi = _mdInvMass[i / 3], wj = _mdInvMass[j / 3];
+        const double d2 = _mdBondLength2[b];
+        double r[3], rv = 0.0;
+        for (int k = 0; k < 3; ++k) {
+          r[k] = x[i + k] - x[j + k];
+          rv += r[k] * (_mdVel[i + k] - _mdVel[j + k]);
+        }
+
+        // same accuracy as the positions after one time step
+        if (fabs(rv) < MD_SHAKE_TOL * d2 / _timestep)
+          continue;
+        converged = false;
+
+        const double g = rv / (d2 * (wi + wj));
+        for (int k = 0; k < 3; ++k) {
+          _mdVel[i + k] -= g * wi * r[k];
+          _mdVel[j + k] += g * wj * r[k];
+        }
+      }
+      if (converged)
+        return true;
+    }
+
+    return false;
+  }
+
+  void OBForceField::VelocityVerletInitialize(double T, double timestep, double tau, bool constrainH)
+  {
+    _mdVel.clear();
+    if (!_validSetup)
+      return;
+
     _temp = T;
+    _timestep = timestep;
+    _mdTau = tau;
+    _mdStep = 0;
+    _mdUnit = (GetUnit() == "kcal/mol") ? 100.0 * KCAL_TO_KJ : 100.0;
+
+    const unsigned int N = _mol.NumAtoms() * 3;
+    _mdVel.assign(N, 0.0);
+    _mdAccel.assign(N, 0.0);
+    _mdInvMass.assign(_mol.NumAtoms(), 0.0);
+
+    // fixed atoms get an infinite mass, partially fixed atoms are not constrained
+    OBBitVec partial;
+    bool hasFixed = false;
+    unsigned int nfree = 0;
+    FOR_ATOMS_OF_MOL (a, _mol) {
+      unsigned int idx = a->GetIdx();
+      if (_constraints.IsFixed(idx) || (_fixAtom == idx) || (_ignoreAtom == idx)) {
+        hasFixed = true;
+        continue;
+      }
+      _mdInvMass[idx - 1] = 1.0 / a->GetAtomicMass();
+      if (_constraints.IsXFixed(idx) || _constraints.IsYFixed(idx) || _constraints.IsZFixed(idx)) {
+        partial.SetBitOn(idx);
+        hasFixed = true;
+      }
+      nfree += !_constraints.IsXFixed(idx) + !_constraints.IsYFixed(idx) + !_constraints.IsZFixed(idx);
+    }
 
+    _mdBonds.clear();
+    _mdBondLength2.clear();
+    if (constrainH) {
+      FOR_BONDS_OF_MOL (b, _mol) {
+        OBAtom *a1 = b->GetBeginAtom();
+        OBAtom *a2 = b->GetEndAtom();
+        if (a1->GetAtomicNum() != OBElements::Hydrogen && a2->GetAtomicNum() != OBElements::Hydrogen)
+          continue;
+        if (partial.BitIsSet(a1->GetIdx()) || partial.BitIsSet(a2->GetIdx()))
+          continue;
+        if (_mdInvMass[a1->GetIdx() - 1] == 0.0 && _mdInvMass[a2->GetIdx() - 1] == 0.0)
+          continue;
+        _mdBonds.push_back((a1->GetIdx() - 1) * 3);
+        _mdBonds.push_back((a2->GetIdx() - 1) * 3);
+        _mdBondLength2.push_back(a1->GetVector().distSq(a2->GetVector()));
+      }
+    }
 
-    timestep2 = 0.5 * _timestep * _timestep;
+    // the center of mass motion is removed when no atoms are fixed
+    _mdNdf = double(nfree) - _mdBondLength2.size() - (hasFixed ? 0 : 3);
+    if (_mdNdf < 1.0)
+      _mdNdf = 1.0;
 
-    if (!_velocityPtr)
-      GenerateVelocities();
-    Energy(true); // compute gradients
+    // Maxwell-Boltzmann velocities (Box-Muller transform)
+    OBRandom generator;
+    if (_randomSeed)
+      generator.Seed(_randomSeed);
+    else
+      generator.TimeSeed();
+    FOR_ATOMS_OF_MOL (a, _mol) {
+      unsigned int idx = a->GetIdx();
+      unsigned int coordIdx = (idx - 1) * 3;
+      if (_mdInvMass[idx - 1] == 0.0)
+        continue;
 
-    for (int i = 1; i <= n; i++) {
-      FOR_ATOMS_OF_MOL (a, _mol) {
-        if (!_constraints.IsFixed(a->GetIdx()) || (_fixAtom == a->GetIdx()) || (_ignoreAtom == a->GetIdx())) {
-          if (HasAnalyticalGradients())
-            force = GetGradient(&*a) + _constraints.GetGradient(a->GetIdx());
-          else
-            force = NumericalDerivative(&*a) + _constraints.GetGradient(a->GetIdx());
+      const double sigma = sqrt(MD_GAS_CONSTANT * T * _mdInvMass[idx - 1]);
+      for (int k = 0; k < 3; ++k) {
+        double u1;
+        do {
+          u1 = generator.NextFloat();
+        } while (u1 <= 0.0);
+        double u2 = generator.NextFloat();
+        _mdVel[coordIdx + k] = sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+      }
+      if (_constraints.IsXFixed(idx))
+        _mdVel[coordIdx] = 0.0;
+      if (_constraints.IsYFixed(idx))
+        _mdVel[coordIdx + 1] = 0.0;
+      if (_constraints.IsZFixed(idx))
+        _mdVel[coordIdx + 2] = 0.0;
+    }
 
-          pos = a->GetVector();
-          coordIdx = (a->GetIdx() - 1) * 3;
+    if (!hasFixed) {
+      double p[3] = { 0.0, 0.0, 0.0 }, mass = 0.0;
+      for (unsigned int c = 0; c < N; c += 3) {
+        double m = 1.0 / _mdInvMass[c / 3];
+        for (int k = 0; k < 3; ++k)
+          p[k] += m * _mdVel[c + k];
+        mass += m;
+      }
+      for (unsigned int c = 0; c < N; c += 3)
+        for (int k = 0; k < 3; ++k)
+          _mdVel[c + k] -= p[k] / mass;
+    }
 
-          // a(i) = F(i) / m
-          accel = force / (1000 * a->GetAtomicMass());
+    if (!_mdBonds.empty())
+      RattleVelocities();
 
-          // x(i+1) = x(i) + v(i) /\t + 0.5 a(i) /\t^2
-          pos.SetX(pos.x() + _velocityPtr[coordIdx]   * _timestep + accel.x() * timestep2);
-          pos.SetY(pos.y() + _velocityPtr[coordIdx+1] * _timestep + accel.y() * timestep2);
-          pos.SetZ(pos.z() + _velocityPtr[coordIdx+2] * _timestep + accel.z() * timestep2);
-          a->SetVector(pos);
+    // scale to the exact temperature
+    double T0 = GetTemperature();
+    if (T0 > 0.0) {
+      double factor = sqrt(T / T0);
+      for (unsigned int c = 0; c < N; ++c)
+        _mdVel[c] *= factor;
+    }
 
-          // v(i+.5) = v(i) + 0.5 a(i) /\t
-          _velocityPtr[coordIdx]   += 0.5 * accel.x() * _timestep;
-          _velocityPtr[coordIdx+1] += 0.5 * accel.y() * _timestep;
-          _velocityPtr[coordIdx+2] += 0.5 * accel.z() * _timestep;
+    if (_cutoff)
+      UpdateMDPairs();
 
-          Energy(true); // compute gradients
+    double energy = EnergyAndForces(&_mdAccel[0]);
+    for (unsigned int c = 0; c < N; ++c)
+      _mdAccel[c] *= _mdUnit * _mdInvMass[c / 3];
 
-          if (HasAnalyticalGradients())
-            force = GetGradient(&*a) + _constraints.GetGradient(a->GetIdx());
-          else
-            force = NumericalDerivative(&*a) + _constraints.GetGradient(a->GetIdx());
+    IF_OBFF_LOGLVL_LOW {
+      OBFFLog("\nV E L O C I T Y   V E R L E T\n\n");
+      snprintf(_logbuf, BUFF_SIZE, "T = %.2f K  TIME STEP = %.4f ps  CONSTRAINED BONDS = %lu\n\n",
+               T, timestep, (unsigned long)_mdBondLength2.size());
+      OBFFLog(_logbuf);
+      OBFFLog("STEP n     E_pot      E_kin       T    \n");
+      OBFFLog("---------------------------------------\n");
+      snprintf(_logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f   %6.1f\n", _mdStep, energy,
+               GetKineticEnergy(), GetTemperature());
+      OBFFLog(_logbuf);
+    }
+  }
 
-          // a(i+1) = F(i+1) / m
-          accel = force / (1000 * a->GetAtomicMass());
+  bool OBForceField::VelocityVerletTakeNSteps(int n)
+  {
+    const unsigned int N = _mol.NumAtoms() * 3;
+    if (!_validSetup || _mdVel.size() != N)
+      return false;
 
-          _velocityPtr[coordIdx]   += 0.5 * accel.x() * _timestep;
-          _velocityPtr[coordIdx+1] += 0.5 * accel.y() * _timestep;
-          _velocityPtr[coordIdx+2] += 0.5 * accel.z() * _timestep;
+    double *x = _mol.GetCoordinates();
+    const double dt = _timestep;
+    std::vector<double> oldCoords;
+
+    for (int i = 0; i < n; ++i) {
+      // v(t + dt/2) = v(t) + a(t) dt/2
+      // x(t + dt) = x(t) + v(t + dt/2) dt
+      if (!_mdBonds.empty())
+        oldCoords.assign(x, x + N);
+      for (unsigned int c = 0; c < N; ++c) {
+        _mdVel[c] += 0.5 * dt * _mdAccel[c];
+        x[c] += dt * _mdVel[c];
+      }
+      if (!_mdBonds.empty() && !ShakePositions(&oldCoords[0])) {
+        IF_OBFF_LOGLVL_LOW
+          OBFFLog("    SHAKE FAILED TO CONVERGE\n");
+        return false;
+      }
 
+      // rebuild the neighbor list when an atom may have crossed the cut-off
+      if (_cutoff) {
+        double maxd2 = 0.0;
+        if (_mdPairCoords.size() == N) {
+          for (unsigned int c = 0; c < N; c += 3) {
+            double d2 = SQUARE(x[c] - _mdPairCoords[c]) + SQUARE(x[c+1] - _mdPairCoords[c+1])
+              + SQUARE(x[c+2] - _mdPairCoords[c+2]);
+            if (d2 > maxd2)
+              maxd2 = d2;
+          }
         }
+        if (_mdPairCoords.size() != N || maxd2 > SQUARE(0.5 * MD_PAIR_SKIN))
+          UpdateMDPairs();
       }
-      if (i % 10 == 0)
-        CorrectVelocities();
+
+      // v(t + dt) = v(t + dt/2) + a(t + dt) dt/2
+      double energy = EnergyAndForces(&_mdAccel[0]);
+      for (unsigned int c = 0; c < N; ++c) {
+        _mdAccel[c] *= _mdUnit * _mdInvMass[c / 3];
+        _mdVel[c] += 0.5 * dt * _mdAccel[c];
+      }
+      if (!_mdBonds.empty() && !RattleVelocities()) {
+        IF_OBFF_LOGLVL_LOW
+          OBFFLog("    RATTLE FAILED TO CONVERGE\n");
+        return false;
+      }
+
+      // Berendsen thermostat, the scaling is limited as in GROMACS
+      if (_mdTau > 0.0) {
+        double T = GetTemperature();
+        if (T > 0.0) {
+          double lambda = sqrt(1.0 + dt / _mdTau * (_temp / T - 1.0));
+          lambda = std::max(0.8, std::min(1.25, lambda));
+          for (unsigned int c = 0; c < N; ++c)
+            _mdVel[c] *= lambda;
+        }
+      }
+
+      ++_mdStep;
+      IF_OBFF_LOGLVL_LOW {
+        if (_mdStep % 100 == 0) {
+          snprintf(_logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f   %6.1f\n", _mdStep, energy,
+                   GetKineticEnergy(), GetTemperature());
+          OBFFLog(_logbuf);
+        }
+      }
+
+      if (_trajWriter && _mdStep % _trajFreq == 0 && !_trajWriter->WriteFrame(_mol, x))
+        return false;
     }
+
+    return true;
+  }
+
+  double OBForceField::GetKineticEnergy()
+  {
+    if (_mdVel.empty())
+      return 0.0;
+
+    double ekin = 0.0;
+    for (unsigned int c = 0; c < _mdVel.size(); ++c)
+      if (_mdInvMass[c / 3] > 0.0)
+        ekin += _mdVel[c] * _mdVel[c] / _mdInvMass[c / 3];
+    return 0.5 * ekin / _mdUnit;
+  }
+
+  double OBForceField::GetTemperature()
+  {
+    if (_mdVel.empty())
+      return 0.0;
+
+    return 2.0 * GetKineticEnergy() * _mdUnit / (_mdNdf * MD_GAS_CONSTANT);
   }
 
   //////////////////////////////////////////////////////////////////////////////////
@@ -89,6 +89,136 @@ namespace OpenBabel
     return energy;
   }
 
+  // Point the calculation at the atom positions in the coordinate set coords
+  static inline void SetBatchPointers(OBFFCalculation2 &calc, double *coords)
+  {
+    calc.pos_a = coords + 3 * (calc.idx_a - 1);
+    calc.pos_b = coords + 3 * (calc.idx_b - 1);
+  }
+  static inline void SetBatchPointers(OBFFCalculation3 &calc, double *coords)
+  {
+    SetBatchPointers(static_cast<OBFFCalculation2&>(calc), coords);
+    calc.pos_c = coords + 3 * (calc.idx_c - 1);
+  }
+  static inline void SetBatchPointers(OBFFCalculation4 &calc, double *coords)
+  {
+    SetBatchPointers(static_cast<OBFFCalculation3&>(calc), coords);
+    calc.pos_d = coords + 3 * (calc.idx_d - 1);
+  }
+
+  static inline void AddBatchForce(double *forces, const double *force, int idx)
+  {
+    const int coordIdx = (idx - 1) * 3;
+    forces[coordIdx] += force[0];
+    forces[coordIdx + 1] += force[1];
+    forces[coordIdx + 2] += force[2];
+  }
+  static inline void AddBatchForces(const OBFFCalculation2 &calc, double *forces)
+  {
+    AddBatchForce(forces, calc.force_a, calc.idx_a);
+    AddBatchForce(forces, calc.force_b, calc.idx_b);
+  }
+  static inline void AddBatchForces(const OBFFCalculation3 &calc, double *forces)
+  {
+    AddBatchForces(static_cast<const OBFFCalculation2&>(calc), forces);
+    AddBatchForce(forces, calc.force_c, calc.idx_c);
+  }
+  static inline void AddBatchForces(const OBFFCalculation4 &calc, double *forces)
+  {
+    AddBatchForces(static_cast<const OBFFCalculation3&>(calc), forces);
+    AddBatchForce(forces, calc.force_d, calc.idx_d);
+  }
+
+  // Compute each calculation for all coordinate sets before moving on to the
+  // next one. The parameters of a calculation are only loaded once and the
+  // coordinate sets are small enough to stay in the cache. The calculation is
+  // copied since it also holds the positions and forces: the shared
+  // calculations are only read and several threads can run this at once.
+  template<bool gradients, class T>
+  static void ComputeBatch(const std::vector<T> &calculations, double factor, double *coords,
+                           unsigned int nconf, unsigned int ncoords,
+                           double *energies, double *forces)
+  {
+    for (unsigned int i = 0; i < calculations.size(); ++i) {
+      T calc = calculations[i];
+      for (unsigned int k = 0; k < nconf; ++k) {
+        SetBatchPointers(calc, coords + k * ncoords);
+        calc.template Compute<gradients>();
+        energies[k] += factor * calc.energy;
+        if (gradients)
+          AddBatchForces(calc, forces + k * ncoords);
+      }
+    }
+  }
+
+  template<bool gradients>
+  void OBForceFieldMMFF94::ComputeBatchAll(double *coords, unsigned int nconf,
+                                           double *energies, double *forces)
+  {
+    const unsigned int N = _mol.NumAtoms() * 3;
+
+    // use the same factors as E_Bond(), E_Angle(), ...
+    ComputeBatch<gradients>(_bondcalculations, 143.9325 * 0.5, coords, nconf, N, energies, forces);
+    ComputeBatch<gradients>(_anglecalculations, 1.0, coords, nconf, N, energies, forces);
+    ComputeBatch<gradients>(_strbndcalculations, 2.51210, coords, nconf, N, energies, forces);
+    ComputeBatch<gradients>(_torsioncalculations, 0.5, coords, nconf, N, energies, forces);
+    ComputeBatch<gradients>(_oopcalculations, 0.043844 * 0.5, coords, nconf, N, energies, forces);
+    ComputeBatch<gradients>(_vdwcalculations, 1.0, coords, nconf, N, energies, forces);
+    ComputeBatch<gradients>(_electrostaticcalculations, 1.0, coords, nconf, N, energies, forces);
+  }
+
+  bool OBForceFieldMMFF94::HasThreadSafeEnergyBatch()
+  {
+    // the VDW and electrostatic pairs within the cut-offs are those of the
+    // coordinates of _mol (see UpdatePairsSimple()), so Energy() is used
+    if (_cutoff)
+      return false;
+    // distance, angle and torsion constraints work on the atoms of _mol
+    for (int i = 0; i < _constraints.Size(); ++i) {
+      int type = _constraints.GetConstraintType(i);
+      if (type == OBFF_CONST_DISTANCE || type == OBFF_CONST_ANGLE || type == OBFF_CONST_TORSION)
+        return false;
+    }
+    return true;
+  }
+
+  void OBForceFieldMMFF94::EnergyBatch(const double *coords, unsigned int nconf,
+                                       double *energies, double *forces)
+  {
+    if (!HasThreadSafeEnergyBatch()) {
+      OBForceField::EnergyBatch(coords, nconf, energies, forces);
+      return;
+    }
+
+    const unsigned int N = _mol.NumAtoms() * 3;
+    // the calculations only read the coordinates
+    double *x = const_cast<double*>(coords);
+
+    memset(energies, '\0', sizeof(double) * nconf);
+    if (!forces) {
+      ComputeBatchAll<false>(x, nconf, energies, NULL);
+      return;
+    }
+
+    memset(forces, '\0', sizeof(double) * nconf * N);
+    ComputeBatchAll<true>(x, nconf, energies, forces);
+
+    // no forces on fixed atoms
+    FOR_ATOMS_OF_MOL (a, _mol) {
+      unsigned int idx = a->GetIdx();
+      bool fixed = _constraints.IsFixed(idx) || (_fixAtom == idx) || (_ignoreAtom == idx);
+      for (unsigned int k = 0; k < nconf; ++k) {
+        double *f = forces + k * N + (idx - 1) * 3;
+        if (fixed || _constraints.IsXFixed(idx))
+          f[0] = 0.0;
+        if (fixed || _constraints.IsYFixed(idx))
+          f[1] = 0.0;
+        if (fixed || _constraints.IsZFixed(idx))
+          f[2] = 0.0;
+      }
+    }
+  }
+
   //
   // MMFF part I - page 494
   //
@@ -227,6 +227,10 @@ namespace OpenBabel
 
       bool mmff94s;
 
+      //! Compute all calculations for the coordinate sets (see EnergyBatch())
+      template<bool> void ComputeBatchAll(double *coords, unsigned int nconf,
+                                          double *energies, double *forces);
+
     public:
       //! Constructor
       explicit OBForceFieldMMFF94(const char* ID, bool IsDefault=true) : OBForceField(ID, IsDefault)
@@ -239,8 +243,6 @@ namespace OpenBabel
         _pairfreq = 15;
         _cutoff = false;
         _linesearch = LineSearchType::Newton2Num;
-        _gradientPtr = NULL;
-        _grad1 = NULL;
 	if (!strncmp(ID, "MMFF94s", 7)) {
           mmff94s = true;
           _parFile = std::string("mmff94s.ff");
@@ -282,6 +284,11 @@ namespace OpenBabel
 
       //! Returns total energy
       double Energy(bool gradients = true);
+      //! Energy and forces for several coordinate sets in one pass over the calculations
+      void EnergyBatch(const double *coords, unsigned int nconf,
+                       double *energies, double *forces);
+      //! \return true unless there are distance, angle or torsion constraints
+      bool HasThreadSafeEnergyBatch();
       //! Returns the bond stretching energy
       template<bool> double E_Bond();
       double E_Bond(bool gradients = true)
@@ -125,6 +125,7 @@ set(formats_misc
       mpqcformat
       msiformat
       msmsformat
+      obmformat
       opendxformat
       outformat
       pcmodelformat
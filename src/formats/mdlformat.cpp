@@ -33,6 +33,7 @@ GNU General Public License for more details.
 #include <openbabel/obiter.h>
 #include <openbabel/elements.h>
 #include <openbabel/obmolecformat.h>
+#include <openbabel/mappedinput.h>
 #include <openbabel/stereo/stereo.h>
 #include <openbabel/stereo/cistrans.h>
 #include <openbabel/stereo/tetrahedral.h>
@@ -84,7 +85,11 @@ namespace OpenBabel
                "       When filtering an sdf file on title or properties\n"
                "       only, avoid lengthy chemical interpretation by\n"
                "       using the ``T`` or ``P`` option together with the\n"
-               "       :ref:`copy format <Copy_raw_text>`.\n\n"
+               "       :ref:`copy format <Copy_raw_text>`.\n"
+               " L  parse the data items only when they are used\n"
+               "       The items are kept as text and each one is converted\n"
+               "       when it is looked up, e.g. by ``--filter`` or ``--sort``.\n"
+               "       Items that are not used are written to SD output as text.\n\n"
 
                "Write Options, e.g. -x3\n"
                " 3  output V3000 not V2000 (used for >999 atoms/bonds) \n"
@@ -144,7 +149,7 @@ namespace OpenBabel
       bool ReadRGroupBlock(istream& ifs,OBMol& mol, OBConversion* pConv);
       bool ReadUnimplementedBlock(istream& ifs,OBMol& mol, OBConversion* pConv, string& blockname);
       bool WriteV3000(ostream& ofs,OBMol& mol, OBConversion* pConv);
-      bool ReadPropertyLines(istream& ifs, OBMol& mol);
+      bool ReadPropertyLines(istream& ifs, OBMol& mol, bool lazy = false);
       bool TestForAlias(const string& symbol, OBAtom* at, vector<pair<AliasData*,OBAtom*> >& aliases);
 
     private:
@@ -178,6 +183,12 @@ namespace OpenBabel
         OBConversion::RegisterOptionParam("2", this);
         OBConversion::RegisterOptionParam("3", this);
       }
+
+      //The reader keeps state in member variables; a copy is not registered
+      virtual OBFormat* MakeNewInstance()
+      {
+        return new MOLFormat(*this);
+      }
   };
 
   //Make an instance of the format class
@@ -199,6 +210,11 @@ namespace OpenBabel
         pConv->AddOption("sd", OBConversion::OUTOPTIONS);
         return MDLFormat::WriteMolecule(pOb, pConv);
       }
+
+      virtual OBFormat* MakeNewInstance()
+      {
+        return new SDFormat(*this);
+      }
   };
 
   //Make an instance of the format class
@@ -265,12 +281,14 @@ namespace OpenBabel
       return false;
 
     std::string line;
+    // copies the lines straight from the input file if it is memory-mapped
+    OBLineReader reader(ifs);
     //
     // The Header Block
     //
 
     // line1: molecule name
-    if (!std::getline(ifs, line)) {
+    if (!reader.GetLine(line)) {
       errorMsg << "WARNING: Problems reading a MDL file\n";
       errorMsg << "Cannot read title line\n";
       obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
@@ -296,7 +314,7 @@ namespace OpenBabel
       //Read Title and Property lines only
       ignore(ifs, "M  END");
       ifs.ignore(100,'\n');
-      ReadPropertyLines(ifs, mol);//also reads $$$$
+      ReadPropertyLines(ifs, mol, pConv->IsOption("L",OBConversion::INOPTIONS) != NULL);//also reads $$$$
       return true;
     }
 
@@ -310,7 +328,7 @@ namespace OpenBabel
     //         24..33    s = scaling facter (double format 10.5)
     //         34..45    E = energy
     //         46..51    R = internal registry number
-    if (!std::getline(ifs, line)) {
+    if (!reader.GetLine(line)) {
       errorMsg << "WARNING: Problems reading a MDL file\n";
       errorMsg << "Cannot read creator/dimension line line\n";
       obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
@@ -334,7 +352,7 @@ namespace OpenBabel
     }
 
     // line 3: comment line
-    if (!std::getline(ifs, line)) {
+    if (!reader.GetLine(line)) {
       errorMsg << "WARNING: Problems reading a MDL file\n";
       errorMsg << "Cannot read comment line\n";
       obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
@@ -349,7 +367,7 @@ namespace OpenBabel
     //
 
     // line 1: counts line
-    if (!std::getline(ifs, line)) {
+    if (!reader.GetLine(line)) {
       errorMsg << "WARNING: Problems reading a MDL file\n";
       errorMsg << "Cannot read atom and bond count\n";
       errorMsg << "File ended prematurely\n";
@@ -415,7 +433,7 @@ namespace OpenBabel
       vector<int> massDiffs, charges;
       Parity parity;
       for (i = 0; i < natoms; ++i) {
-        if (!std::getline(ifs, line)) {
+        if (!reader.GetLine(line)) {
           errorMsg << "WARNING: Problems reading a MDL file\n";
           errorMsg << "Not enough atoms to match atom count (" << natoms << ") in counts line\n";
           obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
@@ -523,7 +541,7 @@ namespace OpenBabel
       unsigned int begin, end, order, flag;
       for (i = 0;i < nbonds; ++i) {
         flag = 0;
-        if (!std::getline(ifs, line)) {
+        if (!reader.GetLine(line)) {
           errorMsg << "WARNING: Problems reading a MDL file\n";
           errorMsg << "Not enough bonds to match bond count (" << nbonds << ") in counts line\n";
           obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
@@ -620,7 +638,7 @@ namespace OpenBabel
       // Properties Block
       //
       bool foundISO = false, foundCHG = false;
-      while (std::getline(ifs, line)) {
+      while (reader.GetLine(line)) {
         if (line.substr(0, 4) == "$$$$")
           return true;
         if (line.substr(0, 6) == "M  END")
@@ -629,14 +647,14 @@ namespace OpenBabel
           int i = ReadUIntField((line.substr(6, line.size() - 6)).c_str());
           for(; i > 0; --i)
             if (ifs.good()) // check for EOL, suggested by Dalke
-              std::getline(ifs, line);
+              reader.GetLine(line);
         }
 
         if (line.substr(0, 3) == "A  " && line.size() > 3) { //alias
           int atomnum = ReadUIntField((line.substr(2, line.size() - 2)).c_str());
           //MDL documentation just has alias text here( x... ). A single line is assumed,
           //and the alias is ignored if the line starts with ? or * or is blank .
-          std::getline(ifs, line);
+          reader.GetLine(line);
           if(!line.empty() && line.at(0) != '?' && line.at(0) != '*') {
             AliasData* ad = new AliasData();
             ad->SetAlias(line);
@@ -846,7 +864,7 @@ namespace OpenBabel
     }
 
     //Get property lines
-    if(!ReadPropertyLines(ifs, mol)) {
+    if(!ReadPropertyLines(ifs, mol, pConv->IsOption("L",OBConversion::INOPTIONS) != NULL)) {
       //Has read the first line of the next reaction in RXN format
       pConv->AddOption("$RXNread");
       return true;
@@ -1388,6 +1406,23 @@ namespace OpenBabel
             ofs << ((OBPairData*)(*k))->GetValue() << endl << endl;
           }
         }
+        else if ((*k)->GetDataType() == OBGenericDataType::PropertyBlockData)
+        {
+          //Items read with -aL and not used since
+          OBPropertyBlockData* block = static_cast<OBPropertyBlockData*>(*k);
+          for (unsigned int i = 0; i < block->NumItems(); ++i)
+          {
+            if (block->IsExtracted(i))
+              continue;
+            HasProperties = true;
+            string attr = block->GetItemAttribute(i);
+            if(attr!="PartialCharges")
+            {
+              ofs << ">  <" << attr << ">" << endl;
+              ofs << block->GetItemValue(i) << endl << endl;
+            }
+          }
+        }
       }
     }
 
@@ -1888,10 +1923,40 @@ namespace OpenBabel
     return n;
   }
 
-  bool MDLFormat::ReadPropertyLines(istream& ifs, OBMol& mol)
+  bool MDLFormat::ReadPropertyLines(istream& ifs, OBMol& mol, bool lazy)
   {
+    OBLineReader reader(ifs);
     string line;
-    while (std::getline(ifs, line)) {
+    if (lazy) {
+      //Keep the lines as they are; items are parsed when used
+      OBPropertyBlockData *block = new OBPropertyBlockData;
+      string& text = block->GetBlock();
+      OBLineRef ref;
+      bool rxn = false;
+      while (reader.GetLine(ref)) {
+        if (ref.StartsWith("$RXN")) {
+          rxn = true;
+          break;
+        }
+        if (ref.StartsWith("$$$$") || ref.StartsWith("$MOL"))
+          break;
+        text.append(ref.Data(), ref.Size());
+        text += '\n';
+      }
+      if (text.find('<') == string::npos) { //no items
+        delete block;
+        return !rxn;
+      }
+      mol.SetData(block);
+      if (*mol.GetTitle() == '\0')
+        for (unsigned int i = 0; i < block->NumItems(); ++i)
+          if (!strcasecmp(block->GetItemAttribute(i).c_str(), "NAME")) {
+            mol.SetTitle(block->GetItemValue(i).c_str());
+            break;
+          }
+      return !rxn;
+    }
+    while (reader.GetLine(line)) {
       if (line.substr(0, 4) == "$RXN")
         return false; //Has read the first line of the next reaction in RXN format
 
@@ -1902,7 +1967,7 @@ namespace OpenBabel
 
         // sometimes we can hit more data than BUFF_SIZE, so we'll use a std::string
         string buff;
-        while (std::getline(ifs, line)) {
+        while (reader.GetLine(line)) {
           Trim(line);
           if (line.size()) {
             buff.append(line);
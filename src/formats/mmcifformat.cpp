@@ -21,6 +21,7 @@ GNU General Public License for more details.
 #include <openbabel/atom.h>
 #include <openbabel/elements.h>
 #include <openbabel/generic.h>
+#include <openbabel/data.h>
 
 #include <openbabel/op.h>
 
@@ -48,6 +49,8 @@ namespace OpenBabel
      OBConversion::RegisterOptionParam("p", this);
      OBConversion::RegisterOptionParam("b", this);
      OBConversion::RegisterOptionParam("w", this);
+     OBConversion::RegisterOptionParam("r", this, 0, OBConversion::INOPTIONS);
+     OBConversion::RegisterOptionParam("x", this, 0, OBConversion::INOPTIONS);
    }
 
    virtual const char* Description() //required
@@ -58,7 +61,11 @@ namespace OpenBabel
        "  s  Output single bonds only\n"
        "  p  Apply periodic boundary conditions for bonds\n"
        "  b  Disable bonding entirely\n"
-       "  w  Wrap atomic coordinates into unit cell box\n\n";
+       "  w  Wrap atomic coordinates into unit cell box\n"
+       "  r  Bond standard residues from templates, not by distance\n"
+       "     (much faster for large structures; ignores p)\n"
+       "  x  Read the atoms and coordinates only\n"
+       "     (no residues, bonds or per-atom data)\n\n";
    };
 
    virtual const char* SpecificationURL()
@@ -508,6 +515,7 @@ namespace OpenBabel
    pmol->SetChainsPerceived(); // avoid perception if we are setting residues
 
    bool wrap_coords = pConv->IsOption("w",OBConversion::INOPTIONS);
+   bool coords_only = pConv->IsOption("x",OBConversion::INOPTIONS) != NULL;
 
    // move to the next data block (i.e. molecule, we hope )
    while (lexer.next_token(token) && token.type != CIFLexer::KeyDataToken);
@@ -610,6 +618,8 @@ namespace OpenBabel
                break;
                }
              }
+           if (coords_only)
+             use_residue = 0;
            if (use_cartn)
              {
              for (CIFColumnList::iterator colx = columns.begin(), coly = columns.end(); colx != coly; ++ colx)
@@ -636,11 +646,14 @@ namespace OpenBabel
              switch (columns[column_idx])
                {
              case CIFTagID::_atom_site_label: // The atomic label within the molecule
-               label = new OBPairData;
-               label->SetAttribute("_atom_site_label");
-               label->SetValue(token.as_text);
-               label->SetOrigin(fileformatInput);
-               atom->SetData(label);
+               if (!coords_only)
+                 {
+                 label = new OBPairData;
+                 label->SetAttribute("_atom_site_label");
+                 label->SetValue(token.as_text);
+                 label->SetOrigin(fileformatInput);
+                 atom->SetData(label);
+                 }
                atom_mol_label.assign(token.as_text);
 
                if (atom_type_tag != CIFTagID::_atom_site_label)
@@ -783,6 +796,7 @@ namespace OpenBabel
                residue_num = token.as_unsigned();
                break;
              case CIFTagID::_atom_site_occupancy: // The occupancy of the site.
+               if (!coords_only)
                {
                  OBPairFloatingPoint * occup = new OBPairFloatingPoint;
                  occup->SetAttribute("_atom_site_occupancy");
@@ -1006,11 +1020,16 @@ namespace OpenBabel
          }
        }
 
-       if (!pConv->IsOption("b",OBConversion::INOPTIONS))
+       if (!coords_only && !pConv->IsOption("b",OBConversion::INOPTIONS))
          {
-         pmol->ConnectTheDots();
-         if (!pConv->IsOption("s",OBConversion::INOPTIONS))
-           pmol->PerceiveBondOrders();
+         if (pConv->IsOption("r",OBConversion::INOPTIONS))
+           resdat.AssignTemplateBonds(*pmol, !pConv->IsOption("s",OBConversion::INOPTIONS));
+         else
+           {
+           pmol->ConnectTheDots();
+           if (!pConv->IsOption("s",OBConversion::INOPTIONS))
+             pmol->PerceiveBondOrders();
+           }
          }
        }
 
@@ -15,6 +15,7 @@ GNU General Public License for more details.
 #include <openbabel/babelconfig.h>
 
 #include <openbabel/obmolecformat.h>
+#include <openbabel/mappedinput.h>
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
 #include <openbabel/bond.h>
@@ -140,12 +141,12 @@ namespace OpenBabel
   }
 
   //read from ifs until next rti is found and return it
-  static string read_until_rti(istream & ifs) 
+  static string read_until_rti(OBLineReader & reader)
   {
       char buffer[BUFF_SIZE];
       for (;;)
       {
-        if (!ifs.getline(buffer,BUFF_SIZE))
+        if (!reader.GetLine(buffer,BUFF_SIZE))
           return "";
         if (!strncmp(buffer,"@<TRIPOS>",9))
           return string(buffer);
@@ -162,6 +163,8 @@ namespace OpenBabel
     //Define some references so we can use the old parameter names
     istream &ifs = *pConv->GetInStream();
     OBMol &mol = *pmol;
+    // copies the lines straight from the input file if it is memory-mapped
+    OBLineReader reader(ifs);
 
     //Old code follows...
     bool foundAtomLine = false;
@@ -178,7 +181,7 @@ namespace OpenBabel
 
     for (;;)
       {
-        if (!ifs.getline(buffer,BUFF_SIZE))
+        if (!reader.GetLine(buffer,BUFF_SIZE))
           return(false);
         if (pConv->IsOption("c", OBConversion::INOPTIONS)!=NULL && EQn(buffer,"###########",10))
           {
@@ -200,7 +203,7 @@ namespace OpenBabel
     bool hasPartialCharges = true;
     for (lcount=0;;lcount++)
       {
-        if (!ifs.getline(buffer,BUFF_SIZE))
+        if (!reader.GetLine(buffer,BUFF_SIZE))
           return(false);
         if (EQn(buffer,"@<TRIPOS>ATOM",13))
           {
@@ -274,7 +277,7 @@ namespace OpenBabel
     ttab.SetFromType("SYB");
     for (i = 0;i < natoms;i++)
       {
-        if (!ifs.getline(buffer,BUFF_SIZE))
+        if (!reader.GetLine(buffer,BUFF_SIZE))
           return(false);
         sscanf(buffer," %*s %1024s %lf %lf %lf %1024s %d %1024s %lf",
                atmid, &x,&y,&z, temp_type, &resnum, resname, &pcharge);
@@ -402,18 +405,18 @@ namespace OpenBabel
       }
 
     string nextrti;
-    do { nextrti = read_until_rti(ifs); } 
+    do { nextrti = read_until_rti(reader); } 
     while(nextrti != "@<TRIPOS>UNITY_ATOM_ATTR" && nextrti != "@<TRIPOS>BOND" && nextrti.length() > 0);
 
     if(nextrti == "@<TRIPOS>UNITY_ATOM_ATTR")
     { //read in formal charge information, must be done before Kekulization
         int aid = 0, num = 0;
-        while (ifs.peek() != '@' && ifs.getline(buffer,BUFF_SIZE))
+        while (ifs.peek() != '@' && reader.GetLine(buffer,BUFF_SIZE))
         {
           sscanf(buffer,"%d %d",&aid, &num);
           for(int i = 0; i < num; i++) 
           {
-            if (!ifs.getline(buffer,BUFF_SIZE))
+            if (!reader.GetLine(buffer,BUFF_SIZE))
               return(false);
             if(strncmp(buffer, "charge", 6) == 0)
             {
@@ -430,7 +433,7 @@ namespace OpenBabel
     }
 
     while(nextrti != "@<TRIPOS>BOND" && nextrti.length() > 0)
-      nextrti = read_until_rti(ifs);
+      nextrti = read_until_rti(reader);
 
     if(nextrti != "@<TRIPOS>BOND")
       return false;
@@ -439,7 +442,7 @@ namespace OpenBabel
     bool needs_kekulization = false;
     for (i = 0; i < nbonds; i++)
       {
-        if (!ifs.getline(buffer,BUFF_SIZE))
+        if (!reader.GetLine(buffer,BUFF_SIZE))
           return(false);
 
         sscanf(buffer,"%*d %d %d %1024s",&start,&end,temp_type);
@@ -620,7 +623,7 @@ namespace OpenBabel
     //Check if UCSF Dock style coments are on
     if(pConv->IsOption("c", OBConversion::OUTOPTIONS)!=NULL) {
         vector<OBGenericData*>::iterator k;
-        vector<OBGenericData*> vdata = mol.GetData();
+        vector<OBGenericData*> vdata = mol.GetAllData(OBGenericDataType::PairData);
         ofs << endl;
         for (k = vdata.begin();k != vdata.end();++k) {
             if ((*k)->GetDataType() == OBGenericDataType::PairData
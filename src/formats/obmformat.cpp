@@ -0,0 +1,874 @@
+/**********************************************************************
+obmformat.cpp - Open Babel binary molecule format
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <openbabel/babelconfig.h>
+#include <openbabel/obmolecformat.h>
+#include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/residue.h>
+#include <openbabel/obiter.h>
+#include <openbabel/generic.h>
+#include <openbabel/math/spacegroup.h>
+#include <openbabel/stereo/tetrahedral.h>
+#include <openbabel/stereo/cistrans.h>
+#include <openbabel/stereo/squareplanar.h>
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace OpenBabel
+{
+  /*
+    Each molecule is a record: a header, then a body read with a single
+    read() and parsed in memory. Values are in the byte order of the
+    machine which wrote the file, as in the record index files.
+
+    header:
+       char[4]  "OBMR"
+       uint32   version (OBM_VERSION)
+       uint32   0x01020304, to check the byte order
+       uint64   length of the body, at most OBM_MAXLENGTH
+    body:
+       string   title (uint32 length + characters)
+       int32    OBMol flags, for the perceived data stored below
+       uint8    OBM_PARTIALCHARGES | OBM_NOAUTOPARTIAL | OBM_NOAUTOFORMAL
+       uint16   dimension
+       int32    total charge, uint32 total spin multiplicity
+       uint32   number of atoms, of bonds, of conformers (0 if all the
+                coordinates are zero), index of the current conformer
+       double   coordinates[conformers][atoms][3]
+       uint32   number of energies, double energies[]
+       atoms    uint32 id, uint8 atomic number, uint8 implicit H count,
+                int16 formal charge, uint16 isotope, int16 spin
+                multiplicity, uint16 hybridization, uint8 flags
+                (OBM_AROMATIC, OBM_RING), [string type], [double charge]
+       bonds    uint32 begin index, uint32 end index, uint8 order,
+                uint16 flags
+       atoms    the bond indexes of each atom in the order of its bond list,
+                to keep the order of the neighbours (from version 2)
+       uint32   number of residues, each: string name, string number,
+                char chain, char insertion code, uint32 number of atoms,
+                and for each atom uint32 index, string ID, uint32 serial
+                number, uint8 hetero atom
+       uint32   number of stereo units, each: uint8 OBStereo::Type, then
+                the ids of the config (center or begin and end, from, refs)
+                and uint8 specified
+       data     of the molecule: uint32 count, then for each item uint8
+                type (OBM_PAIR etc.), uint8 origin, string attribute and
+                the value (OBM_COMMENT from version 3)
+       uint32   number of atoms with data, each: uint32 index, data
+  */
+  static const char     OBM_MAGIC[4]   = { 'O','B','M','R' };
+  static const uint32_t OBM_VERSION    = 3;
+  static const uint32_t OBM_BYTEORDER  = 0x01020304;
+  static const size_t   OBM_HEADERSIZE = 4 + 4 + 4 + 8;
+  // A longer body is taken as a corrupted header, rather than allocated
+  static const uint64_t OBM_MAXLENGTH  = static_cast<uint64_t>(1) << 30;
+
+  enum { OBM_PARTIALCHARGES = 1, OBM_NOAUTOPARTIAL = 2, OBM_NOAUTOFORMAL = 4 };
+  enum { OBM_AROMATIC = 1, OBM_RING = 2 };
+  enum { OBM_PAIR = 1, OBM_PAIRINTEGER, OBM_PAIRDOUBLE, OBM_UNITCELL, OBM_COMMENT };
+
+  // The perception flags kept: those of the data stored, and of the
+  // structure. Ring, atom and chirality perception are not redone.
+  static const int OBM_FLAGS = OB_RINGFLAGS_MOL | OB_AROMATIC_MOL | OB_ATOMTYPES_MOL
+    | OB_CHIRALITY_MOL | OB_PCHARGE_MOL | OB_HYBRID_MOL | OB_CLOSURE_MOL | OB_H_ADDED_MOL
+    | OB_PH_CORRECTED_MOL | OB_CHAINS_MOL | OB_TCHARGE_MOL | OB_TSPIN_MOL
+    | OB_PATTERN_STRUCTURE | OB_ATOMSPIN_MOL | OB_REACTION_MOL | OB_PERIODIC_MOL;
+
+  // Appends values to a record
+  class OBMWriter
+  {
+  public:
+    explicit OBMWriter(string &record) : _record(record) {}
+    template<typename T>
+    void Put(T value)
+    {
+      _record.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void PutString(const string &s)
+    {
+      Put(static_cast<uint32_t>(s.size()));
+      _record.append(s);
+    }
+    void PutDoubles(const double *values, size_t n)
+    {
+      _record.append(reinterpret_cast<const char*>(values), n * sizeof(double));
+    }
+    //! Reserve a count, set later with SetCount()
+    size_t PutCount()
+    {
+      Put(static_cast<uint32_t>(0));
+      return _record.size() - sizeof(uint32_t);
+    }
+    void SetCount(size_t pos, uint32_t count)
+    {
+      memcpy(&_record[pos], &count, sizeof(count));
+    }
+  private:
+    string &_record;
+  };
+
+  // Reads values from a record in memory. After reading past its end,
+  // Good() is false and zeros are returned.
+  class OBMReader
+  {
+  public:
+    OBMReader(const char *begin, const char *end) : _p(begin), _end(end), _good(true) {}
+    template<typename T>
+    T Get()
+    {
+      T value = T();
+      if (static_cast<size_t>(_end - _p) < sizeof(T))
+        _good = false;
+      else {
+        memcpy(&value, _p, sizeof(T));
+        _p += sizeof(T);
+      }
+      return value;
+    }
+    string GetString()
+    {
+      uint32_t size = Get<uint32_t>();
+      if (static_cast<size_t>(_end - _p) < size) {
+        _good = false;
+        return string();
+      }
+      string s(_p, size);
+      _p += size;
+      return s;
+    }
+    //! \return the position of \p n doubles in the record, to be copied
+    const char* GetDoubles(size_t n)
+    {
+      if (static_cast<size_t>(_end - _p) / sizeof(double) < n) {
+        _good = false;
+        return NULL;
+      }
+      const char *p = _p;
+      _p += n * sizeof(double);
+      return p;
+    }
+    bool Good() const { return _good; }
+  private:
+    const char *_p, *_end;
+    bool _good;
+  };
+
+  class OBMFormat : public OBMoleculeFormat
+  {
+  public:
+    OBMFormat()
+    {
+      OBConversion::RegisterFormat("obm", this);
+      OBConversion::RegisterOptionParam("s", this, 0, OBConversion::OUTOPTIONS);
+    }
+
+    virtual const char* Description() //required
+    {
+      return
+        "Open Babel binary molecule format\n"
+        "A compact binary form of OBMol, to keep molecules between steps\n"
+        "The atoms, bonds, conformers, charges, stereochemistry, residues and\n"
+        "the pair and unit cell data are stored with the perception flags, so\n"
+        "reading a molecule does not perceive them again. It is much faster\n"
+        "to read and write than SDF. The files are in the byte order of the\n"
+        "machine which wrote them and are not meant for exchange.\n\n"
+        "Write Options e.g. -xs\n"
+        "  s  fail rather than drop data which cannot be stored\n\n";
+    }
+
+    virtual unsigned int Flags()
+    {
+      return READBINARY | WRITEBINARY | WRITETHREADSAFE | NOTEXTNUMBERS;
+    }
+
+    virtual int SkipObjects(int n, OBConversion* pConv);
+    virtual bool ReadMolecule(OBBase* pOb, OBConversion* pConv);
+    virtual bool WriteMolecule(OBBase* pOb, OBConversion* pConv);
+
+  private:
+    static bool ReadHeader(istream &ifs, uint64_t &length, uint32_t &version);
+    static void WriteData(OBMWriter &w, OBBase *pOb);
+    static bool AllDataStored(OBBase *pOb, bool mol);
+    static bool OnlyPerceivedData(OBBase *pOb);
+    static bool ReadData(OBMReader &r, OBBase *pOb);
+  };
+
+  OBMFormat theOBMFormat;
+
+  /////////////////////////////////////////////////////////////////
+  bool OBMFormat::ReadHeader(istream &ifs, uint64_t &length, uint32_t &version)
+  {
+    char header[OBM_HEADERSIZE];
+    if (!ifs.read(header, OBM_HEADERSIZE))
+      return false;
+    uint32_t byteorder;
+    memcpy(&version, header + 4, 4);
+    memcpy(&byteorder, header + 8, 4);
+    memcpy(&length, header + 12, 8);
+    if (memcmp(header, OBM_MAGIC, 4) != 0) {
+      obErrorLog.ThrowError(__FUNCTION__, "Not an Open Babel binary molecule record", obError);
+      return false;
+    }
+    if (byteorder != OBM_BYTEORDER) {
+      obErrorLog.ThrowError(__FUNCTION__,
+        "The binary molecule file was written on a machine with a different byte order", obError);
+      return false;
+    }
+    if (version > OBM_VERSION) {
+      obErrorLog.ThrowError(__FUNCTION__,
+        "The binary molecule file was written by a later version of Open Babel", obError);
+      return false;
+    }
+    // the body has to fit in the rest of the stream, when its size is known
+    bool fits = length <= OBM_MAXLENGTH;
+    streambuf *buf = ifs.rdbuf();
+    const streampos pos = buf->pubseekoff(0, ios_base::cur, ios_base::in);
+    if (fits && pos != streampos(-1)) {
+      const streampos end = buf->pubseekoff(0, ios_base::end, ios_base::in);
+      buf->pubseekpos(pos, ios_base::in);
+      if (end != streampos(-1) && length > static_cast<uint64_t>(end - pos))
+        fits = false;
+    }
+    if (!fits) {
+      obErrorLog.ThrowError(__FUNCTION__, "The binary molecule record is truncated or corrupted", obError);
+      return false;
+    }
+    return true;
+  }
+
+  int OBMFormat::SkipObjects(int n, OBConversion* pConv)
+  {
+    istream &ifs = *pConv->GetInStream();
+    if (n == 0)
+      ++n;
+    uint64_t length;
+    uint32_t version;
+    while (n--) {
+      if (!ReadHeader(ifs, length, version))
+        return -1;
+      ifs.seekg(static_cast<streamoff>(length), ios_base::cur);
+    }
+    return ifs.good() ? 1 : -1;
+  }
+
+  /////////////////////////////////////////////////////////////////
+  void OBMFormat::WriteData(OBMWriter &w, OBBase *pOb)
+  {
+    size_t countPos = w.PutCount();
+    uint32_t count = 0;
+    for (OBDataIterator d = pOb->BeginData(); d != pOb->EndData(); ++d) {
+      switch ((*d)->GetDataType()) {
+      case OBGenericDataType::PairData: {
+        // OBPairData, OBPairInteger and OBPairFloatingPoint share the type
+        OBGenericData *pd = *d;
+        if (dynamic_cast<OBPairData*>(pd)) {
+          w.Put(static_cast<uint8_t>(OBM_PAIR));
+          w.Put(static_cast<uint8_t>(pd->GetOrigin()));
+          w.PutString(pd->GetAttribute());
+          w.PutString(pd->GetValue());
+        }
+        else if (OBPairInteger *pi = dynamic_cast<OBPairInteger*>(pd)) {
+          w.Put(static_cast<uint8_t>(OBM_PAIRINTEGER));
+          w.Put(static_cast<uint8_t>(pd->GetOrigin()));
+          w.PutString(pd->GetAttribute());
+          w.Put(static_cast<int32_t>(pi->GetGenericValue()));
+        }
+        else if (OBPairFloatingPoint *pf = dynamic_cast<OBPairFloatingPoint*>(pd)) {
+          w.Put(static_cast<uint8_t>(OBM_PAIRDOUBLE));
+          w.Put(static_cast<uint8_t>(pd->GetOrigin()));
+          w.PutString(pd->GetAttribute());
+          w.Put(pf->GetGenericValue());
+        }
+        else // not stored
+          continue;
+        break;
+      }
+      case OBGenericDataType::PropertyBlockData: {
+        // the SD items read with -aL which have not been used
+        OBPropertyBlockData *block = static_cast<OBPropertyBlockData*>(*d);
+        for (unsigned int i = 0; i < block->NumItems(); ++i) {
+          if (block->IsExtracted(i))
+            continue;
+          w.Put(static_cast<uint8_t>(OBM_PAIR));
+          w.Put(static_cast<uint8_t>(block->GetOrigin()));
+          w.PutString(block->GetItemAttribute(i));
+          w.PutString(block->GetItemValue(i));
+          ++count;
+        }
+        continue;
+      }
+      case OBGenericDataType::CommentData:
+        w.Put(static_cast<uint8_t>(OBM_COMMENT));
+        w.Put(static_cast<uint8_t>((*d)->GetOrigin()));
+        w.PutString((*d)->GetAttribute());
+        w.PutString((*d)->GetValue());
+        break;
+      case OBGenericDataType::UnitCell: {
+        OBUnitCell *cell = static_cast<OBUnitCell*>(*d);
+        w.Put(static_cast<uint8_t>(OBM_UNITCELL));
+        w.Put(static_cast<uint8_t>(cell->GetOrigin()));
+        w.PutString(cell->GetAttribute());
+        double values[12];
+        cell->GetCellMatrix().GetArray(values);
+        cell->GetOffset().Get(values + 9);
+        w.PutDoubles(values, 12);
+        string group = cell->GetSpaceGroupName();
+        if (group.empty() && cell->GetSpaceGroup())
+          group = cell->GetSpaceGroup()->GetHMName();
+        w.PutString(group);
+        break;
+      }
+      default: // not stored
+        continue;
+      }
+      ++count;
+    }
+    w.SetCount(countPos, count);
+  }
+
+  bool OBMFormat::ReadData(OBMReader &r, OBBase *pOb)
+  {
+    uint32_t count = r.Get<uint32_t>();
+    for (uint32_t i = 0; i < count && r.Good(); ++i) {
+      uint8_t type = r.Get<uint8_t>();
+      DataOrigin origin = static_cast<DataOrigin>(r.Get<uint8_t>());
+      string attr = r.GetString();
+      OBGenericData *data = NULL;
+      switch (type) {
+      case OBM_PAIR: {
+        OBPairData *pd = new OBPairData;
+        pd->SetValue(r.GetString());
+        data = pd;
+        break;
+      }
+      case OBM_PAIRINTEGER: {
+        OBPairInteger *pd = new OBPairInteger;
+        pd->SetValue(r.Get<int32_t>());
+        data = pd;
+        break;
+      }
+      case OBM_PAIRDOUBLE: {
+        OBPairFloatingPoint *pd = new OBPairFloatingPoint;
+        pd->SetValue(r.Get<double>());
+        data = pd;
+        break;
+      }
+      case OBM_COMMENT: {
+        OBCommentData *cd = new OBCommentData;
+        cd->SetData(r.GetString());
+        data = cd;
+        break;
+      }
+      case OBM_UNITCELL: {
+        double values[12];
+        const char *p = r.GetDoubles(12);
+        if (!p)
+          return false;
+        memcpy(values, p, sizeof(values));
+        OBUnitCell *cell = new OBUnitCell;
+        cell->SetData(matrix3x3(vector3(values[0], values[1], values[2]),
+                                vector3(values[3], values[4], values[5]),
+                                vector3(values[6], values[7], values[8])));
+        cell->SetOffset(vector3(values[9], values[10], values[11]));
+        string group = r.GetString();
+        if (!group.empty())
+          cell->SetSpaceGroup(group);
+        data = cell;
+        break;
+      }
+      default:
+        return false;
+      }
+      data->SetAttribute(attr);
+      data->SetOrigin(origin);
+      pOb->SetData(data);
+    }
+    return r.Good();
+  }
+
+  //! \return whether WriteData() stores all the data of \p pOb, except what
+  //! is perceived again when needed. The stereo data and the conformer
+  //! energies of a molecule are stored apart.
+  bool OBMFormat::AllDataStored(OBBase *pOb, bool mol)
+  {
+    for (OBDataIterator d = pOb->BeginData(); d != pOb->EndData(); ++d) {
+      if ((*d)->GetOrigin() == perceived)
+        continue;
+      switch ((*d)->GetDataType()) {
+      case OBGenericDataType::PairData:
+        if (dynamic_cast<OBPairData*>(*d) || dynamic_cast<OBPairInteger*>(*d)
+            || dynamic_cast<OBPairFloatingPoint*>(*d))
+          continue;
+        return false;
+      case OBGenericDataType::PropertyBlockData:
+      case OBGenericDataType::CommentData:
+      case OBGenericDataType::UnitCell:
+        continue;
+      case OBGenericDataType::StereoData:
+        if (mol)
+          continue;
+        return false;
+      case OBGenericDataType::ConformerData: {
+        OBConformerData *cd = static_cast<OBConformerData*>(*d);
+        if (mol && cd->GetForces().empty() && cd->GetVelocities().empty()
+            && cd->GetDisplacements().empty() && cd->GetData().empty())
+          continue;
+        return false;
+      }
+      default:
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //! \return whether \p pOb has no data but what is perceived again when
+  //! needed (the data of bonds and residues is not stored)
+  bool OBMFormat::OnlyPerceivedData(OBBase *pOb)
+  {
+    for (OBDataIterator d = pOb->BeginData(); d != pOb->EndData(); ++d)
+      if ((*d)->GetOrigin() != perceived)
+        return false;
+    return true;
+  }
+
+  /////////////////////////////////////////////////////////////////
+  bool OBMFormat::WriteMolecule(OBBase* pOb, OBConversion* pConv)
+  {
+    OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+    if (pmol == NULL)
+      return false;
+    OBMol &mol = *pmol;
+    ostream &ofs = *pConv->GetOutStream();
+
+    if (pConv->IsOption("s")) {
+      bool stored = AllDataStored(&mol, true);
+      FOR_ATOMS_OF_MOL(atom, mol)
+        stored = stored && AllDataStored(&*atom, false);
+      FOR_BONDS_OF_MOL(bond, mol)
+        stored = stored && OnlyPerceivedData(&*bond);
+      FOR_RESIDUES_OF_MOL(res, mol)
+        stored = stored && OnlyPerceivedData(&*res);
+      if (!stored) {
+        obErrorLog.ThrowError(__FUNCTION__,
+          "The molecule has data which the binary molecule format cannot store", obError);
+        return false;
+      }
+    }
+
+    // Only what has been perceived is stored: the accessors would perceive
+    // the rest (e.g. GetHyb(), IsAromatic())
+    const int flags = mol.GetFlags() & OBM_FLAGS;
+    const bool aromatic = (flags & OB_AROMATIC_MOL) != 0;
+    const bool rings = (flags & OB_RINGFLAGS_MOL) != 0;
+    const bool types = (flags & OB_ATOMTYPES_MOL) != 0;
+    const bool hyb = (flags & OB_HYBRID_MOL) != 0;
+    const bool charges = (flags & OB_PCHARGE_MOL) || !mol.AutomaticPartialCharge();
+    const unsigned int natoms = mol.NumAtoms();
+
+    static THREAD_LOCAL string record;
+    record.clear();
+    OBMWriter w(record);
+    w.PutString(mol.GetTitle());
+    w.Put(static_cast<int32_t>(flags));
+    w.Put(static_cast<uint8_t>((charges ? OBM_PARTIALCHARGES : 0)
+                               | (mol.AutomaticPartialCharge() ? 0 : OBM_NOAUTOPARTIAL)
+                               | (mol.AutomaticFormalCharge() ? 0 : OBM_NOAUTOFORMAL)));
+    w.Put(static_cast<uint16_t>(mol.GetDimension()));
+    w.Put(static_cast<int32_t>((flags & OB_TCHARGE_MOL) ? mol.GetTotalCharge() : 0));
+    w.Put(static_cast<uint32_t>((flags & OB_TSPIN_MOL) ? mol.GetTotalSpinMultiplicity() : 0));
+
+    // conformers, unless all the coordinates are zero (e.g. from SMILES)
+    bool coordinates = false;
+    for (int i = 0; i < mol.NumConformers() && !coordinates; ++i) {
+      const double *c = mol.GetConformer(i);
+      for (unsigned int j = 0; j < natoms * 3; ++j)
+        if (c[j] != 0.0) {
+          coordinates = true;
+          break;
+        }
+    }
+    uint32_t current = 0;
+    for (int i = 0; i < mol.NumConformers(); ++i)
+      if (mol.GetConformer(i) == mol.GetCoordinates())
+        current = i;
+    w.Put(static_cast<uint32_t>(natoms));
+    w.Put(static_cast<uint32_t>(mol.NumBonds()));
+    w.Put(static_cast<uint32_t>(coordinates ? mol.NumConformers() : 0));
+    w.Put(current);
+    if (coordinates)
+      for (int i = 0; i < mol.NumConformers(); ++i)
+        w.PutDoubles(mol.GetConformer(i), natoms * 3);
+    vector<double> energies = mol.GetEnergies();
+    w.Put(static_cast<uint32_t>(energies.size()));
+    if (!energies.empty())
+      w.PutDoubles(&energies[0], energies.size());
+
+    FOR_ATOMS_OF_MOL(atom, mol) {
+      w.Put(static_cast<uint32_t>(atom->GetId()));
+      w.Put(static_cast<uint8_t>(atom->GetAtomicNum()));
+      w.Put(static_cast<uint8_t>(atom->GetImplicitHCount()));
+      w.Put(static_cast<int16_t>(atom->GetFormalCharge()));
+      w.Put(static_cast<uint16_t>(atom->GetIsotope()));
+      w.Put(static_cast<int16_t>(atom->GetSpinMultiplicity()));
+      w.Put(static_cast<uint16_t>(hyb ? atom->GetHyb() : 0));
+      w.Put(static_cast<uint8_t>((aromatic && atom->IsAromatic() ? OBM_AROMATIC : 0)
+                                 | (rings && atom->IsInRing() ? OBM_RING : 0)));
+      if (types)
+        w.PutString(atom->GetType());
+      if (charges)
+        w.Put(atom->GetPartialCharge());
+    }
+
+    unsigned int bondMask = ~0U;
+    if (!aromatic)
+      bondMask &= ~OB_AROMATIC_BOND;
+    if (!rings)
+      bondMask &= ~OB_RING_BOND;
+    if (!(flags & OB_CLOSURE_MOL))
+      bondMask &= ~OB_CLOSURE_BOND;
+    FOR_BONDS_OF_MOL(bond, mol) {
+      w.Put(static_cast<uint32_t>(bond->GetBeginAtomIdx()));
+      w.Put(static_cast<uint32_t>(bond->GetEndAtomIdx()));
+      w.Put(static_cast<uint8_t>(bond->GetBondOrder()));
+      w.Put(static_cast<uint16_t>(bond->GetFlags() & bondMask));
+    }
+    FOR_ATOMS_OF_MOL(atom, mol)
+      FOR_BONDS_OF_ATOM(bond, &*atom)
+        w.Put(static_cast<uint32_t>(bond->GetIdx()));
+
+    w.Put(static_cast<uint32_t>(mol.NumResidues()));
+    FOR_RESIDUES_OF_MOL(res, mol) {
+      w.PutString(res->GetName());
+      w.PutString(res->GetNumString());
+      w.Put(res->GetChain());
+      w.Put(res->GetInsertionCode());
+      vector<OBAtom*> atoms = res->GetAtoms();
+      w.Put(static_cast<uint32_t>(atoms.size()));
+      for (unsigned int i = 0; i < atoms.size(); ++i) {
+        w.Put(static_cast<uint32_t>(atoms[i]->GetIdx()));
+        w.PutString(res->GetAtomID(atoms[i]));
+        w.Put(static_cast<uint32_t>(res->GetSerialNum(atoms[i])));
+        w.Put(static_cast<uint8_t>(res->IsHetAtom(atoms[i])));
+      }
+    }
+
+    size_t stereoPos = w.PutCount();
+    uint32_t nstereo = 0;
+    vector<OBGenericData*> stereo = mol.GetAllData(OBGenericDataType::StereoData);
+    for (unsigned int i = 0; i < stereo.size(); ++i) {
+      OBStereoBase *base = static_cast<OBStereoBase*>(stereo[i]);
+      OBStereo::Refs refs;
+      switch (base->GetType()) {
+      case OBStereo::Tetrahedral: {
+        OBTetrahedralStereo *ts = static_cast<OBTetrahedralStereo*>(base);
+        if (!ts->IsValid())
+          continue;
+        OBTetrahedralStereo::Config cfg = ts->GetConfig();
+        w.Put(static_cast<uint8_t>(OBStereo::Tetrahedral));
+        w.Put(static_cast<uint32_t>(cfg.center));
+        w.Put(static_cast<uint32_t>(cfg.from));
+        refs = cfg.refs;
+        refs.resize(3, OBStereo::NoRef);
+        w.Put(static_cast<uint8_t>(cfg.specified));
+        break;
+      }
+      case OBStereo::CisTrans: {
+        OBCisTransStereo *ct = static_cast<OBCisTransStereo*>(base);
+        if (!ct->IsValid())
+          continue;
+        OBCisTransStereo::Config cfg = ct->GetConfig();
+        w.Put(static_cast<uint8_t>(OBStereo::CisTrans));
+        w.Put(static_cast<uint32_t>(cfg.begin));
+        w.Put(static_cast<uint32_t>(cfg.end));
+        refs = cfg.refs;
+        refs.resize(4, OBStereo::NoRef);
+        w.Put(static_cast<uint8_t>(cfg.specified));
+        break;
+      }
+      case OBStereo::SquarePlanar: {
+        OBSquarePlanarStereo *sp = static_cast<OBSquarePlanarStereo*>(base);
+        if (!sp->IsValid())
+          continue;
+        OBSquarePlanarStereo::Config cfg = sp->GetConfig();
+        w.Put(static_cast<uint8_t>(OBStereo::SquarePlanar));
+        w.Put(static_cast<uint32_t>(cfg.center));
+        refs = cfg.refs;
+        refs.resize(4, OBStereo::NoRef);
+        w.Put(static_cast<uint8_t>(cfg.specified));
+        break;
+      }
+      default:
+        continue;
+      }
+      for (unsigned int j = 0; j < refs.size(); ++j)
+        w.Put(static_cast<uint32_t>(refs[j]));
+      ++nstereo;
+    }
+    w.SetCount(stereoPos, nstereo);
+
+    WriteData(w, &mol);
+    size_t atomDataPos = w.PutCount();
+    uint32_t natomdata = 0;
+    FOR_ATOMS_OF_MOL(atom, mol) {
+      if (atom->BeginData() == atom->EndData())
+        continue;
+      w.Put(static_cast<uint32_t>(atom->GetIdx()));
+      WriteData(w, &*atom);
+      ++natomdata;
+    }
+    w.SetCount(atomDataPos, natomdata);
+
+    const uint64_t length = record.size();
+    if (length > OBM_MAXLENGTH) {
+      obErrorLog.ThrowError(__FUNCTION__, "The molecule is too large for the binary molecule format", obError);
+      return false;
+    }
+    char header[OBM_HEADERSIZE];
+    memcpy(header, OBM_MAGIC, 4);
+    memcpy(header + 4, &OBM_VERSION, 4);
+    memcpy(header + 8, &OBM_BYTEORDER, 4);
+    memcpy(header + 12, &length, 8);
+    ofs.write(header, OBM_HEADERSIZE);
+    ofs.write(record.data(), record.size());
+    return ofs.good();
+  }
+
+  /////////////////////////////////////////////////////////////////
+  bool OBMFormat::ReadMolecule(OBBase* pOb, OBConversion* pConv)
+  {
+    OBMol* pmol = pOb->CastAndClear<OBMol>();
+    if (pmol == NULL)
+      return false;
+    OBMol &mol = *pmol;
+    istream &ifs = *pConv->GetInStream();
+
+    if (ifs.peek() == EOF)
+      return false;
+    uint64_t length;
+    uint32_t version;
+    if (!ReadHeader(ifs, length, version))
+      return false;
+    static THREAD_LOCAL vector<char> record;
+    record.resize(length);
+    if (length && !ifs.read(&record[0], length)) {
+      obErrorLog.ThrowError(__FUNCTION__, "The binary molecule record is truncated", obError);
+      return false;
+    }
+    OBMReader r(record.empty() ? NULL : &record[0], record.empty() ? NULL : &record[0] + length);
+
+    string title = r.GetString();
+    mol.SetTitle(title);
+    const int flags = r.Get<int32_t>();
+    const uint8_t options = r.Get<uint8_t>();
+    mol.SetDimension(r.Get<uint16_t>());
+    const int totalCharge = r.Get<int32_t>();
+    const unsigned int totalSpin = r.Get<uint32_t>();
+    const uint32_t natoms = r.Get<uint32_t>();
+    const uint32_t nbonds = r.Get<uint32_t>();
+    const uint32_t nconformers = r.Get<uint32_t>();
+    const uint32_t current = r.Get<uint32_t>();
+    const char *conformers = r.GetDoubles(static_cast<size_t>(nconformers) * natoms * 3);
+    vector<double> energies(r.Get<uint32_t>());
+    if (!energies.empty()) {
+      const char *p = r.GetDoubles(energies.size());
+      if (p)
+        memcpy(&energies[0], p, energies.size() * sizeof(double));
+    }
+    if (!r.Good() || (nconformers && current >= nconformers))
+      return false;
+
+    // the coordinates of the current conformer are set on the atoms
+    const char *coords = nconformers ? conformers + current * natoms * 3 * sizeof(double) : NULL;
+    const bool types = (flags & OB_ATOMTYPES_MOL) != 0;
+    const bool charges = (options & OBM_PARTIALCHARGES) != 0;
+    mol.BeginModify();
+    mol.ReserveAtoms(natoms);
+    for (uint32_t i = 0; i < natoms; ++i) {
+      OBAtom *atom = mol.NewAtom(r.Get<uint32_t>());
+      if (!atom || !r.Good()) {
+        mol.EndModify();
+        return false;
+      }
+      atom->SetAtomicNum(r.Get<uint8_t>());
+      atom->SetImplicitHCount(r.Get<uint8_t>());
+      atom->SetFormalCharge(r.Get<int16_t>());
+      atom->SetIsotope(r.Get<uint16_t>());
+      atom->SetSpinMultiplicity(r.Get<int16_t>());
+      atom->SetHyb(r.Get<uint16_t>());
+      uint8_t atomFlags = r.Get<uint8_t>();
+      if (atomFlags & OBM_AROMATIC)
+        atom->SetAromatic();
+      if (atomFlags & OBM_RING)
+        atom->SetInRing();
+      if (types)
+        atom->SetType(r.GetString());
+      if (charges)
+        atom->SetPartialCharge(r.Get<double>());
+      if (coords) {
+        double v[3];
+        memcpy(v, coords + i * 3 * sizeof(double), sizeof(v));
+        atom->SetVector(v[0], v[1], v[2]);
+      }
+    }
+    for (uint32_t i = 0; i < nbonds && r.Good(); ++i) {
+      uint32_t begin = r.Get<uint32_t>();
+      uint32_t end = r.Get<uint32_t>();
+      int order = r.Get<uint8_t>();
+      int bondFlags = r.Get<uint16_t>();
+      if (r.Good() && !mol.AddBond(begin, end, order, bondFlags)) {
+        mol.EndModify();
+        return false;
+      }
+    }
+    if (version >= 2) {
+      // the bonds of each atom, in the order they had
+      bool valid = r.Good();
+      vector<OBBond*> bonds, current;
+      for (uint32_t i = 1; i <= natoms && valid; ++i) {
+        OBAtom *atom = mol.GetAtom(i);
+        bonds.clear();
+        current.clear();
+        FOR_BONDS_OF_ATOM(bond, atom) {
+          current.push_back(&*bond);
+          bonds.push_back(mol.GetBond(r.Get<uint32_t>()));
+        }
+        if (bonds == current)
+          continue;
+        // has to be a permutation of the bonds of the atom
+        vector<OBBond*> sorted(bonds);
+        sort(sorted.begin(), sorted.end());
+        sort(current.begin(), current.end());
+        valid = r.Good() && sorted == current;
+        if (!valid)
+          break;
+        atom->ClearBond();
+        for (unsigned int j = 0; j < bonds.size(); ++j)
+          atom->AddBond(bonds[j]);
+      }
+      if (!valid) {
+        mol.EndModify();
+        obErrorLog.ThrowError(__FUNCTION__, "The binary molecule record is corrupted", obError);
+        return false;
+      }
+    }
+
+    uint32_t nresidues = r.Get<uint32_t>();
+    for (uint32_t i = 0; i < nresidues && r.Good(); ++i) {
+      OBResidue *res = mol.NewResidue();
+      res->SetName(r.GetString());
+      res->SetNum(r.GetString());
+      res->SetChain(r.Get<char>());
+      res->SetInsertionCode(r.Get<char>());
+      uint32_t resatoms = r.Get<uint32_t>();
+      for (uint32_t j = 0; j < resatoms && r.Good(); ++j) {
+        OBAtom *atom = mol.GetAtom(r.Get<uint32_t>());
+        string id = r.GetString();
+        uint32_t serial = r.Get<uint32_t>();
+        bool het = r.Get<uint8_t>() != 0;
+        if (!atom)
+          continue;
+        res->AddAtom(atom);
+        res->SetAtomID(atom, id);
+        res->SetSerialNum(atom, serial);
+        res->SetHetAtom(atom, het);
+      }
+    }
+    mol.EndModify(false);
+
+    if (nconformers > 1) {
+      vector<double*> confs(nconformers);
+      for (uint32_t i = 0; i < nconformers; ++i) {
+        confs[i] = new double[natoms * 3];
+        memcpy(confs[i], conformers + i * natoms * 3 * sizeof(double), natoms * 3 * sizeof(double));
+      }
+      mol.SetConformers(confs);
+      mol.SetConformer(current);
+    }
+    if (!energies.empty())
+      mol.SetEnergies(energies);
+
+    uint32_t nstereo = r.Get<uint32_t>();
+    for (uint32_t i = 0; i < nstereo && r.Good(); ++i) {
+      uint8_t type = r.Get<uint8_t>();
+      OBStereo::Refs refs;
+      if (type == OBStereo::Tetrahedral) {
+        OBTetrahedralStereo::Config cfg;
+        cfg.center = r.Get<uint32_t>();
+        cfg.from = r.Get<uint32_t>();
+        cfg.specified = r.Get<uint8_t>() != 0;
+        for (unsigned int j = 0; j < 3; ++j)
+          cfg.refs.push_back(r.Get<uint32_t>());
+        OBTetrahedralStereo *ts = new OBTetrahedralStereo(&mol);
+        ts->SetConfig(cfg);
+        mol.SetData(ts);
+      }
+      else if (type == OBStereo::CisTrans) {
+        OBCisTransStereo::Config cfg;
+        cfg.begin = r.Get<uint32_t>();
+        cfg.end = r.Get<uint32_t>();
+        cfg.specified = r.Get<uint8_t>() != 0;
+        for (unsigned int j = 0; j < 4; ++j)
+          cfg.refs.push_back(r.Get<uint32_t>());
+        OBCisTransStereo *ct = new OBCisTransStereo(&mol);
+        ct->SetConfig(cfg);
+        mol.SetData(ct);
+      }
+      else if (type == OBStereo::SquarePlanar) {
+        OBSquarePlanarStereo::Config cfg;
+        cfg.center = r.Get<uint32_t>();
+        cfg.specified = r.Get<uint8_t>() != 0;
+        for (unsigned int j = 0; j < 4; ++j)
+          cfg.refs.push_back(r.Get<uint32_t>());
+        OBSquarePlanarStereo *sp = new OBSquarePlanarStereo(&mol);
+        sp->SetConfig(cfg);
+        mol.SetData(sp);
+      }
+      else
+        return false;
+    }
+
+    if (!ReadData(r, &mol))
+      return false;
+    uint32_t natomdata = r.Get<uint32_t>();
+    for (uint32_t i = 0; i < natomdata && r.Good(); ++i) {
+      OBAtom *atom = mol.GetAtom(r.Get<uint32_t>());
+      if (!atom || !ReadData(r, atom))
+        return false;
+    }
+    if (!r.Good()) {
+      obErrorLog.ThrowError(__FUNCTION__, "The binary molecule record is corrupted", obError);
+      return false;
+    }
+
+    if (flags & OB_TCHARGE_MOL)
+      mol.SetTotalCharge(totalCharge);
+    if (flags & OB_TSPIN_MOL)
+      mol.SetTotalSpinMultiplicity(totalSpin);
+    mol.SetAutomaticPartialCharge(!(options & OBM_NOAUTOPARTIAL));
+    mol.SetAutomaticFormalCharge(!(options & OBM_NOAUTOFORMAL));
+    mol.SetFlags(flags);
+    return true;
+  }
+
+} //namespace OpenBabel
@@ -15,6 +15,7 @@ GNU General Public License for more details.
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/obmolecformat.h>
+#include <openbabel/mappedinput.h>
 #include <openbabel/obfunctions.h>
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
@@ -46,6 +47,9 @@ namespace OpenBabel
       OBConversion::RegisterOptionParam("s", this, 0, OBConversion::INOPTIONS);
       OBConversion::RegisterOptionParam("b", this, 0, OBConversion::INOPTIONS);
       OBConversion::RegisterOptionParam("c", this, 0, OBConversion::INOPTIONS);
+      OBConversion::RegisterOptionParam("r", this, 0, OBConversion::INOPTIONS);
+      OBConversion::RegisterOptionParam("C", this, 0, OBConversion::INOPTIONS);
+      OBConversion::RegisterOptionParam("x", this, 0, OBConversion::INOPTIONS);
 
       OBConversion::RegisterOptionParam("o", this, 0, OBConversion::OUTOPTIONS);
       OBConversion::RegisterOptionParam("n", this, 0, OBConversion::OUTOPTIONS);
@@ -58,7 +62,12 @@ namespace OpenBabel
         "Read Options e.g. -as\n"
         "  s  Output single bonds only\n"
         "  b  Disable bonding entirely\n"
-        "  c  Ignore CONECT records\n\n"
+        "  c  Ignore CONECT records\n"
+        "  r  Bond standard residues from templates, not by distance\n"
+        "     (much faster for large structures)\n"
+        "  C  Read each chain (ended by TER) as a separate molecule\n"
+        "  x  Read the atoms and coordinates only\n"
+        "     (no residues, bonds or other records)\n\n"
 
         "Write Options, e.g. -xo\n"
         "  n  Do not write duplicate CONECT records to indicate bond order\n"
@@ -88,8 +97,15 @@ namespace OpenBabel
   /// Utility functions
   static void fixRhombohedralSpaceGroupWriter(string &strHM);
   static void fixRhombohedralSpaceGroupReader(string &strHM);
-  static bool parseAtomRecord(char *buffer, OBMol & mol, int chainNum);
-  static bool parseConectRecord(char *buffer, OBMol & mol);
+  // The residues and atoms of the molecule being read, to find them quickly
+  struct PDBReadIndex
+  {
+    map<string, OBResidue*> residues; // by name, number, chain and insertion code
+    map<long int, OBAtom*> serials;   // atoms by serial number
+  };
+
+  static bool parseAtomRecord(char *buffer, OBMol & mol, int chainNum, PDBReadIndex *index);
+  static bool parseConectRecord(char *buffer, OBMol & mol, PDBReadIndex &index, bool perChain);
   static bool readIntegerFromRecord(char *buffer, unsigned int columnAsSpecifiedInPDB, long int *target);
 
   //extern OBResidueData    resdat; now in mol.h
@@ -97,11 +113,14 @@ namespace OpenBabel
   /////////////////////////////////////////////////////////////////
  	int PDBFormat::SkipObjects(int n, OBConversion* pConv)
   {
+    if (pConv->IsOption("C",OBConversion::INOPTIONS))
+      return 0; // the molecules are read and discarded
     if (n == 0)
       ++ n;
     istream &ifs = *pConv->GetInStream();
+    OBLineReader reader(ifs);
     char buffer[BUFF_SIZE];
-    while (n && ifs.getline(buffer,BUFF_SIZE))
+    while (n && reader.GetLine(buffer,BUFF_SIZE))
       {
         if (EQn(buffer,"ENDMDL",6))
           -- n;
@@ -129,11 +148,16 @@ namespace OpenBabel
     istream &ifs = *pConv->GetInStream();
     OBMol &mol = *pmol;
     const char* title = pConv->GetTitle();
+    // copies the lines straight from the input file if it is memory-mapped
+    OBLineReader reader(ifs);
 
     int chainNum = 1;
     char buffer[BUFF_SIZE] = {0,};
     string line, key, value;
     OBPairData *dp;
+    const bool perChain = pConv->IsOption("C",OBConversion::INOPTIONS) != NULL;
+    const bool coordsOnly = pConv->IsOption("x",OBConversion::INOPTIONS) != NULL;
+    PDBReadIndex index;
 
     mol.SetTitle(title);
     // We need to prevent chains perception routines from running while
@@ -142,25 +166,31 @@ namespace OpenBabel
 
     mol.BeginModify();
     bool ateend = false;
-    while (ifs.good() && ifs.getline(buffer,BUFF_SIZE))
+    while (ifs.good() && reader.GetLine(buffer,BUFF_SIZE))
       {
         if (EQn(buffer,"ENDMDL",6)) {
+          if (perChain && !mol.NumAtoms())
+            continue; // the last chain of the model has been read
           ateend = true;
           break;
         }
         if (EQn(buffer,"END",3)) {
           // eat anything until the next ENDMDL
-          while (ifs.getline(buffer,BUFF_SIZE) && !EQn(buffer,"ENDMDL",6));
+          while (reader.GetLine(buffer,BUFF_SIZE) && !EQn(buffer,"ENDMDL",6));
+          if (perChain && !mol.NumAtoms())
+            continue;
           ateend = true;
           break;
         }
         if (EQn(buffer,"TER",3)) {
           chainNum++;
+          if (perChain && mol.NumAtoms())
+            break;
           continue;
         }
         if (EQn(buffer,"ATOM",4) || EQn(buffer,"HETATM",6))
           {
-            if( ! parseAtomRecord(buffer,mol,chainNum))
+            if( ! parseAtomRecord(buffer,mol,chainNum,coordsOnly ? NULL : &index))
               {
                 stringstream errorMsg;
                 errorMsg << "WARNING: Problems reading a PDB file\n"
@@ -172,8 +202,8 @@ namespace OpenBabel
 
         if (EQn(buffer,"CONECT",6)) {
           // Don't parse a CONECT record if the user tells us to ignore them
-          if (!pConv->IsOption("c",OBConversion::INOPTIONS)) {
-            parseConectRecord(buffer,mol);
+          if (!pConv->IsOption("c",OBConversion::INOPTIONS) && !coordsOnly) {
+            parseConectRecord(buffer,mol,index,perChain);
             continue;
           }
         }
@@ -208,6 +238,8 @@ namespace OpenBabel
             obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obError);
             return false;
           }
+        if (coordsOnly)
+          continue;
         key = line.substr(0,6); // the first 6 characters are the record name
         Trim(key);
         value = line.substr(6);
@@ -232,10 +264,13 @@ namespace OpenBabel
 
     if (!mol.NumAtoms()) { // skip the rest of this processing
       mol.EndModify();
-      return ateend; //explictly empty molecules are not invalid
+      // with -aC, only the records after the last chain are left
+      return ateend && !perChain; //explictly empty molecules are not invalid
     }
 
-    resdat.AssignBonds(mol);
+    const bool templates = pConv->IsOption("r",OBConversion::INOPTIONS) != NULL;
+    if (!templates && !coordsOnly)
+      resdat.AssignBonds(mol);
     /*assign hetatm bonds based on distance*/
 
     mol.EndModify();
@@ -243,18 +278,23 @@ namespace OpenBabel
     vector<OBGenericData*> vbonds = mol.GetAllData(OBGenericDataType::VirtualBondData);
     mol.DeleteData(vbonds);
 
-    if (!pConv->IsOption("b",OBConversion::INOPTIONS))
-      mol.ConnectTheDots();
-
-    if (!pConv->IsOption("s",OBConversion::INOPTIONS) && !pConv->IsOption("b",OBConversion::INOPTIONS))
-      mol.PerceiveBondOrders();
+    if (!coordsOnly && !pConv->IsOption("b",OBConversion::INOPTIONS)) {
+      if (templates)
+        resdat.AssignTemplateBonds(mol, !pConv->IsOption("s",OBConversion::INOPTIONS));
+      else {
+        mol.ConnectTheDots();
+        if (!pConv->IsOption("s",OBConversion::INOPTIONS))
+          mol.PerceiveBondOrders();
+      }
+    }
 
     // EndModify() blows away the chains perception flag so we set it again here
     mol.SetChainsPerceived();
 
     // Guess how many hydrogens are present on each atom based on typical valencies
-    FOR_ATOMS_OF_MOL(matom, mol)
-      OBAtomAssignTypicalImplicitHydrogens(&*matom);
+    if (!coordsOnly)
+      FOR_ATOMS_OF_MOL(matom, mol)
+        OBAtomAssignTypicalImplicitHydrogens(&*matom);
 
     // clean out remaining blank lines
     std::streampos ipos;
@@ -309,6 +349,16 @@ namespace OpenBabel
     return(true);
   }
 
+  // With -aC, the CONECT records at the end of the file refer to atoms of
+  // all the chains, while only one chain is in the molecule
+  static bool otherChainConect()
+  {
+    obErrorLog.ThrowError(__FUNCTION__,
+                          "CONECT records which refer to atoms of other chains are ignored with -aC",
+                          obWarning, onceOnly);
+    return false;
+  }
+
   //! Read a CONECT record
   /*! This function reads a CONECT record, as specified
     http://www.rcsb.org/pdb/docs/format/pdbguide2.2/guide2.2_frame.html,
@@ -332,7 +382,7 @@ namespace OpenBabel
     Hydrogen bonds and salt bridges are ignored. --Stefan Kebekus.
   */
 
-  bool parseConectRecord(char *buffer,OBMol &mol)
+  bool parseConectRecord(char *buffer,OBMol &mol,PDBReadIndex &index,bool perChain)
   {
     stringstream errorMsg;
     string clearError;
@@ -398,21 +448,14 @@ namespace OpenBabel
           }
       }
 
-    vector<OBAtom*>::iterator i;
-    for (OBAtom *a1 = mol.BeginAtom(i);a1;a1 = mol.NextAtom(i)) {
-      // atoms may not have residue information, but if they do,
-      // check serial numbers
-      if (a1->GetResidue() != NULL &&
-          static_cast<long int>(a1->GetResidue()->
-                                GetSerialNum(a1)) == startAtomSerialNumber)
-        {
-          firstAtom = a1;
-          break;
-        }
-    }
+    map<long int, OBAtom*>::const_iterator serial = index.serials.find(startAtomSerialNumber);
+    if (serial != index.serials.end())
+      firstAtom = serial->second;
 
     if (firstAtom == NULL)
       {
+        if (perChain)
+          return(otherChainConect());
         errorMsg << "WARNING: Problems reading a PDB file:\n"
                  << "  Problems reading a CONECT record.\n"
                  << "  According to the PDB specification,\n"
@@ -457,18 +500,13 @@ namespace OpenBabel
       {
         // Find atom that is connected to, write an error message
         OBAtom *connectedAtom = 0L;
-        for (OBAtom *a1 = mol.BeginAtom(i);a1;a1 = mol.NextAtom(i)) {
-          // again, atoms may not have residues, but if they do, check serials
-          if (a1->GetResidue() != NULL &&
-              static_cast<long int>(a1->GetResidue()->
-                                    GetSerialNum(a1)) == boundedAtomsSerialNumbers[k])
-            {
-              connectedAtom = a1;
-              break;
-            }
-        }
+        serial = index.serials.find(boundedAtomsSerialNumbers[k]);
+        if (serial != index.serials.end())
+          connectedAtom = serial->second;
         if (connectedAtom == 0L)
           {
+            if (perChain)
+              return(otherChainConect());
             errorMsg << "WARNING: Problems reading a PDB file:\n"
                      << "  Problems reading a CONECT record.\n"
                      << "  According to the PDB specification,\n"
@@ -893,7 +931,9 @@ namespace OpenBabel
 	77 - 78        LString(2)      Element symbol, right-justified.
 	79 - 80        LString(2)      Charge on the atom.
   */
-  static bool parseAtomRecord(char *buffer, OBMol &mol,int /*chainNum*/)
+  //! Read an ATOM or HETATM record; with no \p index, only the element,
+  //! coordinates and charge of the atom are read
+  static bool parseAtomRecord(char *buffer, OBMol &mol,int /*chainNum*/, PDBReadIndex *index)
   /* ATOMFORMAT "(i5,1x,a4,a1,a3,1x,a1,i4,a1,3x,3f8.3,2f6.2,a2,a2)" */
   {
     string sbuf = &buffer[6];
@@ -1080,15 +1120,17 @@ namespace OpenBabel
     vector3 v(atof(xstr.c_str()),atof(ystr.c_str()),atof(zstr.c_str()));
     atom.SetVector(v);
 
-    double occupancy = atof(sbuf.substr(48, 6).c_str());
-    OBPairFloatingPoint* occup = new OBPairFloatingPoint;
-    occup->SetAttribute("_atom_site_occupancy");
-    if (occupancy <= 0.0 || occupancy > 1.0){
-      occupancy = 1.0;
+    if (index) {
+      double occupancy = atof(sbuf.substr(48, 6).c_str());
+      OBPairFloatingPoint* occup = new OBPairFloatingPoint;
+      occup->SetAttribute("_atom_site_occupancy");
+      if (occupancy <= 0.0 || occupancy > 1.0){
+        occupancy = 1.0;
+      }
+      occup->SetValue(occupancy);
+      occup->SetOrigin(fileformatInput);
+      atom.SetData(occup);
     }
-    occup->SetValue(occupancy);
-    occup->SetOrigin(fileformatInput);
-    atom.SetData(occup);
 
     // useful for debugging unknown atom types (e.g., PR#1577238)
     //    cout << mol.NumAtoms() + 1  << " : '" << element << "'" << " " << OBElements::GetAtomicNum(element.c_str()) << endl;
@@ -1126,6 +1168,9 @@ namespace OpenBabel
       atom.SetFormalCharge(0);
     }
 
+    if (!index)
+      return mol.AddAtom(atom);
+
     /* residue sequence number */
     string resnum = sbuf.substr(16,4);
     OBResidue *res  = (mol.NumResidues() > 0) ? mol.GetResidue(mol.NumResidues()-1) : NULL;
@@ -1135,22 +1180,19 @@ namespace OpenBabel
         || res->GetChain() != chain
         || res->GetInsertionCode() != insertioncode)
       {
-        vector<OBResidue*>::iterator ri;
-        for (res = mol.BeginResidue(ri) ; res ; res = mol.NextResidue(ri))
-          if (res->GetName() == resname
-              && res->GetNumString() == resnum
-              && static_cast<int>(res->GetChain()) == chain
-              && static_cast<int>(res->GetInsertionCode()) == insertioncode) {
-            if (insertioncode) fprintf(stderr,"I: identified residue wrt insertion code: '%c'\n",insertioncode);
-            break;
-          }
-
-        if (res == NULL) {
+        string key = resname + '\n' + resnum + chain + static_cast<char>(insertioncode);
+        map<string, OBResidue*>::iterator ri = index->residues.find(key);
+        if (ri != index->residues.end()) {
+          res = ri->second;
+          if (insertioncode) fprintf(stderr,"I: identified residue wrt insertion code: '%c'\n",insertioncode);
+        }
+        else {
           res = mol.NewResidue();
           res->SetChain(chain);
           res->SetName(resname);
           res->SetNum(resnum);
           res->SetInsertionCode(insertioncode);
+          index->residues[key] = res;
         }
       }
 
@@ -1161,6 +1203,7 @@ namespace OpenBabel
 
       res->AddAtom(atom);
       res->SetSerialNum(atom, atoi(serno.c_str()));
+      index->serials.insert(make_pair(static_cast<long int>(atoi(serno.c_str())), atom));
       res->SetAtomID(atom, sbuf.substr(6,4));
       res->SetHetAtom(atom, hetatm);
 
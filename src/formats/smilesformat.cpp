@@ -21,6 +21,7 @@ GNU General Public License for more details.
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/obmolecformat.h>
+#include <openbabel/mappedinput.h>
 
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
@@ -46,6 +47,8 @@ GNU General Public License for more details.
 #include <iostream>
 #include <cassert>
 #include <string>
+#include <cstring>
+#include <cstdlib>
 
 //#define DEBUG 1
 #define IMPLICIT_CIS_RING_SIZE 8
@@ -90,6 +93,12 @@ namespace OpenBabel {
     virtual const char* SpecificationURL()
     {return "http://www.daylight.com/smiles/";};
 
+    //the writer keeps no state in the format object
+    virtual unsigned int Flags()
+    {
+      return WRITETHREADSAFE;
+    };
+
     virtual int SkipObjects(int n, OBConversion* pConv)
     {
       if(n==0) return 1; //already points after current line
@@ -193,6 +202,9 @@ namespace OpenBabel {
         "     to clean up stereochemistry (e.g. by removing tetrahedral\n"
         "     stereochemistry where two of the substituents are identical)\n"
         "     then specifying this option will reperceive stereocenters.\n"
+        "  g  Read every SMILES with the general parser\n"
+        "     SMILES without stereochemistry, reactions or extensions are\n"
+        "     normally read by a faster parser, which gives the same molecules.\n"
         "\n\n"
         ;
     }
@@ -289,6 +301,7 @@ namespace OpenBabel {
     int _rxnrole;
     const char *_ptr;
     bool _preserve_aromaticity;
+    bool _fast; // try ParseFast() before ParseSmiles()
     vector<int>             _vprev;
     vector<RingClosureBond> _rclose;
     vector<ExternalBond>    _extbond;
@@ -315,11 +328,13 @@ namespace OpenBabel {
 
   public:
 
-    OBSmilesParser(bool preserve_aromaticity=false): _preserve_aromaticity(preserve_aromaticity), _rxnrole(1) { }
+    OBSmilesParser(bool preserve_aromaticity=false, bool fast=true): _rxnrole(1), _preserve_aromaticity(preserve_aromaticity), _fast(fast) { }
     ~OBSmilesParser() { }
 
     bool SmiToMol(OBMol&,const string&);
     bool ParseSmiles(OBMol&, const string&);
+    bool ParseFast(OBMol&, const string&);
+    bool FinishMolecule(OBMol&, bool kekulize);
     bool ParseSimple(OBMol&);
     bool ParseComplex(OBMol&);
     bool ParseRingBond(OBMol&);
@@ -348,32 +363,33 @@ namespace OpenBabel {
   {
     OBMol* pmol = pOb->CastAndClear<OBMol>();
 
-    istream &ifs = *pConv->GetInStream();
-    string ln, smiles, title;
+    OBLineReader reader(*pConv->GetInStream());
+    OBLineRef ln;
+    string smiles;
     string::size_type pos;
 
     //Ignore lines that start with #
-    while(ifs && ifs.peek()=='#')
-      if(!getline(ifs, ln))
-        return false;
+    bool ok;
+    while((ok = reader.GetLine(ln)) && !ln.Empty() && ln[0]=='#')
+      ;
 
     //Get title
-    if(getline(ifs, ln))
+    if(ok)
     {
-      pos = ln.find_first_of(" \t");
+      pos = ln.FindFirstOf(" \t");
       if(pos!=string::npos)
       {
-        smiles = ln.substr(0,pos);
-        title = ln.substr(pos+1);
-        Trim(title);
-        pmol->SetTitle(title.c_str());
+        smiles = ln.Substr(0,pos).Str();
+        string title = ln.Substr(pos+1).Trim().Str();
+        pmol->SetTitle(title);
       }
       else
-        smiles = ln;
+        smiles = ln.Str();
     }
 
     pmol->SetDimension(0);
-    OBSmilesParser sp(pConv->IsOption("a", OBConversion::INOPTIONS));
+    OBSmilesParser sp(pConv->IsOption("a", OBConversion::INOPTIONS),
+                      !pConv->IsOption("g", OBConversion::INOPTIONS));
     if (!pConv->IsOption("S", OBConversion::INOPTIONS))
       pmol->SetChiralityPerceived();
 
@@ -390,8 +406,16 @@ namespace OpenBabel {
     chiralWatch=false;
     squarePlanarWatch = false;
 
+    // Most SMILES are read by ParseFast(), which gives up before changing
+    // the molecule if the SMILES needs the general parser
+    bool ok = _fast && ParseFast(mol, s);
+    if (!ok) {
+      _vprev.clear(); // may have been used by ParseFast()
+      ok = ParseSmiles(mol, s);
+    }
+
     // We allow the empty reaction (">>") but not the empty molecule ("")
-    if (!ParseSmiles(mol, s) || (!mol.IsReaction() && mol.NumAtoms() == 0))
+    if (!ok || (!mol.IsReaction() && mol.NumAtoms() == 0))
       {
         mol.Clear();
         return(false);
@@ -532,6 +556,14 @@ namespace OpenBabel {
       } // end switch
     } // end for _ptr
 
+    return FinishMolecule(mol, true);
+  }
+
+  // The checks and perception shared by ParseSmiles() and ParseFast(), from
+  // the end of the SMILES string to the finished molecule. Kekulization can
+  // be skipped if there are no aromatic atoms.
+  bool OBSmilesParser::FinishMolecule(OBMol &mol, bool kekulize)
+  {
     // place dummy atoms for each unfilled external bond
     if(!_extbond.empty())
       CapExternalBonds(mol);
@@ -593,7 +625,7 @@ namespace OpenBabel {
     }
 
     // TODO: Only Kekulize if the molecule has a lower case atom
-    bool ok = OBKekulize(&mol);
+    bool ok = !kekulize || OBKekulize(&mol);
     if (!ok) {
       stringstream errorMsg;
       errorMsg << "Failed to kekulize aromatic SMILES";
@@ -672,11 +704,349 @@ namespace OpenBabel {
     if (!_preserve_aromaticity)
       mol.SetAromaticPerceived(false);
 
-    CreateCisTrans(mol);
+    if (!_upDownMap.empty())
+      CreateCisTrans(mol);
 
     return(true);
   }
 
+  // An atom read by ParseFastAtom(); hcount is -1 for the SMILES implicit
+  // valence model
+  struct FastSmilesAtom
+  {
+    int element;
+    int isotope;
+    int charge;
+    int hcount;
+    bool arom;
+  };
+
+  // The element of a bracket atom, for the symbols usually found in
+  // SMILES files. Returns -1 for the others (which ParseComplex() handles)
+  // and leaves p at the last character of the symbol.
+  static int FastBracketElement(const char *&p, bool &arom)
+  {
+    static const struct { char symbol[3]; int element; } twoLetter[] = {
+      { "Cl", 17 }, { "Br", 35 }, { "Na", 11 }, { "Li",  3 }, { "Mg", 12 },
+      { "Ca", 20 }, { "Si", 14 }, { "Se", 34 }, { "Zn", 30 }, { "Fe", 26 },
+      { "Cu", 29 }, { "Al", 13 }, { "As", 33 }, { "Sn", 50 }, { "Pt", 78 },
+      { "Co", 27 }, { "Ni", 28 }, { "Mn", 25 }, { "Ag", 47 }, { "Au", 79 },
+      { "Hg", 80 }, { "Pd", 46 }, { "Cr", 24 }, { "Ti", 22 }, { "Ba", 56 },
+      { "Sr", 38 }, { "Cs", 55 }, { "Rb", 37 }, { "Ge", 32 }, { "Te", 52 },
+      { "Sb", 51 }, { "Bi", 83 }, { "Ga", 31 }, { "Cd", 48 }, { "Tl", 81 },
+      { "Pb", 82 }, { "Gd", 64 }, { "Tc", 43 }, { "Be",  4 }, { "He",  2 },
+      { "Ne", 10 }, { "Ar", 18 }, { "Kr", 36 }, { "Xe", 54 }
+    };
+
+    arom = false;
+    if (islower(p[1])) {
+      if (isupper(*p)) {
+        for (unsigned int i = 0; i < sizeof(twoLetter) / sizeof(twoLetter[0]); ++i)
+          if (twoLetter[i].symbol[0] == p[0] && twoLetter[i].symbol[1] == p[1]) {
+            ++p;
+            return twoLetter[i].element;
+          }
+        return -1;
+      }
+      arom = true;
+      int element = -1;
+      if (p[0] == 's' && p[1] == 'e')
+        element = 34;
+      else if (p[0] == 'a' && p[1] == 's')
+        element = 33;
+      else if (p[0] == 't' && p[1] == 'e')
+        element = 52;
+      if (element != -1)
+        ++p;
+      return element;
+    }
+
+    switch (*p) {
+    case '*': return 0;
+    case 'H': return 1;
+    case 'B': return 5;
+    case 'C': return 6;
+    case 'N': return 7;
+    case 'O': return 8;
+    case 'F': return 9;
+    case 'P': return 15;
+    case 'S': return 16;
+    case 'K': return 19;
+    case 'V': return 23;
+    case 'Y': return 39;
+    case 'I': return 53;
+    case 'W': return 74;
+    case 'U': return 92;
+    }
+    arom = true;
+    switch (*p) {
+    case 'b': return 5;
+    case 'c': return 6;
+    case 'n': return 7;
+    case 'o': return 8;
+    case 'p': return 15;
+    case 's': return 16;
+    }
+    return -1;
+  }
+
+  // Reads an atom of the organic subset or a bracket atom with only an
+  // isotope, hydrogen count and charge, as ParseSimple() and ParseComplex()
+  // would. Returns the last character of the atom, or NULL for anything
+  // else, including stereo, atom classes and radicals.
+  static const char* ParseFastAtom(const char *p, FastSmilesAtom &atom)
+  {
+    atom.isotope = 0;
+    atom.charge = 0;
+    atom.hcount = -1;
+    atom.arom = false;
+
+    switch (*p) {
+    case '*': atom.element = 0; return p;
+    case 'C':
+      if (p[1] == 'l') {
+        atom.element = 17;
+        return p + 1;
+      }
+      atom.element = 6;
+      return p;
+    case 'B':
+      if (p[1] == 'r') {
+        atom.element = 35;
+        return p + 1;
+      }
+      atom.element = 5;
+      return p;
+    case 'N': atom.element = 7; return p;
+    case 'O': atom.element = 8; return p;
+    case 'S': atom.element = 16; return p;
+    case 'P': atom.element = 15; return p;
+    case 'F': atom.element = 9; return p;
+    case 'I': atom.element = 53; return p;
+    case 'b': atom.element = 5; atom.arom = true; return p;
+    case 'c': atom.element = 6; atom.arom = true; return p;
+    case 'n': atom.element = 7; atom.arom = true; return p;
+    case 'o': atom.element = 8; atom.arom = true; return p;
+    case 'p': atom.element = 15; atom.arom = true; return p;
+    case 's': atom.element = 16; atom.arom = true; return p;
+    case '[':
+      break;
+    default:
+      return NULL;
+    }
+
+    ++p;
+    unsigned int size = 0;
+    for (; isdigit(*p) && size < 5; ++p, ++size)
+      atom.isotope = atom.isotope * 10 + *p - '0';
+    if (size == 5)
+      return NULL;
+
+    atom.element = FastBracketElement(p, atom.arom);
+    if (atom.element < 0)
+      return NULL;
+
+    atom.hcount = 0;
+    for (++p; *p != ']'; ++p) {
+      switch (*p) {
+      case 'H':
+        if (isdigit(p[1]))
+          atom.hcount = *++p - '0';
+        else
+          atom.hcount = 1;
+        break;
+      case '-':
+        ++p;
+        if (!isdigit(*p))
+          atom.charge--;
+        while (isdigit(*p))
+          atom.charge = atom.charge * 10 - (*p++ - '0');
+        --p;
+        break;
+      case '+':
+        ++p;
+        if (!isdigit(*p))
+          atom.charge++;
+        while (isdigit(*p))
+          atom.charge = atom.charge * 10 + (*p++ - '0');
+        --p;
+        break;
+      default: // including the end of the string
+        return NULL;
+      }
+    }
+
+    // ParseComplex() warns about these
+    if (abs(atom.charge) > 10 || (atom.element && atom.charge > atom.element))
+      return NULL;
+    return p;
+  }
+
+  // A streamlined parser for the SMILES found in most files: atoms of the
+  // organic subset, simple bracket atoms, bonds, branches, ring closures
+  // and dots. The string is checked first and false is returned, with the
+  // molecule unchanged, if it uses anything else (stereochemistry,
+  // reactions, external bonds, %(NNN) ring closures...) or is invalid, so
+  // that ParseSmiles() reads it and reports any errors. Otherwise the atoms
+  // and bonds are added as ParseSmiles() adds them, without the stereo and
+  // reaction bookkeeping, so the molecules are identical.
+  bool OBSmilesParser::ParseFast(OBMol &mol, const string &smiles)
+  {
+    const char *begin = smiles.c_str();
+    FastSmilesAtom atom;
+
+    // Check the syntax and count the atoms
+    int ring[100]; // the atom with each open ring closure, or 0
+    memset(ring, 0, sizeof(ring));
+    unsigned int natoms = 0, nopen = 0;
+    int prev = 0;
+    _vprev.clear();
+    for (const char *p = begin; *p; ++p) {
+      switch (*p) {
+      case '\r':
+        if (p[1] != '\0')
+          return false;
+        break;
+      case '0': case '1': case '2': case '3': case '4':
+      case '5': case '6': case '7': case '8': case '9':
+      case '%': {
+        if (prev == 0)
+          return false;
+        int digit = *p - '0';
+        if (*p == '%') {
+          if (!isdigit(p[1]) || !isdigit(p[2]))
+            return false;
+          digit = (p[1] - '0') * 10 + p[2] - '0';
+          p += 2;
+        }
+        if (ring[digit] == 0) {
+          ring[digit] = prev;
+          ++nopen;
+        }
+        else if (ring[digit] == prev) // bonded to itself
+          return false;
+        else {
+          ring[digit] = 0;
+          --nopen;
+        }
+        break;
+      }
+      case '.':
+        prev = 0;
+        break;
+      case '(':
+        _vprev.push_back(prev);
+        break;
+      case ')':
+        if (_vprev.empty())
+          return false;
+        prev = _vprev.back();
+        _vprev.pop_back();
+        break;
+      case '-': case '=': case '#': case '$': case ':':
+        if (prev == 0)
+          return false;
+        break;
+      default:
+        p = ParseFastAtom(p, atom);
+        if (!p)
+          return false;
+        prev = ++natoms;
+      }
+    }
+    if (natoms == 0 || nopen != 0)
+      return false;
+
+    // Build the molecule
+    mol.SetAromaticPerceived(); // Turn off perception until FinishMolecule()
+    mol.BeginModify();
+    mol.ReserveAtoms(natoms);
+    _hcount.reserve(natoms);
+    _vprev.clear();
+    _prev = 0;
+    _order = 0;
+    _updown = ' ';
+    bool aromatic = false;
+
+    for (_ptr = begin; *_ptr; ++_ptr) {
+      switch (*_ptr) {
+      case '\r':
+        break;
+      case '0': case '1': case '2': case '3': case '4':
+      case '5': case '6': case '7': case '8': case '9':
+      case '%': {
+        int digit = *_ptr - '0';
+        if (*_ptr == '%') {
+          digit = (_ptr[1] - '0') * 10 + _ptr[2] - '0';
+          _ptr += 2;
+        }
+        vector<RingClosureBond>::iterator bond;
+        for (bond = _rclose.begin(); bond != _rclose.end(); ++bond)
+          if (bond->digit == digit)
+            break;
+        if (bond != _rclose.end()) { // close the ring as ParseRingBond() does
+          int bondOrder = (_order > bond->order) ? _order : bond->order;
+          bool aromatic_bond = bondOrder == 0 && mol.GetAtom(bond->prev)->IsAromatic()
+                               && mol.GetAtom(_prev)->IsAromatic();
+          mol.AddBond(bond->prev, _prev, bondOrder == 0 ? 1 : bondOrder,
+                      aromatic_bond ? OB_AROMATIC_BOND : 0, bond->numConnections);
+          _rclose.erase(bond);
+        }
+        else {
+          RingClosureBond ringClosure;
+          ringClosure.digit = digit;
+          ringClosure.prev = _prev;
+          ringClosure.order = _order;
+          ringClosure.updown = ' ';
+          ringClosure.numConnections = NumConnections(mol.GetAtom(_prev));
+          _rclose.push_back(ringClosure);
+        }
+        _order = 0;
+        break;
+      }
+      case '.':
+        _prev = 0;
+        break;
+      case '(':
+        _vprev.push_back(_prev);
+        break;
+      case ')':
+        _prev = _vprev.back();
+        _vprev.pop_back();
+        break;
+      case '-': _order = 1; break;
+      case '=': _order = 2; break;
+      case '#': _order = 3; break;
+      case '$': _order = 4; break;
+      case ':': _order = 0; break;
+      default: {
+        _ptr = ParseFastAtom(_ptr, atom);
+        OBAtom *obatom = mol.NewAtom();
+        if (atom.charge)
+          obatom->SetFormalCharge(atom.charge);
+        obatom->SetAtomicNum(atom.element);
+        if (atom.isotope)
+          obatom->SetIsotope(atom.isotope);
+        if (atom.arom) {
+          obatom->SetAromatic();
+          aromatic = true;
+        }
+        if (_prev) {
+          if (atom.arom && mol.GetAtom(_prev)->IsAromatic() && _order == 0)
+            mol.AddBond(_prev, mol.NumAtoms(), 1, OB_AROMATIC_BOND); // this will be kekulized later
+          else
+            mol.AddBond(_prev, mol.NumAtoms(), _order == 0 ? 1 : _order);
+        }
+        _prev = mol.NumAtoms();
+        _order = 0;
+        _hcount.push_back(atom.hcount);
+      }
+      }
+    }
+
+    return FinishMolecule(mol, aromatic);
+  }
+
   bool OBSmilesParser::IsUp(OBBond *bond)
   {
     map<OBBond*, char>::iterator UpDownSearch;
@@ -2336,10 +2706,15 @@ namespace OpenBabel {
     OBAtom* _endatom;
     OBAtom* _startatom;
 
-    OutOptions &options;
+    OutOptions options;
+
+    // Scratch space of CreateFragCansmiString(), kept between molecules
+    // so that a reused writer does not reallocate it
+    std::vector<unsigned int> _symmetry_classes, _canonical_order, _fragsym;
+    std::vector<OBBitVec> _fragments;
 
   public:
-    OBMol2Cansmi(OutOptions &_options): options(_options)
+    OBMol2Cansmi(const OutOptions &_options): _stereoFacade(NULL), options(_options)
     {
     }
     ~OBMol2Cansmi()
@@ -2347,6 +2722,7 @@ namespace OpenBabel {
       delete _stereoFacade;
     }
 
+    void         SetOptions(const OutOptions &_options) { options = _options; }
     void         Init(OBMol* pmol, bool canonicalOutput = true, OBConversion* pconv=NULL);
 
     void         CreateCisTrans(OBMol&);
@@ -2403,8 +2779,12 @@ namespace OpenBabel {
     _uatoms.Clear();
     _ubonds.Clear();
     _vopen.clear();
+    _cistrans.clear();
+    _unvisited_cistrans.clear();
+    _isup.clear();
 
     _pmol = pmol;
+    delete _stereoFacade; // left over if this writer is being reused
     _stereoFacade = new OBStereoFacade(_pmol); // needs to be destroyed in dtor
     _pconv = pconv;
     _canonicalOutput = canonical;
@@ -3796,7 +4176,10 @@ namespace OpenBabel {
     OBCanSmiNode *root;
     buffer[0] = '\0';
     vector<OBNodeBase*>::iterator ai;
-    vector<unsigned int> symmetry_classes, canonical_order;
+    vector<unsigned int> &symmetry_classes = _symmetry_classes;
+    vector<unsigned int> &canonical_order = _canonical_order;
+    symmetry_classes.clear();
+    canonical_order.clear();
     symmetry_classes.reserve(mol.NumAtoms());
     canonical_order.reserve(mol.NumAtoms());
 
@@ -3830,7 +4213,12 @@ namespace OpenBabel {
     // Was Universal SMILES requested?
     bool universal_smiles = _pconv->IsOption("U");
     if (universal_smiles) {
-      bool parsedOkay = ParseInChI(mol, atom_order);
+      bool parsedOkay;
+      // the InChI library is not reentrant
+#ifdef _OPENMP
+      #pragma omp critical (smiles_inchi)
+#endif
+      parsedOkay = ParseInChI(mol, atom_order);
       if (!parsedOkay)
         universal_smiles = false;
     }
@@ -3841,7 +4229,8 @@ namespace OpenBabel {
 
       // Find the (dis)connected fragments.
       OBBitVec visited;
-      std::vector<OBBitVec> fragments;
+      std::vector<OBBitVec> &fragments = _fragments;
+      fragments.clear();
       for (std::size_t i = 0; i < mol.NumAtoms(); ++i) {
         if (!frag_atoms.BitIsSet(i+1) || visited.BitIsSet(i+1))
           continue;
@@ -3853,7 +4242,7 @@ namespace OpenBabel {
       symmetry_classes.resize(mol.NumAtoms());
       for (std::size_t i = 0; i < fragments.size(); ++i) {
         OBGraphSym gs(&mol, &(fragments[i]));
-        vector<unsigned int> tmp;
+        vector<unsigned int> &tmp = _fragsym;
         gs.GetSymmetry(tmp);
 
         for (std::size_t j = 0; j < mol.NumAtoms(); ++j)
@@ -4039,7 +4428,16 @@ namespace OpenBabel {
       pConv->IsOption("h"), pConv->IsOption("s"),
       pConv->IsOption("o"));
 
-    OBMol2Cansmi m2s(options);
+    // Reuse this thread's writer so that its buffers keep their capacity
+    // from one molecule to the next. A nested call (which should not
+    // happen) gets a writer of its own.
+    static THREAD_LOCAL OBMol2Cansmi threadM2s(options);
+    static THREAD_LOCAL bool threadM2sBusy = false;
+    OBMol2Cansmi nestedM2s(options);
+    bool nested = threadM2sBusy;
+    OBMol2Cansmi &m2s = nested ? nestedM2s : threadM2s;
+    threadM2sBusy = true;
+    m2s.SetOptions(options);
     m2s.Init(&mol, canonical, pConv);
 
     if (options.isomeric) {
@@ -4091,6 +4489,8 @@ namespace OpenBabel {
       m2s.GetOutputOrder(atmorder);
       canData->SetValue(atmorder);
     }
+    if (!nested)
+      threadM2sBusy = false;
   }
 
   bool SMIBaseFormat::GetInchifiedSMILESMolecule(OBMol *mol, bool useFixedHRecMet)
@@ -4142,7 +4542,11 @@ namespace OpenBabel {
 
     // Inchified SMILES? If so, then replace mol with the new 'normalised' one
     if (pConv->IsOption("I")) {
-      bool success = GetInchifiedSMILESMolecule(pmol, false);
+      bool success;
+#ifdef _OPENMP
+      #pragma omp critical (smiles_inchi)
+#endif
+      success = GetInchifiedSMILESMolecule(pmol, false);
       if (!success) {
         ofs << NewLine();
         obErrorLog.ThrowError(__FUNCTION__, "Cannot generate Universal NSMILES for this molecule", obError);
@@ -4162,8 +4566,9 @@ namespace OpenBabel {
     if (pConv->IsOption("x"))
       pConv->AddOption("O");
 
-    std::string buffer;
-    buffer.reserve(1000);
+    // reused for each molecule (and by each thread when writing concurrently)
+    static THREAD_LOCAL std::string buffer;
+    buffer.clear();
 
     // If there is data attached called "SMILES_Fragment", then it's
     // an ascii OBBitVec, representing the atoms of a fragment.  The
@@ -4192,7 +4597,6 @@ namespace OpenBabel {
       CreateCansmiString(*pmol, buffer, fragatoms, pConv);
     }
 
-    bool writenewline = false;
     if(!pConv->IsOption("smilesonly")) {
 
       if(!pConv->IsOption("n")) {
@@ -4220,12 +4624,10 @@ namespace OpenBabel {
       }
 
       if(!pConv->IsOption("nonewline"))
-        writenewline = true;
+        buffer += NewLine();
     }
 
-    ofs << buffer;
-    if (writenewline)
-      ofs << NewLine();
+    ofs.write(buffer.data(), buffer.size());
 
     return true;
   }
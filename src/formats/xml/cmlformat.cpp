@@ -2156,7 +2156,7 @@ namespace OpenBabel
     static const xmlChar C_TITLE[]        = "title";
 
     vector<OBGenericData*>::iterator k;
-    vector<OBGenericData*> vdata = mol.GetData();
+    vector<OBGenericData*> vdata = mol.GetAllData(OBGenericDataType::PairData);
     for (k = vdata.begin();k != vdata.end();++k)
       {
         if  ((*k)->GetDataType() == OBGenericDataType::PairData
@@ -56,6 +56,7 @@ namespace OpenBabel
     XDR*	xdridptr[MAXID];
     char 	xdrmodes[MAXID];
     unsigned int cnt;
+    int nframes; // number of frames written to the current output
 
     static int magicints[]; // defined below
     int	xdropen(XDR *xdrs, const char *filename, const char *type);
@@ -70,18 +71,42 @@ namespace OpenBabel
                       unsigned int sizes[], int nums[]);
     int	xdr3dfcoord(XDR *xdrs, float *fp, int *size, float *precision);
 
+    // trajectory mode (-aT)
+    bool ReadFrameRecord(std::istream &ifs);
+    bool ReadFrame(OBMol &mol, OBConversion* pConv);
+    std::vector<char> _frame;        // the XDR record of a frame
+    std::vector<float> _frameCoords; // its coordinates, in nm
+    std::vector<double> _coords;     // and in A
+    std::vector<int> _readInts, _readBuffer; // used by xdr3dfcoord() to read
+    OBMol _topology;                 // the molecule of the frames
+    std::string _topologyFile;
+
   public:
     //Register this format type ID
-    XTCFormat()
+    XTCFormat() : nframes(0)
     {
       OBConversion::RegisterFormat("xtc",this);
+      OBConversion::RegisterOptionParam("F", this, 1, OBConversion::INOPTIONS);
     }
 
     virtual const char* Description() //required
     {
       return
         "XTC format\n"
-        "A portable format for trajectories (gromacs)\n";
+        "A portable format for trajectories (gromacs)\n"
+        "All conformers of a molecule are written as frames.\n\n"
+        "By default, all the frames are read as conformers of the molecule\n"
+        "read into, which must have the atoms of the trajectory. In trajectory\n"
+        "mode (-aT), each frame is read from the input as a molecule: the\n"
+        "atoms and bonds are those of the molecule read into if it has the\n"
+        "number of atoms of the trajectory (e.g. it is reused in a loop over\n"
+        "the frames), otherwise of the topology file. Only the coordinates\n"
+        "are read for each frame.\n\n"
+        "Read Options e.g. -aT -aF topology.pdb\n"
+        "  T  trajectory mode, one frame at a time\n"
+        "  F <file> the atoms and bonds of the frames, in any format\n\n"
+        "Write Options e.g. -xt 0.002\n"
+        "  t <time> time between frames in ps (default 1)\n\n";
     };
 
     virtual const char* SpecificationURL()
@@ -93,14 +118,15 @@ namespace OpenBabel
     // NOTREADABLE  READONEONLY  NOTWRITABLE  WRITEONEONLY
     virtual unsigned int Flags()
     {
-      return NOTWRITABLE;
+      return READBINARY | WRITEBINARY;
     };
 
     //*** This section identical for most OBMol conversions ***
     ////////////////////////////////////////////////////
     /// The "API" interface functions
+    virtual int SkipObjects(int n, OBConversion* pConv);
     virtual bool ReadMolecule(OBBase* pOb, OBConversion* pConv);
-    //virtual bool WriteMolecule(OBBase* pOb, OBConversion* pConv);
+    virtual bool WriteMolecule(OBBase* pOb, OBConversion* pConv);
   };
   //***
 
@@ -118,6 +144,120 @@ namespace OpenBabel
   //Make an instance of the format class
   XTCFormat theXTCFormat;
 
+  // an int of an XDR stream (big-endian)
+  static int XDRInt(const char *p)
+  {
+    const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<int>((static_cast<unsigned int>(u[0]) << 24) | (u[1] << 16) | (u[2] << 8) | u[3]);
+  }
+
+  // Read the bytes of the next frame into _frame: the header, then the
+  // coordinates as written by xdr3dfcoord()
+  bool XTCFormat::ReadFrameRecord(std::istream &ifs)
+  {
+    // magic, natoms, step, time, box[9] and the number of atoms again
+    const size_t header = 14 * 4;
+    _frame.resize(header);
+    if (!ifs.read(&_frame[0], header))
+      return false;
+    if (XDRInt(&_frame[0]) != 1995) {
+      obErrorLog.ThrowError(__FUNCTION__, "Error: the XTC frame does not start with the magic int 1995.", obWarning);
+      return false;
+    }
+    int natoms = XDRInt(&_frame[header - 4]);
+    if (natoms < 0)
+      return false;
+    if (natoms <= 9) { // not compressed
+      _frame.resize(header + natoms * 12);
+      return natoms == 0 || ifs.read(&_frame[header], natoms * 12);
+    }
+    // precision, minint[3], maxint[3], smallidx and the number of bytes
+    const size_t compressed = header + 9 * 4;
+    _frame.resize(compressed);
+    if (!ifs.read(&_frame[header], compressed - header))
+      return false;
+    int nbytes = XDRInt(&_frame[compressed - 4]);
+    if (nbytes < 0)
+      return false;
+    size_t padded = (static_cast<size_t>(nbytes) + 3) / 4 * 4;
+    _frame.resize(compressed + padded);
+    return padded == 0 || ifs.read(&_frame[compressed], padded);
+  }
+
+  // Decode the frame in _frame into the coordinates of \p mol
+  bool XTCFormat::ReadFrame(OBMol &mol, OBConversion* pConv)
+  {
+    XDR xdrs;
+    xdrmem_create(&xdrs, &_frame[0], _frame.size(), XDR_DECODE);
+    xdridptr[0] = &xdrs;
+    xdrmodes[0] = 'r';
+    int magic, natoms, step;
+    float time, box[9];
+    bool ok = xdr_int(&xdrs, &magic) && xdr_int(&xdrs, &natoms) &&
+      xdr_int(&xdrs, &step) && xdr_float(&xdrs, &time);
+    for (int j = 0; ok && j < 9; ++j)
+      ok = xdr_float(&xdrs, &box[j]);
+    float prec = 1000.0;
+    if (ok) {
+      _frameCoords.resize(natoms * 3);
+      ok = xdr3dfcoord(&xdrs, natoms ? &_frameCoords[0] : NULL, &natoms, &prec) != 0;
+    }
+    xdridptr[0] = NULL;
+    xdr_destroy(&xdrs);
+    if (!ok) {
+      obErrorLog.ThrowError(__FUNCTION__, "Error while decoding an XTC frame.", obWarning);
+      return false;
+    }
+
+    if (mol.NumAtoms() != static_cast<unsigned int>(natoms)) {
+      const char *topology = pConv->IsOption("F", OBConversion::INOPTIONS);
+      if (topology && _topologyFile != topology) {
+        OBConversion topconv;
+        OBFormat *format = topconv.FormatFromExt(topology);
+        _topology.Clear();
+        if (!format || !topconv.SetInFormat(format) || !topconv.ReadFile(&_topology, topology)) {
+          obErrorLog.ThrowError(__FUNCTION__, std::string("Error while reading the topology ") + topology, obWarning);
+          return false;
+        }
+        _topologyFile = topology;
+      }
+      if (!topology || _topology.NumAtoms() != static_cast<unsigned int>(natoms)) {
+        std::stringstream errorMsg;
+        errorMsg << "Error: number of atoms in the trajectory (" << natoms
+                 << ") doesn't match the number of atoms in the supplied "
+                 << "molecule or topology (-aF).";
+        obErrorLog.ThrowError(__FUNCTION__, errorMsg.str(), obWarning);
+        return false;
+      }
+      mol = _topology;
+    }
+    else {
+      // the coordinates of the last frame were used for perception
+      mol.DeleteData(OBGenericDataType::StereoData);
+      mol.SetFlags(mol.GetFlags() & ~OB_CHIRALITY_MOL);
+    }
+
+    // nm to A, into the coordinates of the molecule
+    _coords.resize(natoms * 3);
+    for (int i = 0; i < natoms * 3; ++i)
+      _coords[i] = 10.0 * _frameCoords[i];
+    if (natoms)
+      mol.SetCoordinates(&_coords[0]);
+    return true;
+  }
+
+  int XTCFormat::SkipObjects(int n, OBConversion* pConv)
+  {
+    if (!pConv->IsOption("T", OBConversion::INOPTIONS))
+      return 0;
+    if (n == 0)
+      ++n;
+    while (n--)
+      if (!ReadFrameRecord(*pConv->GetInStream()))
+        return -1;
+    return 1;
+  }
+
   /////////////////////////////////////////////////////////////////
   bool XTCFormat::ReadMolecule(OBBase* pOb, OBConversion* pConv)
   {
@@ -127,6 +267,14 @@ namespace OpenBabel
       return false;
 
     OBMol &mol = *pmol;
+
+    // with -aT, one frame from the input stream
+    if (pConv->IsOption("T", OBConversion::INOPTIONS)) {
+      std::istream &ifs = *pConv->GetInStream();
+      if (ifs.peek() == EOF || !ReadFrameRecord(ifs))
+        return false;
+      return ReadFrame(mol, pConv);
+    }
     std::string filename = pConv->GetInFilename();
 
     if (xdropen(&xd, filename.c_str(),"r") == 0) {
@@ -206,6 +354,77 @@ namespace OpenBabel
     return(true);
   }
 
+  /////////////////////////////////////////////////////////////////
+  bool XTCFormat::WriteMolecule(OBBase* pOb, OBConversion* pConv)
+  {
+    OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+    if(pmol==NULL)
+      return false;
+
+    OBMol &mol = *pmol;
+    std::ostream &ofs = *pConv->GetOutStream();
+
+    if (pConv->GetOutputIndex() <= 1)
+      nframes = 0;
+
+    float dt = 1.0;
+    const char *t = pConv->IsOption("t");
+    if (t)
+      dt = static_cast<float>(atof(t));
+
+    // with --writeconformers, this is called for each conformer
+    std::vector<double*> frames;
+    if (pConv->IsOption("writeconformers", OBConversion::GENOPTIONS) || mol.NumConformers() == 0)
+      frames.push_back(mol.GetCoordinates());
+    else
+      frames = mol.GetConformers();
+
+    int natoms = mol.NumAtoms();
+    float prec = 1000.0;
+    float box[9] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    std::vector<float> floatCoord(natoms * 3);
+    // header and compressed coordinates (at most 1.2 ints per coordinate)
+    std::vector<char> buffer(256 + 8 * natoms * 3);
+
+    for (unsigned int i = 0; i < frames.size(); ++i) {
+      if (frames[i] == NULL)
+        return false;
+
+      // Convert positions from A to nm in single precision
+      for (int j = 0; j < natoms * 3; ++j)
+        floatCoord[j] = static_cast<float>(0.1 * frames[i][j]);
+
+      // Encode the frame in memory. xdr3dfcoord() looks up the mode of the
+      // stream, slot 0 is not used by xdropen().
+      XDR xdrs;
+      xdrmem_create(&xdrs, &buffer[0], buffer.size(), XDR_ENCODE);
+      xdridptr[0] = &xdrs;
+      xdrmodes[0] = 'w';
+
+      int magic = 1995;
+      int step = nframes;
+      float time = dt * nframes;
+      bool ok = xdr_int(&xdrs, &magic) && xdr_int(&xdrs, &natoms) &&
+        xdr_int(&xdrs, &step) && xdr_float(&xdrs, &time);
+      for (int j = 0; ok && j < 9; ++j)
+        ok = xdr_float(&xdrs, &box[j]);
+      ok = ok && xdr3dfcoord(&xdrs, &floatCoord[0], &natoms, &prec);
+
+      unsigned int size = xdr_getpos(&xdrs);
+      xdridptr[0] = NULL;
+      xdr_destroy(&xdrs);
+      if (!ok) {
+        obErrorLog.ThrowError(__FUNCTION__, "Error while encoding an XTC frame.", obWarning);
+        return false;
+      }
+
+      ofs.write(&buffer[0], size);
+      ++nframes;
+    }
+
+    return ofs.good();
+  }
+
   /*____________________________________________________________________________
     |
     | libxdrf - portable fortran interface to xdr. some xdr routines
@@ -884,7 +1103,10 @@ namespace OpenBabel
       }
       if (buf[1] != 0) buf[0]++;;
       xdr_int(xdrs, &(buf[0])); /* buf[0] holds the length in bytes */
-      return errval * (xdr_opaque(xdrs, (caddr_t)&(buf[3]), (u_int)buf[0]));
+      errval *= xdr_opaque(xdrs, (caddr_t)&(buf[3]), (u_int)buf[0]);
+      free(ip);
+      free(buf);
+      return errval;
     } else {
 
       /* xdrs is open for reading */
@@ -902,33 +1124,12 @@ namespace OpenBabel
                            (xdrproc_t)xdr_float));
       }
       xdr_float(xdrs, precision);
-      if (ip == NULL) {
-        ip = (int *)malloc(size3 * sizeof(*ip));
-        if (ip == NULL) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        bufsize = static_cast<int> (size3 * 1.2);
-        buf = (int *)malloc(bufsize * sizeof(*buf));
-        if (buf == NULL) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        oldsize = *size;
-      } else if (*size > oldsize) {
-        ip = (int *)realloc(ip, size3 * sizeof(*ip));
-        if (ip == NULL) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        bufsize = static_cast<int> (size3 * 1.2);
-        buf = (int *)realloc(buf, bufsize * sizeof(*buf));
-        if (buf == NULL) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        oldsize = *size;
-      }
+      // the buffers are kept for the next frame
+      _readInts.resize(size3);
+      ip = &_readInts[0];
+      if (_readBuffer.size() < 3)
+        _readBuffer.resize(3);
+      buf = &_readBuffer[0];
       buf[0] = buf[1] = buf[2] = 0;
 
       xdr_int(xdrs, &(minint[0]));
@@ -963,8 +1164,14 @@ namespace OpenBabel
 
     	/* buf[0] holds the length in bytes */
 
-      if (xdr_int(xdrs, &(buf[0])) == 0)
+      int nbytes;
+      if (xdr_int(xdrs, &nbytes) == 0 || nbytes < 0)
         return 0;
+      if (_readBuffer.size() < 3 + (static_cast<size_t>(nbytes) + 3) / 4 + 1) {
+        _readBuffer.resize(3 + (static_cast<size_t>(nbytes) + 3) / 4 + 1);
+        buf = &_readBuffer[0];
+      }
+      buf[0] = nbytes;
       if (xdr_opaque(xdrs, (caddr_t)&(buf[3]), (u_int)buf[0]) == 0)
         return 0;
       buf[0] = buf[1] = buf[2] = 0;
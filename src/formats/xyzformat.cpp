@@ -15,6 +15,7 @@ GNU General Public License for more details.
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/obmolecformat.h>
+#include <openbabel/mappedinput.h>
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
 #include <openbabel/elements.h>
@@ -82,7 +83,13 @@ namespace OpenBabel
 
         "Read Options e.g. -as\n"
         "  s  Output single bonds only\n"
-        "  b  Disable bonding entirely\n\n";
+        "  b  Disable bonding entirely\n"
+        "  T  Trajectory: the frames have the same bonds\n"
+        "     The bonds are perceived for the first frame only; a frame with\n"
+        "     the same elements takes the bonds of the previous one and only\n"
+        "     its coordinates are read. When the molecule read into already has\n"
+        "     these atoms (e.g. it is reused in a loop over the frames), only\n"
+        "     its coordinates are changed. Charges are not read.\n\n";
     };
 
     virtual const char* SpecificationURL()
@@ -96,16 +103,134 @@ namespace OpenBabel
     /// The "API" interface functions
     virtual bool ReadMolecule(OBBase* pOb, OBConversion* pConv);
     virtual bool WriteMolecule(OBBase* pOb, OBConversion* pConv);
+
+    //The reader keeps the last topology with -aT; a copy is not registered
+    virtual OBFormat* MakeNewInstance()
+    {
+      return new XYZFormat(*this);
+    }
+
+  private:
+    bool ReadFrame(OBMol &mol, OBLineReader &reader, int natoms, OBConversion* pConv);
+    bool HasFrameAtoms(OBMol &mol) const;
+
+    OBMol _topology;             //!< the last frame whose bonds were perceived (-aT)
+    vector<int> _frameElements;  //!< atomic numbers of the frame read
+    vector<string> _frameTypes;  //!< symbols of the frame not known as elements
+    vector<double> _frameCoords; //!< coordinates of the frame read
   };
   //***
 
   //Make an instance of the format class
   XYZFormat theXYZFormat;
 
+  // Skip the blank lines after a molecule
+  static void SkipBlankLines(istream &ifs)
+  {
+    char buffer[BUFF_SIZE];
+    std::streampos ipos;
+    do
+    {
+      ipos = ifs.tellg();
+      ifs.getline(buffer,BUFF_SIZE);
+    }
+    while(strlen(buffer) == 0 && !ifs.eof() );
+    ifs.seekg(ipos);
+  }
+
+  bool XYZFormat::HasFrameAtoms(OBMol &mol) const
+  {
+    if (mol.NumAtoms() != _frameElements.size())
+      return false;
+    for (unsigned int i = 0; i < _frameElements.size(); ++i)
+      if (mol.GetAtom(i + 1)->GetAtomicNum() != static_cast<unsigned int>(_frameElements[i]))
+        return false;
+    return true;
+  }
+
+  // Read the atoms of a frame with -aT. Only the coordinates are set if
+  // \p mol or the last topology have the same atoms.
+  bool XYZFormat::ReadFrame(OBMol &mol, OBLineReader &reader, int natoms, OBConversion* pConv)
+  {
+    _frameElements.resize(natoms);
+    _frameTypes.clear();
+    _frameCoords.resize(natoms * 3);
+    vector<OBLineRef> vs;
+    OBLineRef line;
+    for (int i = 0; i < natoms; ++i)
+      {
+        if (!reader.GetLine(line))
+          {
+            obErrorLog.ThrowError(__FUNCTION__,
+                                  "Problems reading an XYZ file: the frame has fewer atoms than on its first line.", obWarning);
+            return false;
+          }
+        line.Tokenize(vs);
+        if (vs.size() < 4)
+          {
+            obErrorLog.ThrowError(__FUNCTION__,
+                                  "Problems reading an XYZ file: could not read the line '" + line.Str() + "'.", obWarning);
+            return false;
+          }
+        string symbol = vs[0].Str();
+        int atomicNum = OBElements::GetAtomicNum(symbol.c_str());
+        if (atomicNum == 0)
+          atomicNum = atoi(symbol.c_str());
+        if (atomicNum == 0)
+          {
+            _frameTypes.resize(natoms);
+            _frameTypes[i] = symbol;
+          }
+        _frameElements[i] = atomicNum;
+        for (unsigned int j = 0; j < 3; ++j)
+          if (!vs[j + 1].ToDouble(_frameCoords[i * 3 + j]))
+            {
+              obErrorLog.ThrowError(__FUNCTION__,
+                                    "Problems reading an XYZ file: could not read the coordinates on the line '" + line.Str() + "'.", obWarning);
+              return false;
+            }
+      }
+
+    if (HasFrameAtoms(mol))
+      {
+        // the coordinates of the last frame were used for perception
+        mol.DeleteData(OBGenericDataType::StereoData);
+        mol.SetFlags(mol.GetFlags() & ~OB_CHIRALITY_MOL);
+      }
+    else if (HasFrameAtoms(_topology))
+      mol = _topology;
+    else
+      {
+        mol.Clear();
+        mol.ReserveAtoms(natoms);
+        mol.BeginModify();
+        for (int i = 0; i < natoms; ++i)
+          {
+            OBAtom *atom = mol.NewAtom();
+            atom->SetAtomicNum(_frameElements[i]);
+            if (_frameElements[i] == 0)
+              atom->SetType(_frameTypes[i]);
+            atom->SetVector(_frameCoords[i * 3], _frameCoords[i * 3 + 1], _frameCoords[i * 3 + 2]);
+          }
+        if (!pConv->IsOption("b",OBConversion::INOPTIONS))
+          mol.ConnectTheDots();
+        if (!pConv->IsOption("s",OBConversion::INOPTIONS) && !pConv->IsOption("b",OBConversion::INOPTIONS))
+          mol.PerceiveBondOrders();
+        mol.EndModify();
+        _topology = mol;
+        return true;
+      }
+    if (natoms > 0)
+      mol.SetCoordinates(&_frameCoords[0]);
+    return true;
+  }
+
   /////////////////////////////////////////////////////////////////
   bool XYZFormat::ReadMolecule(OBBase* pOb, OBConversion* pConv)
   {
-    OBMol* pmol = pOb->CastAndClear<OBMol>();
+    // with -aT the molecule is kept if it has the atoms of the frame
+    const bool trajectory = pConv->IsOption("T",OBConversion::INOPTIONS) != NULL;
+    OBMol* pmol = trajectory ? dynamic_cast<OBMol*>(pOb) : pOb->CastAndClear<OBMol>();
     if(pmol==NULL)
       return false;
 
@@ -113,60 +238,69 @@ namespace OpenBabel
     istream &ifs = *pConv->GetInStream();
     OBMol &mol = *pmol;
     const char* title = pConv->GetTitle();
-    char buffer[BUFF_SIZE];
 
     stringstream errorMsg;
 
-    unsigned int natoms;	// [ejk] assumed natoms could not be -ve
+    int natoms;
 
     if (!ifs)
       return false; // we're attempting to read past the end of the file
 
-    if (!ifs.getline(buffer,BUFF_SIZE))
+    // the lines are references into the input file if it is memory-mapped
+    OBLineReader reader(ifs);
+    OBLineRef line;
+    if (!reader.GetLine(line))
       {
         obErrorLog.ThrowError(__FUNCTION__,
                               "Problems reading an XYZ file: Cannot read the first line.", obWarning);
         return(false);
       }
 
-    if (sscanf(buffer, "%d", &natoms) == 0 || !natoms)
+    if (!line.Trim().ToInt(natoms) || natoms <= 0)
       {
         obErrorLog.ThrowError(__FUNCTION__,
                               "Problems reading an XYZ file: The first line must contain the number of atoms.", obWarning);
         return(false);
       }
 
-    mol.ReserveAtoms(natoms);
-
     // The next line contains a title string for the molecule. Use this
     // as the title for the molecule if the line is not
     // empty. Otherwise, use the title given by the calling function.
-    if (!ifs.getline(buffer,BUFF_SIZE))
+    if (!reader.GetLine(line))
       {
         obErrorLog.ThrowError(__FUNCTION__,
                               "Problems reading an XYZ file: Could not read the second line (title/comments).", obWarning);
         return(false);
       }
-    string readTitle(buffer);
+    string readTitle(line.Str());
     string::size_type location = readTitle.find("Energy");
     if (location != string::npos)
       readTitle.erase(location);
     Trim(readTitle);
 
     location = readTitle.find_first_not_of(" \t\n\r");
-    if (location != string::npos)
-      mol.SetTitle(readTitle);
-    else
-      mol.SetTitle(title);
+    if (location == string::npos)
+      readTitle = title;
 
+    if (trajectory)
+      {
+        if (!ReadFrame(mol, reader, natoms, pConv))
+          return false;
+        mol.SetTitle(readTitle);
+        SkipBlankLines(ifs);
+        return true;
+      }
+
+    mol.SetTitle(readTitle);
+    mol.ReserveAtoms(natoms);
     mol.BeginModify();
 
     // The next lines contain four items each, separated by white
     // spaces: the atom type, and the coordinates of the atom
-    vector<string> vs;
-    for (unsigned int i = 1; i <= natoms; i ++)
+    vector<OBLineRef> vs;
+    for (int i = 1; i <= natoms; i ++)
       {
-        if (!ifs.getline(buffer,BUFF_SIZE))
+        if (!reader.GetLine(line))
           {
             errorMsg << "Problems reading an XYZ file: "
                      << "Could not read line #" << i+2 << ", file error." << endl
@@ -176,12 +310,12 @@ namespace OpenBabel
             obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
             return(false);
           }
-        tokenize(vs,buffer);
+        line.Tokenize(vs);
         if (vs.size() < 4) // ignore extra columns which some applications add
           {
             errorMsg << "Problems reading an XYZ file: "
                      << "Could not read line #" << i+2 << "." << endl
-                     << "OpenBabel found the line '" << buffer << "'" << endl
+                     << "OpenBabel found the line '" << line.Str() << "'" << endl
                      << "According to the specifications, this line should contain exactly 4 entries, separated by white space." << endl
                      << "However, OpenBabel found " << vs.size() << " items.";
 
@@ -198,79 +332,47 @@ namespace OpenBabel
         // something "special" in mind.
         OBAtom *atom  = mol.NewAtom();
 
-        int atomicNum = OBElements::GetAtomicNum(vs[0].c_str());
+        string symbol = vs[0].Str();
+        int atomicNum = OBElements::GetAtomicNum(symbol.c_str());
         //set atomic number, or '0' if the atom type is not recognized
         if (atomicNum == 0) {
           // Sometimes people call this an XYZ file, but it's actually Unichem
           // i.e., the first column is the atomic number, not a symbol
           // so we'll first check if we can convert this to an element number
-          atomicNum = atoi(vs[0].c_str());
+          atomicNum = atoi(symbol.c_str());
         }
 
         atom->SetAtomicNum(atomicNum);
         if (atomicNum == 0) // still strange, try using an atom type
-          atom->SetType(vs[0]);
+          atom->SetType(symbol);
 
         // Read the atom coordinates
-        char *endptr;
-        double x = strtod((char*)vs[1].c_str(),&endptr);
-        if (endptr == (char*)vs[1].c_str())
-          {
-            errorMsg << "Problems reading an XYZ file: "
-                     << "Could not read line #" << i+2 << "." << endl
-                     << "OpenBabel found the line '" << buffer << "'" << endl
-                     << "According to the specifications, this line should contain exactly 4 entries, separated by white space." << endl
-                     << "OpenBabel could not interpret item #1 as a number.";
-
-            obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
-            return(false);
-          }
-        double y = strtod((char*)vs[2].c_str(),&endptr);
-        if (endptr == (char*)vs[2].c_str())
-          {
-            errorMsg << "Problems reading an XYZ file: "
-                     << "Could not read line #" << i+2 << "." << endl
-                     << "OpenBabel found the line '" << buffer << "'" << endl
-                     << "According to the specifications, this line should contain exactly 4 entries, separated by white space." << endl
-                     << "OpenBabel could not interpret item #2 as a number.";
-
-            obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
-            return(false);
-          }
-        double z = strtod((char*)vs[3].c_str(),&endptr);
-        if (endptr == (char*)vs[3].c_str())
-          {
-            errorMsg << "Problems reading an XYZ file: "
-                     << "Could not read line #" << i+2 << "." << endl
-                     << "OpenBabel found the line '" << buffer << "'" << endl
-                     << "According to the specifications, this line should contain exactly 4 entries, separated by white space." << endl
-                     << "OpenBabel could not interpret item #3 as a number.";
-
-            obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
-            return(false);
-          }
-        atom->SetVector(x,y,z); //set coordinates
+        double coords[3];
+        for (unsigned int j = 0; j < 3; ++j)
+          if (!vs[j + 1].ToDouble(coords[j]))
+            {
+              errorMsg << "Problems reading an XYZ file: "
+                       << "Could not read line #" << i+2 << "." << endl
+                       << "OpenBabel found the line '" << line.Str() << "'" << endl
+                       << "According to the specifications, this line should contain exactly 4 entries, separated by white space." << endl
+                       << "OpenBabel could not interpret item #" << j + 1 << " as a number.";
+
+              obErrorLog.ThrowError(__FUNCTION__, errorMsg.str() , obWarning);
+              return(false);
+            }
+        atom->SetVector(coords[0], coords[1], coords[2]); //set coordinates
 
         // OK, sometimes there's sym x y z charge -- accepted by Jmol
         if (vs.size() > 5) {
-          string::size_type decimal = vs[4].find('.');
-          if (decimal !=string::npos) { // period found
-            double charge = strtod((char*)vs[4].c_str(),&endptr);
-            if (endptr != (char*)vs[4].c_str())
-              atom->SetPartialCharge(charge);
-          }
+          double charge;
+          if (vs[4].FindFirstOf(".") != string::npos // period found
+              && vs[4].ToDouble(charge))
+            atom->SetPartialCharge(charge);
         } // attempt to parse charges
       }
 
     // clean out any remaining blank lines
-    std::streampos ipos;
-    do
-    {
-      ipos = ifs.tellg();
-      ifs.getline(buffer,BUFF_SIZE);
-    }
-    while(strlen(buffer) == 0 && !ifs.eof() );
-    ifs.seekg(ipos);
+    SkipBlankLines(ifs);
 
     if (!pConv->IsOption("b",OBConversion::INOPTIONS))
       mol.ConnectTheDots();
@@ -21,6 +21,8 @@ GNU General Public License for more details.
 
 #include <string>
 #include <set>
+#include <algorithm>
+#include <cstring>
 
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
@@ -234,6 +236,152 @@ namespace OpenBabel
     OBGenericData("PairData", OBGenericDataType::PairData)
   { }
 
+  //
+  //member functions for OBPropertyBlockData class
+  //
+
+  OBPropertyBlockData::OBPropertyBlockData() :
+    OBGenericData("PropertyBlock", OBGenericDataType::PropertyBlockData, fileformatInput),
+    _indexed(false)
+  { }
+
+  //! \return whether the text from \p b to \p e has only white space, as for Trim()
+  static bool IsBlank(const char *b, const char *e)
+  {
+    for (; b != e; ++b)
+      if (*b != ' ' && *b != '\t' && *b != '\r' && *b != '\n')
+        return false;
+    return true;
+  }
+
+  //! Finds the items as MDLFormat::ReadPropertyLines() does: a line with a '<'
+  //! starts an item, whose value is in the following lines up to a blank one.
+  void OBPropertyBlockData::Index()
+  {
+    if (_indexed)
+      return;
+    _indexed = true;
+    const string::size_type n = _block.size();
+    string::size_type pos = 0;
+    while (pos < n) {
+      string::size_type eol = _block.find('\n', pos);
+      if (eol == string::npos)
+        eol = n;
+      string::size_type lt = _block.find('<', pos);
+      if (lt >= eol) { // not an item
+        pos = eol + 1;
+        continue;
+      }
+      Item item;
+      item.attrBegin = lt + 1;
+      string::size_type rt = eol > pos ? _block.find_last_of('>', eol - 1) : string::npos;
+      item.attrEnd = (rt == string::npos || rt < item.attrBegin) ? eol : rt;
+      item.extracted = false;
+      pos = item.valueBegin = item.valueEnd = eol + 1;
+      while (pos < n) {
+        eol = _block.find('\n', pos);
+        if (eol == string::npos)
+          eol = n;
+        const char *line = _block.data() + pos;
+        pos = eol + 1;
+        if (IsBlank(line, _block.data() + eol))
+          break;
+        item.valueEnd = eol;
+      }
+      item.valueBegin = min(item.valueBegin, n);
+      item.valueEnd = max(min(item.valueEnd, n), item.valueBegin);
+      _items.push_back(item);
+    }
+  }
+
+  unsigned int OBPropertyBlockData::NumItems()
+  {
+    Index();
+    return static_cast<unsigned int>(_items.size());
+  }
+
+  bool OBPropertyBlockData::IsExtracted(unsigned int i)
+  {
+    Index();
+    return i >= _items.size() || _items[i].extracted;
+  }
+
+  std::string OBPropertyBlockData::GetItemAttribute(unsigned int i)
+  {
+    Index();
+    if (i >= _items.size())
+      return string();
+    return _block.substr(_items[i].attrBegin, _items[i].attrEnd - _items[i].attrBegin);
+  }
+
+  std::string OBPropertyBlockData::GetItemValue(unsigned int i)
+  {
+    Index();
+    string value;
+    if (i >= _items.size())
+      return value;
+    // each line trimmed, joined with newlines
+    const char *p = _block.data() + _items[i].valueBegin;
+    const char *end = _block.data() + _items[i].valueEnd;
+    while (p < end) {
+      const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (!eol)
+        eol = end;
+      const char *b = p, *e = eol;
+      while (b != e && IsBlank(b, b + 1))
+        ++b;
+      while (e != b && IsBlank(e - 1, e))
+        --e;
+      if (!value.empty())
+        value += '\n';
+      value.append(b, e);
+      p = eol + 1;
+    }
+    return value;
+  }
+
+  std::vector<OBPairData*> OBPropertyBlockData::ExtractThrough(const char *attr)
+  {
+    Index();
+    vector<OBPairData*> items;
+    const size_t len = strlen(attr);
+    for (unsigned int i = 0; i < _items.size(); ++i) {
+      const Item &item = _items[i];
+      if (item.extracted || item.attrEnd - item.attrBegin != len
+          || _block.compare(item.attrBegin, len, attr) != 0)
+        continue;
+      for (unsigned int j = 0; j <= i; ++j) {
+        if (_items[j].extracted)
+          continue;
+        OBPairData *dp = new OBPairData;
+        dp->SetAttribute(GetItemAttribute(j));
+        dp->SetValue(GetItemValue(j));
+        dp->SetOrigin(fileformatInput);
+        _items[j].extracted = true;
+        items.push_back(dp);
+      }
+      break;
+    }
+    return items;
+  }
+
+  std::vector<OBPairData*> OBPropertyBlockData::ExtractAll()
+  {
+    Index();
+    vector<OBPairData*> items;
+    for (unsigned int i = 0; i < _items.size(); ++i) {
+      if (_items[i].extracted)
+        continue;
+      OBPairData *dp = new OBPairData;
+      dp->SetAttribute(GetItemAttribute(i));
+      dp->SetValue(GetItemValue(i));
+      dp->SetOrigin(fileformatInput);
+      _items[i].extracted = true;
+      items.push_back(dp);
+    }
+    return items;
+  }
+
   //
   //member functions for OBVirtualBond class
   //
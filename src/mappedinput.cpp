@@ -0,0 +1,372 @@
+/**********************************************************************
+mappedinput.cpp - Memory-mapped input files and line-by-line reading
+                  without copying
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <openbabel/babelconfig.h>
+#include <openbabel/mappedinput.h>
+
+#include <iostream>
+#include <openbabel/lineend.h>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef HAVE_SYS_MMAN_H
+  #include <sys/mman.h>
+  #include <sys/types.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace OpenBabel
+{
+  OBLineRef OBLineRef::Substr(size_t pos, size_t n) const
+  {
+    if (pos >= _size)
+      return OBLineRef(_data + _size, 0);
+    if (n > _size - pos)
+      n = _size - pos;
+    return OBLineRef(_data + pos, n);
+  }
+
+  size_t OBLineRef::FindFirstOf(const char *chars, size_t pos) const
+  {
+    for (; pos < _size; ++pos)
+      if (strchr(chars, _data[pos]) && _data[pos] != '\0')
+        return pos;
+    return string::npos;
+  }
+
+  bool OBLineRef::StartsWith(const char *prefix) const
+  {
+    size_t n = strlen(prefix);
+    return n <= _size && memcmp(_data, prefix, n) == 0;
+  }
+
+  OBLineRef OBLineRef::Trim() const
+  {
+    const char *white = " \t\n\r";
+    size_t first = 0, last = _size;
+    while (first < last && strchr(white, _data[first]) && _data[first] != '\0')
+      ++first;
+    while (last > first && strchr(white, _data[last - 1]) && _data[last - 1] != '\0')
+      --last;
+    return OBLineRef(_data + first, last - first);
+  }
+
+  void OBLineRef::Tokenize(vector<OBLineRef> &tokens, const char *delimiters) const
+  {
+    tokens.clear();
+    size_t i = 0;
+    for (;;) {
+      while (i < _size && strchr(delimiters, _data[i]) && _data[i] != '\0')
+        ++i;
+      if (i == _size)
+        break;
+      size_t start = i;
+      while (i < _size && !(strchr(delimiters, _data[i]) && _data[i] != '\0'))
+        ++i;
+      tokens.push_back(OBLineRef(_data + start, i - start));
+    }
+  }
+
+  // The characters are copied to null-terminate them; numbers are short, so
+  // the copy is usually on the stack
+  bool OBLineRef::ToDouble(double &value) const
+  {
+    char buffer[64];
+    string copy;
+    const char *s = buffer;
+    if (_size < sizeof(buffer)) {
+      memcpy(buffer, _data, _size);
+      buffer[_size] = '\0';
+    } else {
+      copy = Str();
+      s = copy.c_str();
+    }
+    char *end;
+    value = strtod(s, &end);
+    return end != s;
+  }
+
+  bool OBLineRef::ToInt(int &value) const
+  {
+    char buffer[64];
+    string copy;
+    const char *s = buffer;
+    if (_size < sizeof(buffer)) {
+      memcpy(buffer, _data, _size);
+      buffer[_size] = '\0';
+    } else {
+      copy = Str();
+      s = copy.c_str();
+    }
+    char *end;
+    value = static_cast<int>(strtol(s, &end, 10));
+    return end != s;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+
+  OBMappedStreambuf::OBMappedStreambuf() : _data(NULL), _size(0)
+  {
+    setg(NULL, NULL, NULL);
+  }
+
+  OBMappedStreambuf::~OBMappedStreambuf()
+  {
+    Close();
+  }
+
+  bool OBMappedStreambuf::Open(const string &filename)
+  {
+    Close();
+#ifdef HAVE_SYS_MMAN_H
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    // empty files cannot be mapped; pipes and devices have no fixed size
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+      close(fd);
+      return false;
+    }
+    void *data = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (data == MAP_FAILED)
+      return false;
+  #ifdef MADV_SEQUENTIAL
+    madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+  #endif
+    // the mapping is read-only: the get area is never written to, since
+    // putback of a different character fails in pbackfail()
+    _data = static_cast<char*>(data);
+    _size = static_cast<size_t>(st.st_size);
+    setg(_data, _data, _data + _size);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void OBMappedStreambuf::Close()
+  {
+#ifdef HAVE_SYS_MMAN_H
+    if (_data)
+      munmap(_data, _size);
+#endif
+    _data = NULL;
+    _size = 0;
+    setg(NULL, NULL, NULL);
+  }
+
+  bool OBMappedStreambuf::GetLine(OBLineRef &line, bool &terminated)
+  {
+    const char *start = gptr(), *end = egptr();
+    if (start >= end)
+      return false;
+
+    const char *nl = static_cast<const char*>(memchr(start, '\n', end - start));
+    const char *lineEnd = nl ? nl : end;
+    const char *cr = static_cast<const char*>(memchr(start, '\r', lineEnd - start));
+    const char *next;
+    if (cr) { // "\r\n" or an old Mac "\r"
+      lineEnd = cr;
+      next = (cr + 1 < end && cr[1] == '\n') ? cr + 2 : cr + 1;
+      terminated = true;
+    }
+    else if (nl) {
+      next = nl + 1;
+      terminated = true;
+    }
+    else {
+      next = end;
+      terminated = false;
+    }
+    line = OBLineRef(start, lineEnd - start);
+    gbump(static_cast<int>(next - start));
+    return true;
+  }
+
+  streampos OBMappedStreambuf::seekoff(streamoff off, ios_base::seekdir way,
+                                       ios_base::openmode which)
+  {
+    if (!_data || !(which & ios_base::in))
+      return streampos(streamoff(-1));
+    streamoff pos;
+    if (way == ios_base::beg)
+      pos = off;
+    else if (way == ios_base::cur)
+      pos = (gptr() - eback()) + off;
+    else
+      pos = static_cast<streamoff>(_size) + off;
+    if (pos < 0 || pos > static_cast<streamoff>(_size))
+      return streampos(streamoff(-1));
+    setg(_data, _data + pos, _data + _size);
+    return streampos(pos);
+  }
+
+  streampos OBMappedStreambuf::seekpos(streampos sp, ios_base::openmode which)
+  {
+    return seekoff(streamoff(sp), ios_base::beg, which);
+  }
+
+  //////////////////////////////////////////////////////////////////////
+
+  OBMappedInStream::OBMappedInStream() : istream(NULL)
+  {
+  }
+
+  OBMappedInStream::OBMappedInStream(const string &filename) : istream(NULL)
+  {
+    Open(filename);
+  }
+
+  bool OBMappedInStream::Open(const string &filename)
+  {
+    if (_buf.Open(filename)) {
+      rdbuf(&_buf); // also clears the state
+      return true;
+    }
+    rdbuf(NULL);
+    return false;
+  }
+
+  void OBMappedInStream::Close()
+  {
+    _buf.Close();
+    rdbuf(NULL);
+  }
+
+  //////////////////////////////////////////////////////////////////////
+
+  typedef FilteringInputStreambuf<LineEndingExtractor> LEStreambuf;
+
+  // std::getline() which also ends a line at "\r" and "\r\n", as
+  // LineEndingExtractor does, for a stream without the line ending filter
+  static bool GetLineAnyEnding(istream &is, string &line)
+  {
+    line.clear();
+    istream::sentry se(is, true);
+    if (!se)
+      return false;
+    streambuf *sb = is.rdbuf();
+    const int eof = char_traits<char>::eof();
+    for (;;) {
+      int c = sb->sbumpc();
+      if (c == eof) {
+        is.setstate(line.empty() ? ios_base::eofbit | ios_base::failbit : ios_base::eofbit);
+        break;
+      }
+      if (c == '\n')
+        break;
+      if (c == '\r') {
+        if (sb->sgetc() == '\n')
+          sb->sbumpc();
+        break;
+      }
+      line += static_cast<char>(c);
+    }
+    return !is.fail();
+  }
+
+  OBLineReader::OBLineReader(istream &is) : _is(is), _mapped(NULL), _filter(NULL), _raw(false)
+  {
+    streambuf *sb = is.rdbuf();
+    _mapped = dynamic_cast<OBMappedStreambuf*>(sb);
+    if (!_mapped) {
+      LEStreambuf *le = dynamic_cast<LEStreambuf*>(sb);
+      if (le && le->GetSource()) {
+        _mapped = dynamic_cast<OBMappedStreambuf*>(le->GetSource()->rdbuf());
+        if (_mapped)
+          _filter = le;
+      }
+      _raw = !_mapped && !le;
+    }
+  }
+
+  bool OBLineReader::GetLine(OBLineRef &line)
+  {
+    if (!_mapped) {
+      if (!(_raw ? GetLineAnyEnding(_is, _line) : static_cast<bool>(std::getline(_is, _line))))
+        return false;
+      line = OBLineRef(_line.data(), _line.size());
+      return true;
+    }
+
+    if (!_is.good()) {
+      _is.setstate(ios_base::failbit);
+      return false;
+    }
+    if (_filter && _filter->in_avail() > 0) {
+      // A character read ahead by the filter, e.g. by a peek() on the
+      // stream (see mappedinputtest). It is taken from the mapping unless
+      // it is a newline translated from "\r".
+      int c = _filter->sbumpc();
+      if (c == '\n') {
+        line = OBLineRef();
+        return true;
+      }
+      _mapped->sungetc();
+    }
+
+    bool terminated;
+    if (!_mapped->GetLine(line, terminated)) {
+      _is.setstate(ios_base::eofbit | ios_base::failbit);
+      return false;
+    }
+    if (!terminated)
+      _is.setstate(ios_base::eofbit);
+    return true;
+  }
+
+  bool OBLineReader::GetLine(string &line)
+  {
+    if (!_mapped)
+      return _raw ? GetLineAnyEnding(_is, line) : static_cast<bool>(std::getline(_is, line));
+    OBLineRef ref;
+    if (!GetLine(ref))
+      return false;
+    line.assign(ref.Data(), ref.Size());
+    return true;
+  }
+
+  bool OBLineReader::GetLine(char *buffer, size_t size)
+  {
+    if (!_mapped && !_raw)
+      return static_cast<bool>(_is.getline(buffer, size));
+    OBLineRef ref;
+    if (size == 0 || !GetLine(ref)) {
+      if (size)
+        buffer[0] = '\0';
+      return false;
+    }
+    size_t n = ref.Size();
+    if (n >= size) {
+      n = size - 1;
+      _is.setstate(ios_base::failbit);
+    }
+    memcpy(buffer, ref.Data(), n);
+    buffer[n] = '\0';
+    return !_is.fail();
+  }
+
+} // end namespace OpenBabel
+
+//! \file mappedinput.cpp
+//! \brief Memory-mapped input files and line-by-line reading without copying
@@ -20,6 +20,7 @@ GNU General Public License for more details.
 
 #include <vector>
 #include <climits> // UINT_MAX
+#include <algorithm>
 
 #include <openbabel/math/align.h>
 #include <openbabel/atom.h>
@@ -76,6 +77,13 @@ namespace OpenBabel
       coords.col(colm) = Eigen::Vector3d( it->AsArray() );
   }
 
+  template<typename T>
+  void OBAlign::ArrayToMatrix(const T *coords, unsigned int numAtoms, Eigen::MatrixXd &mcoords) {
+    // The storage of mcoords is only reallocated if the size changes
+    mcoords.resize(3, numAtoms);
+    mcoords = Eigen::Map<const Eigen::Matrix<T, 3, Eigen::Dynamic> >(coords, 3, numAtoms).template cast<double>();
+  }
+
   Eigen::Vector3d OBAlign::MoveToOrigin(Eigen::MatrixXd &coords) {
 
     vector<vector3>::size_type N = coords.cols();
@@ -106,6 +114,38 @@ namespace OpenBabel
     _ready = false;
   }
 
+  void OBAlign::SetRef(const double *coords, unsigned int numAtoms) {
+    _pref = NULL;
+    ArrayToMatrix(coords, numAtoms, _mref);
+    _ref_centr = MoveToOrigin(_mref);
+
+    _ready = false;
+  }
+
+  void OBAlign::SetRef(const float *coords, unsigned int numAtoms) {
+    _pref = NULL;
+    ArrayToMatrix(coords, numAtoms, _mref);
+    _ref_centr = MoveToOrigin(_mref);
+
+    _ready = false;
+  }
+
+  void OBAlign::SetTarget(const double *coords, unsigned int numAtoms) {
+    _ptarget = NULL;
+    ArrayToMatrix(coords, numAtoms, _mtarget);
+    _target_centr = MoveToOrigin(_mtarget);
+
+    _ready = false;
+  }
+
+  void OBAlign::SetTarget(const float *coords, unsigned int numAtoms) {
+    _ptarget = NULL;
+    ArrayToMatrix(coords, numAtoms, _mtarget);
+    _target_centr = MoveToOrigin(_mtarget);
+
+    _ready = false;
+  }
+
   void OBAlign::SetRefMol(const OBMol &refmol) {
     _prefmol = &refmol;
 
@@ -131,8 +171,26 @@ namespace OpenBabel
     }
     SetRef(_refmol_coords);
 
+    _autcols.clear();
     if (_symmetry) {
       FindAutomorphisms((OBMol*)&refmol, _aut, _frag_atoms);
+
+      // Generate the column permutation of each automorphism once. For
+      // example, map(213465) will be converted to (102354).
+      _autcols.resize(_aut.size());
+      for (unsigned int k = 0; k < _aut.size(); ++k) {
+        for (unsigned int j = 1; j <= refmol.NumAtoms(); ++j) {
+          if (!_frag_atoms.BitIsSet(j))
+            continue;
+          unsigned int col = _autcols[k].size();
+          for (std::size_t l = 0; l < _aut[k].size(); ++l)
+            if (_aut[k][l].first == j - 1) {
+              col = _newidx[_aut[k][l].second];
+              break;
+            }
+          _autcols[k].push_back(col);
+        }
+      }
     }
   }
 
@@ -154,7 +212,7 @@ namespace OpenBabel
 
 /* Evaluates the Newton-Raphson correction for the Horn quartic.
    only 11 FLOPs */
-  static double eval_horn_NR_corrxn(const vector<double> &c, const double x)
+  static double eval_horn_NR_corrxn(const double *c, const double x)
   {
     double x2 = x*x;
     double b = (x2 + c[2])*x;
@@ -164,7 +222,7 @@ namespace OpenBabel
   }
 
   /* Newton-Raphson root finding */
-  static double QCProot(const vector<double> &coeff, double guess, const double delta)
+  static double QCProot(const double *coeff, double guess, const double delta)
   {
     int             i;
     double          oldg;
@@ -183,31 +241,25 @@ namespace OpenBabel
     return initialg + 1.0; // Failed to converge!
   }
 
-  vector<double> CalcQuarticCoeffs(const Eigen::Matrix3d &M)
+  /* The coefficients of the quartic (c[0] + c[1] x + c[2] x^2 + x^4)
+     for the 3x3 matrix M stored by rows */
+  static void CalcQuarticCoeffs(const double *M, double *coeff)
   {
-    vector<double> coeff(4);
-
     double          Sxx, Sxy, Sxz, Syx, Syy, Syz, Szx, Szy, Szz;
     double          Szz2, Syy2, Sxx2, Sxy2, Syz2, Sxz2, Syx2, Szy2, Szx2,
                     SyzSzymSyySzz2, Sxx2Syy2Szz2Syz2Szy2, Sxy2Sxz2Syx2Szx2,
                     SxzpSzx, SyzpSzy, SxypSyx, SyzmSzy,
                     SxzmSzx, SxymSyx, SxxpSyy, SxxmSyy;
 
-#ifdef HAVE_EIGEN3
-    Eigen::MatrixXd M_sqr = M.array().square();
-#else
-    Eigen::MatrixXd M_sqr = M.cwise().square();
-#endif
-
-    Sxx = M(0, 0);
-    Sxy = M(1, 0);
-    Sxz = M(2, 0);
-    Syx = M(0, 1);
-    Syy = M(1, 1);
-    Syz = M(2, 1);
-    Szx = M(0, 2);
-    Szy = M(1, 2);
-    Szz = M(2, 2);
+    Sxx = M[0];
+    Sxy = M[3];
+    Sxz = M[6];
+    Syx = M[1];
+    Syy = M[4];
+    Syz = M[7];
+    Szx = M[2];
+    Szy = M[5];
+    Szz = M[8];
 
     Sxx2 = Sxx * Sxx;
     Syy2 = Syy * Syy;
@@ -226,8 +278,7 @@ namespace OpenBabel
 
     /* coeff[4] = 1.0; */
     /* coeff[3] = 0.0; */
-    // coeff[2] = -2.0 * (Sxx2 + Syy2 + Szz2 + Sxy2 + Syx2 + Sxz2 + Szx2 + Syz2 + Szy2);
-    coeff[2] = -2.0 * M_sqr.sum();
+    coeff[2] = -2.0 * (Sxx2 + Syy2 + Szz2 + Sxy2 + Syx2 + Sxz2 + Szx2 + Syz2 + Szy2);
     coeff[1] = 8.0 * (Sxx*Syz*Szy + Syy*Szx*Sxz + Szz*Sxy*Syx - Sxx*Syy*Szz - Syz*Szx*Sxy - Szy*Syx*Sxz);
 
     SxzpSzx = Sxz+Szx;
@@ -246,7 +297,16 @@ namespace OpenBabel
              + (-(SxzpSzx)*(SyzpSzy)-(SxypSyx)*(SxxpSyy-Szz)) * (-(SxzmSzx)*(SyzmSzy)-(SxypSyx)*(SxxpSyy+Szz))
              + (+(SxypSyx)*(SyzpSzy)+(SxzpSzx)*(SxxmSyy+Szz)) * (-(SxymSyx)*(SyzmSzy)+(SxzpSzx)*(SxxpSyy+Szz))
              + (+(SxypSyx)*(SyzmSzy)+(SxzmSzx)*(SxxmSyy-Szz)) * (-(SxymSyx)*(SyzpSzy)+(SxzmSzx)*(SxxpSyy-Szz));
+  }
 
+  vector<double> CalcQuarticCoeffs(const Eigen::Matrix3d &M)
+  {
+    vector<double> coeff(4);
+    double m[9];
+    for (int r = 0; r < 3; ++r)
+      for (int c = 0; c < 3; ++c)
+        m[3 * r + c] = M(r, c);
+    CalcQuarticCoeffs(m, &coeff[0]);
     return coeff;
   }
 
@@ -259,7 +319,7 @@ namespace OpenBabel
     double innerprod = mtarget.squaredNorm() + _mref.squaredNorm();
 
     vector<double> coeffs = CalcQuarticCoeffs(M);
-    double lambdamax = QCProot(coeffs, 0.5 * innerprod, 1e-6);
+    double lambdamax = QCProot(&coeffs[0], 0.5 * innerprod, 1e-6);
     if (lambdamax > (0.5 * innerprod))
       _fail = true;
     else {
@@ -302,16 +362,35 @@ namespace OpenBabel
 
   }
 
+  double OBAlign::PermutedSquaredDeviation(const vector<unsigned int> &cols)
+  {
+    // Covariance matrix C = X times Y(t) where the columns of Y are permuted
+    Eigen::Matrix3d C = Eigen::Matrix3d::Zero();
+    for (unsigned int i = 0; i < cols.size(); ++i)
+      C += _mref.col(i) * _mtarget.col(cols[i]).transpose();
+
+    // The squared deviation after the optimal rotation follows from the
+    // singular values of C (the rotation itself is not needed)
+#ifdef HAVE_EIGEN3
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(C);
+#else
+    Eigen::SVD<Eigen::Matrix3d> svd(C);
+#endif
+    Eigen::Vector3d sv = svd.singularValues();
+    double sign = (C.determinant() > 0) ? 1. : -1.;
+    return _mref.squaredNorm() + _mtarget.squaredNorm() - 2.0 * (sv(0) + sv(1) + sign * sv(2));
+  }
+
   bool OBAlign::Align()
   {
-    vector<vector3>::size_type N = _ptarget->size();
+    Eigen::MatrixXd::Index N = _mtarget.cols();
 
-    if (_pref->size() != N) {
+    if (_mref.cols() != N) {
       obErrorLog.ThrowError(__FUNCTION__, "Cannot align the reference and target as they are of different size" , obError);
       return false;
     }
 
-    if (!_symmetry || _aut.size() == 1) {
+    if (!_symmetry || _autcols.size() <= 1 || _autcols[0].size() != (std::size_t)N) {
       if (_method == OBAlign::Kabsch)
         SimpleAlign(_mtarget);
       else
@@ -319,42 +398,27 @@ namespace OpenBabel
     }
     else {  // Iterate over the automorphisms
 
-      // ...for storing the results from the lowest rmsd to date
-      double min_rmsd = DBL_MAX;
-      Eigen::MatrixXd result, rotMatrix;
-
-      // Try all of the symmetry-allowed permutations
-      OBIsomorphismMapper::Mappings::const_iterator cit;
-      Eigen::MatrixXd mtarget(_mtarget.rows(), _mtarget.cols());
-
-      for (unsigned int k = 0; k < _aut.size(); ++k) {
-        // Rearrange columns of _mtarget for this permutation
-        unsigned int i=0;
-        for (unsigned int j=1; j<=_prefmol->NumAtoms(); ++j) {
-          if (_frag_atoms.BitIsSet(j)) {
-            for (std::size_t l = 0; l < _aut[k].size(); ++l)
-              if (_aut[k][l].first == j - 1) {
-                mtarget.col(i) = _mtarget.col(_newidx[_aut[k][l].second]);
-                break;
-              }
-            i++;
-          }
-        }
-        if (_method == OBAlign::Kabsch)
-          SimpleAlign(mtarget);
-        else
-          TheobaldAlign(mtarget);
-        if (_rmsd < min_rmsd) {
-          min_rmsd = _rmsd;
-          result = _result;
-          rotMatrix = _rotMatrix;
+      // Find the symmetry-allowed permutation with the lowest RMSD without
+      // copying the target or computing the aligned coordinates...
+      double min_sqrdev = DBL_MAX;
+      unsigned int best = 0;
+      for (unsigned int k = 0; k < _autcols.size(); ++k) {
+        double sqrdev = PermutedSquaredDeviation(_autcols[k]);
+        if (sqrdev < min_sqrdev) {
+          min_sqrdev = sqrdev;
+          best = k;
         }
       }
 
-      // Restore the best answer from memory
-      _rmsd = min_rmsd;
-      _result = result;
-      _rotMatrix = rotMatrix;
+      // ...and then align the target rearranged for this permutation
+      const vector<unsigned int> &cols = _autcols[best];
+      _mtarget_perm.resize(3, N);
+      for (Eigen::MatrixXd::Index i = 0; i < N; ++i)
+        _mtarget_perm.col(i) = _mtarget.col(cols[i]);
+      if (_method == OBAlign::Kabsch)
+        SimpleAlign(_mtarget_perm);
+      else
+        TheobaldAlign(_mtarget_perm);
     }
 
     _ready = true;
@@ -451,6 +515,217 @@ namespace OpenBabel
     return _rmsd;
   }
 
+  ////////////////////////////////////////////////////////////////
+  // OBRMSDMatrix
+
+  OBRMSDMatrix::OBRMSDMatrix(unsigned int numAtoms) : _numAtoms(numAtoms),
+    _numConformers(0), _stride((numAtoms + 3) & ~3u), _nthreads(1)
+  {
+  }
+
+  void OBRMSDMatrix::Clear()
+  {
+    _numConformers = 0;
+    _coords.clear();
+    _innerprod.clear();
+    _perms.clear();
+  }
+
+  unsigned int OBRMSDMatrix::AddConformer(const double *coords)
+  {
+    // Store the conformer as blocks of x, y and z coordinates so that the
+    // loop in SquaredDeviation() can be vectorized. The padding is zero
+    // and does not contribute to the sums.
+    _coords.resize((std::size_t)3 * _stride * (_numConformers + 1), 0.0);
+    double *x = &_coords[(std::size_t)3 * _stride * _numConformers];
+    double *y = x + _stride;
+    double *z = y + _stride;
+
+    double centroid[3] = {0.0, 0.0, 0.0};
+    for (unsigned int k = 0; k < _numAtoms; ++k)
+      for (unsigned int c = 0; c < 3; ++c)
+        centroid[c] += coords[3 * k + c];
+    if (_numAtoms)
+      for (unsigned int c = 0; c < 3; ++c)
+        centroid[c] /= _numAtoms;
+
+    double innerprod = 0.0;
+    for (unsigned int k = 0; k < _numAtoms; ++k) {
+      x[k] = coords[3 * k] - centroid[0];
+      y[k] = coords[3 * k + 1] - centroid[1];
+      z[k] = coords[3 * k + 2] - centroid[2];
+      innerprod += x[k] * x[k] + y[k] * y[k] + z[k] * z[k];
+    }
+    _innerprod.push_back(innerprod);
+
+    return _numConformers++;
+  }
+
+  unsigned int OBRMSDMatrix::AddConformer(const std::vector<vector3> &coords)
+  {
+    if (!_numConformers && !_numAtoms) {
+      _numAtoms = coords.size();
+      _stride = (_numAtoms + 3) & ~3u;
+    }
+    if (coords.size() != _numAtoms) {
+      obErrorLog.ThrowError(__FUNCTION__, "The conformer has a different number of atoms than the previous ones", obError);
+      return UINT_MAX;
+    }
+
+    vector<double> xyz(3 * _numAtoms);
+    for (unsigned int k = 0; k < _numAtoms; ++k) {
+      xyz[3 * k] = coords[k].x();
+      xyz[3 * k + 1] = coords[k].y();
+      xyz[3 * k + 2] = coords[k].z();
+    }
+    return AddConformer(_numAtoms ? &xyz[0] : NULL);
+  }
+
+  void OBRMSDMatrix::AddConformers(OBMol &mol, bool includeH)
+  {
+    vector<unsigned int> atoms;
+    FOR_ATOMS_OF_MOL(a, mol)
+      if (includeH || a->GetAtomicNum() != OBElements::Hydrogen)
+        atoms.push_back(a->GetIdx() - 1);
+
+    if (!_numConformers && !_numAtoms) {
+      _numAtoms = atoms.size();
+      _stride = (_numAtoms + 3) & ~3u;
+    }
+    if (atoms.size() != _numAtoms) {
+      obErrorLog.ThrowError(__FUNCTION__, "The molecule has a different number of atoms than the previous conformers", obError);
+      return;
+    }
+
+    vector<double> xyz(3 * _numAtoms);
+    for (int i = 0; i < mol.NumConformers(); ++i) {
+      const double *coords = mol.GetConformer(i);
+      for (unsigned int k = 0; k < _numAtoms; ++k)
+        for (unsigned int c = 0; c < 3; ++c)
+          xyz[3 * k + c] = coords[3 * atoms[k] + c];
+      AddConformer(_numAtoms ? &xyz[0] : NULL);
+    }
+  }
+
+  void OBRMSDMatrix::RemoveLastConformer()
+  {
+    if (!_numConformers)
+      return;
+    _numConformers--;
+    _coords.resize((std::size_t)3 * _stride * _numConformers);
+    _innerprod.pop_back();
+  }
+
+  void OBRMSDMatrix::AddPermutation(const std::vector<unsigned int> &perm)
+  {
+    if (perm.size() != _numAtoms) {
+      obErrorLog.ThrowError(__FUNCTION__, "The permutation has a different number of atoms than the conformers", obError);
+      return;
+    }
+    _perms.push_back(perm);
+  }
+
+  double OBRMSDMatrix::SquaredDeviation(unsigned int i, unsigned int j) const
+  {
+    const double *ax = &_coords[(std::size_t)3 * _stride * i];
+    const double *ay = ax + _stride;
+    const double *az = ay + _stride;
+    const double *bx = &_coords[(std::size_t)3 * _stride * j];
+    const double *by = bx + _stride;
+    const double *bz = by + _stride;
+    const double innerprod = _innerprod[i] + _innerprod[j];
+
+    double best = innerprod;
+    for (unsigned int p = 0; p <= _perms.size(); ++p) {
+      // M = B(t) times A as in OBAlign::TheobaldAlign()
+      double M[9] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+      if (!p) {
+        // four independent partial sums (the stride is a multiple of 4)
+        double S[9][4] = {{0.0}};
+        for (unsigned int k = 0; k < _stride; k += 4)
+          for (unsigned int l = 0; l < 4; ++l) {
+            S[0][l] += bx[k + l] * ax[k + l];
+            S[1][l] += bx[k + l] * ay[k + l];
+            S[2][l] += bx[k + l] * az[k + l];
+            S[3][l] += by[k + l] * ax[k + l];
+            S[4][l] += by[k + l] * ay[k + l];
+            S[5][l] += by[k + l] * az[k + l];
+            S[6][l] += bz[k + l] * ax[k + l];
+            S[7][l] += bz[k + l] * ay[k + l];
+            S[8][l] += bz[k + l] * az[k + l];
+          }
+        for (unsigned int m = 0; m < 9; ++m)
+          M[m] = (S[m][0] + S[m][1]) + (S[m][2] + S[m][3]);
+      } else {
+        const vector<unsigned int> &perm = _perms[p - 1];
+        for (unsigned int k = 0; k < _numAtoms; ++k) {
+          const unsigned int l = perm[k];
+          M[0] += bx[l] * ax[k]; M[1] += bx[l] * ay[k]; M[2] += bx[l] * az[k];
+          M[3] += by[l] * ax[k]; M[4] += by[l] * ay[k]; M[5] += by[l] * az[k];
+          M[6] += bz[l] * ax[k]; M[7] += bz[l] * ay[k]; M[8] += bz[l] * az[k];
+        }
+      }
+
+      double coeffs[3];
+      CalcQuarticCoeffs(M, coeffs);
+      double lambdamax = QCProot(coeffs, 0.5 * innerprod, 1e-11);
+      if (lambdamax > 0.5 * innerprod) {
+        // Newton-Raphson did not converge, use the singular values instead
+        Eigen::Matrix3d m;
+        m << M[0], M[1], M[2], M[3], M[4], M[5], M[6], M[7], M[8];
+        Eigen::JacobiSVD<Eigen::Matrix3d> svd(m);
+        Eigen::Vector3d sv = svd.singularValues();
+        lambdamax = sv(0) + sv(1) + (m.determinant() < 0.0 ? -sv(2) : sv(2));
+      }
+      double sqrdev = innerprod - 2.0 * lambdamax;
+      if (sqrdev < best)
+        best = sqrdev;
+    }
+
+    return best > 0.0 ? best : 0.0;
+  }
+
+  double OBRMSDMatrix::GetRMSD(unsigned int i, unsigned int j) const
+  {
+    if (i >= _numConformers || j >= _numConformers) {
+      obErrorLog.ThrowError(__FUNCTION__, "Conformer index out of range", obError);
+      return HUGE_VAL;
+    }
+    if (i == j || !_numAtoms)
+      return 0.0;
+    return sqrt(SquaredDeviation(i, j) / _numAtoms);
+  }
+
+  void OBRMSDMatrix::GetMatrix(std::vector<double> &condensed, double threshold) const
+  {
+    const unsigned int n = _numConformers;
+    condensed.resize((std::size_t)n * (n > 0 ? n - 1 : 0) / 2);
+    if (!_numAtoms) {
+      std::fill(condensed.begin(), condensed.end(), 0.0);
+      return;
+    }
+
+    // Lower bound: the squared deviation of two centered conformers is at
+    // least (sqrt(Ga) - sqrt(Gb))^2 for any rotation
+    vector<double> norms(n);
+    for (unsigned int i = 0; i < n; ++i)
+      norms[i] = sqrt(_innerprod[i]);
+    const double maxdev = threshold * threshold * _numAtoms;
+
+#ifdef _OPENMP
+    const int nthreads = std::max(1, std::min<int>(_nthreads, n));
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+#endif
+    for (int i = 0; i < (int)n; ++i) {
+      const std::size_t row = (std::size_t)i * (2 * n - i - 1) / 2;
+      for (unsigned int j = i + 1; j < n; ++j) {
+        double bound = norms[i] - norms[j];
+        bound *= bound;
+        condensed[row + j - i - 1] = sqrt((bound > maxdev ? bound : SquaredDeviation(i, j)) / _numAtoms);
+      }
+    }
+  }
+
 } // namespace OpenBabel
 
 //! \file align.cpp
@@ -42,15 +42,19 @@ GNU General Public License for more details.
 #include <limits>
 #include <typeinfo>
 #include <iterator>
+#include <algorithm>
 
 #include <stdlib.h>
 
 #include <openbabel/obconversion.h>
 //#include <openbabel/mol.h>
 #include <openbabel/locale.h>
+#include <openbabel/recordindex.h>
+#include <openbabel/mappedinput.h>
 
 #ifdef HAVE_LIBZ
 #include "zipstream.h"
+#include <openbabel/parallelzip.h>
 #endif
 
 #if !HAVE_STRNCASECMP
@@ -233,7 +237,7 @@ namespace OpenBabel {
     EndNumber(0), Count(-1), m_IsFirstInput(true), m_IsLast(true),
     MoreFilesToCome(false), OneObjectOnly(false), SkippedMolecules(false),
     inFormatGzip(false), outFormatGzip(false),
-    pOb1(NULL),wInpos(0),wInlen(0),pAuxConv(NULL)
+    pOb1(NULL),wInpos(0),wInlen(0),pAuxConv(NULL),pReaderState(NULL)
   {
    	SetInStream(is);
    	SetOutStream(os);
@@ -251,7 +255,7 @@ namespace OpenBabel {
         EndNumber(0), Count(-1), m_IsFirstInput(true), m_IsLast(true),
         MoreFilesToCome(false), OneObjectOnly(false), SkippedMolecules(false),
         inFormatGzip(false), outFormatGzip(false),
-        pOb1(NULL), wInpos(0),wInlen(0), pAuxConv(NULL)
+        pOb1(NULL), wInpos(0),wInlen(0), pAuxConv(NULL), pReaderState(NULL)
   {
     //These options take a parameter
     RegisterOptionParam("f", NULL, 1,GENOPTIONS);
@@ -261,7 +265,7 @@ namespace OpenBabel {
   }
 
   /////////////////////////////////////////////////
-  OBConversion::OBConversion(const OBConversion& o)
+  OBConversion::OBConversion(const OBConversion& o) : pReaderState(NULL)
   {
     *this = o;
   }
@@ -310,6 +314,7 @@ namespace OpenBabel {
 
   OBConversion::~OBConversion()
   {
+    delete pReaderState; // may refer to the input stream
     if(pAuxConv!=this)
       if(pAuxConv)
       {
@@ -320,6 +325,14 @@ namespace OpenBabel {
     SetOutStream(NULL);
 
   }
+  //////////////////////////////////////////////////////
+  void OBConversion::SetReaderState(OBReaderState* pState)
+  {
+    if(pState != pReaderState)
+      delete pReaderState;
+    pReaderState = pState;
+  }
+
   //////////////////////////////////////////////////////
 
   /// Class information on formats is collected by making an instance of the class
@@ -337,10 +350,10 @@ namespace OpenBabel {
   /// If takeOwnership is true, takes responsibility for freeing pIn
   void OBConversion::SetInStream(std::istream* pIn, bool takeOwnership)
   {
-      //clear and deallocate any existing streams
-      for(unsigned i = 0, n = ownedInStreams.size(); i < n; i++)
+      //clear and deallocate any existing streams, each before the stream it reads from
+      for(unsigned i = ownedInStreams.size(); i > 0; i--)
       {
-        delete ownedInStreams[i];
+        delete ownedInStreams[i-1];
       }
       ownedInStreams.clear();
       pInput = NULL;
@@ -354,9 +367,32 @@ namespace OpenBabel {
   #ifdef HAVE_LIBZ
           if(IsOption("zin", GENOPTIONS) || inFormatGzip)
           {
-            zlib_stream::zip_istream *zIn = new zlib_stream::zip_istream(*pInput);
-            ownedInStreams.push_back(zIn);
-            pInput = zIn;
+            bool isFile = dynamic_cast<ifstream*>(pIn) || dynamic_cast<OBMappedInStream*>(pIn);
+            if(OBBgzfStreambuf::IsBGZF(*pInput))
+            {
+              //the blocks are inflated in parallel; seeking uses the .gzi index if there is one
+              OBBgzfInStream *bgzfIn = new OBBgzfInStream(*pInput);
+              ifstream gzi;
+              if(isFile && !InFilename.empty())
+                gzi.open((InFilename + ".gzi").c_str(), ios_base::in | ios_base::binary);
+              if(gzi)
+                bgzfIn->LoadIndex(gzi);
+              ownedInStreams.push_back(bgzfIn);
+              pInput = bgzfIn;
+            }
+            else
+            {
+              zlib_stream::zip_istream *zIn = new zlib_stream::zip_istream(*pInput);
+              ownedInStreams.push_back(zIn);
+              pInput = zIn;
+              //a file is decompressed on another thread, ahead of the parsing
+              if(isFile)
+              {
+                OBReadAheadInStream *raIn = new OBReadAheadInStream(*zIn);
+                ownedInStreams.push_back(raIn);
+                pInput = raIn;
+              }
+            }
           }
   #endif
           //always transform newlines if input isn't binary/xml
@@ -393,9 +429,14 @@ namespace OpenBabel {
 
 #ifdef HAVE_LIBZ
 
-      if (IsOption("z", GENOPTIONS) || outFormatGzip)
+      bool bgzf = IsOption("bgzf", GENOPTIONS) != NULL;
+      if (IsOption("z", GENOPTIONS) || outFormatGzip || bgzf)
       {
-        zlib_stream::zip_ostream *zOut = new zlib_stream::zip_ostream(*pOutput, true);
+        //blocks are compressed in parallel
+        OBParallelZipOutStream *zOut = new OBParallelZipOutStream(*pOutput, bgzf);
+        if (bgzf && dynamic_cast<ofstream*>(pOut) && !OutFilename.empty()
+            && OutFilename.find('*') == string::npos)
+          zOut->SetIndexFile(OutFilename + ".gzi");
         //we need to delete the zstream _before_ the underlying stream so it can add the footer
         ownedOutStreams.insert(ownedOutStreams.begin(),zOut);
         pOutput = zOut;
@@ -615,31 +656,87 @@ namespace OpenBabel {
 
     return Index; //The number actually output
   }
+  //////////////////////////////////////////////////////
+  /// Opens the record index of the input file, building it first if the
+  /// --index option is set. Not available for stdin or compressed input.
+  static bool LoadRecordIndex(OBConversion* pConv, OBRecordIndex& index)
+  {
+    string filename = pConv->GetInFilename();
+    if(filename.empty() || pConv->IsOption("zin", OBConversion::GENOPTIONS)
+       || (filename.size()>3 && filename.substr(filename.size()-3)==".gz"))
+      return false;
+    if(index.Load(filename, pConv->GetInFormat()))
+      return true;
+    return pConv->IsOption("index", OBConversion::GENOPTIONS)
+      && index.Build(filename, pConv->GetInFormat());
+  }
+
   //////////////////////////////////////////////////////
   bool OBConversion::SetStartAndEnd()
   {
     unsigned int TempStartNumber=0;
     const char* p = IsOption("f",GENOPTIONS);
+    OBRecordIndex index;
+    bool indexed = (IsOption("index",GENOPTIONS) || IsOption("seektitle",GENOPTIONS)
+                    || (p && atoi(p)>1)) && LoadRecordIndex(this, index);
+
+    //--seektitle selects a single object, found in the record index
+    unsigned int TitleNumber=0;
+    p = IsOption("seektitle",GENOPTIONS);
     if(p)
       {
-        StartNumber=atoi(p);
+        if(!indexed)
+          {
+            obErrorLog.ThrowError(__FUNCTION__,
+              "--seektitle needs a record index of the input file (use --index)", obError);
+            return false;
+          }
+        TitleNumber = index.FindTitle(p);
+        if(!TitleNumber)
+          {
+            obErrorLog.ThrowError(__FUNCTION__,
+              "No object titled " + string(p) + " in " + InFilename, obError);
+            return false;
+          }
+      }
+
+    p = IsOption("f",GENOPTIONS);
+    if(p || TitleNumber)
+      {
+        StartNumber = TitleNumber ? TitleNumber : atoi(p);
         if(StartNumber>1)
           {
             TempStartNumber=StartNumber;
-            //Try to skip objects now
-            int ret = pInFormat->SkipObjects(StartNumber-1,this);
-            if(ret==-1) //error
-              return false;
-            if(ret==1) //success:objects skipped
+            streamoff offset = indexed ? index.GetOffset(StartNumber) : -1;
+            if(offset>=0)
               {
+                //Seek directly to the object in an indexed input file
+                pInput->clear();
+                pInput->seekg(offset);
+                if(!*pInput)
+                  return false;
                 Count = StartNumber-1;
                 StartNumber=0;
               }
+            else
+              {
+                //Try to skip objects now
+                int ret = pInFormat->SkipObjects(StartNumber-1,this);
+                if(ret==-1) //error
+                  return false;
+                if(ret==1) //success:objects skipped
+                  {
+                    Count = StartNumber-1;
+                    StartNumber=0;
+                  }
+              }
           }
       }
 
     p = IsOption("l",GENOPTIONS);
-    if(p)
+    if(TitleNumber)
+      EndNumber=TitleNumber;
+    else if(p)
       {
         EndNumber=atoi(p);
         if(TempStartNumber && EndNumber<TempStartNumber)
@@ -850,12 +947,18 @@ namespace OpenBabel {
     if(pInput->eof()) pInput->get();
 
     // Set the locale for number parsing to avoid locale issues: PR#1785463
-    obLocale.SetLocale();
-
-    // Also set the C++ stream locale
-    locale originalLocale = pInput->getloc(); // save the original
-    locale cNumericLocale(originalLocale, "C", locale::numeric);
-    pInput->imbue(cNumericLocale);
+    // (not needed by formats without numbers in text, for which it is a large
+    // part of the time)
+    const bool text = !(pInFormat->Flags() & NOTEXTNUMBERS);
+    locale originalLocale;
+    if (text) {
+      obLocale.SetLocale();
+
+      // Also set the C++ stream locale
+      originalLocale = pInput->getloc(); // save the original
+      locale cNumericLocale(originalLocale, "C", locale::numeric);
+      pInput->imbue(cNumericLocale);
+    }
 
     // skip molecules if -f or -l option is set
     if (!SkippedMolecules) {
@@ -873,16 +976,28 @@ namespace OpenBabel {
         success = pInFormat->ReadMolecule(pOb, this);
     }
 
-    // return the C locale to the original one
-    obLocale.RestoreLocale();
-    // Restore the original C++ locale as well
-    pInput->imbue(originalLocale);
+    if (text) {
+      // return the C locale to the original one
+      obLocale.RestoreLocale();
+      // Restore the original C++ locale as well
+      pInput->imbue(originalLocale);
+    }
 
     // If we failed to read, plus the stream is over, then check if this is a stream from ReadFile
     if (!success && !pInput->good() && ownedInStreams.size() > 0) {
+#ifdef HAVE_LIBZ
+      for (unsigned i = 1; i < ownedInStreams.size(); ++i) {
+        OBReadAheadInStream *readAhead = dynamic_cast<OBReadAheadInStream*>(ownedInStreams[i]);
+        if (readAhead != 0)
+          readAhead->Stop(); // it may be reading the file
+      }
+#endif
       ifstream *inFstream = dynamic_cast<ifstream*>(ownedInStreams[0]);
       if (inFstream != 0)
         inFstream->close(); // We will free the stream later, but close the file now
+      OBMappedInStream *inMapped = dynamic_cast<OBMappedInStream*>(ownedInStreams[0]);
+      if (inMapped != 0)
+        inMapped->Close();
     }
 
     return success;
@@ -902,19 +1017,25 @@ namespace OpenBabel {
     SetOneObjectOnly(); //So that IsLast() returns true, which is important for XML formats
 
     // Set the locale for number parsing to avoid locale issues: PR#1785463
-    obLocale.SetLocale();
-    // Also set the C++ stream locale
-    locale originalLocale = pOutput->getloc(); // save the original
-    locale cNumericLocale(originalLocale, "C", locale::numeric);
-    pOutput->imbue(cNumericLocale);
+    const bool text = !(pOutFormat->Flags() & NOTEXTNUMBERS);
+    locale originalLocale;
+    if (text) {
+      obLocale.SetLocale();
+      // Also set the C++ stream locale
+      originalLocale = pOutput->getloc(); // save the original
+      locale cNumericLocale(originalLocale, "C", locale::numeric);
+      pOutput->imbue(cNumericLocale);
+    }
 
     // The actual work is done here
     bool success = pOutFormat->WriteMolecule(pOb,this);
 
-    // return the C locale to the original one
-    obLocale.RestoreLocale();
-    // Restore the C++ stream locale too
-    pOutput->imbue(originalLocale);
+    if (text) {
+      // return the C locale to the original one
+      obLocale.RestoreLocale();
+      // Restore the C++ stream locale too
+      pOutput->imbue(originalLocale);
+    }
 
     return success;
   }
@@ -1033,6 +1154,8 @@ namespace OpenBabel {
         return false;
       }
 
+    // save the filename, e.g. for the index of BGZF output
+    OutFilename = filePath;
     SetOutStream(ofs, true);
     return Write(pOb);
   }
@@ -1050,6 +1173,35 @@ namespace OpenBabel {
   }
 
 
+  ////////////////////////////////////////////
+  /// Input files are memory-mapped when possible, so that formats using
+  /// OBLineReader read lines straight from the mapping. Otherwise, e.g. for
+  /// an empty file or without mmap(), an ifstream is used.
+  /// Returns NULL if the file cannot be opened.
+  static istream* OpenInputFile(const string& filename)
+  {
+    OBMappedInStream *mapped = new OBMappedInStream(filename);
+    if(mapped->IsOpen())
+      return mapped;
+    delete mapped;
+    ifstream *ifs = new ifstream(filename.c_str(),ios_base::in|ios_base::binary); //now always binary because may be gzipped
+    if(!ifs->good())
+    {
+      delete ifs;
+      return NULL;
+    }
+    return ifs;
+  }
+
+  /// Use a memory mapping of an already opened input file if possible
+  static istream* MapInputFile(ifstream& ifs, OBMappedInStream& mapped, const string& filename)
+  {
+    if(!mapped.Open(filename))
+      return &ifs;
+    ifs.close();
+    return &mapped;
+  }
+
   ////////////////////////////////////////////
   bool	OBConversion::ReadFile(OBBase* pOb, std::string filePath)
   {
@@ -1063,11 +1215,9 @@ namespace OpenBabel {
 
     // save the filename
     InFilename = filePath;
-    ios_base::openmode imode = ios_base::in|ios_base::binary; //now always binary because may be gzipped
-    ifstream *ifs = new ifstream(filePath.c_str(),imode);
-    if(!ifs || !ifs->good())
+    istream *ifs = OpenInputFile(filePath);
+    if(!ifs)
     {
-        if(ifs) delete ifs;
         obErrorLog.ThrowError(__FUNCTION__,"Cannot read from " + filePath, obError);
         return false;
     }
@@ -1092,10 +1242,9 @@ namespace OpenBabel {
       //attempt to auto-detect file format from extension
       pInFormat = FormatFromExt(infilepath.c_str(), inFormatGzip);
     }
-    ifstream *ifs = new ifstream(infilepath.c_str(),ios_base::in|ios_base::binary);  //always open in binary mode
-    if(!ifs || !ifs->good())
+    istream *ifs = OpenInputFile(infilepath);
+    if(!ifs)
     {
-      if(ifs) delete ifs;
       obErrorLog.ThrowError(__FUNCTION__,"Cannot read from " + infilepath, obError);
       return false;
     }
@@ -1273,6 +1422,7 @@ namespace OpenBabel {
     istream* pIs=NULL;
     ostream* pOs=NULL;
     ifstream is;
+    OBMappedInStream mappedIs;
     ofstream os;
     stringstream ssOut, ssIn;
     bool HasMultipleOutputFiles=false;
@@ -1370,10 +1520,11 @@ namespace OpenBabel {
                   {
                     InFilename = *itr;
                     ifstream ifs;
+                    OBMappedInStream mappedIfs;
                     if(!OpenAndSetFormat(CommonInFormat, &ifs, &ssIn))
                       continue;
                     if(ifs)
-                      pIs = &ifs;
+                      pIs = MapInputFile(ifs, mappedIfs, InFilename);
                     else
                       pIs = &ssIn;
 
@@ -1430,7 +1581,7 @@ namespace OpenBabel {
                 if(!OpenAndSetFormat(CommonInFormat, &is, &ssIn))
                   return 0;
                 if(is)
-                  pIs =&is;
+                  pIs = MapInputFile(is, mappedIs, InFilename);
                 else
                   pIs = &ssIn;
 
@@ -1576,6 +1727,10 @@ Additional options :
 --addtotitle <text> Append to title
 --writeconformers Output multiple conformers separately
 --addindex Append output index to title
+--bgzf Compress the output as BGZF blocks and write a .gzi index of the output file
+--index Build or refresh the record index of an SDF, SMILES, MOL2 or XYZ input file
+--threads <n> Parse SDF, SMILES, MOL2 or XYZ input with n threads (all if n is omitted)
+--seektitle <title> Convert only the first molecule with this title (uses the index)
 </pre>
 **/
 #endif
@@ -1654,7 +1809,8 @@ Additional options :
             return;
           }
       }
-    OptionParamArray(typ)[name] = numberParams;
+    else //not written again, as OBConversion objects may be made in several threads
+      OptionParamArray(typ)[name] = numberParams;
   }
 
   int OBConversion::GetOptionParams(string name, Option_type typ)
@@ -1724,14 +1880,6 @@ Additional options :
     if(!ifs)
       return -1;
 
-    //check that the input format supports SkipObjects()
-    if(GetInFormat()->SkipObjects(0, this)==0)
-    {
-      obErrorLog.ThrowError(__FUNCTION__,
-        "Input format does not have a SkipObjects function.", obError);
-      return -1;
-    }
-
     //counts objects only between the values of -f and -l options
     int nfirst=1, nlast=numeric_limits<int>::max();
     const char* p;
@@ -1740,6 +1888,22 @@ Additional options :
     if( (p=IsOption("l", GENOPTIONS)) ) // extra parens to indicate truth value
       nlast=atoi(p);
 
+    //an indexed input file need not be read
+    OBRecordIndex index;
+    if(LoadRecordIndex(this, index))
+      {
+        int count = min(static_cast<int>(index.NumRecords()), nlast);
+        return count - (nfirst-1);
+      }
+
+    //check that the input format supports SkipObjects()
+    if(GetInFormat()->SkipObjects(0, this)==0)
+    {
+      obErrorLog.ThrowError(__FUNCTION__,
+        "Input format does not have a SkipObjects function.", obError);
+      return -1;
+    }
+
     ifs.seekg(0); //rewind
     //Compressed files currently show an error here.***TAKE CHANCE: RESET ifs****
     ifs.clear();
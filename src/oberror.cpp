@@ -165,17 +165,23 @@ namespace OpenBabel
     if (!_logging)
       return;
 
-    //Output error message if level sufficiently high and, if onceOnly set, it has not been logged before
-    if (err.GetLevel() <= _outputLevel &&
-      (qualifier!=onceOnly || find(_messageList.begin(), _messageList.end(), err)==_messageList.end()))
+    //Messages may come from several threads, e.g. when reading with --threads
+#ifdef _OPENMP
+    #pragma omp critical(OBMessageHandler)
+#endif
     {
-      *_outputStream << err;
-    }
+      //Output error message if level sufficiently high and, if onceOnly set, it has not been logged before
+      if (err.GetLevel() <= _outputLevel &&
+        (qualifier!=onceOnly || find(_messageList.begin(), _messageList.end(), err)==_messageList.end()))
+      {
+        *_outputStream << err;
+      }
 
-    _messageList.push_back(err);
-    _messageCount[err.GetLevel()]++;
-    if (_maxEntries != 0 && _messageList.size() > _maxEntries)
-      _messageList.pop_front();
+      _messageList.push_back(err);
+      _messageCount[err.GetLevel()]++;
+      if (_maxEntries != 0 && _messageList.size() > _maxEntries)
+        _messageList.pop_front();
+    }
   }
 
   void OBMessageHandler::ThrowError(const std::string &method,
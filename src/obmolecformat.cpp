@@ -22,7 +22,16 @@ GNU General Public License for more details.
   #include <openbabel/reaction.h>
 #endif
 
+#include <openbabel/recordindex.h>
+#include <openbabel/generic.h>
+#include <openbabel/op.h>
+
 #include <algorithm>
+#include <cstdlib>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
 
 using namespace std;
 namespace OpenBabel
@@ -33,6 +42,237 @@ namespace OpenBabel
   std::vector<OBMol> OBMoleculeFormat::MolArray;
   bool OBMoleculeFormat::StoredMolsReady=false;
 
+  /// The attribute of the OBPairData holding the text written for a molecule
+  /// by a reading thread (see ThreadedReader)
+  static const char* PreparedOutput = "OpenBabel Prepared Output";
+
+  /// Reading with the --threads option.
+  /// The records of the input stream are split off in batches by an
+  /// OBRecordReader, parsed concurrently, each thread with its own
+  /// OBConversion and format instance, and handed out in input order.
+  /// The first op may do part of its work in the reading threads. When no
+  /// other option is given and the output format is WRITETHREADSAFE, the
+  /// threads also write the molecules and only the text is output here,
+  /// in input order; otherwise output is done one molecule at a time.
+  /// It is kept with the OBConversion (see OBConversion::SetReaderState()).
+  class ThreadedReader : public OBReaderState
+  {
+  public:
+    ThreadedReader() : _pConv(NULL), _pFormat(NULL), _pIn(NULL), _reader(NULL),
+                       _prepare(false), _pOp(NULL), _next(0) {}
+    ~ThreadedReader() { Clear(); }
+
+    /// \return the number of threads requested with --threads for this
+    /// input, or 1 if it cannot be read with several threads
+    static int NumThreads(OBConversion* pConv, OBFormat* pFormat)
+    {
+      const char* p = pConv->IsOption("threads", OBConversion::GENOPTIONS);
+      //not for stdin: the Convert() loop stops when nothing is left to peek at
+      if(!p || pConv->GetInStream() == &cin
+         || pConv->IsOption("C", OBConversion::GENOPTIONS)
+         || pConv->IsOption("separate", OBConversion::GENOPTIONS)
+         || !OBRecordReader::IsSupportedFormat(pFormat))
+        return 1;
+#ifdef _OPENMP
+      int nthreads = atoi(p);
+      return nthreads > 0 ? nthreads : omp_get_max_threads();
+#else
+      return 1;
+#endif
+    }
+
+    /// Provides the next molecule of the input in \p pmol, which is NULL at
+    /// the end of the input. With the -e option, records that cannot be
+    /// parsed are skipped.
+    /// \return false at the end of the input or for an unparsable record
+    bool Next(OBConversion* pConv, OBFormat* pFormat, int nthreads, OBMol*& pmol)
+    {
+      // a new conversion or input file
+      if(pConv != _pConv || pConv->GetInStream() != _pIn || pConv->IsFirstInput())
+        Reset(pConv, pFormat, nthreads);
+
+      pmol = NULL;
+      while(true)
+      {
+        if(_next == _mols.size() && !ReadBatch())
+        {
+          Clear(); // end of the input
+          _pConv = NULL;
+          return false;
+        }
+        bool ok = _ok[_next] != 0;
+        pmol = _mols[_next];
+        _mols[_next++] = NULL;
+        if(ok)
+          return true;
+        if(!pConv->IsOption("e", OBConversion::GENOPTIONS))
+          return false;
+        delete pmol;
+        pmol = NULL;
+      }
+    }
+
+  private:
+    void Reset(OBConversion* pConv, OBFormat* pFormat, int nthreads)
+    {
+      Clear();
+      _pConv = pConv;
+      _pFormat = pFormat;
+      _pIn = pConv->GetInStream();
+      _reader = new OBRecordReader(*_pIn, pFormat);
+      // When nothing is done to the molecules between reading and writing,
+      // an output format that can be written concurrently writes each
+      // molecule in the reading thread; WriteChemObjectImpl() then only
+      // copies the text.
+      OBFormat* pOutFormat = pConv->GetOutFormat();
+      _prepare = pOutFormat && (pOutFormat->Flags() & WRITETHREADSAFE) && pConv->GetOutStream();
+      const map<string,string>* genOptions = pConv->GetOptions(OBConversion::GENOPTIONS);
+      for(map<string,string>::const_iterator it = genOptions->begin(); it != genOptions->end(); ++it)
+        if(it->first != "threads" && it->first != "e")
+          _prepare = false;
+      // The first op (see OBOp::DoOps()) can do some of its work in the
+      // reading threads. Those after it could see a molecule it has changed.
+      _pOp = NULL;
+      for(map<string,string>::const_iterator it = genOptions->begin(); it != genOptions->end() && !_pOp; ++it)
+        if((_pOp = OBOp::FindType(it->first.c_str())))
+          _opText = it->second;
+      // copies made here, not in the threads, as the OBConversion
+      // constructors register options in static maps
+      for(int t = 0; t < nthreads; ++t)
+      {
+        OBFormat* pThreadFormat = pFormat->MakeNewInstance();
+        _formats.push_back(pThreadFormat ? pThreadFormat : pFormat);
+        OBConversion* pThreadConv = new OBConversion(*pConv);
+        pThreadConv->SetAuxConv(NULL);
+        pThreadConv->SetInFormat(_formats.back());
+        _convs.push_back(pThreadConv);
+        // each record is parsed from the thread's stringstream
+        _streams.push_back(new stringstream);
+        _streams.back()->imbue(_pIn->getloc());
+        pThreadConv->SetInStream(_streams.back(), false);
+        if(_prepare)
+        {
+          // not compressed: that is done by the output stream of pConv
+          pThreadConv->SetOutFormat(pOutFormat);
+          _outStreams.push_back(new stringstream);
+          _outStreams.back()->imbue(pConv->GetOutStream()->getloc());
+          pThreadConv->SetOutStream(_outStreams.back(), false);
+        }
+      }
+    }
+
+    void Clear()
+    {
+      for(unsigned int i = 0; i < _convs.size(); ++i)
+      {
+        delete _convs[i];
+        delete _streams[i];
+        if(_formats[i] != _pFormat)
+          delete _formats[i];
+      }
+      for(unsigned int i = 0; i < _outStreams.size(); ++i)
+        delete _outStreams[i];
+      _convs.clear();
+      _streams.clear();
+      _outStreams.clear();
+      _formats.clear();
+      for(unsigned int i = _next; i < _mols.size(); ++i)
+        delete _mols[i];
+      _mols.clear();
+      _ok.clear();
+      _next = 0;
+      delete _reader;
+      _reader = NULL;
+    }
+
+    bool ReadBatch()
+    {
+      const unsigned int batchSize = 256 * _convs.size();
+      _records.clear();
+      string text;
+      while(_records.size() < batchSize && _reader->ReadRecord(&text))
+        _records.push_back(text);
+
+      _mols.assign(_records.size(), static_cast<OBMol*>(NULL));
+      _ok.assign(_records.size(), 0);
+      _next = 0;
+      if(_records.empty())
+        return false;
+      // the Convert() loop stops at the end of the stream, but the
+      // molecules of this batch still have to be handed out
+      _pIn->clear();
+
+      const int nrecords = static_cast<int>(_records.size());
+#ifdef _OPENMP
+      #pragma omp parallel for num_threads(static_cast<int>(_convs.size())) schedule(dynamic, 16)
+#endif
+      for(int i = 0; i < nrecords; ++i)
+      {
+#ifdef _OPENMP
+        const int t = omp_get_thread_num();
+#else
+        const int t = 0;
+#endif
+        OBConversion* pThreadConv = _convs[t];
+        _streams[t]->clear();
+        _streams[t]->str(_records[i]);
+        istream* pThreadIn = pThreadConv->GetInStream();
+        pThreadIn->clear();
+        pThreadIn->seekg(0); // also drops a character buffered by a line ending filter
+        OBMol* pmol = new OBMol;
+        bool ok = false;
+#ifndef DONT_CATCH_EXCEPTIONS
+        try
+#endif
+        {
+          ok = pThreadConv->GetInFormat()->ReadMolecule(pmol, pThreadConv);
+          if(ok && _pOp && pmol->NumAtoms() > 0)
+            _pOp->Prepare(pmol, _opText.c_str(), pThreadConv);
+          if(ok && _prepare && pmol->NumAtoms() > 0)
+          {
+            stringstream& out = *_outStreams[t];
+            out.clear();
+            out.str(string());
+            // on failure the molecule is written again by WriteChemObjectImpl()
+            if(pThreadConv->GetOutFormat()->WriteMolecule(pmol, pThreadConv) && out)
+            {
+              OBPairData* dp = new OBPairData;
+              dp->SetAttribute(PreparedOutput);
+              dp->SetValue(out.str());
+              dp->SetOrigin(local);
+              pmol->SetData(dp);
+            }
+          }
+        }
+#ifndef DONT_CATCH_EXCEPTIONS
+        catch(...)
+        {
+          obErrorLog.ThrowError(__FUNCTION__, "Reading a molecule failed with an exception", obError);
+        }
+#endif
+        _mols[i] = pmol;
+        _ok[i] = ok;
+      }
+      return true;
+    }
+
+    OBConversion* _pConv;
+    OBFormat* _pFormat;
+    istream* _pIn;
+    OBRecordReader* _reader;
+    vector<OBConversion*> _convs;
+    vector<stringstream*> _streams;
+    vector<stringstream*> _outStreams;
+    vector<OBFormat*> _formats;
+    vector<string> _records;
+    vector<OBMol*> _mols;
+    vector<char> _ok;
+    bool _prepare;
+    OBOp* _pOp;
+    string _opText;
+    unsigned int _next;
+  };
+
   bool OBMoleculeFormat::ReadChemObjectImpl(OBConversion* pConv, OBFormat* pFormat)
   {
     std::istream *ifs = pConv->GetInStream();
@@ -99,7 +339,22 @@ namespace OpenBabel
      return ret;
    }
 
-    ret=pFormat->ReadMolecule(pmol,pConv);
+    int nthreads = ThreadedReader::NumThreads(pConv, pFormat);
+    if(nthreads > 1)
+    {
+      delete pmol;
+      ThreadedReader* pReader = dynamic_cast<ThreadedReader*>(pConv->GetReaderState());
+      if(!pReader)
+      {
+        pReader = new ThreadedReader;
+        pConv->SetReaderState(pReader);
+      }
+      ret = pReader->Next(pConv, pFormat, nthreads, pmol);
+      if(!pmol)
+        return false;
+    }
+    else
+      ret=pFormat->ReadMolecule(pmol,pConv);
 
     OBMol* ptmol = NULL;
     //Molecule is valid if it has some atoms
@@ -170,7 +425,15 @@ namespace OpenBabel
 
         ret = DoOutputOptions(pOb, pConv);
 
-        if(ret)
+        OBPairData* dp = static_cast<OBPairData*>(pmol->GetData(PreparedOutput));
+        if(ret && dp && pConv->GetOutStream())
+        {
+          //already written by a reading thread
+          const string& text = dp->GetValue();
+          pConv->GetOutStream()->write(text.data(), text.size());
+          ret = pConv->GetOutStream()->good();
+        }
+        else if(ret)
           ret = pFormat->WriteMolecule(pmol,pConv);
     }
 
@@ -65,6 +65,9 @@ namespace OpenBabel
           " --weighted       weighted rotor search for lowest energy conformer\n"
           " --ff #           select a forcefield (default = MMFF94)\n"
           " --rings          sample ring torsions\n"
+          " --nthreads #     number of threads for the forcefield based methods and\n"
+          "                  the GA scores (default = 1)\n"
+          " --seed #         random seed for --random, --weighted and the GA (default = time)\n"
           " genetic algorithm (GA) based methods (default):\n"
           " --children #     number of children to generate for each parent (default = 5)\n"
           " --mutability #   mutation frequency (default = 5)\n"
@@ -116,6 +119,8 @@ namespace OpenBabel
     bool fast = false;
     bool rings = false;
     int numConformers = 30;
+    int numThreads = 1;
+    unsigned int seed = 0;
 
     iter = pmap->find("log");
     if(iter!=pmap->end())
@@ -125,6 +130,14 @@ namespace OpenBabel
     if(iter!=pmap->end())
       getValue<int>(iter->second, numConformers);
 
+    iter = pmap->find("nthreads");
+    if(iter!=pmap->end())
+      getValue<int>(iter->second, numThreads);
+
+    iter = pmap->find("seed");
+    if(iter!=pmap->end())
+      getValue<unsigned int>(iter->second, seed);
+
     iter = pmap->find("systematic");
     if(iter!=pmap->end())
       systematic = true;
@@ -166,6 +179,8 @@ namespace OpenBabel
       pFF->SetVDWCutOff(10.0);
       pFF->SetElectrostaticCutOff(20.0);
       pFF->SetUpdateFrequency(10); // delay updates of non-bonded distances
+      pFF->SetNumThreads(numThreads);
+      pFF->SetRandomSeed(seed);
 
       if (!pFF->Setup(*pmol)) {
         cerr  << "Could not setup force field." << endl;
@@ -216,6 +231,8 @@ namespace OpenBabel
         score = iter->second;
 
       OBConformerSearch cs;
+      cs.SetNumThreads(numThreads);
+      cs.SetRandomSeed(seed);
       if (score == "energy")
         cs.SetScore(new OBEnergyConformerScore);
       else if (score == "mine" || score == "minenergy")
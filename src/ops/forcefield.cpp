@@ -137,6 +137,8 @@ namespace OpenBabel
           " --log        output a log of the minimization process(default= no log)\n"
           " --crit #     set convergence criteria (default=1e-6)\n"
           " --sd         use steepest descent algorithm (default = conjugate gradient)\n"
+          " --lbfgs      use L-BFGS algorithm\n"
+          " --fire       use FIRE algorithm\n"
           " --newton     use Newton2Num linesearch (default = Simple)\n"
           " --ff #       select a forcefield (default = Ghemical)\n"
           " --steps #    specify the maximum number of steps (default = 2500)\n"
@@ -172,6 +174,8 @@ namespace OpenBabel
     int steps = 2500;
     double crit = 1e-6;
     bool sd = false;
+    bool lbfgs = false;
+    bool fire = false;
     bool cut = false;
     bool newton = true;
     double epsilon = 1.0;
@@ -190,6 +194,14 @@ namespace OpenBabel
     if(iter!=pmap->end())
       sd=true;
 
+    iter = pmap->find("lbfgs");
+    if(iter!=pmap->end())
+      lbfgs=true;
+
+    iter = pmap->find("fire");
+    if(iter!=pmap->end())
+      fire=true;
+
     iter = pmap->find("newton");
     if(iter!=pmap->end())
       newton=true;
@@ -249,6 +261,10 @@ namespace OpenBabel
     bool done = true;
     if (sd)
       pFF->SteepestDescent(steps, crit);
+    else if (lbfgs)
+      pFF->LBFGS(steps, crit);
+    else if (fire)
+      pFF->FIRE(steps, crit);
     else
       pFF->ConjugateGradients(steps, crit);
 
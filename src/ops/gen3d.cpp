@@ -22,6 +22,8 @@ GNU General Public License for more details.
 #include <openbabel/builder.h>
 #include <openbabel/distgeom.h>
 #include <openbabel/forcefield.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/generic.h>
 
 #include <cstdlib> // needed for strtol and gcc 4.8
 
@@ -32,15 +34,46 @@ class OpGen3D : public OBOp
 {
 public:
   OpGen3D(const char* ID) : OBOp(ID, false){};
-  const char* Description(){ return "Generate 3D coordinates"; }
+  const char* Description(){ return "Generate 3D coordinates\n"
+      "The parameter is the speed: fastest, fast, med (default), slow, best,\n"
+      "or dist for distance geometry.\n"
+      "With --threads, the molecules are built in the reading threads.\n"
+      "--seed # gives the same coordinates in every run, and with any number\n"
+      "of threads\n"; }
 
   virtual bool WorksWith(OBBase* pOb)const{ return dynamic_cast<OBMol*>(pOb)!=NULL; }
   virtual bool Do(OBBase* pOb, const char* OptionText=NULL, OpMap* pOptions=NULL, OBConversion* pConv=NULL);
+  virtual bool Prepare(OBBase* pOb, const char* OptionText, OBConversion* pConv);
+
+private:
+  static void Generate(OBMol* pmol, const char* OptionText, unsigned int seed);
 };
 
 /////////////////////////////////////////////////////////////////
 OpGen3D theOpGen3D("gen3D"); //Global instance
 
+// The attribute of the OBPairData marking a molecule built by Prepare()
+static const char* Prepared3D = "OpenBabel Gen3D Done";
+
+/////////////////////////////////////////////////////////////////
+bool OpGen3D::Prepare(OBBase* pOb, const char* OptionText, OBConversion* pConv)
+{
+  OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+  if(!pmol)
+    return false;
+  unsigned int seed = 0;
+  const char* p = pConv->IsOption("seed", OBConversion::GENOPTIONS);
+  if (p)
+    seed = strtoul(p, NULL, 10);
+  Generate(pmol, OptionText, seed);
+
+  OBPairData* dp = new OBPairData;
+  dp->SetAttribute(Prepared3D);
+  dp->SetOrigin(local);
+  pmol->SetData(dp);
+  return true;
+}
+
 /////////////////////////////////////////////////////////////////
 bool OpGen3D::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConversion* pConv)
 {
@@ -48,6 +81,27 @@ bool OpGen3D::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConvers
   if(!pmol)
     return false;
 
+  OBGenericData* dp = pmol->GetData(Prepared3D);
+  if (dp) { // already built in a reading thread
+    pmol->DeleteData(dp);
+    return true;
+  }
+
+  unsigned int seed = 0;
+  if (pOptions) {
+    OpMap::const_iterator iter = pOptions->find("seed");
+    if (iter != pOptions->end())
+      seed = strtoul(iter->second.c_str(), NULL, 10);
+  }
+  Generate(pmol, OptionText, seed);
+  return true;
+}
+
+void OpGen3D::Generate(OBMol* pmol, const char* OptionText, unsigned int seed)
+{
+  if (!OptionText)
+    OptionText = "";
+
   // As with gen2D, we need to perceive the stereo if coming from 0D.
   // Otherwise, unspecified cis/trans stereobonds become specified.
   if (pmol->GetDimension() == 0) {
@@ -97,6 +151,7 @@ bool OpGen3D::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConvers
 
   // This is done for all speed levels (i.e., create the structure)
   OBBuilder builder;
+  builder.SetRandomSeed(seed);
   bool attemptBuild = !useDistGeom;
   if (attemptBuild && !builder.Build(*pmol) ) {
     std::cerr << "Warning: Stereochemistry is wrong, using the distance geometry method instead" << std::endl;
@@ -105,6 +160,7 @@ bool OpGen3D::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConvers
 
 #ifdef HAVE_EIGEN
   OBDistanceGeometry dg;
+  dg.SetRandomSeed(seed);
   if (useDistGeom) {
     // use the bond lengths and angles if we ran the builder
     dg.GetGeometry(*pmol, attemptBuild); // ensured to have correct stereo
@@ -117,17 +173,18 @@ bool OpGen3D::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConvers
   pmol->AddHydrogens(false, false); // Add some hydrogens before running MMFF
 
   if (speed == 5)
-    return true; // done
+    return; // done
 
   // All other speed levels do some FF cleanup
   // Try MMFF94 first and UFF if that doesn't work
-  OBForceField* pFF = OBForceField::FindForceField("MMFF94");
+  OBForceField* pFF = OBForceField::GetThreadInstance("MMFF94");
   if (!pFF)
-    return true;
+    return;
   if (!pFF->Setup(*pmol)) {
-    pFF = OBForceField::FindForceField("UFF");
-    if (!pFF || !pFF->Setup(*pmol)) return true; // can't use either MMFF94 or UFF
+    pFF = OBForceField::GetThreadInstance("UFF");
+    if (!pFF || !pFF->Setup(*pmol)) return; // can't use either MMFF94 or UFF
   }
+  pFF->SetRandomSeed(seed);
 
   // Since we only want a rough geometry, use distance cutoffs for VDW, Electrostatics
   pFF->EnableCutOff(true);
@@ -155,7 +212,7 @@ bool OpGen3D::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConvers
 
   if (speed == 4) {
     pFF->UpdateCoordinates(*pmol);
-    return true; // no conformer searching
+    return; // no conformer searching
   }
 
   switch(speed) {
@@ -173,7 +230,5 @@ bool OpGen3D::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConvers
   // Final cleanup and copy the new coordinates back
   pFF->ConjugateGradients(iterations, 1.0e-6);
   pFF->UpdateCoordinates(*pmol);
-
-  return true;
 }
 }//namespace
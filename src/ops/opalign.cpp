@@ -79,6 +79,7 @@ private:
   OBAlign _align;
   OBMol _refMol;
   std::vector<vector3> _refvec;
+  std::vector<double> _coords; //the coordinates of the matched atoms (-s option)
   OpNewS* _pOpIsoM;  //the address of the -s option or NULL if it is not used
   std::string _stext;//the -s option parameters
 };
@@ -208,18 +209,18 @@ bool OpAlign::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion*
     // Get the atoms equivalent to those in ref molecule        
     vector<int> ats = _pOpIsoM->GetMatchAtoms();
 
-    // Make a vector of their coordinates and get the centroid
-    vector<vector3> vec;
+    // Copy their coordinates and get the centroid
+    _coords.resize(3 * ats.size());
     vector3 centroid;
-    for(vector<int>::iterator iter=ats.begin(); iter!=ats.end(); ++iter) {
-      vector3 v = pmol->GetAtom(*iter)->GetVector();
+    for(unsigned int i=0; i<ats.size(); ++i) {
+      vector3 v = pmol->GetAtom(ats[i])->GetVector();
       centroid += v;
-      vec.push_back(v);
+      v.Get(&_coords[3 * i]);
     }
-    centroid /= vec.size();
+    centroid /= ats.size();
     
     // Do the alignment
-    _align.SetTarget(vec);
+    _align.SetTarget(_coords.empty() ? NULL : &_coords[0], ats.size());
     if(!_align.Align())
       return false;
 
@@ -61,6 +61,7 @@ namespace OpenBabel
           "    --rcutoff #  RMSD cutoff (default 0.5 Angstrom)\n"
           "    --ecutoff #  Energy cutoff (default 50.0 kcal/mol)\n"
           "    --original   Include the input conformation as the first conformer\n"
+          "    --nthreads # Number of threads for the energies (default is 1)\n"
           "    --verbose    Verbose output\n"
           ;
       }
@@ -78,6 +79,7 @@ namespace OpenBabel
       unsigned int conf_cutoff;
       bool verbose;
       bool include_original;
+      int nthreads;
       unsigned int N;
       OBForceField *pff;
   };
@@ -102,6 +104,7 @@ namespace OpenBabel
       conf_cutoff = 1000000; // 1 Million
       verbose = false;
       include_original = false;
+      nthreads = 1;
 
       OpMap::const_iterator iter;
       iter = pmap->find("rcutoff");
@@ -119,6 +122,9 @@ namespace OpenBabel
       iter = pmap->find("original");
       if(iter!=pmap->end())
         include_original = true;
+      iter = pmap->find("nthreads");
+      if(iter!=pmap->end())
+        nthreads = atoi(iter->second.c_str());
 
       cout << "**Starting Confab " << CONFAB_VER << "\n";
       cout << "**To support, cite Journal of Cheminformatics, 2011, 3, 8.\n";
@@ -127,6 +133,7 @@ namespace OpenBabel
         cout << "!!Cannot find forcefield!" << endl;
         exit(-1);
       }
+      pff->SetNumThreads(nthreads);
       DisplayConfig(pConv);
     }
 
@@ -181,6 +188,7 @@ namespace OpenBabel
     cout << "..Energy cutoff = " << energy_cutoff << endl;
     cout << "..Conformer cutoff = " << conf_cutoff << endl;
     cout << "..Write input conformation? " << (include_original ? "True" : "False") << endl;
+    cout << "..Threads = " << nthreads << endl;
     cout << "..Verbose? " << (verbose ? "True" : "False") << endl;
     cout << endl;
   }
@@ -19,28 +19,126 @@ GNU General Public License for more details.
 #include <openbabel/op.h>
 #include <openbabel/mol.h>
 #include <openbabel/obconversion.h>
+#include <openbabel/atom.h>
+#include <openbabel/bond.h>
 #include <openbabel/descriptor.h>
 #include <openbabel/obutil.h>
-#include "deferred.h"
+#include <openbabel/generic.h>
+#include <stdint.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <set>
 #include <algorithm>
 
 namespace OpenBabel
 {
 
-template<class T>
-struct Order : public std::binary_function<std::pair<OBBase*,T>, std::pair<OBBase*,T>, bool>
+// The value of the descriptor for a molecule: a number, or a string for
+// descriptors like inchi
+struct SortKey
 {
-  Order(OBDescriptor* pDesc, bool rev) : _pDesc(pDesc), _rev(rev){}
-  bool operator()(std::pair<OBBase*,T> p1, std::pair<OBBase*,T> p2) const
+  double num;
+  std::string str;
+};
+
+/**
+SortFormat takes the place of the output format, as DeferredFormat does
+(see deferred.h), and holds the molecules with their sort keys, which are
+computed as the molecules arrive. When the molecules held exceed the
+memory budget they are sorted and written with their keys to a temporary
+file, in the binary obm format, unless obm cannot store all their data;
+they are then all kept in memory. At the end, the molecules still held are
+sorted and, if there are temporary files, merged with them. Molecules with
+the same key keep the input order.
+**/
+class SortFormat : public OBFormat
+{
+public:
+  SortFormat(OBConversion* pConv, OBDescriptor* pDesc, const std::string& descOption,
+             bool rev, bool addDescToTitle, double budget)
+    : _pDesc(pDesc), _descOption(descOption), _rev(rev), _addDescToTitle(addDescToTitle),
+      _numeric(true), _budget(budget), _used(0), _next(0)
+  {
+    _pRealOutFormat = pConv->GetOutFormat();
+    pConv->SetOutFormat(this);
+  }
+  virtual ~SortFormat()
+  {
+    for(unsigned i=_next; i<_entries.size(); ++i)
+      delete _entries[i].pOb;
+    for(unsigned i=0; i<_runs.size(); ++i)
+      if(_runs[i].file)
+        fclose(_runs[i].file);
+  }
+  virtual const char* Description() { return "Sort molecules, in temporary files if needed"; }
+
+  virtual bool WriteChemObject(OBConversion* pConv);
+  virtual bool ReadChemObject(OBConversion* pConv);
+
+private:
+  struct Entry
+  {
+    OBBase* pOb;
+    SortKey key;
+  };
+  // A sorted run in a temporary file, or the molecules held (file==NULL)
+  struct Run
+  {
+    FILE* file;
+    SortKey key;        // of the next molecule
+    std::string record; // the next molecule, in obm format
+  };
+  struct EntryOrder
+  {
+    EntryOrder(SortFormat* pFormat) : _pFormat(pFormat){}
+    bool operator()(const Entry& e1, const Entry& e2) const
+    { return _pFormat->Less(e1.key, e2.key); }
+    SortFormat* _pFormat;
+  };
+  // Order of a heap whose top is the run with the first molecule; an
+  // earlier run goes first if the keys are the same
+  struct RunOrder
+  {
+    RunOrder(SortFormat* pFormat) : _pFormat(pFormat){}
+    bool operator()(unsigned r1, unsigned r2) const
+    {
+      const SortKey& k1 = _pFormat->_runs[r1].key;
+      const SortKey& k2 = _pFormat->_runs[r2].key;
+      if(_pFormat->Less(k2, k1))
+        return true;
+      return !_pFormat->Less(k1, k2) && r2 < r1;
+    }
+    SortFormat* _pFormat;
+  };
+
+  bool Less(const SortKey& k1, const SortKey& k2) const
   {
-    return _rev ?
-      _pDesc->Order(p2.second, p1.second) :
-      _pDesc->Order(p1.second, p2.second);
+    if(_numeric)
+      return _rev ? _pDesc->Order(k2.num, k1.num) : _pDesc->Order(k1.num, k2.num);
+    return _rev ? _pDesc->Order(k2.str, k1.str) : _pDesc->Order(k1.str, k2.str);
   }
+  static size_t Estimate(OBBase* pOb);
+  bool Spill();
+  bool ReadRun(Run& run);
+  void Output(OBConversion* pConv, OBBase* pOb, const SortKey& key);
+
+  OBFormat* _pRealOutFormat;
   OBDescriptor* _pDesc;
+  std::string _descOption;
   bool _rev;
+  bool _addDescToTitle;
+  bool _numeric;
+  double _budget;     // bytes
+  size_t _used;       // estimated size of the molecules held
+  std::vector<Entry> _entries;
+  unsigned _next;     // the next entry to output
+  std::vector<Run> _runs;
+  std::vector<unsigned> _heap;
+  OBConversion _serializer;
 };
+
 //*****************************************************************
 class OpSort : public OBOp
 {
@@ -48,15 +146,16 @@ public:
   OpSort(const char* ID) : OBOp(ID, false)
   {
     OBConversion::RegisterOptionParam(ID, NULL, 1, OBConversion::GENOPTIONS);
+    OBConversion::RegisterOptionParam("sortmem", NULL, 1, OBConversion::GENOPTIONS);
   }
 
   const char* Description(){ return "<desc> Sort by descriptor(~desc for reverse)"
     "\n Follow descriptor with + to also add it to the title, e.g. MW+ "
-    "\n Custom ordering is possible; see inchi descriptor"; }
+    "\n Custom ordering is possible; see inchi descriptor"
+    "\n Above --sortmem <MB> (default 1024) of molecules, sorts in temporary files"; }
 
   virtual bool WorksWith(OBBase* pOb)const{ return dynamic_cast<OBMol*>(pOb)!=NULL; }
   virtual bool Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion* pConv);
-  virtual bool ProcessVec(std::vector<OBBase*>& vec);
 private:
   OBDescriptor* _pDesc;
   std::string _pDescOption;
@@ -96,78 +195,251 @@ bool OpSort::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion*
     _pDescOption = spair.second;
     _pDesc->Init();//needed  to clear cache of InChIFilter
 
+    double megabytes = 1024;
+    const char* mem = pConv->IsOption("sortmem", OBConversion::GENOPTIONS);
+    if(mem && atof(mem) > 0)
+      megabytes = atof(mem);
 
-    //Make a deferred format and divert the output to it
-    new DeferredFormat(pConv, this); //it will delete itself
+    //Make a sorting format and divert the output to it
+    new SortFormat(pConv, _pDesc, _pDescOption, _rev, _addDescToTitle,
+                   megabytes * 1024 * 1024); //it will delete itself
   }
   return true;
 }
 
 //****************************************************************
-bool OpSort::ProcessVec(std::vector<OBBase*>& vec)
+// A rough size of a molecule in memory
+size_t SortFormat::Estimate(OBBase* pOb)
+{
+  size_t size = sizeof(OBMol);
+  for(OBDataIterator d=pOb->BeginData(); d!=pOb->EndData(); ++d)
+  {
+    size += 64;
+    if((*d)->GetDataType()==OBGenericDataType::PropertyBlockData)
+      size += static_cast<OBPropertyBlockData*>(*d)->GetBlock().size();
+    else if((*d)->GetDataType()==OBGenericDataType::PairData)
+      size += (*d)->GetValue().size();
+  }
+  OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+  if(pmol)
+    size += pmol->NumAtoms() * (sizeof(OBAtom) + 64) + pmol->NumBonds() * (sizeof(OBBond) + 32)
+      + pmol->NumConformers() * pmol->NumAtoms() * 3 * sizeof(double);
+  return size;
+}
+
+bool SortFormat::WriteChemObject(OBConversion* pConv)
 {
-  // Make a vector containing both the OBBase* and the descriptor value and the sort it
-  if(!IsNan(_pDesc->Predict(vec[0], &_pDescOption)))
-  {
-    //a numerical descriptor
-    //Copy into a pair vector
-    std::vector<std::pair<OBBase*,double> > valvec;
-    valvec.reserve(vec.size());
-    std::vector<OBBase*>::iterator iter;
-    for(iter=vec.begin();iter!=vec.end();++iter)
-      valvec.push_back(std::make_pair<OBBase*,double>(&(**iter), _pDesc->Predict(*iter, &_pDescOption)));
-
-    //Sort
-    std::sort(valvec.begin(),valvec.end(), Order<double>(_pDesc, _rev));
-
-    //Copy back
-    std::vector<std::pair<OBBase*,double> >::iterator valiter;
-    iter=vec.begin();
-    for(valiter=valvec.begin();valiter!=valvec.end();++valiter, ++iter)
+  OBBase* pOb = pConv->GetChemObject();
+  Entry entry;
+  entry.pOb = pOb;
+  if(_entries.empty() && _runs.empty())
+    _numeric = !IsNan(_pDesc->Predict(pOb, &_descOption));
+  if(_numeric)
+    entry.key.num = _pDesc->Predict(pOb, &_descOption);
+  else
+  {
+    entry.key.num = 0.0;
+    _pDesc->GetStringValue(pOb, entry.key.str, &_descOption);
+  }
+  _entries.push_back(entry);
+  _used += Estimate(pOb);
+
+  if(_used > _budget && !pConv->IsLast() && !Spill())
+  {
+    // the molecules held are deleted with this and the output is stopped
+    pConv->SetOutFormat(_pRealOutFormat);
+    delete this;
+    return false;
+  }
+
+  if(pConv->IsLast())
+  {
+    std::stable_sort(_entries.begin(), _entries.end(), EntryOrder(this));
+    if(!_runs.empty())
     {
-      *iter = valiter->first;
-      if(_addDescToTitle)
+      // the molecules held are the last run
+      Run held;
+      held.file = NULL;
+      _runs.push_back(held);
+      for(unsigned r=0; r<_runs.size(); ++r)
       {
-        std::stringstream ss;
-        ss << (*iter)->GetTitle() << ' ' << valiter->second;
-        (*iter)->SetTitle(ss.str().c_str());
+        if(_runs[r].file)
+          rewind(_runs[r].file);
+        if(ReadRun(_runs[r]))
+          _heap.push_back(r);
       }
+      std::make_heap(_heap.begin(), _heap.end(), RunOrder(this));
     }
+
+    //The options have already been applied
+    pConv->SetOptions("",OBConversion::GENOPTIONS);
+
+    //Now output the sorted molecules
+    pConv->SetInAndOutFormats(this, _pRealOutFormat);
+    std::ifstream ifs; // get rid of gcc warning
+    pConv->SetInStream(&ifs);//Not used, but Convert checks it is ok
+    pConv->GetInStream()->clear();
+    pConv->SetOutputIndex(0);
+    pConv->Convert();
   }
-  else
+  return true;
+}
+
+// Write the molecules held, sorted, to a temporary file: for each, the
+// key (a double, or the length and characters of a string), then the
+// length and bytes of the obm record. If that is not possible, the
+// molecules are kept in memory from then on. \return false if the file
+// could not be written
+bool SortFormat::Spill()
+{
+  if(!_serializer.GetInFormat())
+  {
+    if(!_serializer.SetInAndOutFormats("obm", "obm"))
+    {
+      obErrorLog.ThrowError(__FUNCTION__,
+        "The obm format is not available to sort in temporary files", obWarning, onceOnly);
+      _budget = HUGE_VAL;
+      return true;
+    }
+    _serializer.AddOption("s", OBConversion::OUTOPTIONS); // don't drop data
+  }
+  FILE* file = tmpfile();
+  if(!file)
   {
-    //a string descriptor
-    //Copy into a pair vector
-    std::vector<std::pair<OBBase*,std::string> > valvec;
-    valvec.reserve(vec.size());
-    std::vector<OBBase*>::iterator iter;
-    std::string s;
-    for(iter=vec.begin();iter!=vec.end();++iter)
+    obErrorLog.ThrowError(__FUNCTION__, "Cannot make a temporary file to sort", obWarning, onceOnly);
+    _budget = HUGE_VAL;
+    return true;
+  }
+  std::stable_sort(_entries.begin(), _entries.end(), EntryOrder(this));
+  bool ok = true;
+  for(unsigned i=0; i<_entries.size() && ok; ++i)
+  {
+    obErrorLog.StopLogging(); // the warning below is enough
+    std::string record = _serializer.WriteString(_entries[i].pOb);
+    obErrorLog.StartLogging();
+    if(record.empty())
     {
-      _pDesc->GetStringValue(*iter, s, &_pDescOption);
-      valvec.push_back(std::pair<OBBase*,std::string>(&(**iter), s));
+      obErrorLog.ThrowError(__FUNCTION__,
+        "Sorting in memory because the molecules have data which cannot be put in temporary files",
+        obWarning, onceOnly);
+      fclose(file);
+      _budget = HUGE_VAL;
+      return true;
     }
+    const SortKey& key = _entries[i].key;
+    if(_numeric)
+      ok = fwrite(&key.num, sizeof(double), 1, file)==1;
+    else
+    {
+      uint64_t length = key.str.size();
+      ok = fwrite(&length, sizeof(length), 1, file)==1
+        && fwrite(key.str.data(), 1, key.str.size(), file)==key.str.size();
+    }
+    uint64_t length = record.size();
+    ok = ok && fwrite(&length, sizeof(length), 1, file)==1
+      && fwrite(record.data(), 1, record.size(), file)==record.size();
+  }
+  if(!ok || fflush(file)!=0)
+  {
+    obErrorLog.ThrowError(__FUNCTION__, "Error writing a temporary file to sort", obError, onceOnly);
+    fclose(file);
+    return false;
+  }
+  for(unsigned i=0; i<_entries.size(); ++i)
+    delete _entries[i].pOb;
+  _entries.clear();
+  _used = 0;
+  Run run;
+  run.file = file;
+  _runs.push_back(run);
+  return true;
+}
 
-    //Sort
-    std::sort(valvec.begin(),valvec.end(), Order<std::string>(_pDesc, _rev));
+// Read the key and record of the next molecule of a run
+bool SortFormat::ReadRun(Run& run)
+{
+  if(!run.file)
+  {
+    if(_next >= _entries.size())
+      return false;
+    run.key = _entries[_next].key;
+    return true;
+  }
+  uint64_t length;
+  if(_numeric)
+  {
+    if(fread(&run.key.num, sizeof(double), 1, run.file)!=1)
+      return false;
+  }
+  else
+  {
+    if(fread(&length, sizeof(length), 1, run.file)!=1)
+      return false;
+    run.key.str.resize(length);
+    if(length && fread(&run.key.str[0], 1, length, run.file)!=length)
+      return false;
+  }
+  if(fread(&length, sizeof(length), 1, run.file)!=1)
+    return false;
+  run.record.resize(length);
+  return !length || fread(&run.record[0], 1, length, run.file)==length;
+}
+
+void SortFormat::Output(OBConversion* pConv, OBBase* pOb, const SortKey& key)
+{
+  if(_addDescToTitle)
+  {
+    std::stringstream ss;
+    ss << pOb->GetTitle() << ' ';
+    if(_numeric)
+      ss << key.num;
+    else
+      ss << key.str;
+    pOb->SetTitle(ss.str().c_str());
+  }
+  pConv->AddChemObject(pOb);
+}
 
-    //Copy back
-    std::vector<std::pair<OBBase*,std::string> >::iterator valiter;
-    iter=vec.begin();
-    for(valiter=valvec.begin();valiter!=valvec.end();++valiter, ++iter)
+bool SortFormat::ReadChemObject(OBConversion* pConv)
+{
+  if(_runs.empty())
+  {
+    // all the molecules were held
+    if(_next >= _entries.size())
     {
-      *iter = valiter->first;
-      if(_addDescToTitle)
-      {
-        std::stringstream ss;
-        ss << (*iter)->GetTitle() << ' ' << valiter->second;
-        (*iter)->SetTitle(ss.str().c_str());
-      }
+      delete this;//self destruction; was made in new in an OBOp
+      return false;
     }
+    Output(pConv, _entries[_next].pOb, _entries[_next].key);
+    ++_next;
+    return true;
   }
 
+  if(_heap.empty())
+  {
+    delete this;
+    return false;
+  }
+  std::pop_heap(_heap.begin(), _heap.end(), RunOrder(this));
+  Run& run = _runs[_heap.back()];
+  SortKey key = run.key;
+  OBBase* pOb;
+  if(run.file)
+  {
+    OBMol* pmol = new OBMol;
+    _serializer.ReadString(pmol, run.record);
+    pOb = pmol;
+  }
+  else
+    pOb = _entries[_next++].pOb;
+  if(ReadRun(run))
+    std::push_heap(_heap.begin(), _heap.end(), RunOrder(this));
+  else
+    _heap.pop_back();
+  Output(pConv, pOb, key);
   return true;
 }
+
 /*
 This started as a nice compact piece of code! The need to handle descriptors
 which return either numbers or strings was originally achieved without testing
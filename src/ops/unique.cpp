@@ -15,12 +15,21 @@ but WITHOUT ANY WARRANTY; without even the implied warranty of
 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 GNU General Public License for more details.
 ***********************************************************************/
+// the --uniquehash verify file can be larger than 2GB
+#ifndef _FILE_OFFSET_BITS
+  #define _FILE_OFFSET_BITS 64
+#endif
 #include <openbabel/babelconfig.h>
 #include <openbabel/op.h>
 #include <openbabel/mol.h>
 #include <openbabel/obconversion.h>
 #include <openbabel/descriptor.h>
 #include <openbabel/inchiformat.h>
+#include <openbabel/generic.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
 #if defined(_MSC_VER) || defined(_LIBCPP_VERSION)
   #include <unordered_map>
 #elif (__GNUC__ == 4 && __GNUC_MINOR__ >= 1 && !defined(__APPLE_CC__))
@@ -45,11 +54,123 @@ using namespace std;
 namespace OpenBabel
 {
 
+// A 128-bit hash of a descriptor value
+struct KeyHash
+{
+  uint64_t h1, h2;
+};
+
+/// MurmurHash3 x64_128 by Austin Appleby (public domain)
+static KeyHash HashKey(const std::string& s)
+{
+  const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(s.data());
+  const size_t len = s.size(), nblocks = len / 16;
+  uint64_t h1 = 0, h2 = 0;
+  struct Mix
+  {
+    static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t Load(const unsigned char* p, size_t n)
+    {
+      uint64_t k = 0;
+      for(size_t i = 0; i < n; ++i)
+        k |= static_cast<uint64_t>(p[i]) << (8 * i);
+      return k;
+    }
+    static uint64_t Final(uint64_t k)
+    {
+      k ^= k >> 33; k *= 0xff51afd7ed558ccdULL;
+      k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ULL;
+      return k ^ (k >> 33);
+    }
+  };
+  for(size_t i = 0; i < nblocks; ++i)
+  {
+    uint64_t k1 = Mix::Load(data + 16 * i, 8), k2 = Mix::Load(data + 16 * i + 8, 8);
+    k1 *= c1; k1 = Mix::Rotl(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = Mix::Rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2; k2 = Mix::Rotl(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = Mix::Rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+  const unsigned char* tail = data + 16 * nblocks;
+  const size_t rest = len & 15;
+  if(rest > 8)
+  {
+    uint64_t k2 = Mix::Load(tail + 8, rest - 8);
+    k2 *= c2; k2 = Mix::Rotl(k2, 33); k2 *= c1; h2 ^= k2;
+  }
+  if(rest)
+  {
+    uint64_t k1 = Mix::Load(tail, rest < 8 ? rest : 8);
+    k1 *= c1; k1 = Mix::Rotl(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+  h1 ^= len; h2 ^= len;
+  h1 += h2; h2 += h1;
+  h1 = Mix::Final(h1); h2 = Mix::Final(h2);
+  h1 += h2; h2 += h1;
+  KeyHash hash = { h1, h2 };
+  return hash;
+}
+
+/// An open addressing hash table of 128-bit key hashes, each with a number:
+/// 24 bytes for each entry, and at most twice that when it has just grown.
+class KeyHashTable
+{
+public:
+  struct Slot
+  {
+    KeyHash hash;
+    uint64_t value; // 0 for an empty slot
+  };
+  KeyHashTable() : _count(0) {}
+  void Clear() { _slots.clear(); _count = 0; }
+
+  /// \return the slot with the hash, or an empty slot where it can be added
+  Slot& Find(const KeyHash& hash)
+  {
+    if(_slots.empty() || 4 * (_count + 1) > 3 * _slots.size())
+      Grow();
+    return Probe(_slots, hash);
+  }
+  /// Call after setting the value of an empty slot returned by Find()
+  void Added() { ++_count; }
+
+private:
+  static Slot& Probe(std::vector<Slot>& slots, const KeyHash& hash)
+  {
+    size_t mask = slots.size() - 1;
+    for(size_t i = hash.h1 & mask; ; i = (i + 1) & mask)
+      if(!slots[i].value || (slots[i].hash.h1 == hash.h1 && slots[i].hash.h2 == hash.h2))
+        return slots[i];
+  }
+  void Grow()
+  {
+    std::vector<Slot> slots(_slots.empty() ? 1024 : 2 * _slots.size());
+    for(size_t i = 0; i < _slots.size(); ++i)
+      if(_slots[i].value)
+        Probe(slots, _slots[i].hash) = _slots[i];
+    _slots.swap(slots);
+  }
+  std::vector<Slot> _slots;
+  size_t _count;
+};
+
+/// Seek in the --uniquehash verify file with 64-bit offsets
+static bool SeekKeyFile(FILE* fp, uint64_t pos)
+{
+#ifdef _MSC_VER
+  return _fseeki64(fp, static_cast<__int64>(pos), SEEK_SET)==0;
+#else
+  return fseeko(fp, static_cast<off_t>(pos), SEEK_SET)==0;
+#endif
+}
+
 class OpUnique : public OBOp
 {
 public:
-  OpUnique(const char* ID) : OBOp(ID, false){
-    OBConversion::RegisterOptionParam("unique", NULL, 1, OBConversion::GENOPTIONS);}
+  OpUnique(const char* ID) : OBOp(ID, false), _keyFile(NULL){
+    OBConversion::RegisterOptionParam("unique", NULL, 1, OBConversion::GENOPTIONS);
+    OBConversion::RegisterOptionParam("uniquehash", NULL, 1, OBConversion::GENOPTIONS);}
 
   const char* Description(){ return
     "[param] remove duplicates by descriptor;default inchi\n"
@@ -68,18 +189,35 @@ public:
     "/noEZ     ignore E/Z steroeochemistry\n"
     "/nochg    ignore charge and protonation\n"
     "/noiso    ignore isotopes\n\n"
+
+    "For large inputs, --uniquehash keeps only a 128-bit hash of each\n"
+    "descriptor value, and a duplicate is reported with the number of the\n"
+    "molecule it duplicates. With --uniquehash verify, the values and titles\n"
+    "are also written to a temporary file, so that a duplicate is checked\n"
+    "against the full value and reported with its title.\n"
+    "With --threads, the values are computed in the reading threads.\n\n"
 ; }
 
   virtual bool WorksWith(OBBase* pOb)const{ return dynamic_cast<OBMol*>(pOb)!=NULL; }
   virtual bool Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion* pConv);
+  virtual bool Prepare(OBBase* pOb, const char* OptionText, OBConversion* pConv);
+  void CloseKeyFile();
 
 private:
+  static OBDescriptor* ParseOption(const char* OptionText, bool& inv, std::string& trunc);
+  static void GetKey(OBMol* pmol, OBDescriptor* pDesc, std::string& trunc, std::string& s);
+  bool IsDuplicate(const std::string& s, OBMol* pmol, std::string& original);
 
   bool _reportDup;
   std::string _trunc;
   OBDescriptor* _pDesc;
   unsigned _ndups;
   bool _inv;
+  bool _hashed;
+  FILE* _keyFile;     // values and titles with --uniquehash verify
+  uint64_t _keyFileSize;
+  uint64_t _nmols;    // molecules seen
+  KeyHashTable _hashes;
 
 #ifdef NO_UNORDERED_MAP
   typedef map<std::string, std::string> UMap;
@@ -88,12 +226,109 @@ private:
 #endif
 
   //key is descriptor text(usually inchi) value is molecule title
+  //With --uniquehash verify, has only those whose hash was already present
   UMap _inchimap;
 };
 
 /////////////////////////////////////////////////////////////////
 OpUnique theOpUnique("unique"); //Global instance
 
+// The attribute of the OBPairData with a descriptor value computed by Prepare()
+static const char* PreparedKey = "OpenBabel Unique Key";
+
+/// Passes the output objects on to the real output format and closes the
+/// --uniquehash verify file after the last one. Like DeferredFormat, it is
+/// not registered and deletes itself.
+class UniqueEndFormat : public OBFormat
+{
+public:
+  UniqueEndFormat(OBConversion* pConv, OpUnique* pOp)
+    : _pRealOutFormat(pConv->GetOutFormat()), _pOp(pOp)
+  {
+    pConv->SetOutFormat(this);
+  }
+  virtual const char* Description() { return "Pass-through output for --uniquehash verify"; }
+  virtual unsigned int Flags() { return _pRealOutFormat->Flags(); }
+  virtual bool WriteChemObject(OBConversion* pConv)
+  {
+    // the real format may look itself up with GetOutFormat()
+    pConv->SetOutFormat(_pRealOutFormat);
+    bool ret = _pRealOutFormat->WriteChemObject(pConv);
+    if(ret && !pConv->IsLast())
+      pConv->SetOutFormat(this);
+    else
+    {
+      _pOp->CloseKeyFile();
+      delete this;
+    }
+    return ret;
+  }
+private:
+  OBFormat* _pRealOutFormat;
+  OpUnique* _pOp;
+};
+
+void OpUnique::CloseKeyFile()
+{
+  if(_keyFile)
+    fclose(_keyFile);
+  _keyFile = NULL;
+}
+
+/////////////////////////////////////////////////////////////////
+OBDescriptor* OpUnique::ParseOption(const char* OptionText, bool& inv, std::string& trunc)
+{
+  string descID("inchi"); // the default
+  trunc.clear();
+  inv = OptionText[0]=='~';   //has the parameter a leading ~ ?
+
+  if(OptionText[0+inv]=='/')  //is parameter is /x?
+    trunc = OptionText+inv;
+  else if(OptionText[0+inv]!='\0') // not empty?
+    descID = OptionText+inv;
+
+  OBDescriptor* pDesc = OBDescriptor::FindType(descID.c_str());
+  if(!pDesc)
+    obErrorLog.ThrowError(__FUNCTION__,
+            "Cannot find descriptor " + descID, obError, onceOnly);
+  return pDesc;
+}
+
+void OpUnique::GetKey(OBMol* pmol, OBDescriptor* pDesc, std::string& trunc, std::string& s)
+{
+  if(strncasecmp(pDesc->GetID(), "inchi", 5)==0)
+  {
+    // the InChI library is not reentrant
+#ifdef _OPENMP
+    #pragma omp critical (smiles_inchi)
+#endif
+    pDesc->GetStringValue(pmol, s);
+  }
+  else
+    pDesc->GetStringValue(pmol, s);
+
+  if(!trunc.empty())
+    InChIFormat::EditInchi(s, trunc);
+}
+
+bool OpUnique::Prepare(OBBase* pOb, const char* OptionText, OBConversion* pConv)
+{
+  OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+  bool inv;
+  std::string trunc;
+  OBDescriptor* pDesc;
+  if(!pmol || !(pDesc = ParseOption(OptionText, inv, trunc)))
+    return false;
+  std::string s;
+  GetKey(pmol, pDesc, trunc, s);
+  OBPairData* dp = new OBPairData;
+  dp->SetAttribute(PreparedKey);
+  dp->SetValue(s);
+  dp->SetOrigin(local);
+  pmol->SetData(dp);
+  return true;
+}
+
 /////////////////////////////////////////////////////////////////
 bool OpUnique::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion* pConv)
 {
@@ -104,45 +339,52 @@ bool OpUnique::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion
   if(pConv->IsFirstInput())
   {
     _ndups=0;
-    string descID("inchi"); // the default
-    _trunc.clear();
-    _inv = OptionText[0]=='~';   //has the parameter a leading ~ ?
+    _pDesc = ParseOption(OptionText, _inv, _trunc);
     if(_inv)
       clog << "The output has the duplicate structures" << endl;
-
-    if(OptionText[0+_inv]=='/')  //is parameter is /x?
-      _trunc = OptionText+_inv;
-    else if(OptionText[0+_inv]!='\0') // not empty?
-      descID = OptionText+_inv;
-
-    _pDesc = OBDescriptor::FindType(descID.c_str());
     if(!_pDesc)
-    {
-      obErrorLog.ThrowError(__FUNCTION__,
-              "Cannot find descriptor " + descID, obError, onceOnly);
       return false;
-    }
     _pDesc->Init();
     _inchimap.clear();
+    _hashes.Clear();
+    _nmols = 0;
+    CloseKeyFile(); // if a previous conversion stopped early
+    _keyFileSize = 0;
+    const char* hashOption = pConv->IsOption("uniquehash", OBConversion::GENOPTIONS);
+    _hashed = hashOption!=NULL;
+    if(_hashed && !strcmp(hashOption, "verify"))
+    {
+      if(!(_keyFile = tmpfile()))
+        obErrorLog.ThrowError(__FUNCTION__,
+          "Cannot make a temporary file for --uniquehash verify", obWarning, onceOnly);
+      else if(pConv->GetOutFormat())
+        new UniqueEndFormat(pConv, this); // it will delete itself
+    }
 
     _reportDup = !_inv; //do not report duplicates when they are the output
   }
 
   if(!_pDesc)
     return false;
+  ++_nmols;
   std::string s;
-  _pDesc->GetStringValue(pmol, s);
+  OBPairData* dp = static_cast<OBPairData*>(pmol->GetData(PreparedKey));
+  if(dp)
+  {
+    s = dp->GetValue();
+    pmol->DeleteData(dp);
+  }
+  else
+    GetKey(pmol, _pDesc, _trunc, s);
 
-  if(!_trunc.empty())
-    InChIFormat::EditInchi(s, _trunc);
-  std::pair<UMap::iterator, bool> result = _inchimap.insert(make_pair(s, pmol->GetTitle()));
+  std::string original;
   bool ret = true;
-  if(!s.empty() && !result.second)
+  if(!s.empty() && IsDuplicate(s, pmol, original))
   {
     // InChI is already present in set
     ++_ndups;
     if(_reportDup)
-      clog << "Removed " << pmol->GetTitle() << " - a duplicate of " << result.first->second
+      clog << "Removed " << pmol->GetTitle() << " - a duplicate of " << original
          << " (#" << _ndups << ")" << endl;
     //delete pOb;
     ret = false; //filtered out
@@ -154,6 +396,86 @@ bool OpUnique::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion
   return ret;
 }
 
+/// \return true if the descriptor value \p s has been seen before, with
+/// \p original the title, or number, of the molecule it was first seen in.
+/// Otherwise it is stored.
+bool OpUnique::IsDuplicate(const std::string& s, OBMol* pmol, std::string& original)
+{
+  if(!_hashed)
+  {
+    std::pair<UMap::iterator, bool> result = _inchimap.insert(make_pair(s, pmol->GetTitle()));
+    original = result.first->second;
+    return !result.second;
+  }
+
+  KeyHash hash = HashKey(s);
+  KeyHashTable::Slot& slot = _hashes.Find(hash);
+  if(!slot.value)
+  {
+    // new: with verify, the value and title are stored at the end of the
+    // file, and the slot has their position
+    if(_keyFile)
+    {
+      // kept in memory after a failed write?
+      UMap::iterator it = _inchimap.find(s);
+      if(it!=_inchimap.end())
+      {
+        original = it->second;
+        return true;
+      }
+      uint32_t lengths[2] = { static_cast<uint32_t>(s.size()),
+                              static_cast<uint32_t>(strlen(pmol->GetTitle())) };
+      if(!SeekKeyFile(_keyFile, _keyFileSize)
+         || fwrite(lengths, sizeof(uint32_t), 2, _keyFile)!=2
+         || fwrite(s.data(), 1, lengths[0], _keyFile)!=lengths[0]
+         || fwrite(pmol->GetTitle(), 1, lengths[1], _keyFile)!=lengths[1])
+      {
+        // the hash is not added, so the value is checked in full, in memory
+        obErrorLog.ThrowError(__FUNCTION__,
+          "Cannot write to the temporary file for --uniquehash verify. "
+          "Values which cannot be stored are kept in memory", obError, onceOnly);
+        std::pair<UMap::iterator, bool> result = _inchimap.insert(make_pair(s, pmol->GetTitle()));
+        original = result.first->second;
+        return !result.second;
+      }
+      slot.value = _keyFileSize + 1;
+      _keyFileSize += 2 * sizeof(uint32_t) + lengths[0] + lengths[1];
+    }
+    else
+      slot.value = _nmols;
+    slot.hash = hash;
+    _hashes.Added();
+    return false;
+  }
+
+  if(!_keyFile)
+  {
+    std::stringstream ss;
+    ss << "molecule " << slot.value;
+    original = ss.str();
+    return true;
+  }
+
+  // check the value stored with the same hash
+  uint32_t lengths[2] = { 0, 0 };
+  std::string stored;
+  if(SeekKeyFile(_keyFile, slot.value - 1)
+     && fread(lengths, sizeof(uint32_t), 2, _keyFile)==2)
+  {
+    stored.resize(lengths[0]);
+    original.resize(lengths[1]);
+    if((lengths[0] && fread(&stored[0], 1, lengths[0], _keyFile)!=lengths[0])
+       || (lengths[1] && fread(&original[0], 1, lengths[1], _keyFile)!=lengths[1]))
+      stored.clear();
+  }
+  if(stored==s)
+    return true;
+  // a different value with the same hash
+  std::pair<UMap::iterator, bool> result = _inchimap.insert(make_pair(s, pmol->GetTitle()));
+  original = result.first->second;
+  return !result.second;
+}
+
 
 }//namespace
 /*
@@ -171,6 +493,14 @@ OpUnique works by attempting to insert the string value of the descriptor for
 each molecule to an internal std::unordered_map. If the string has been seen
 previously, the molecule is deleted and OpUnique::Do() returns false, which
 causes the molecule not to be output.
+With --uniquehash only a 128-bit MurmurHash3 of the string is kept, in an
+open addressing table, which needs about 24-48 bytes per unique molecule
+instead of the string and the title. Two different strings with the same
+hash are then taken as duplicates, which is very unlikely; --uniquehash verify
+rules it out by keeping the strings and titles in a temporary file and
+reading back the one stored when a hash is found.
+With --threads, Prepare() computes the string in the reading threads. Calls
+into the InChI library are serialized.
 
 InChI trucation values. param can be a concatination of these e.g. /nochg/noiso
 /formula  formula only
@@ -0,0 +1,692 @@
+/**********************************************************************
+parallelzip.cpp - Multi-threaded gzip streams: read-ahead decompression,
+                  parallel block compression and BGZF random access
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <openbabel/babelconfig.h>
+#include <openbabel/parallelzip.h>
+
+#ifdef HAVE_LIBZ
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
+using namespace std;
+
+namespace OpenBabel
+{
+  //! Characters kept before the get area of the input buffers for putback
+  static const size_t PUTBACK = 4;
+
+  //! Blocks compressed or inflated together, one per thread
+  static size_t BatchSize()
+  {
+#ifdef _OPENMP
+    return 2 * static_cast<size_t>(omp_get_max_threads());
+#else
+    return 1;
+#endif
+  }
+
+  static void PutLE(string &s, unsigned long long value, unsigned int bytes)
+  {
+    for (unsigned int i = 0; i < bytes; ++i, value >>= 8)
+      s += static_cast<char>(value & 0xff);
+  }
+
+  static unsigned long long GetLE(const unsigned char *p, unsigned int bytes)
+  {
+    unsigned long long value = 0;
+    for (unsigned int i = bytes; i > 0; --i)
+      value = (value << 8) | p[i - 1];
+    return value;
+  }
+
+  //! Raw deflate (no header) of \p size bytes, primed with \p dict. The
+  //! output ends on a byte boundary, with the last block flag set only when
+  //! \p flush is Z_FINISH, so the outputs for consecutive blocks can be
+  //! concatenated.
+  static bool DeflateRaw(const char *data, size_t size, const char *dict, size_t dictSize,
+                         int level, int flush, string &out)
+  {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+    if (dictSize)
+      deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(dict), static_cast<uInt>(dictSize));
+    out.resize(deflateBound(&zs, static_cast<uLong>(size)) + 16);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(size);
+    size_t used = 0;
+    bool ok = true;
+    for (;;) {
+      zs.next_out = reinterpret_cast<Bytef*>(&out[used]);
+      zs.avail_out = static_cast<uInt>(out.size() - used);
+      int ret = deflate(&zs, flush);
+      used = out.size() - zs.avail_out;
+      if (ret == Z_STREAM_END || (ret == Z_OK && flush != Z_FINISH && zs.avail_out != 0))
+        break;
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        ok = false;
+        break;
+      }
+      out.resize(2 * out.size());
+    }
+    deflateEnd(&zs);
+    out.resize(used);
+    return ok;
+  }
+
+  //! Inflate a raw deflate stream of exactly \p size bytes into \p out
+  static bool InflateRaw(const char *data, size_t dataSize, char *out, size_t size)
+  {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK)
+      return false;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(dataSize);
+    char dummy;
+    zs.next_out = reinterpret_cast<Bytef*>(size ? out : &dummy);
+    zs.avail_out = static_cast<uInt>(size ? size : 1);
+    int ret = inflate(&zs, Z_FINISH);
+    bool ok = ret == Z_STREAM_END && zs.total_out == size;
+    inflateEnd(&zs);
+    return ok;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+
+  OBReadAheadStreambuf::OBReadAheadStreambuf(istream &source, size_t blockSize, size_t maxBlocks)
+    : _source(source), _blockSize(max(blockSize, static_cast<size_t>(1))),
+      _maxBlocks(max(maxBlocks, static_cast<size_t>(1))), _started(false), _end(false),
+      _stop(false), _current(PUTBACK), _start(0)
+  {
+    streampos pos = source.tellg();
+    if (pos != streampos(-1))
+      _start = pos;
+    char *data = &_current[0] + PUTBACK;
+    setg(data, data, data);
+  }
+
+  OBReadAheadStreambuf::~OBReadAheadStreambuf()
+  {
+    Stop();
+  }
+
+  void OBReadAheadStreambuf::Stop()
+  {
+    if (_thread.joinable()) {
+      {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+      }
+      _emptied.notify_all();
+      _thread.join();
+      _stop = false;
+    }
+    // the blocks already read are kept, and the thread is restarted
+    // for more if the source has not ended
+    _started = false;
+  }
+
+  // The reader thread. A block read when the thread is stopped is still
+  // queued, so that none of the source is lost.
+  void OBReadAheadStreambuf::Run()
+  {
+    for (;;) {
+      vector<char> block(PUTBACK + _blockSize);
+      streamsize n = 0;
+      bool end = true;
+      try {
+        _source.read(&block[PUTBACK], static_cast<streamsize>(_blockSize));
+        n = _source.gcount();
+        end = !_source;
+      }
+      catch (...) {
+      }
+      block.resize(PUTBACK + static_cast<size_t>(n));
+
+      unique_lock<mutex> lock(_mutex);
+      _emptied.wait(lock, [this] { return _stop || _queue.size() < _maxBlocks; });
+      if (n > 0) {
+        _queue.push_back(vector<char>());
+        _queue.back().swap(block);
+      }
+      _end = end;
+      bool stop = _stop || end;
+      lock.unlock();
+      _filled.notify_one();
+      if (stop)
+        return;
+    }
+  }
+
+  OBReadAheadStreambuf::int_type OBReadAheadStreambuf::underflow()
+  {
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    vector<char> block;
+    {
+      unique_lock<mutex> lock(_mutex);
+      if (!_started && !_end && _queue.empty()) {
+        _started = true;
+        _thread = thread(&OBReadAheadStreambuf::Run, this);
+      }
+      _filled.wait(lock, [this] { return !_queue.empty() || _end || !_started; });
+      if (_queue.empty())
+        return traits_type::eof();
+      block.swap(_queue.front());
+      _queue.pop_front();
+    }
+    _emptied.notify_one();
+
+    // the last characters of the previous block can be put back
+    size_t keep = min(PUTBACK, static_cast<size_t>(egptr() - eback()));
+    memcpy(&block[PUTBACK - keep], egptr() - keep, keep);
+    _start += egptr() - (&_current[0] + PUTBACK);
+    _current.swap(block);
+    char *data = &_current[0] + PUTBACK;
+    setg(data - keep, data, &_current[0] + _current.size());
+    return traits_type::to_int_type(*gptr());
+  }
+
+  void OBReadAheadStreambuf::Discard(streamoff pos)
+  {
+    Stop();
+    _queue.clear();
+    _end = false;
+    _start = pos;
+    _current.assign(PUTBACK, 0);
+    char *data = &_current[0] + PUTBACK;
+    setg(data, data, data);
+  }
+
+  streampos OBReadAheadStreambuf::seekoff(streamoff off, ios_base::seekdir way,
+                                          ios_base::openmode which)
+  {
+    if (!(which & ios_base::in))
+      return streampos(streamoff(-1));
+    char *data = &_current[0] + PUTBACK;
+    streamoff pos = _start + (gptr() - data);
+    if (way == ios_base::cur && off == 0) // tellg()
+      return streampos(pos);
+    if (way == ios_base::end) {
+      Discard(0);
+      _source.clear();
+      if (!_source.seekg(off, ios_base::end))
+        return streampos(streamoff(-1));
+      _start = _source.tellg();
+      return streampos(_start);
+    }
+    return seekpos(streampos(way == ios_base::cur ? pos + off : off), which);
+  }
+
+  streampos OBReadAheadStreambuf::seekpos(streampos sp, ios_base::openmode which)
+  {
+    if (!(which & ios_base::in))
+      return streampos(streamoff(-1));
+    char *data = &_current[0] + PUTBACK;
+    streamoff pos = sp;
+    // within the current block, including the putback area
+    if (pos >= _start - (data - eback()) && pos <= _start + (egptr() - data)) {
+      setg(eback(), data + (pos - _start), egptr());
+      return sp;
+    }
+    Discard(pos);
+    _source.clear();
+    if (!_source.seekg(sp))
+      return streampos(streamoff(-1));
+    return sp;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+
+  // The largest uncompressed block of BGZF (as used by bgzip), leaving room
+  // for the header and trailer if the data does not compress
+  static const size_t BGZF_BLOCK_SIZE = 0xff00;
+  static const size_t BGZF_MAX_BLOCK = 0x10000;
+  static const size_t BGZF_HEADER = 18, BGZF_TRAILER = 8;
+  static const unsigned char BGZF_EOF[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+  //! A BGZF block: a gzip member with the block size in a "BC" extra field
+  static bool DeflateBgzf(const char *data, size_t size, int level, string &out)
+  {
+    string cdata;
+    if (!DeflateRaw(data, size, NULL, 0, level, Z_FINISH, cdata))
+      return false;
+    if (cdata.size() + BGZF_HEADER + BGZF_TRAILER > BGZF_MAX_BLOCK
+        && !DeflateRaw(data, size, NULL, 0, 0, Z_FINISH, cdata)) // stored
+      return false;
+    const size_t total = cdata.size() + BGZF_HEADER + BGZF_TRAILER;
+    out.clear();
+    out.reserve(total);
+    out.append(reinterpret_cast<const char*>(BGZF_EOF), 16); // the same header
+    PutLE(out, total - 1, 2);
+    out += cdata;
+    PutLE(out, crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(data),
+                     static_cast<uInt>(size)), 4);
+    PutLE(out, size, 4);
+    return true;
+  }
+
+  OBParallelZipStreambuf::OBParallelZipStreambuf(ostream &dest, bool bgzf, int level)
+    : _dest(dest), _bgzf(bgzf), _level(level), _blockSize(bgzf ? BGZF_BLOCK_SIZE : 128 * 1024),
+      _block(_blockSize), _size(0), _compressedPos(0), _uncompressedPos(0), _finished(false)
+  {
+    _crc = crc32(0L, Z_NULL, 0);
+    setp(&_block[0], &_block[0] + _blockSize);
+    if (!_bgzf) {
+      // no file name or time; the OS is unknown
+      static const char header[10] = { 0x1f, static_cast<char>(0x8b), 0x08, 0, 0, 0, 0, 0, 0,
+                                       static_cast<char>(0xff) };
+      _dest.write(header, sizeof(header));
+    }
+  }
+
+  OBParallelZipStreambuf::~OBParallelZipStreambuf()
+  {
+    Finish();
+  }
+
+  OBParallelZipStreambuf::int_type OBParallelZipStreambuf::overflow(int_type c)
+  {
+    if (_finished)
+      return traits_type::eof();
+    QueueBlock();
+    if (_pending.size() >= BatchSize())
+      CompressBlocks(false);
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  // Blocks are only compressed when full, or by Finish()
+  int OBParallelZipStreambuf::sync()
+  {
+    return 0;
+  }
+
+  void OBParallelZipStreambuf::QueueBlock()
+  {
+    size_t n = pptr() - pbase();
+    if (n == 0)
+      return;
+    _pending.push_back(vector<char>());
+    _pending.back().swap(_block);
+    _pending.back().resize(n);
+    _block.resize(_blockSize);
+    setp(&_block[0], &_block[0] + _blockSize);
+  }
+
+  void OBParallelZipStreambuf::CompressBlocks(bool last)
+  {
+    const int n = static_cast<int>(_pending.size());
+    vector<string> out(n);
+    vector<unsigned long> crcs(n);
+    vector<char> ok(n, 1);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < n; ++i) {
+      const vector<char> &block = _pending[i];
+      const char *data = block.empty() ? "" : &block[0];
+      if (_bgzf) {
+        ok[i] = DeflateBgzf(data, block.size(), _level, out[i]);
+        continue;
+      }
+      // primed with the end of the previous block, as a single deflate
+      // stream would have been
+      const char *dict = _dictionary.data();
+      size_t dictSize = _dictionary.size();
+      if (i > 0) {
+        const vector<char> &prev = _pending[i - 1];
+        dictSize = min(prev.size(), static_cast<size_t>(32768));
+        dict = &prev[0] + prev.size() - dictSize;
+      }
+      crcs[i] = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(data),
+                      static_cast<uInt>(block.size()));
+      ok[i] = DeflateRaw(data, block.size(), dict, dictSize, _level,
+                         last && i == n - 1 ? Z_FINISH : Z_SYNC_FLUSH, out[i]);
+    }
+
+    for (int i = 0; i < n; ++i) {
+      if (!ok[i]) {
+        _dest.setstate(ios_base::badbit);
+        break;
+      }
+      const size_t size = _pending[i].size();
+      if (_bgzf && _compressedPos > 0)
+        _index.push_back(make_pair(_compressedPos, _uncompressedPos));
+      _dest.write(out[i].data(), static_cast<streamsize>(out[i].size()));
+      _compressedPos += out[i].size();
+      _uncompressedPos += size;
+      if (!_bgzf) {
+        _crc = crc32_combine(_crc, crcs[i], static_cast<z_off_t>(size));
+        _size += static_cast<unsigned long>(size);
+      }
+    }
+
+    if (!_bgzf && n > 0) {
+      const vector<char> &block = _pending.back();
+      size_t dictSize = min(block.size(), static_cast<size_t>(32768));
+      if (dictSize)
+        _dictionary.assign(&block[0] + block.size() - dictSize, dictSize);
+    }
+    _pending.clear();
+  }
+
+  bool OBParallelZipStreambuf::Finish()
+  {
+    if (_finished)
+      return _dest.good();
+    _finished = true;
+    QueueBlock();
+    if (!_bgzf && _pending.empty())
+      _pending.push_back(vector<char>()); // to end the deflate stream
+    CompressBlocks(true);
+    setp(NULL, NULL);
+
+    string trailer;
+    if (_bgzf)
+      trailer.assign(reinterpret_cast<const char*>(BGZF_EOF), sizeof(BGZF_EOF));
+    else {
+      PutLE(trailer, _crc, 4);
+      PutLE(trailer, _size & 0xffffffffUL, 4);
+    }
+    _dest.write(trailer.data(), static_cast<streamsize>(trailer.size()));
+    _dest.flush();
+
+    if (_bgzf && !_indexFile.empty()) {
+      ofstream ofs(_indexFile.c_str(), ios_base::out | ios_base::binary);
+      WriteIndex(ofs);
+      if (!ofs)
+        return false;
+    }
+    return _dest.good();
+  }
+
+  void OBParallelZipStreambuf::WriteIndex(ostream &os) const
+  {
+    string s;
+    PutLE(s, _index.size(), 8);
+    for (size_t i = 0; i < _index.size(); ++i) {
+      PutLE(s, _index[i].first, 8);
+      PutLE(s, _index[i].second, 8);
+    }
+    os.write(s.data(), static_cast<streamsize>(s.size()));
+  }
+
+  //////////////////////////////////////////////////////////////////////
+
+  //! \return The size of the BGZF block starting with \p header, or 0
+  static size_t BgzfBlockSize(const unsigned char *header)
+  {
+    if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || !(header[3] & 4)
+        || GetLE(header + 10, 2) < 6 || header[12] != 'B' || header[13] != 'C'
+        || GetLE(header + 14, 2) != 2)
+      return 0;
+    return static_cast<size_t>(GetLE(header + 16, 2)) + 1;
+  }
+
+  OBBgzfStreambuf::OBBgzfStreambuf(istream &source)
+    : _source(source), _current(PUTBACK), _start(0), _sourcePos(0), _sourceOrigin(0),
+      _end(false), _indexComplete(false)
+  {
+    streampos pos = source.tellg();
+    if (pos != streampos(-1))
+      _sourceOrigin = pos;
+    _index.push_back(make_pair(0ULL, 0ULL));
+    char *data = &_current[0] + PUTBACK;
+    setg(data, data, data);
+  }
+
+  bool OBBgzfStreambuf::IsBGZF(istream &is)
+  {
+    streampos pos = is.tellg();
+    if (pos == streampos(-1))
+      return false;
+    unsigned char header[BGZF_HEADER];
+    is.read(reinterpret_cast<char*>(header), BGZF_HEADER);
+    bool bgzf = is.gcount() == static_cast<streamsize>(BGZF_HEADER) && BgzfBlockSize(header) > 0;
+    is.clear();
+    is.seekg(pos);
+    return bgzf;
+  }
+
+  bool OBBgzfStreambuf::LoadIndex(istream &is)
+  {
+    unsigned char buffer[16];
+    if (!is.read(reinterpret_cast<char*>(buffer), 8))
+      return false;
+    unsigned long long n = GetLE(buffer, 8);
+    vector<pair<unsigned long long, unsigned long long> > index(1, make_pair(0ULL, 0ULL));
+    for (unsigned long long i = 0; i < n; ++i) {
+      if (!is.read(reinterpret_cast<char*>(buffer), 16))
+        return false;
+      pair<unsigned long long, unsigned long long> entry(GetLE(buffer, 8), GetLE(buffer + 8, 8));
+      if (entry.first < index.back().first || entry.second < index.back().second)
+        return false;
+      index.push_back(entry);
+    }
+    if (index.size() > _index.size() || !_indexComplete) {
+      _index.swap(index);
+      _indexComplete = false;
+    }
+    return true;
+  }
+
+  // The whole source is read once, but only the block headers and sizes
+  bool OBBgzfStreambuf::ScanIndex()
+  {
+    vector<pair<unsigned long long, unsigned long long> > index;
+    unsigned long long coff = 0, uoff = 0;
+    unsigned char header[BGZF_HEADER];
+    _source.clear();
+    for (;;) {
+      if (!_source.seekg(_sourceOrigin + static_cast<streamoff>(coff)))
+        break;
+      _source.read(reinterpret_cast<char*>(header), BGZF_HEADER);
+      if (_source.gcount() == 0)
+        break;
+      size_t size = _source.gcount() == static_cast<streamsize>(BGZF_HEADER) ? BgzfBlockSize(header) : 0;
+      unsigned char isize[4];
+      if (size < BGZF_HEADER + BGZF_TRAILER
+          || !_source.seekg(_sourceOrigin + static_cast<streamoff>(coff + size - 4))
+          || !_source.read(reinterpret_cast<char*>(isize), 4)) {
+        _source.clear();
+        return false;
+      }
+      index.push_back(make_pair(coff, uoff));
+      coff += size;
+      uoff += GetLE(isize, 4);
+    }
+    index.push_back(make_pair(coff, uoff)); // the end
+    _source.clear();
+    _index.swap(index);
+    _indexComplete = true;
+    return true;
+  }
+
+  // Read a batch of blocks and inflate them in parallel into a new get area
+  bool OBBgzfStreambuf::ReadBlocks()
+  {
+    struct Block
+    {
+      vector<char> data;   //!< the block after the first BGZF_HEADER bytes
+      size_t skip;         //!< the rest of the extra field, before the deflate data
+      size_t offset, size; //!< of the inflated data in the get area
+      unsigned long crc;
+    };
+    vector<Block> blocks;
+    const size_t batch = 2 * BatchSize();
+    size_t total = 0;
+    const streamoff uoff = _start + (egptr() - (&_current[0] + PUTBACK));
+    while (blocks.size() < batch) {
+      unsigned char header[BGZF_HEADER];
+      _source.read(reinterpret_cast<char*>(header), BGZF_HEADER);
+      if (_source.gcount() == 0) {
+        _end = true;
+        break;
+      }
+      size_t size = _source.gcount() == static_cast<streamsize>(BGZF_HEADER) ? BgzfBlockSize(header) : 0;
+      size_t xlen = static_cast<size_t>(GetLE(header + 10, 2));
+      if (size < 12 + xlen + BGZF_TRAILER) {
+        _end = true; // not BGZF, or truncated
+        break;
+      }
+      Block block;
+      block.data.resize(size - BGZF_HEADER);
+      if (!_source.read(&block.data[0], static_cast<streamsize>(block.data.size()))) {
+        _end = true;
+        break;
+      }
+      block.skip = xlen - 6;
+      const unsigned char *trailer =
+        reinterpret_cast<const unsigned char*>(&block.data[0]) + block.data.size() - BGZF_TRAILER;
+      block.crc = static_cast<unsigned long>(GetLE(trailer, 4));
+      block.size = static_cast<size_t>(GetLE(trailer + 4, 4));
+      block.offset = total;
+      // remember where the block starts, for seeking back to it
+      if (!_indexComplete && static_cast<unsigned long long>(_sourcePos) > _index.back().first)
+        _index.push_back(make_pair(static_cast<unsigned long long>(_sourcePos),
+                                   static_cast<unsigned long long>(uoff + total)));
+      _sourcePos += size;
+      total += block.size;
+      blocks.push_back(block);
+    }
+    if (blocks.empty())
+      return false;
+
+    vector<char> buffer(PUTBACK + total);
+    const int n = static_cast<int>(blocks.size());
+    vector<char> ok(n, 1);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < n; ++i) {
+      const Block &block = blocks[i];
+      char *out = &buffer[0] + PUTBACK + block.offset;
+      ok[i] = InflateRaw(&block.data[0] + block.skip,
+                         block.data.size() - block.skip - BGZF_TRAILER, out, block.size)
+        && crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(out),
+                 static_cast<uInt>(block.size)) == block.crc;
+    }
+    // a corrupt block ends the data
+    for (int i = 0; i < n; ++i)
+      if (!ok[i]) {
+        buffer.resize(PUTBACK + blocks[i].offset);
+        _end = true;
+        break;
+      }
+
+    // the last characters of the previous get area can be put back
+    size_t keep = min(PUTBACK, static_cast<size_t>(egptr() - eback()));
+    memcpy(&buffer[PUTBACK - keep], egptr() - keep, keep);
+    _start = uoff;
+    _current.swap(buffer);
+    char *data = &_current[0] + PUTBACK;
+    setg(data - keep, data, &_current[0] + _current.size());
+    return true;
+  }
+
+  OBBgzfStreambuf::int_type OBBgzfStreambuf::underflow()
+  {
+    // empty blocks, like the end-of-file block, are skipped
+    while (gptr() >= egptr())
+      if (_end || !ReadBlocks())
+        return traits_type::eof();
+    return traits_type::to_int_type(*gptr());
+  }
+
+  streampos OBBgzfStreambuf::seekoff(streamoff off, ios_base::seekdir way,
+                                     ios_base::openmode which)
+  {
+    if (!(which & ios_base::in))
+      return streampos(streamoff(-1));
+    streamoff pos = _start + (gptr() - (&_current[0] + PUTBACK));
+    if (way == ios_base::cur)
+      return off == 0 ? streampos(pos) : seekpos(streampos(pos + off), which);
+    if (way == ios_base::beg)
+      return seekpos(streampos(off), which);
+    if (!_indexComplete && !ScanIndex())
+      return streampos(streamoff(-1));
+    return seekpos(streampos(static_cast<streamoff>(_index.back().second) + off), which);
+  }
+
+  streampos OBBgzfStreambuf::seekpos(streampos sp, ios_base::openmode which)
+  {
+    if (!(which & ios_base::in))
+      return streampos(streamoff(-1));
+    char *data = &_current[0] + PUTBACK;
+    const streamoff pos = sp;
+    // within the current get area, including the putback area
+    if (pos >= _start - (data - eback()) && pos <= _start + (egptr() - data)) {
+      setg(eback(), data + (pos - _start), egptr());
+      return sp;
+    }
+    if (pos < 0)
+      return streampos(streamoff(-1));
+    // headers are scanned rather than inflating everything up to a position
+    // past the blocks seen so far
+    if (!_indexComplete && static_cast<unsigned long long>(pos) > _index.back().second)
+      ScanIndex();
+
+    // start at the last block at or before the position
+    vector<pair<unsigned long long, unsigned long long> >::const_iterator entry =
+      upper_bound(_index.begin(), _index.end(),
+                  make_pair(0ULL, static_cast<unsigned long long>(pos)),
+                  [](const pair<unsigned long long, unsigned long long> &a,
+                     const pair<unsigned long long, unsigned long long> &b)
+                  { return a.second < b.second; });
+    --entry; // the first entry is (0, 0)
+    _source.clear();
+    if (!_source.seekg(_sourceOrigin + static_cast<streamoff>(entry->first)))
+      return streampos(streamoff(-1));
+    _sourcePos = static_cast<streamoff>(entry->first);
+    _start = static_cast<streamoff>(entry->second);
+    _end = false;
+    _current.assign(PUTBACK, 0);
+    data = &_current[0] + PUTBACK;
+    setg(data, data, data);
+
+    while (pos > _start + (egptr() - (&_current[0] + PUTBACK)))
+      if (_end || !ReadBlocks())
+        return streampos(streamoff(-1)); // past the end
+    data = &_current[0] + PUTBACK;
+    setg(eback(), data + (pos - _start), egptr());
+    return sp;
+  }
+
+} // end namespace OpenBabel
+
+#endif // HAVE_LIBZ
+
+//! \file parallelzip.cpp
+//! \brief Multi-threaded gzip streams: read-ahead decompression, parallel
+//! block compression and BGZF random access
@@ -0,0 +1,377 @@
+/**********************************************************************
+recordindex.cpp - Sidecar index of record offsets for random access to
+                  multi-molecule text files
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <openbabel/babelconfig.h>
+#include <openbabel/recordindex.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/oberror.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+namespace OpenBabel
+{
+  /* Layout of the index file (native byte order, checked by the marker):
+       char     magic[8]         "OBRECIDX"
+       uint32   version
+       uint32   byte order marker
+       uint64   size of the data file
+       int64    modification time of the data file
+       uint32   record type (RecordType below)
+       uint32   number of records N
+       uint64   offsets[N+1]     the last one is the end of the data
+       N x      uint32 length + title
+  */
+  static const char     IDX_MAGIC[8]  = { 'O','B','R','E','C','I','D','X' };
+  static const uint32_t IDX_VERSION   = 1;
+  static const uint32_t IDX_BYTEORDER = 0x01020304;
+
+  enum RecordType { UNSUPPORTED = 0, SDF_RECORDS, SMILES_RECORDS, MOL2_RECORDS, XYZ_RECORDS };
+
+  // The record separators depend on the reader, not on the format ID,
+  // e.g. the same index serves "sdf" and "mol"
+  static RecordType GetRecordType(OBFormat *pFormat)
+  {
+    if (!pFormat)
+      return UNSUPPORTED;
+    static const char *sdfIDs[]    = { "sdf", "sd", "mol", "mdl", NULL };
+    static const char *smilesIDs[] = { "smi", "smiles", "can", NULL };
+    static const char *mol2IDs[]   = { "mol2", "ml2", "sy2", NULL };
+    static const char *xyzIDs[]    = { "xyz", NULL };
+    for (unsigned int i = 0; sdfIDs[i]; ++i)
+      if (OBConversion::FindFormat(sdfIDs[i]) == pFormat)
+        return SDF_RECORDS;
+    for (unsigned int i = 0; smilesIDs[i]; ++i)
+      if (OBConversion::FindFormat(smilesIDs[i]) == pFormat)
+        return SMILES_RECORDS;
+    for (unsigned int i = 0; mol2IDs[i]; ++i)
+      if (OBConversion::FindFormat(mol2IDs[i]) == pFormat)
+        return MOL2_RECORDS;
+    for (unsigned int i = 0; xyzIDs[i]; ++i)
+      if (OBConversion::FindFormat(xyzIDs[i]) == pFormat)
+        return XYZ_RECORDS;
+    return UNSUPPORTED;
+  }
+
+  static bool GetFileStatus(const string &filename, uint64_t &size, int64_t &mtime)
+  {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+      return false;
+    size = static_cast<uint64_t>(st.st_size);
+    mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+  }
+
+  static string Trim(const string &str)
+  {
+    string::size_type first = str.find_first_not_of(" \t\r\n");
+    if (first == string::npos)
+      return string();
+    string::size_type last = str.find_last_not_of(" \t\r\n");
+    return str.substr(first, last - first + 1);
+  }
+
+  template<typename T>
+  static void WriteValue(ostream &os, T value)
+  {
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template<typename T>
+  static bool ReadValue(istream &is, T &value)
+  {
+    is.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return static_cast<bool>(is);
+  }
+
+  OBRecordReader::OBRecordReader(istream &is, OBFormat *pFormat) : _is(is), _reader(is),
+    _type(GetRecordType(pFormat)), _pos(0), _recordStart(0), _pendingStart(0),
+    _hasPending(false)
+  {
+  }
+
+  bool OBRecordReader::IsSupportedFormat(OBFormat *pFormat)
+  {
+    return GetRecordType(pFormat) != UNSUPPORTED;
+  }
+
+  bool OBRecordReader::GetLine(string &line, streamoff &start)
+  {
+    if (_hasPending) {
+      line.swap(_pending);
+      start = _pendingStart;
+      _hasPending = false;
+      return true;
+    }
+    if (!_reader.GetLine(line))
+      return false;
+    start = _pos;
+    _pos += line.size() + (_is.eof() ? 0 : 1);
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.erase(line.size() - 1);
+    return true;
+  }
+
+  bool OBRecordReader::ReadRecord(string *text)
+  {
+    if (text)
+      text->clear();
+    _title.clear();
+    string line;
+    streamoff start;
+
+    switch (_type) {
+    case SDF_RECORDS:
+      {
+        // up to and including the "$$$$" line
+        bool hasContent = false;
+        for (bool first = true; GetLine(line, start); first = false) {
+          if (first) {
+            _recordStart = start;
+            _title = Trim(line);
+          }
+          if (text)
+            text->append(line).append(1, '\n');
+          if (line.compare(0, 4, "$$$$") == 0)
+            return true;
+          hasContent = hasContent || !Trim(line).empty();
+        }
+        // blank lines after the last "$$$$" are not a record
+        return hasContent;
+      }
+    case SMILES_RECORDS:
+      // every line, except comments
+      while (GetLine(line, start)) {
+        if (!line.empty() && line[0] == '#')
+          continue;
+        _recordStart = start;
+        string::size_type sep = line.find_first_of(" \t");
+        if (sep != string::npos)
+          _title = Trim(line.substr(sep));
+        if (text)
+          text->append(line).append(1, '\n');
+        return true;
+      }
+      return false;
+    case MOL2_RECORDS:
+      {
+        // from a "@<TRIPOS>MOLECULE" line to the next one
+        bool inRecord = false, expectTitle = false;
+        while (GetLine(line, start)) {
+          if (line.compare(0, 17, "@<TRIPOS>MOLECULE") == 0) {
+            if (inRecord) {
+              _pending.swap(line);
+              _pendingStart = start;
+              _hasPending = true;
+              return true;
+            }
+            inRecord = expectTitle = true;
+            _recordStart = start;
+          }
+          else if (expectTitle) {
+            _title = Trim(line);
+            expectTitle = false;
+          }
+          if (inRecord && text)
+            text->append(line).append(1, '\n');
+        }
+        return inRecord;
+      }
+    case XYZ_RECORDS:
+      {
+        // the atom count line, a title line and a line for each atom
+        while (GetLine(line, start) && Trim(line).empty())
+          ;
+        if (Trim(line).empty())
+          return false;
+        _recordStart = start;
+        if (text)
+          text->append(line).append(1, '\n');
+        int natoms = atoi(line.c_str());
+        for (int i = 0; i <= natoms && GetLine(line, start); ++i) {
+          if (i == 0) // as in XYZFormat, without an energy
+            _title = Trim(line.substr(0, line.find("Energy")));
+          if (text)
+            text->append(line).append(1, '\n');
+        }
+        return true;
+      }
+    default:
+      return false;
+    }
+  }
+
+  OBRecordIndex::OBRecordIndex() : _valid(false), _numRecords(0),
+    _offsetsStart(0), _titlesRead(false)
+  {
+  }
+
+  string OBRecordIndex::IndexFilename(const string &datafile)
+  {
+    return datafile + ".obidx";
+  }
+
+  bool OBRecordIndex::Build(const string &datafile, OBFormat *pFormat)
+  {
+    _valid = false;
+    RecordType type = GetRecordType(pFormat);
+    if (type == UNSUPPORTED) {
+      obErrorLog.ThrowError(__FUNCTION__,
+        "A record index can only be built for SDF, SMILES, MOL2 and XYZ files", obError);
+      return false;
+    }
+
+    uint64_t size;
+    int64_t mtime;
+    ifstream ifs(datafile.c_str(), ios_base::in | ios_base::binary);
+    if (!ifs || !GetFileStatus(datafile, size, mtime)) {
+      obErrorLog.ThrowError(__FUNCTION__, "Cannot read from " + datafile, obError);
+      return false;
+    }
+    if (ifs.peek() == 0x1f) { // the offsets of a gzipped file are meaningless
+      obErrorLog.ThrowError(__FUNCTION__,
+        "Cannot build a record index for the compressed file " + datafile, obError);
+      return false;
+    }
+
+    // A single pass over the raw bytes, so the offsets are file positions
+    // whatever the line endings are
+    vector<uint64_t> offsets;
+    vector<string> titles;
+    OBRecordReader reader(ifs, pFormat);
+    while (reader.ReadRecord()) {
+      offsets.push_back(reader.GetRecordStart());
+      titles.push_back(reader.GetTitle());
+    }
+    offsets.push_back(reader.GetPosition());
+
+    const string indexfile = IndexFilename(datafile);
+    ofstream ofs(indexfile.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!ofs) {
+      obErrorLog.ThrowError(__FUNCTION__, "Cannot write the record index " + indexfile, obWarning);
+      return false;
+    }
+    ofs.write(IDX_MAGIC, sizeof(IDX_MAGIC));
+    WriteValue(ofs, IDX_VERSION);
+    WriteValue(ofs, IDX_BYTEORDER);
+    WriteValue(ofs, size);
+    WriteValue(ofs, mtime);
+    WriteValue(ofs, static_cast<uint32_t>(type));
+    WriteValue(ofs, static_cast<uint32_t>(titles.size()));
+    ofs.write(reinterpret_cast<const char*>(&offsets[0]), offsets.size() * sizeof(uint64_t));
+    for (unsigned int i = 0; i < titles.size(); ++i) {
+      WriteValue(ofs, static_cast<uint32_t>(titles[i].size()));
+      ofs.write(titles[i].data(), titles[i].size());
+    }
+    ofs.close();
+    if (!ofs) {
+      obErrorLog.ThrowError(__FUNCTION__, "Cannot write the record index " + indexfile, obWarning);
+      remove(indexfile.c_str());
+      return false;
+    }
+
+    return Load(datafile, pFormat);
+  }
+
+  bool OBRecordIndex::Load(const string &datafile, OBFormat *pFormat)
+  {
+    _valid = false;
+    _titles.clear();
+    _titlesRead = false;
+    if (_ifs.is_open())
+      _ifs.close();
+    _ifs.clear();
+
+    uint64_t size;
+    int64_t mtime;
+    if (!GetFileStatus(datafile, size, mtime))
+      return false;
+    _ifs.open(IndexFilename(datafile).c_str(), ios_base::in | ios_base::binary);
+    if (!_ifs)
+      return false;
+
+    char magic[sizeof(IDX_MAGIC)];
+    uint32_t version, byteorder, type, numRecords;
+    uint64_t indexedSize;
+    int64_t indexedMtime;
+    if (!_ifs.read(magic, sizeof(magic)) || memcmp(magic, IDX_MAGIC, sizeof(magic))
+        || !ReadValue(_ifs, version) || version != IDX_VERSION
+        || !ReadValue(_ifs, byteorder) || byteorder != IDX_BYTEORDER
+        || !ReadValue(_ifs, indexedSize) || !ReadValue(_ifs, indexedMtime)
+        || !ReadValue(_ifs, type) || !ReadValue(_ifs, numRecords))
+      return false;
+    // a stale index or one made for a reader with other record separators
+    if (indexedSize != size || indexedMtime != mtime
+        || type != static_cast<uint32_t>(GetRecordType(pFormat)))
+      return false;
+
+    _numRecords = numRecords;
+    _offsetsStart = _ifs.tellg();
+    _valid = true;
+    return true;
+  }
+
+  streamoff OBRecordIndex::GetOffset(unsigned int n)
+  {
+    if (!_valid || n < 1 || n > _numRecords + 1)
+      return -1;
+    uint64_t offset;
+    _ifs.clear();
+    _ifs.seekg(_offsetsStart + static_cast<streamoff>(n - 1) * sizeof(uint64_t));
+    if (!ReadValue(_ifs, offset))
+      return -1;
+    return static_cast<streamoff>(offset);
+  }
+
+  bool OBRecordIndex::ReadTitles()
+  {
+    _titlesRead = true;
+    _ifs.clear();
+    _ifs.seekg(_offsetsStart + static_cast<streamoff>(_numRecords + 1) * sizeof(uint64_t));
+    string title;
+    for (unsigned int n = 1; n <= _numRecords; ++n) {
+      uint32_t length;
+      if (!ReadValue(_ifs, length))
+        return false;
+      title.resize(length);
+      if (length && !_ifs.read(&title[0], length))
+        return false;
+      _titles.insert(make_pair(title, n)); // keeps the first of duplicates
+    }
+    return true;
+  }
+
+  unsigned int OBRecordIndex::FindTitle(const string &title)
+  {
+    if (!_valid || (!_titlesRead && !ReadTitles()))
+      return 0;
+    map<string, unsigned int>::const_iterator it = _titles.find(title);
+    return it != _titles.end() ? it->second : 0;
+  }
+
+} // end namespace OpenBabel
+
+//! \file recordindex.cpp
+//! \brief Sidecar index of record offsets for random access to files
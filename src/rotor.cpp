@@ -29,6 +29,7 @@ GNU General Public License for more details.
 #include <openbabel/elements.h>
 
 #include <set>
+#include <map>
 #include <assert.h>
 
 // private data headers with default parameters
@@ -53,17 +54,118 @@ namespace OpenBabel
   //**** OBRotorList Member Functions ****
   //**************************************
 
+  // The rotors perceived for a molecule: the rotatable bonds in GTD order, the
+  // torsion rule of each (see OBRotorRules::FindRules(), the hydrogen
+  // references depend on the geometry and are replaced for each setup) and the
+  // symmetry of each rotor
+  struct RotorPerception
+  {
+    RotorPerception(): valid(false), key(0), ringRotors(false) {}
+
+    bool valid;
+    unsigned long long key;             // GraphKey() of the molecule
+    bool ringRotors;
+    vector<unsigned int> bonds;         // bond indexes
+    vector<vector<int> > refs;
+    vector<vector<double> > vals;
+    vector<double> deltas;
+    vector<int> folds;                  // empty until symmetry is removed
+  };
+
+  // The rotor perception kept on a molecule, with and without ring rotors
+  class OBRotorPerceptionData : public OBGenericData
+  {
+  public:
+    OBRotorPerceptionData(): OBGenericData("OpenBabel Rotor Perception",
+                                           OBGenericDataType::UndefinedData, perceived) {}
+    virtual OBGenericData* Clone(OBBase* /*parent*/) const
+    { return new OBRotorPerceptionData(*this); }
+
+    RotorPerception perception[2];
+  };
+
+  static inline void HashValue(unsigned long long &key, unsigned int value)
+  {
+    // FNV-1a
+    key ^= value;
+    key *= 1099511628211ULL;
+  }
+
+  // A key of everything the rotor perception depends on: the atoms, their
+  // hybridization and hydrogens, the bonds and bond orders
+  static unsigned long long GraphKey(OBMol &mol)
+  {
+    unsigned long long key = 14695981039346656037ULL;
+    HashValue(key, mol.NumAtoms());
+    HashValue(key, mol.NumBonds());
+    FOR_ATOMS_OF_MOL (atom, mol) {
+      HashValue(key, atom->GetAtomicNum());
+      HashValue(key, atom->GetHyb());
+      HashValue(key, atom->GetImplicitHCount());
+      HashValue(key, static_cast<unsigned int>(atom->GetFormalCharge() + 128));
+      HashValue(key, atom->IsAromatic());
+    }
+    FOR_BONDS_OF_MOL (bond, mol) {
+      HashValue(key, bond->GetBeginAtomIdx());
+      HashValue(key, bond->GetEndAtomIdx());
+      HashValue(key, bond->GetBondOrder());
+      HashValue(key, bond->IsAromatic());
+    }
+    return key;
+  }
+
   bool OBRotorList::Setup(OBMol &mol, bool sampleRingBonds)
   {
     Clear();
-    // find the rotatable bonds
-    FindRotors(mol, sampleRingBonds);
+
+    // Use the perception kept on the molecule if it is up to date
+    RotorPerception local, *perception = &local;
+    unsigned long long key = 0;
+    if (!HasFixedAtoms() && !HasFixedBonds() && !_customRules) {
+      OBRotorPerceptionData *data =
+        dynamic_cast<OBRotorPerceptionData*>(mol.GetData("OpenBabel Rotor Perception"));
+      if (!data) {
+        data = new OBRotorPerceptionData;
+        mol.SetData(data);
+      }
+      perception = &data->perception[sampleRingBonds ? 1 : 0];
+      key = GraphKey(mol);
+    }
+
+    if (perception->valid && perception->key == key) {
+      vector<unsigned int>::iterator j;
+      int count = 0;
+      for (j = perception->bonds.begin(); j != perception->bonds.end(); ++j, ++count) {
+        OBRotor *rotor = new OBRotor;
+        rotor->SetBond(mol.GetBond(*j));
+        rotor->SetIdx(count);
+        rotor->SetNumCoords(mol.NumAtoms()*3);
+        _rotor.push_back(rotor);
+      }
+      _ringRotors = perception->ringRotors;
+    } else {
+      *perception = RotorPerception();
+      // find the rotatable bonds
+      FindRotors(mol, sampleRingBonds);
+      vector<OBBond*> bonds;
+      vector<OBRotor*>::iterator i;
+      for (i = _rotor.begin(); i != _rotor.end(); ++i) {
+        bonds.push_back((*i)->GetBond());
+        perception->bonds.push_back((*i)->GetBond()->GetIdx());
+      }
+      perception->ringRotors = _ringRotors;
+      // query the rotor database
+      if (!bonds.empty())
+        _rr.FindRules(mol, bonds, perception->refs, perception->vals, perception->deltas);
+      perception->key = key;
+      perception->valid = true;
+    }
     if (!Size())
       return(false);
 
     // set the atoms that should be evaluated when this rotor changes
     SetEvalAtoms(mol);
-    AssignTorVals(mol);
+    SetTorVals(mol, perception->refs, perception->vals, perception->deltas);
 
     OBRotor *rotor;
     vector<OBRotor*>::iterator i;
@@ -79,8 +181,11 @@ namespace OpenBabel
         }
 
     // Reduce the number of torsions to be checked through symmetry considerations
-    if (_removesym)
-      RemoveSymVals(mol);
+    if (_removesym) {
+      if (perception->folds.size() != Size())
+        FindSymmetryFolds(mol, perception->folds);
+      RemoveSymTorsionValues(perception->folds);
+    }
 
     return(true);
   }
@@ -239,11 +344,19 @@ namespace OpenBabel
   }
 
   void OBRotorList::RemoveSymVals(OBMol &mol)
+  {
+    vector<int> folds;
+    FindSymmetryFolds(mol, folds);
+    RemoveSymTorsionValues(folds);
+  }
+
+  void OBRotorList::FindSymmetryFolds(OBMol &mol, vector<int> &folds)
   {
     OBGraphSym gs(&mol);
     vector<unsigned int> sym_classes;
     gs.GetSymmetry(sym_classes);
 
+    folds.clear();
     OBRotor *rotor;
     vector<OBRotor*>::iterator i;
     std::set<unsigned int> syms;
@@ -274,13 +387,22 @@ namespace OpenBabel
                       }
                   }
               }
+      folds.push_back(N_fold_symmetry);
+    }
+  }
 
+  void OBRotorList::RemoveSymTorsionValues(const vector<int> &folds)
+  {
+    for (size_t i = 0; i < _rotor.size() && i < folds.size(); ++i) {
+      OBRotor *rotor = _rotor[i];
+      int N_fold_symmetry = folds[i];
       if (N_fold_symmetry  > 1) {
         size_t old_size = rotor->Size();
         rotor->RemoveSymTorsionValues(N_fold_symmetry);
         if (!_quiet) {
           cout << "...." << N_fold_symmetry << "-fold symmetry at rotor between " <<
-                 begin->GetIdx() << " and " << end->GetIdx();
+                 rotor->GetBond()->GetBeginAtom()->GetIdx() << " and " <<
+                 rotor->GetBond()->GetEndAtom()->GetIdx();
           cout << " - reduced from " << old_size << " to " << rotor->Size() << endl;
                   }
               }
@@ -341,18 +463,34 @@ namespace OpenBabel
 
   bool OBRotorList::AssignTorVals(OBMol &mol)
   {
+    // query the rotor database for all bonds at once
+    vector<OBBond*> bonds;
     vector<OBRotor*>::iterator i;
-    for (i = _rotor.begin(); i != _rotor.end(); ++i) {
-      OBRotor *rotor = *i;
-      OBBond *bond = rotor->GetBond();
+    for (i = _rotor.begin(); i != _rotor.end(); ++i)
+      bonds.push_back((*i)->GetBond());
+    vector<vector<int> > refs;
+    vector<vector<double> > vals;
+    vector<double> deltas;
+    _rr.FindRules(mol, bonds, refs, vals, deltas);
+
+    SetTorVals(mol, refs, vals, deltas);
+    return true;
+  }
+
+  void OBRotorList::SetTorVals(OBMol &mol, const vector<vector<int> > &refs,
+                               const vector<vector<double> > &vals,
+                               const vector<double> &deltas)
+  {
+    for (size_t r = 0; r < _rotor.size(); ++r) {
+      OBRotor *rotor = _rotor[r];
 
-      // query the rotor database
       int ref[4];
-      vector<double> angles;
-      double delta;
-      _rr.GetRotorIncrements(mol, bond, ref, angles, delta);
+      for (int k = 0; k < 4; ++k)
+        ref[k] = refs[r][k];
+      vector<double> angles = vals[r];
+      OBRotorRules::SetHeavyAtomReference(mol, ref, angles);
       rotor->SetTorsionValues(angles);
-      rotor->SetDelta(delta);
+      rotor->SetDelta(deltas[r]);
 
       // Find the smallest set of atoms to rotate. There are two candidate sets,
       // one on either side of the bond. If the first tried set size plus one is
@@ -378,8 +516,6 @@ namespace OpenBabel
       rotor->SetRotAtoms(atoms);
       rotor->SetDihedralAtoms(ref);
     }
-
-    return true;
   }
 
   bool OBRotorList::SetRotAtoms(OBMol &mol)
@@ -460,6 +596,7 @@ namespace OpenBabel
     _quiet = true;
     _removesym = true;
     _ringRotors = false;
+    _customRules = false;
   }
 
   OBRotorList::~OBRotorList()
@@ -807,6 +944,34 @@ namespace OpenBabel
     _filename = "torlib.txt";
     _subdir = "data";
     _dataptr = TorsionDefaults;
+    _shared = false;
+  }
+
+  // The rules of the default torlib.txt, read once. They are only matched with
+  // the thread safe OBSmartsPattern::Match(), so all OBRotorRules share them.
+  struct DefaultRotorRules
+  {
+    DefaultRotorRules() { rules.Init(); }
+    OBRotorRules rules;
+  };
+
+  void OBRotorRules::InitRules()
+  {
+    if (_init)
+      return;
+    if (_filename != "torlib.txt" || _dir != BABEL_DATADIR ||
+        _envvar != "BABEL_DATADIR" || _subdir != "data") {
+      Init();
+      return;
+    }
+
+    static DefaultRotorRules defaults;
+    _vr = defaults.rules._vr;
+    _sp3sp3 = defaults.rules._sp3sp3;
+    _sp3sp2 = defaults.rules._sp3sp2;
+    _sp2sp2 = defaults.rules._sp2sp2;
+    _shared = true;
+    _init = true;
   }
 
   void OBRotorRules::ParseLine(const char *buffer)
@@ -891,168 +1056,215 @@ namespace OpenBabel
   void OBRotorRules::GetRotorIncrements(OBMol &mol,OBBond *bond,
                                         int ref[4],vector<double> &vals,double &delta)
   {
-    if (!_init)
-      Init();
+    vector<OBBond*> bonds(1, bond);
+    vector<vector<int> > refs;
+    vector<vector<double> > bondVals;
+    vector<double> deltas;
+    FindRules(mol, bonds, refs, bondVals, deltas);
+
+    for (int j = 0; j < 4; ++j)
+      ref[j] = refs[0][j];
+    vals = bondVals[0];
+    delta = deltas[0];
+    SetHeavyAtomReference(mol, ref, vals);
+  }
 
-    vals.clear();
-    vector<pair<int,int> > vpr;
-    vpr.push_back(pair<int,int> (0,bond->GetBeginAtomIdx()));
-    vpr.push_back(pair<int,int> (0,bond->GetEndAtomIdx()));
+  // The first heavy atom bonded to atom, other than exclude
+  static OBAtom *HeavyNbrAtom(OBAtom *atom, OBAtom *exclude)
+  {
+    OBAtom *nbr;
+    vector<OBBond*>::iterator k;
+    for (nbr = atom->BeginNbrAtom(k);nbr;nbr = atom->NextNbrAtom(k))
+      if (nbr->GetAtomicNum() != OBElements::Hydrogen && nbr != exclude)
+        return nbr;
+    return NULL;
+  }
 
-    delta = OB_DEFAULT_DELTA;
+  // Whether the dihedral matched by a rule can be used: hydrogens are allowed
+  // at one end only, if there is a heavy atom to use instead
+  static bool IsValidReference(OBMol &mol, const int ref[4])
+  {
+    OBAtom *a1 = mol.GetAtom(ref[0]);
+    OBAtom *a4 = mol.GetAtom(ref[3]);
+    if (a1->GetAtomicNum() == OBElements::Hydrogen && a4->GetAtomicNum() == OBElements::Hydrogen)
+      return false; //don't allow hydrogens at both ends
+    if (a4->GetAtomicNum() == OBElements::Hydrogen)
+      return HeavyNbrAtom(mol.GetAtom(ref[2]), mol.GetAtom(ref[1])) != NULL;
+    if (a1->GetAtomicNum() == OBElements::Hydrogen)
+      return HeavyNbrAtom(mol.GetAtom(ref[1]), mol.GetAtom(ref[2])) != NULL;
+    return true;
+  }
 
-    int j;
-    OBSmartsPattern *sp;
-    vector<vector<int> > map;
+  void OBRotorRules::FindRules(OBMol &mol, const vector<OBBond*> &bonds,
+                               vector<vector<int> > &refs,
+                               vector<vector<double> > &vals,
+                               vector<double> &deltas)
+  {
+    InitRules();
+
+    const size_t numBonds = bonds.size();
+    refs.assign(numBonds, vector<int>(4, 0));
+    vals.assign(numBonds, vector<double>());
+    deltas.assign(numBonds, OB_DEFAULT_DELTA);
+
+    // The bonds by their atoms, 2 * index for the central atoms of a rule in
+    // the order of the bond, 2 * index + 1 for the reverse order
+    map<pair<int,int>, size_t> bondIndex;
+    for (size_t b = 0; b < numBonds; ++b) {
+      bondIndex[make_pair(static_cast<int>(bonds[b]->GetBeginAtomIdx()),
+                          static_cast<int>(bonds[b]->GetEndAtomIdx()))] = 2 * b;
+      bondIndex[make_pair(static_cast<int>(bonds[b]->GetEndAtomIdx()),
+                          static_cast<int>(bonds[b]->GetBeginAtomIdx()))] = 2 * b + 1;
+    }
+
+    // The rules are tried in order, each matched once for all bonds without
+    // a rule yet. A bond gets the first match of a rule in its order, or the
+    // first match in reverse order.
+    vector<bool> found(numBonds, false);
+    size_t numFound = 0;
+    vector<vector<int> > mlist;
+    vector<int> first(2 * numBonds);
+    int ref[4];
     vector<OBRotorRule*>::iterator i;
-    for (i = _vr.begin();i != _vr.end();++i)
+    for (i = _vr.begin();i != _vr.end() && numFound < numBonds;++i)
       {
-        sp = (*i)->GetSmartsPattern();
+        if (!(*i)->GetSmartsPattern()->Match(mol, mlist))
+          continue;
         (*i)->GetReferenceAtoms(ref);
-        vpr[0].first = ref[1];
-        vpr[1].first = ref[2];
-
-        if (!sp->RestrictedMatch(mol,vpr,true))
-          {
-            swap(vpr[0].first,vpr[1].first);
-            if (!sp->RestrictedMatch(mol,vpr,true))
-              continue;
-          }
 
-        map = sp->GetMapList();
-        for (j = 0;j < 4;++j)
-          ref[j] = map[0][ref[j]];
-        vals = (*i)->GetTorsionVals();
-        delta = (*i)->GetDelta();
-
-        OBAtom *a1,*a2,*a3,*a4,*r;
-        a1 = mol.GetAtom(ref[0]);
-        a4 = mol.GetAtom(ref[3]);
-        if (a1->GetAtomicNum() == OBElements::Hydrogen && a4->GetAtomicNum() == OBElements::Hydrogen)
-          continue; //don't allow hydrogens at both ends
-        if (a1->GetAtomicNum() == OBElements::Hydrogen || a4->GetAtomicNum() == OBElements::Hydrogen) //need a heavy atom reference - can use hydrogen
-          {
-            bool swapped = false;
-            a2 = mol.GetAtom(ref[1]);
-            a3 = mol.GetAtom(ref[2]);
-            if (a4->GetAtomicNum() == OBElements::Hydrogen)
-              {
-                swap(a1,a4);
-                swap(a2,a3);
-                swapped = true;
-              }
-
-            vector<OBBond*>::iterator k;
-            for (r = a2->BeginNbrAtom(k);r;r = a2->NextNbrAtom(k))
-              if (r->GetAtomicNum() != OBElements::Hydrogen && r != a3)
-                break;
-
-            if (!r)
-              continue; //unable to find reference heavy atom
-            //			cerr << "r = " << r->GetIdx() << endl;
-
-            double t1 = mol.GetTorsion(a1,a2,a3,a4);
-            double t2 = mol.GetTorsion(r,a2,a3,a4);
-            double diff = t2 - t1;
-            if (diff > 180.0)
-              diff -= 360.0;
-            if (diff < -180.0)
-              diff += 360.0;
-            diff *= DEG_TO_RAD;
-
-            vector<double>::iterator m;
-            for (m = vals.begin();m != vals.end();++m)
-              {
-                *m += diff;
-                if (*m < M_PI)
-                  *m += 2.0*M_PI;
-                if (*m > M_PI)
-                  *m -= 2.0*M_PI;
-              }
-
-            if (swapped)
-              ref[3] = r->GetIdx();
-            else
-              ref[0] = r->GetIdx();
-
-            /*
-              mol.SetTorsion(r,a2,a3,a4,vals[0]);
-              cerr << "test = " << (vals[0]-diff)*RAD_TO_DEG << ' ';
-              cerr << mol.GetTorsion(a1,a2,a3,a4) <<  ' ';
-              cerr << mol.GetTorsion(r,a2,a3,a4) << endl;
-            */
-          }
-
-        char buffer[BUFF_SIZE];
-        if (!_quiet)
-          {
-            snprintf(buffer,BUFF_SIZE,"%3d%3d%3d%3d %s",
-                     ref[0],ref[1],ref[2],ref[3],
-                     ((*i)->GetSmartsString()).c_str());
-            obErrorLog.ThrowError(__FUNCTION__, buffer, obDebug);
-          }
-        return;
-      }
-
-    //***didn't match any rules - assign based on hybridization***
-    OBAtom *a1,*a2,*a3,*a4;
-    a2 = bond->GetBeginAtom();
-    a3 = bond->GetEndAtom();
-    vector<OBBond*>::iterator k;
-
-    for (a1 = a2->BeginNbrAtom(k);a1;a1 = a2->NextNbrAtom(k))
-      if (a1->GetAtomicNum() != OBElements::Hydrogen && a1 != a3)
-        break;
-    for (a4 = a3->BeginNbrAtom(k);a4;a4 = a3->NextNbrAtom(k))
-      if (a4->GetAtomicNum() != OBElements::Hydrogen && a4 != a2)
-        break;
+        std::fill(first.begin(), first.end(), -1);
+        for (size_t m = 0; m < mlist.size(); ++m) {
+          map<pair<int,int>, size_t>::iterator b =
+            bondIndex.find(make_pair(mlist[m][ref[1]], mlist[m][ref[2]]));
+          if (b != bondIndex.end() && first[b->second] < 0)
+            first[b->second] = m;
+        }
 
-    ref[0] = a1->GetIdx();
-    ref[1] = a2->GetIdx();
-    ref[2] = a3->GetIdx();
-    ref[3] = a4->GetIdx();
+        for (size_t b = 0; b < numBonds; ++b) {
+          if (found[b])
+            continue;
+          int m = (first[2 * b] >= 0) ? first[2 * b] : first[2 * b + 1];
+          if (m < 0)
+            continue;
+          int matched[4];
+          for (int j = 0; j < 4; ++j)
+            matched[j] = mlist[m][ref[j]];
+          if (!IsValidReference(mol, matched))
+            continue;
 
-    if (a2->GetHyb() == 3 && a3->GetHyb() == 3) //sp3-sp3
-      {
-        vals = _sp3sp3;
-
-        if (!_quiet)
-          {
-            char buffer[BUFF_SIZE];
-            snprintf(buffer,BUFF_SIZE,"%3d%3d%3d%3d %s",
-                     ref[0],ref[1],ref[2],ref[3],"sp3-sp3");
-            obErrorLog.ThrowError(__FUNCTION__, buffer, obDebug);
-          }
-      }
-    else
-      if (a2->GetHyb() == 2 && a3->GetHyb() == 2) //sp2-sp2
-        {
-          vals = _sp2sp2;
+          refs[b].assign(matched, matched + 4);
+          vals[b] = (*i)->GetTorsionVals();
+          deltas[b] = (*i)->GetDelta();
+          found[b] = true;
+          ++numFound;
 
           if (!_quiet)
             {
               char buffer[BUFF_SIZE];
               snprintf(buffer,BUFF_SIZE,"%3d%3d%3d%3d %s",
-                       ref[0],ref[1],ref[2],ref[3],"sp2-sp2");
+                       matched[0],matched[1],matched[2],matched[3],
+                       ((*i)->GetSmartsString()).c_str());
               obErrorLog.ThrowError(__FUNCTION__, buffer, obDebug);
             }
         }
-      else //must be sp2-sp3
+      }
+
+    for (size_t b = 0; b < numBonds; ++b) {
+      if (found[b])
+        continue;
+
+      //***didn't match any rules - assign based on hybridization***
+      OBAtom *a1,*a2,*a3,*a4;
+      a2 = bonds[b]->GetBeginAtom();
+      a3 = bonds[b]->GetEndAtom();
+      a1 = HeavyNbrAtom(a2, a3);
+      a4 = HeavyNbrAtom(a3, a2);
+
+      refs[b][0] = a1->GetIdx();
+      refs[b][1] = a2->GetIdx();
+      refs[b][2] = a3->GetIdx();
+      refs[b][3] = a4->GetIdx();
+
+      const char *type;
+      if (a2->GetHyb() == 3 && a3->GetHyb() == 3) //sp3-sp3
         {
-          vals = _sp3sp2;
+          vals[b] = _sp3sp3;
+          type = "sp3-sp3";
+        }
+      else
+        if (a2->GetHyb() == 2 && a3->GetHyb() == 2) //sp2-sp2
+          {
+            vals[b] = _sp2sp2;
+            type = "sp2-sp2";
+          }
+        else //must be sp2-sp3
+          {
+            vals[b] = _sp3sp2;
+            type = "sp2-sp3";
+          }
 
-          if (!_quiet)
-            {
-              char buffer[BUFF_SIZE];
-              snprintf(buffer,BUFF_SIZE,"%3d%3d%3d%3d %s",
-                       ref[0],ref[1],ref[2],ref[3],"sp2-sp3");
-              obErrorLog.ThrowError(__FUNCTION__, buffer, obDebug);
-            }
+      if (!_quiet)
+        {
+          char buffer[BUFF_SIZE];
+          snprintf(buffer,BUFF_SIZE,"%3d%3d%3d%3d %s",
+                   refs[b][0],refs[b][1],refs[b][2],refs[b][3],type);
+          obErrorLog.ThrowError(__FUNCTION__, buffer, obDebug);
         }
+    }
+  }
+
+  void OBRotorRules::SetHeavyAtomReference(OBMol &mol, int ref[4], vector<double> &vals)
+  {
+    OBAtom *a1,*a2,*a3,*a4,*r;
+    a1 = mol.GetAtom(ref[0]);
+    a4 = mol.GetAtom(ref[3]);
+    if (a1->GetAtomicNum() != OBElements::Hydrogen && a4->GetAtomicNum() != OBElements::Hydrogen)
+      return;
+
+    //need a heavy atom reference - can use hydrogen
+    bool swapped = false;
+    a2 = mol.GetAtom(ref[1]);
+    a3 = mol.GetAtom(ref[2]);
+    if (a4->GetAtomicNum() == OBElements::Hydrogen)
+      {
+        swap(a1,a4);
+        swap(a2,a3);
+        swapped = true;
+      }
+
+    r = HeavyNbrAtom(a2, a3);
+    if (!r)
+      return; //unable to find reference heavy atom
+
+    double t1 = mol.GetTorsion(a1,a2,a3,a4);
+    double t2 = mol.GetTorsion(r,a2,a3,a4);
+    double diff = t2 - t1;
+    if (diff > 180.0)
+      diff -= 360.0;
+    if (diff < -180.0)
+      diff += 360.0;
+    diff *= DEG_TO_RAD;
+
+    vector<double>::iterator m;
+    for (m = vals.begin();m != vals.end();++m)
+      {
+        *m += diff;
+        if (*m < M_PI)
+          *m += 2.0*M_PI;
+        if (*m > M_PI)
+          *m -= 2.0*M_PI;
+      }
+
+    if (swapped)
+      ref[3] = r->GetIdx();
+    else
+      ref[0] = r->GetIdx();
   }
 
   OBRotorRules::~OBRotorRules()
   {
+    if (_shared)
+      return;
     vector<OBRotorRule*>::iterator i;
     for (i = _vr.begin();i != _vr.end();++i)
       delete (*i);
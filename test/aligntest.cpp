@@ -387,6 +387,146 @@ void test_QCP()
 
 }
 
+void test_alignRawCoords()
+{
+  vv3 ref, target;
+  vector<double> dtarget;
+  vector<float> ftarget;
+  matrix3x3 rot;
+  rot.RotAboutAxisByAngle(vector3(0.3, 1.0, -0.2), 35.0);
+  for (int k = 0; k < 7; ++k) {
+    vector3 v(k, cos(1.1 * k), sin(0.5 * k));
+    ref.push_back(v);
+    target.push_back(rot * (v + vector3(0.0, 0.05 * k, 0.0)) + vector3(2.0, 1.0, -1.0));
+    for (int c = 0; c < 3; ++c) {
+      dtarget.push_back(target.back()[c]);
+      ftarget.push_back(target.back()[c]);
+    }
+  }
+
+  OBAlign align(ref, target);
+  align.Align();
+  double rmsd = align.GetRMSD();
+  vv3 result = align.GetAlignment();
+  OB_ASSERT( rmsd > 0.01 );
+
+  // double coordinates give the same alignment...
+  OBAlign raw;
+  raw.SetRef(ref);
+  raw.SetTarget(&dtarget[0], 7);
+  OB_REQUIRE( raw.Align() );
+  OB_ASSERT( fabs(raw.GetRMSD() - rmsd) < 1.0E-10 );
+  vv3 rawresult = raw.GetAlignment();
+  OB_REQUIRE( rawresult.size() == result.size() );
+  for (unsigned int i = 0; i < result.size(); ++i)
+    OB_ASSERT( rawresult[i].IsApprox(result[i], 1.0E-08) );
+
+  // ...and float coordinates the same within float precision
+  raw.SetTarget(&ftarget[0], 7);
+  OB_REQUIRE( raw.Align() );
+  OB_ASSERT( fabs(raw.GetRMSD() - rmsd) < 1.0E-5 );
+
+  // A target of a different size is refused
+  raw.SetTarget(&dtarget[0], 6);
+  OB_ASSERT( !raw.Align() );
+
+  // Symmetry with the raw coordinates of a renumbered molecule
+  OBConversion conv;
+  OB_REQUIRE( conv.SetInFormat("smi") );
+  OBMol mol;
+  OB_REQUIRE( conv.ReadString(&mol, "ClC(=O)Cl") );
+  OBBuilder builder;
+  OB_REQUIRE( builder.Build(mol) );
+  OBAtom *patom = mol.GetAtom(1);
+  patom->SetVector( patom->GetVector() + vector3(.1, .1, .1) );
+  OBMol mol_b = mol;
+  vector<int> a(4);
+  a[0] = 4; a[1] = 2; a[2] = 3; a[3] = 1;
+  mol_b.RenumberAtoms(a);
+
+  OBAlign symalign(true, true);
+  symalign.SetRefMol(mol);
+  symalign.SetTarget(mol_b.GetCoordinates(), mol_b.NumAtoms());
+  symalign.Align();
+  OB_ASSERT( fabs(symalign.GetRMSD()) < 1.0E-6 );
+  symalign.SetMethod(OBAlign::QCP);
+  symalign.Align();
+  OB_ASSERT( fabs(symalign.GetRMSD()) < 1.0E-6 );
+
+  OBAlign nosym(true, false);
+  nosym.SetRefMol(mol);
+  nosym.SetTarget(mol_b.GetCoordinates(), mol_b.NumAtoms());
+  nosym.Align();
+  OB_ASSERT( fabs(nosym.GetRMSD()) > 1.0E-2 );
+}
+
+void test_RMSDMatrix()
+{
+  // 12 distorted and rotated copies of 9 points (not a multiple of 4)
+  const unsigned int natoms = 9, nconf = 12;
+  vector<vv3> confs(nconf);
+  OBRMSDMatrix ensemble;
+  for (unsigned int i = 0; i < nconf; ++i) {
+    matrix3x3 rot;
+    rot.RotAboutAxisByAngle(vector3(1.0, i, 0.5), 20.0 * i);
+    for (unsigned int k = 0; k < natoms; ++k) {
+      vector3 v(k, sin(1.3 * k), cos(0.7 * k) + 0.3 * sin(i * k + 1.0));
+      confs[i].push_back(rot * v + vector3(i, -2.0 * i, 0.5));
+    }
+    OB_ASSERT( ensemble.AddConformer(confs[i]) == i );
+  }
+  OB_COMPARE( ensemble.NumAtoms(), natoms );
+  OB_COMPARE( ensemble.NumConformers(), nconf );
+
+  // Same RMSD as OBAlign
+  vector<double> rmsd;
+  ensemble.GetMatrix(rmsd);
+  OB_REQUIRE( rmsd.size() == nconf * (nconf - 1) / 2 );
+  unsigned int nbelow = 0;
+  for (unsigned int i = 0; i < nconf; ++i)
+    for (unsigned int j = i + 1; j < nconf; ++j) {
+      OBAlign align(confs[i], confs[j]);
+      align.Align();
+      double expected = align.GetRMSD();
+      double value = rmsd[OBRMSDMatrix::CondensedIndex(nconf, i, j)];
+      OB_ASSERT( fabs(value - expected) < 1.0E-08 );
+      OB_ASSERT( fabs(ensemble.GetRMSD(j, i) - expected) < 1.0E-08 );
+      if (expected < 0.3)
+        nbelow++;
+    }
+  OB_ASSERT( nbelow > 0 );
+
+  // With a threshold, the pairs below the threshold are unchanged
+  vector<double> thresholded;
+  ensemble.GetMatrix(thresholded, 0.3);
+  for (unsigned int ij = 0; ij < rmsd.size(); ++ij) {
+    if (rmsd[ij] < 0.3)
+      OB_ASSERT( thresholded[ij] == rmsd[ij] );
+    else
+      OB_ASSERT( thresholded[ij] > 0.3 && thresholded[ij] <= rmsd[ij] + 1.0E-12 );
+  }
+
+  // The result does not depend on the number of threads
+  vector<double> threaded;
+  ensemble.SetNumThreads(3);
+  ensemble.GetMatrix(threaded);
+  OB_ASSERT( threaded == rmsd );
+
+  // Swap two atoms of the first conformer; the permutation undoes the swap
+  vv3 swapped = confs[0];
+  std::swap(swapped[0], swapped[1]);
+  unsigned int last = ensemble.AddConformer(swapped);
+  OB_ASSERT( ensemble.GetRMSD(0, last) > 0.1 );
+  vector<unsigned int> perm(natoms);
+  for (unsigned int k = 0; k < natoms; ++k)
+    perm[k] = k;
+  std::swap(perm[0], perm[1]);
+  ensemble.AddPermutation(perm);
+  OB_ASSERT( ensemble.GetRMSD(0, last) < 1.0E-06 );
+  ensemble.RemoveLastConformer();
+  OB_COMPARE( ensemble.NumConformers(), nconf );
+}
+
 int aligntest(int argc, char* argv[])
 {
   int defaultchoice = 1;
@@ -425,6 +565,12 @@ int aligntest(int argc, char* argv[])
     test_alignWithoutHydrogens();
     test_alignWithSymWithoutHydrogens();
     break;
+  case 6:
+    test_RMSDMatrix();
+    break;
+  case 7:
+    test_alignRawCoords();
+    break;
   default:
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
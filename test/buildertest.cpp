@@ -1,10 +1,18 @@
 #include "obtest.h"
 #include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/obiter.h>
 #include <openbabel/obconversion.h>
 #include <openbabel/builder.h>
 #include <openbabel/forcefield.h>
+#ifdef HAVE_EIGEN
+#include <openbabel/distgeom.h>
+#include <openbabel/stereo/stereo.h>
+#endif
 
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
@@ -99,6 +107,134 @@ bool doSMILESBuilderTest(string smiles)
   return mol.Has3D();
 }
 
+// --gen3d with a seed gives the same coordinates in every run, and when the
+// molecules are built by several reading threads
+static string doGen3D(const string &smiles, const char *threads)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInAndOutFormats("smi", "sdf"));
+  conv.AddOption("gen3d", OBConversion::GENOPTIONS, "fast");
+  conv.AddOption("seed", OBConversion::GENOPTIONS, "5");
+  if (threads)
+    conv.AddOption("threads", OBConversion::GENOPTIONS, threads);
+  stringstream in(smiles), out;
+  OB_REQUIRE(conv.Convert(&in, &out) == 8);
+  return out.str();
+}
+
+bool doGen3DSeedTest()
+{
+  const string smiles =
+    "CCO\tethanol\nc1ccccc1C(=O)O\tbenzoic acid\nC1CCCCC1N\tcyclohexylamine\n"
+    "CC(C)Cc1ccc(cc1)[C@@H](C)C(=O)O\tibuprofen\nOCC(O)CO\tglycerol\n"
+    "c1ccc2ccccc2c1\tnaphthalene\nC/C=C/C(=O)Cl\tcrotonyl chloride\n"
+    "NC(=O)c1cccnc1\tnicotinamide\n";
+  const string serial = doGen3D(smiles, NULL);
+  OB_COMPARE(doGen3D(smiles, NULL), serial);
+  OB_COMPARE(doGen3D(smiles, "3"), serial);
+  return true;
+}
+
+// The coordinates of the rigid fragments are read once, without the file
+bool doFragmentCoordTest()
+{
+  OBBuilder builder;
+  vector<vector3> benzene = builder.GetFragmentCoord("c1ccccc1");
+  OB_REQUIRE(benzene.size() == 6);
+  for (unsigned int i = 0; i < 6; ++i)
+    OB_ASSERT(fabs((benzene[i] - benzene[(i + 1) % 6]).length() - 1.39) < 0.15);
+  OB_ASSERT(builder.GetFragmentCoord("not a fragment").empty());
+
+  // the ring of toluene takes the coordinates of the template
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("smi"));
+  OBMol mol;
+  OB_REQUIRE(conv.ReadString(&mol, "Cc1ccccc1"));
+  OB_REQUIRE(builder.Build(mol));
+  for (unsigned int i = 2; i <= 7; ++i)
+    OB_ASSERT(fabs(mol.GetAtom(i)->GetDistance(i == 7 ? 2 : i + 1) - 1.39) < 0.15);
+  return true;
+}
+
+#ifdef HAVE_EIGEN
+// Distance geometry conformers from several random starts, which keep the
+// stereochemistry and do not depend on the number of threads
+static vector<double> doDistGeom(OBMol mol, int threads)
+{
+  OBDistanceGeometry dg;
+  OB_REQUIRE(dg.Setup(mol));
+  dg.SetRandomSeed(3);
+  dg.SetNumThreads(threads);
+  OB_COMPARE(dg.AddConformers(3), 3);
+  dg.GetConformers(mol);
+  OB_REQUIRE(mol.NumConformers() == 3);
+
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("can"));
+  vector<double> coords;
+  for (int c = 0; c < mol.NumConformers(); ++c) {
+    mol.SetConformer(c);
+    OBMol conf = mol;
+    StereoFrom3D(&conf, true);
+    OB_COMPARE(conv.WriteString(&conf, true), "C[C@H](CC[C@H](O)C)N");
+    coords.insert(coords.end(), mol.GetConformer(c), mol.GetConformer(c) + 3 * mol.NumAtoms());
+  }
+  return coords;
+}
+
+bool doDistGeomTest()
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("smi"));
+  OBMol mol;
+  OB_REQUIRE(conv.ReadString(&mol, "C[C@@H](O)CC[C@H](N)C"));
+  mol.AddHydrogens();
+  const vector<double> serial = doDistGeom(mol, 1);
+  OB_ASSERT(doDistGeom(mol, 1) == serial);
+  OB_ASSERT(doDistGeom(mol, 3) == serial);
+  return true;
+}
+
+// The smoothed bounds meet the triangle inequalities for all triples
+bool doDistGeomBoundsTest()
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("smi"));
+  OBMol mol;
+  OB_REQUIRE(conv.ReadString(&mol, "CC(=O)N[C@@H](Cc1ccccc1)C(=O)NCCC(C)C"));
+  mol.AddHydrogens();
+  OBDistanceGeometry dg;
+  OB_REQUIRE(dg.Setup(mol));
+
+  const int N = mol.NumAtoms();
+  const float eps = 1.0e-4f;
+  int errors = 0;
+  for (int i = 0; i < N; ++i)
+    for (int j = i + 1; j < N; ++j) {
+      const float u_ij = dg.GetUpperBounds(i, j), l_ij = dg.GetLowerBounds(i, j);
+      if (l_ij > u_ij)
+        ++errors;
+      for (int k = 0; k < N; ++k) {
+        if (k == i || k == j)
+          continue;
+        if (u_ij > dg.GetUpperBounds(i, k) + dg.GetUpperBounds(k, j) + eps)
+          ++errors;
+        if (l_ij < dg.GetLowerBounds(i, k) - dg.GetUpperBounds(k, j) - eps)
+          ++errors;
+      }
+    }
+  OB_COMPARE(errors, 0);
+
+  // bonds keep their bounds
+  FOR_BONDS_OF_MOL(bond, mol) {
+    const int i = bond->GetBeginAtomIdx() - 1, j = bond->GetEndAtomIdx() - 1;
+    OB_ASSERT(dg.GetUpperBounds(i, j) < 2.0f);
+    OB_ASSERT(dg.GetLowerBounds(i, j) > 0.8f);
+  }
+  return true;
+}
+#endif
+
 int buildertest(int argc, char* argv[])
 {
   int defaultchoice = 1;
@@ -147,6 +283,20 @@ int buildertest(int argc, char* argv[])
     // from Martin Guetlein -- PR#3107218 ("OBBuilder terminates while building 3d")
     OB_ASSERT( doSMILESBuilderTest("N12[C@@H]([C@@H](NC([C@@H](c3ccsc3)C(=O)O)=O)C2=O)SC(C)(C)[C@@-]1C(=O)O") );
     break;
+  case 6:
+    OB_ASSERT( doGen3DSeedTest() );
+    break;
+  case 7:
+    OB_ASSERT( doFragmentCoordTest() );
+    break;
+#ifdef HAVE_EIGEN
+  case 8:
+    OB_ASSERT( doDistGeomTest() );
+    break;
+  case 9:
+    OB_ASSERT( doDistGeomBoundsTest() );
+    break;
+#endif
   default:
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
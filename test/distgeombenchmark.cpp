@@ -0,0 +1,127 @@
+#include "obbench.h"
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/distgeom.h>
+
+#include <cstring>
+
+using namespace std;
+using namespace OpenBabel;
+
+// Side chains of the repeated sequence (Gly-Ala-Ser-Leu-Phe)
+static const char *sideChains[] = { "", "C", "CO", "CC(C)C", "Cc1ccccc1" };
+
+// SMILES of a linear L-peptide with the given number of residues
+static string PeptideSmiles(unsigned int residues)
+{
+  string smiles = "N";
+  for (unsigned int i = 0; i < residues; ++i) {
+    const char *side = sideChains[i % 5];
+    if (*side)
+      smiles += string("[C@@H](") + side + ")";
+    else
+      smiles += "C";
+    smiles += (i + 1 < residues) ? "C(=O)N" : "C(=O)O";
+  }
+  return smiles;
+}
+
+template<typename T>
+static string ToString(const T &value)
+{
+  stringstream ss;
+  ss << value;
+  return ss.str();
+}
+
+// Setup (bounds matrix and triangle smoothing) and optionally the embedding
+// of one conformer
+void benchmarkPeptide(unsigned int residues, bool embed)
+{
+  OBConversion conv;
+  conv.SetInFormat("smi");
+  OBMol mol;
+  conv.ReadString(&mol, PeptideSmiles(residues));
+  mol.AddHydrogens();
+
+  const string name = "peptide " + ToString(residues) + " ";
+  BenchmarkResults &results = BenchmarkResults::instance();
+  results.setLabel("residues", ToString(residues));
+  results.setLabel("atoms", ToString(mol.NumAtoms()));
+  cout << name << "(" << mol.NumAtoms() << " atoms)" << endl;
+
+  OBDistanceGeometry dg;
+  OB_BENCHMARK_STR(name + "Setup") {
+    dg.Setup(mol);
+  }
+
+  if (embed) {
+    dg.SetRandomSeed(1);
+    unsigned int found = 0, tried = 0;
+    OB_BENCHMARK_STR(name + "AddConformers(1)") {
+      dg.Setup(mol);
+      found += dg.AddConformers(1, 10);
+      ++tried;
+    }
+    cout << name << found << " of " << tried << " embeddings met the constraints" << endl;
+  }
+  results.clearLabels();
+}
+
+static void usage()
+{
+  cout << "Usage: distgeombenchmark [-n <residues>] [-embed <residues>]\n"
+       << "                         [-json <file>] [-csv <file>]\n\n"
+       << "  -n       largest peptide, the sizes double from 5 residues (default 80)\n"
+       << "  -embed   also embed one conformer for peptides up to this size\n"
+       << "           (default 5)\n"
+       << "  -json    write the results as JSON\n"
+       << "  -csv     write the results as CSV\n";
+}
+
+int main(int argc, char* argv[])
+{
+  // Define location of file formats and data files for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+  if (!getenv("BABEL_DATADIR")) {
+    static char datadir[BUFF_SIZE];
+    snprintf(datadir, BUFF_SIZE, "BABEL_DATADIR=%s../../data", TESTDATADIR);
+    putenv(datadir);
+  }
+
+  string json, csv;
+  unsigned int maxResidues = 80, maxEmbed = 5;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-n"))
+      maxResidues = atoi(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-embed"))
+      maxEmbed = atoi(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-json"))
+      json = argv[++i];
+    else if (i + 1 < argc && !strcmp(argv[i], "-csv"))
+      csv = argv[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  for (unsigned int residues = 5; residues <= maxResidues; residues *= 2)
+    benchmarkPeptide(residues, residues <= maxEmbed);
+
+  if (!json.empty()) {
+    ofstream ofs(json.c_str());
+    BenchmarkResults::instance().writeJSON(ofs);
+  }
+  if (!csv.empty()) {
+    ofstream ofs(csv.c_str());
+    BenchmarkResults::instance().writeCSV(ofs);
+  }
+
+  return 0;
+}
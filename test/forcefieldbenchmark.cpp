@@ -0,0 +1,206 @@
+#include "obbench.h"
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/forcefield.h>
+#include <openbabel/obutil.h>
+
+#include <cstring>
+
+using namespace std;
+using namespace OpenBabel;
+
+// A set of molecules that is set up and evaluated together
+struct System
+{
+  string name;
+  vector<OBMol> mols;
+  unsigned int numAtoms;
+};
+
+static bool ReadSystem(System &system, const string &name, const string &filename,
+                       const char *format, unsigned int maxMols, bool addH)
+{
+  system.name = name;
+  system.numAtoms = 0;
+
+  ifstream ifs;
+  if (!SafeOpen(ifs, OBTestUtil::GetFilename(filename).c_str()))
+    return false;
+  OBConversion conv(&ifs);
+  if (!conv.SetInFormat(format))
+    return false;
+
+  OBMol mol;
+  while (system.mols.size() < maxMols && conv.Read(&mol)) {
+    if (addH)
+      mol.AddHydrogens();
+    system.mols.push_back(mol);
+    system.numAtoms += mol.NumAtoms();
+  }
+  return !system.mols.empty();
+}
+
+template<typename T>
+static string ToString(const T &value)
+{
+  stringstream ss;
+  ss << value;
+  return ss.str();
+}
+
+// Setup, Energy(), Energy(true) and 100 steps of ConjugateGradients for all
+// molecules of the system
+void benchmarkForceField(OBForceField *pFF, const System &system)
+{
+  const string name = string(pFF->GetID()) + " " + system.name + " ";
+  BenchmarkResults &results = BenchmarkResults::instance();
+  results.setLabel("forcefield", pFF->GetID());
+  results.setLabel("system", system.name);
+  results.setLabel("molecules", ToString(system.mols.size()));
+  results.setLabel("atoms", ToString(system.numAtoms));
+
+  // one instance per molecule, so only the timed operation is repeated
+  vector<OBForceField*> instances;
+  vector<OBMol> mols;
+  for (unsigned int i = 0; i < system.mols.size(); ++i) {
+    OBMol mol = system.mols[i];
+    OBForceField *ff = pFF->MakeNewInstance();
+    ff->SetLogLevel(OBFF_LOGLVL_NONE);
+    if (!ff->Setup(mol)) {
+      delete ff;
+      continue;
+    }
+    instances.push_back(ff);
+    mols.push_back(mol);
+  }
+  if (instances.empty()) {
+    cout << name << "skipped: setup failed" << endl;
+    return;
+  }
+  if (instances.size() < system.mols.size())
+    cout << name << "skipped " << system.mols.size() - instances.size()
+         << " molecules: setup failed" << endl;
+
+  // setting up an empty molecule first forces a full setup
+  OBMol empty;
+  OB_BENCHMARK_STR(name + "Setup") {
+    for (unsigned int i = 0; i < mols.size(); ++i) {
+      instances[i]->Setup(empty);
+      instances[i]->Setup(mols[i]);
+    }
+  }
+
+  OB_BENCHMARK_STR(name + "Energy()") {
+    for (unsigned int i = 0; i < instances.size(); ++i)
+      instances[i]->Energy(false);
+  }
+
+  OB_BENCHMARK_STR(name + "Energy(true)") {
+    for (unsigned int i = 0; i < instances.size(); ++i)
+      instances[i]->Energy(true);
+  }
+
+  OB_BENCHMARK_STR(name + "ConjugateGradients(100)") {
+    for (unsigned int i = 0; i < instances.size(); ++i) {
+      instances[i]->SetCoordinates(mols[i]);
+      instances[i]->ConjugateGradients(100);
+    }
+  }
+
+  for (unsigned int i = 0; i < instances.size(); ++i)
+    delete instances[i];
+  results.clearLabels();
+}
+
+static void usage()
+{
+  cout << "Usage: forcefieldbenchmark [-ff <name>] [-system <name>] [-n <ligands>]\n"
+       << "                           [-json <file>] [-csv <file>]\n\n"
+       << "  -ff      force field to benchmark (default: MMFF94, UFF, GAFF and Ghemical)\n"
+       << "  -system  ligands (first n molecules of forcefield.sdf), 1DRF (1788 heavy\n"
+       << "           atoms) or 3G61 (18448 heavy atoms, not run by default: the force\n"
+       << "           fields store all non-bonded pairs and need several GB of memory).\n"
+       << "           Hydrogens are added to the proteins.\n"
+       << "  -n       number of ligands (default 20)\n"
+       << "  -json    write the results as JSON\n"
+       << "  -csv     write the results as CSV\n";
+}
+
+int main(int argc, char* argv[])
+{
+  // Define location of file formats and data files for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+  if (!getenv("BABEL_DATADIR")) {
+    static char datadir[BUFF_SIZE];
+    snprintf(datadir, BUFF_SIZE, "BABEL_DATADIR=%s../../data", TESTDATADIR);
+    putenv(datadir);
+  }
+
+  vector<string> forcefields, systems;
+  string json, csv;
+  unsigned int numLigands = 20;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-ff"))
+      forcefields.push_back(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-system"))
+      systems.push_back(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-n"))
+      numLigands = atoi(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-json"))
+      json = argv[++i];
+    else if (i + 1 < argc && !strcmp(argv[i], "-csv"))
+      csv = argv[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (forcefields.empty()) {
+    forcefields.push_back("MMFF94");
+    forcefields.push_back("UFF");
+    forcefields.push_back("GAFF");
+    forcefields.push_back("Ghemical");
+  }
+  if (systems.empty()) {
+    systems.push_back("ligands");
+    systems.push_back("1DRF");
+  }
+
+  for (unsigned int s = 0; s < systems.size(); ++s) {
+    System system;
+    bool ok;
+    if (systems[s] == "ligands")
+      ok = ReadSystem(system, "ligands", "forcefield.sdf", "sdf", numLigands, false);
+    else
+      ok = ReadSystem(system, systems[s], systems[s] + ".pdb", "pdb", 1, true);
+    if (!ok) {
+      cerr << "Could not read system " << systems[s] << endl;
+      return 1;
+    }
+
+    for (unsigned int f = 0; f < forcefields.size(); ++f) {
+      OBForceField *pFF = OBForceField::FindForceField(forcefields[f]);
+      if (!pFF) {
+        cerr << "Could not find force field " << forcefields[f] << endl;
+        return 1;
+      }
+      benchmarkForceField(pFF, system);
+    }
+  }
+
+  if (!json.empty()) {
+    ofstream ofs(json.c_str());
+    BenchmarkResults::instance().writeJSON(ofs);
+  }
+  if (!csv.empty()) {
+    ofstream ofs(csv.c_str());
+    BenchmarkResults::instance().writeCSV(ofs);
+  }
+
+  return 0;
+}
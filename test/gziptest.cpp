@@ -24,10 +24,14 @@ GNU General Public License for more details.
 #include <openbabel/babelconfig.h>
 #include <openbabel/mol.h>
 #include <openbabel/obconversion.h>
+#include <openbabel/parallelzip.h>
+#include "obtest.h"
+#include "../src/zipstream.h"
 
 #include <stdio.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 using namespace std;
 using namespace OpenBabel;
@@ -85,24 +89,8 @@ void checkResults(const string& file, const vector<string>& correctResults)
 // string into a molecule, converts that molecule into canonical smiles
 // and compares to gzip.out
 
-int gziptest(int argc, char* argv[])
+int testGzipFiles()
 {
-
-  int choice = 1;
-
-  if (argc > 1) {
-    if(sscanf(argv[1], "%d", &choice) != 1) {
-      printf("Couldn't parse that input as a number\n");
-      return -1;
-    }
-  }
-
-  if(choice != 1) //eh, not bothering to split this up
-  {
-    cout << "Test number " << choice << " does not exist!\n";
-    return -1;
-  }
-
   cout << endl << "# Testing gzip handling...  " << endl;
  
   #ifdef TESTDATADIR
@@ -112,12 +100,6 @@ int gziptest(int argc, char* argv[])
     string gzipin = "files/gzip.in";
   #endif
 
-  #ifdef FORMATDIR
-    char env[BUFF_SIZE];
-    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
-    putenv(env);
-  #endif
-
   ifstream ifs(gzipin.c_str());
   if (!ifs)
     {
@@ -172,3 +154,237 @@ int gziptest(int argc, char* argv[])
 
   return(0);
 }
+
+// Text of several compression blocks, compressible but not repetitive
+static string MakeText(unsigned int lines)
+{
+  stringstream ss;
+  for (unsigned int i = 0; i < lines; ++i)
+    ss << "line " << i << " " << (i * 7919) % 1000 << " C" << i % 17 << "CC(=O)O\n";
+  return ss.str();
+}
+
+static string Decompress(const string &compressed)
+{
+  stringstream in(compressed);
+  zlib_stream::zip_istream zin(in);
+  stringstream out;
+  out << zin.rdbuf();
+  return out.str();
+}
+
+// 2
+// output compressed in parallel blocks is a single valid gzip member
+void testParallelGzip()
+{
+  const string text = MakeText(50000); // about 1.3MB
+  for (unsigned int size = 0; size < 3; ++size) {
+    string input = size == 0 ? string() : size == 1 ? string("C") : text;
+    stringstream ss;
+    {
+      OBParallelZipOutStream zout(ss);
+      zout << input << flush; // does not end a block
+      OB_ASSERT(zout.Finish());
+    }
+    const string compressed = ss.str();
+    OB_REQUIRE(zlib_stream::isGZip(ss));
+    OB_ASSERT(compressed.size() < input.size() / 4 + 32);
+    OB_COMPARE(Decompress(compressed), input);
+  }
+
+  // through OBConversion
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInAndOutFormats("smi", "smi", false, true));
+  OBMol mol;
+  stringstream smiles;
+  for (unsigned int i = 0; i < 2000; ++i)
+    smiles << "CC(=O)OC" << string(i % 10, 'C') << "\tmol" << i << "\n";
+  stringstream gz;
+  conv.Convert(&smiles, &gz);
+  conv.SetInStream(NULL);
+  conv.SetOutStream(NULL); // writes the trailer
+  OB_COMPARE(Decompress(gz.str()), smiles.str());
+}
+
+// 3
+// BGZF output can be read by any gzip reader, and sought with its index
+void testBgzf()
+{
+  const string text = MakeText(50000);
+  stringstream ss, index;
+  {
+    OBParallelZipOutStream zout(ss, true);
+    zout << text;
+    OB_ASSERT(zout.Finish());
+    zout.WriteIndex(index);
+  }
+  const string compressed = ss.str();
+  OB_COMPARE(Decompress(compressed), text);
+  OB_REQUIRE(OBBgzfStreambuf::IsBGZF(ss));
+  OB_COMPARE(static_cast<int>(streamoff(ss.tellg())), 0);
+  OB_ASSERT(compressed.size() < text.size() / 3);
+
+  // (at least) one entry per 64KB block, after the first
+  const string idx = index.str();
+  OB_REQUIRE(idx.size() >= 8);
+  OB_COMPARE(static_cast<unsigned int>(static_cast<unsigned char>(idx[0])),
+             (idx.size() - 8) / 16);
+  OB_ASSERT(idx.size() - 8 >= 16 * (text.size() / 0x10000));
+
+  for (unsigned int indexed = 0; indexed < 2; ++indexed) {
+    stringstream source(compressed);
+    OBBgzfInStream in(source);
+    if (indexed) {
+      stringstream is(idx);
+      OB_ASSERT(in.LoadIndex(is));
+    }
+    string line;
+    OB_REQUIRE(getline(in, line));
+    OB_COMPARE(line, "line 0 0 C0CC(=O)O");
+
+    // forwards to a later block, back and to the end
+    const size_t positions[] = { text.size() / 2 + 3, 100, 0x20000, text.size() - 10 };
+    for (unsigned int i = 0; i < 4; ++i) {
+      in.clear();
+      OB_REQUIRE(in.seekg(positions[i]));
+      OB_COMPARE(static_cast<size_t>(streamoff(in.tellg())), positions[i]);
+      OB_REQUIRE(getline(in, line));
+      OB_COMPARE(line, text.substr(positions[i], text.find('\n', positions[i]) - positions[i]));
+    }
+    in.clear();
+    OB_REQUIRE(in.seekg(0, ios_base::end));
+    OB_COMPARE(static_cast<size_t>(streamoff(in.tellg())), text.size());
+    in.clear();
+    in.seekg(0);
+    stringstream all;
+    all << in.rdbuf();
+    OB_COMPARE(all.str(), text);
+  }
+
+  // a plain gzip stream is not BGZF
+  stringstream gz;
+  {
+    OBParallelZipOutStream zout(gz);
+    zout << text;
+  }
+  OB_ASSERT(!OBBgzfStreambuf::IsBGZF(gz));
+
+  // OBConversion writes the index of a BGZF output file, and reads it back
+  const string filename = "gziptest_bgzf.smi.gz";
+  OBConversion conv;
+  conv.AddOption("bgzf", OBConversion::GENOPTIONS);
+  OB_REQUIRE(conv.SetInAndOutFormats("smi", "smi"));
+  OBMol mol;
+  OB_REQUIRE(conv.ReadString(&mol, "CCO ethanol"));
+  OB_REQUIRE(conv.WriteFile(&mol, filename));
+  for (unsigned int i = 0; i < 5000; ++i)
+    conv.Write(&mol);
+  conv.CloseOutFile();
+  ifstream gzi((filename + ".gzi").c_str(), ios_base::in | ios_base::binary);
+  OB_ASSERT(gzi.good());
+
+  OBConversion readConv;
+  OB_REQUIRE(readConv.SetInFormat("smi"));
+  unsigned int count = 0;
+  for (bool ok = readConv.ReadFile(&mol, filename); ok; ok = readConv.Read(&mol))
+    ++count;
+  OB_COMPARE(count, 5001);
+  remove(filename.c_str());
+  remove((filename + ".gzi").c_str());
+}
+
+// 4
+// a gzipped file is decompressed ahead of the reader, on another thread
+void testReadAhead()
+{
+  const string text = MakeText(50000);
+  stringstream gz;
+  {
+    OBParallelZipOutStream zout(gz);
+    zout << text;
+  }
+
+  for (unsigned int blockSize = 1000; blockSize <= 1000000; blockSize *= 1000) {
+    stringstream source(gz.str());
+    zlib_stream::zip_istream zin(source);
+    OBReadAheadStreambuf buf(zin, blockSize, 2);
+    istream in(&buf);
+    string line;
+    OB_REQUIRE(getline(in, line));
+    OB_COMPARE(line, "line 0 0 C0CC(=O)O");
+    streampos pos = in.tellg();
+    OB_COMPARE(static_cast<size_t>(streamoff(pos)), line.size() + 1);
+    // putback across a block boundary
+    in.ignore(blockSize - pos);
+    OB_COMPARE(in.get(), text[blockSize]);
+    OB_ASSERT(in.unget());
+    OB_ASSERT(in.unget());
+    OB_COMPARE(in.get(), text[blockSize - 1]);
+    // within a block
+    in.seekg(blockSize + 10);
+    OB_COMPARE(in.get(), text[blockSize + 10]);
+    buf.Stop();
+    // back to the start, which restarts the reading
+    in.seekg(pos);
+    stringstream rest;
+    rest << in.rdbuf();
+    OB_COMPARE(rest.str(), text.substr(line.size() + 1));
+  }
+
+  // OBConversion reads a gzipped file ahead
+  const string filename = "gziptest_readahead.smi.gz";
+  {
+    ofstream ofs(filename.c_str(), ios_base::out | ios_base::binary);
+    OBParallelZipOutStream zout(ofs);
+    for (unsigned int i = 0; i < 20000; ++i)
+      zout << "c1ccccc1C" << string(i % 5, 'C') << " mol" << i << "\n";
+  }
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("smi"));
+  OBMol mol;
+  unsigned int count = 0;
+  for (bool ok = conv.ReadFile(&mol, filename); ok; ok = conv.Read(&mol)) {
+    if (count == 19999)
+      OB_COMPARE(mol.GetTitle(), string("mol19999"));
+    ++count;
+  }
+  OB_COMPARE(count, 20000);
+  remove(filename.c_str());
+}
+
+int gziptest(int argc, char* argv[])
+{
+  int choice = 1;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    return testGzipFiles();
+  case 2:
+    testParallelGzip();
+    break;
+  case 3:
+    testBgzf();
+    break;
+  case 4:
+    testReadAhead();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
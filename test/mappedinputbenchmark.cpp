@@ -0,0 +1,180 @@
+#include "obbench.h"
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/mappedinput.h>
+#include <openbabel/lineend.h>
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+using namespace OpenBabel;
+
+typedef FilteringInputStream<LineEndingExtractor> LEInStream;
+
+template<typename T>
+static string ToString(const T &value)
+{
+  stringstream ss;
+  ss << value;
+  return ss.str();
+}
+
+// Concatenate copies of a test file until it has at least minSize bytes
+static bool MakeInputFile(const string &source, const string &filename, size_t minSize)
+{
+  ifstream ifs(OBTestUtil::GetFilename(source).c_str(), ios_base::in | ios_base::binary);
+  if (!ifs)
+    return false;
+  stringstream contents;
+  contents << ifs.rdbuf();
+  const string data = contents.str();
+  if (data.empty())
+    return false;
+  ofstream ofs(filename.c_str(), ios_base::out | ios_base::binary);
+  for (size_t size = 0; size < minSize; size += data.size())
+    ofs << data;
+  return true;
+}
+
+static void PrintRate(const string &what, double count)
+{
+  const vector<BenchmarkResults::Result> &results = BenchmarkResults::instance().results();
+  if (!results.empty() && results.back().secondsPerIter > 0.0)
+    cout << "  " << static_cast<unsigned long>(count / results.back().secondsPerIter)
+         << " " << what << "/s" << endl;
+}
+
+// Lines and molecules per second read from the same file through an
+// ifstream (the istream path) and through a memory mapping (OBLineReader)
+void benchmarkFormat(const string &format, const string &source, size_t minSize)
+{
+  const string filename = "mappedinputbenchmark." + format;
+  if (!MakeInputFile(source, filename, minSize)) {
+    cout << format << " skipped: cannot read " << source << endl;
+    return;
+  }
+
+  BenchmarkResults &results = BenchmarkResults::instance();
+  results.setLabel("format", format);
+
+  unsigned long lines = 0;
+  OB_BENCHMARK_STR(format + " lines (istream)") {
+    ifstream ifs(filename.c_str(), ios_base::in | ios_base::binary);
+    LEInStream in(ifs);
+    string line;
+    lines = 0;
+    while (getline(in, line))
+      ++lines;
+  }
+  PrintRate("lines", lines);
+
+  OB_BENCHMARK_STR(format + " lines (mapped)") {
+    OBMappedInStream mapped(filename);
+    LEInStream in(mapped);
+    OBLineReader reader(in);
+    OBLineRef line;
+    lines = 0;
+    while (reader.GetLine(line))
+      ++lines;
+  }
+  PrintRate("lines", lines);
+  results.setLabel("lines", ToString(lines));
+
+  OBConversion conv;
+  OBFormat *pFormat = conv.FindFormat(format);
+  unsigned long mols = 0;
+  OB_BENCHMARK_STR(format + " molecules (istream)") {
+    ifstream ifs(filename.c_str(), ios_base::in | ios_base::binary);
+    OBConversion readConv;
+    readConv.SetInFormat(pFormat);
+    readConv.SetInStream(&ifs, false);
+    OBMol mol;
+    mols = 0;
+    while (readConv.Read(&mol))
+      ++mols;
+  }
+  PrintRate("molecules", mols);
+
+  OB_BENCHMARK_STR(format + " molecules (mapped)") {
+    OBConversion readConv;
+    readConv.SetInFormat(pFormat);
+    OBMol mol;
+    mols = 0;
+    for (bool ok = readConv.ReadFile(&mol, filename); ok; ok = readConv.Read(&mol))
+      ++mols;
+  }
+  PrintRate("molecules", mols);
+
+  results.clearLabels();
+  remove(filename.c_str());
+}
+
+static void usage()
+{
+  cout << "Usage: mappedinputbenchmark [-format <id>] [-size <MB>]\n"
+       << "                            [-json <file>] [-csv <file>]\n\n"
+       << "  -format  smi, sdf, xyz, pdb or mol2 (default: all)\n"
+       << "  -size    size of the input files, made by repeating a test file (default 4)\n"
+       << "  -json    write the results as JSON\n"
+       << "  -csv     write the results as CSV\n";
+}
+
+int main(int argc, char* argv[])
+{
+  // Define location of file formats and data files for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+  if (!getenv("BABEL_DATADIR")) {
+    static char datadir[BUFF_SIZE];
+    snprintf(datadir, BUFF_SIZE, "BABEL_DATADIR=%s../../data", TESTDATADIR);
+    putenv(datadir);
+  }
+
+  // the PDB test file has aromatic rings that cannot be kekulized
+  obErrorLog.SetOutputLevel(obError);
+
+  vector<string> formats;
+  string json, csv;
+  double sizeMB = 4.0;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-format"))
+      formats.push_back(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-size"))
+      sizeMB = atof(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-json"))
+      json = argv[++i];
+    else if (i + 1 < argc && !strcmp(argv[i], "-csv"))
+      csv = argv[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  const char *defaults[][2] = { { "smi", "nci.smi" }, { "sdf", "forcefield.sdf" },
+                                { "xyz", "test3d.xyz" }, { "pdb", "1DRF.pdb" },
+                                { "mol2", "culgi_00.mol2" } };
+  const size_t minSize = static_cast<size_t>(sizeMB * 1024 * 1024);
+  for (unsigned int i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i) {
+    if (!formats.empty() && find(formats.begin(), formats.end(), defaults[i][0]) == formats.end())
+      continue;
+    benchmarkFormat(defaults[i][0], defaults[i][1], minSize);
+  }
+
+  if (!json.empty()) {
+    ofstream ofs(json.c_str());
+    BenchmarkResults::instance().writeJSON(ofs);
+  }
+  if (!csv.empty()) {
+    ofstream ofs(csv.c_str());
+    BenchmarkResults::instance().writeCSV(ofs);
+  }
+
+  return 0;
+}
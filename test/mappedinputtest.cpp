@@ -0,0 +1,236 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/mappedinput.h>
+#include <openbabel/lineend.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace OpenBabel;
+
+typedef FilteringInputStream<LineEndingExtractor> LEInStream;
+
+static void WriteFile(const string &filename, const string &contents)
+{
+  ofstream ofs(filename.c_str(), ios_base::out | ios_base::binary);
+  ofs << contents;
+}
+
+static vector<string> ReadLines(istream &is)
+{
+  vector<string> lines;
+  OBLineReader reader(is);
+  OBLineRef line;
+  while (reader.GetLine(line))
+    lines.push_back(line.Str());
+  return lines;
+}
+
+// Lines from a memory-mapped file, or a stream without the line ending
+// filter, are split as std::getline() splits them
+// after the line ending filter, for UNIX, DOS and old Mac line endings
+void testLines()
+{
+  const string filename = "mappedinputtest.txt";
+  const char *contents[] = { "a\nbb\n\nccc\n", "a\r\nbb\r\n\r\nccc\r\n", "a\rbb\r\rccc\r",
+                             "a\nbb\r\n\rccc", NULL };
+  for (unsigned int i = 0; contents[i]; ++i) {
+    WriteFile(filename, contents[i]);
+
+    ifstream ifs(filename.c_str(), ios_base::in | ios_base::binary);
+    LEInStream le(ifs);
+    vector<string> expected;
+    string line;
+    while (getline(le, line))
+      expected.push_back(line);
+    OB_COMPARE(expected.size(), 4);
+
+    OBMappedInStream mapped(filename);
+    OB_REQUIRE(mapped.IsOpen());
+    LEInStream mappedLe(mapped);
+    OBLineReader reader(mappedLe);
+    OB_ASSERT(reader.IsMapped());
+    vector<string> lines = ReadLines(mappedLe);
+    OB_COMPARE(lines.size(), expected.size());
+    for (unsigned int j = 0; j < lines.size() && j < expected.size(); ++j)
+      OB_COMPARE(lines[j], expected[j]);
+    OB_ASSERT(mappedLe.eof());
+    OB_ASSERT(mappedLe.fail());
+
+    // the istream fallback
+    stringstream ss(contents[i]);
+    LEInStream ssLe(ss);
+    OB_ASSERT(!OBLineReader(ssLe).IsMapped());
+    OB_ASSERT(ReadLines(ssLe) == expected);
+
+    // a stream without the line ending filter, like std::cin
+    stringstream raw(contents[i]);
+    OB_ASSERT(ReadLines(raw) == expected);
+    OB_ASSERT(raw.eof());
+  }
+
+  // a mapped file can be read and positioned through the istream as well
+  WriteFile(filename, "first line\r\nsecond line\r\nthird\n");
+  OBMappedInStream mapped(filename);
+  LEInStream le(mapped);
+  OBLineReader reader(le);
+  OBLineRef line;
+  OB_REQUIRE(reader.GetLine(line));
+  OB_COMPARE(line.Str(), "first line");
+  streampos pos = le.tellg();
+  OB_COMPARE(static_cast<int>(streamoff(pos)), 12);
+  OB_COMPARE(le.peek(), 's');
+  OB_REQUIRE(reader.GetLine(line));
+  OB_COMPARE(line.Str(), "second line");
+  string str;
+  OB_REQUIRE(getline(le, str));
+  OB_COMPARE(str, "third");
+  le.clear();
+  le.seekg(pos);
+  char buffer[8];
+  OB_ASSERT(!reader.GetLine(buffer, sizeof(buffer))); // too long
+  OB_COMPARE(string(buffer), "second ");
+  le.clear();
+  le.seekg(0);
+  OB_REQUIRE(reader.GetLine(str));
+  OB_COMPARE(str, "first line");
+
+  // empty files are not mapped
+  WriteFile(filename, "");
+  OBMappedInStream empty(filename);
+  OB_ASSERT(!empty.IsOpen());
+  OB_ASSERT(!empty);
+
+  remove(filename.c_str());
+}
+
+void testLineRef()
+{
+  const char *text = "  C   1.5 -2 abc  ";
+  OBLineRef ref(text, strlen(text));
+  vector<OBLineRef> tokens;
+  ref.Tokenize(tokens);
+  OB_REQUIRE(tokens.size() == 4);
+  OB_COMPARE(tokens[0].Str(), "C");
+  double d;
+  OB_ASSERT(tokens[1].ToDouble(d));
+  OB_ASSERT(d == 1.5);
+  int n;
+  OB_ASSERT(tokens[2].ToInt(n));
+  OB_COMPARE(n, -2);
+  OB_ASSERT(!tokens[3].ToDouble(d));
+  // the conversions stop at the end of the reference
+  OB_ASSERT(OBLineRef(text + 6, 2).ToDouble(d));
+  OB_ASSERT(d == 1.0);
+  OB_COMPARE(ref.Trim().Str(), "C   1.5 -2 abc");
+  OB_COMPARE(ref.FindFirstOf("."), 7);
+  OB_COMPARE(ref.Substr(2, 1).Str(), "C");
+  OB_ASSERT(ref.Substr(100).Empty());
+  OB_ASSERT(ref.Trim().StartsWith("C "));
+}
+
+static void SetFormats(OBConversion &conv, const string &filename)
+{
+  OB_REQUIRE(conv.SetInAndOutFormats(conv.FormatFromExt(filename), conv.FindFormat("can")));
+  // without titles, which are the file name for some formats
+  conv.AddOption("n", OBConversion::OUTOPTIONS);
+  conv.AddOption("i", OBConversion::OUTOPTIONS);
+}
+
+static string Convert(OBConversion &conv, OBMol &mol, bool ok)
+{
+  string result;
+  for (; ok; ok = conv.Read(&mol))
+    result += conv.WriteString(&mol);
+  return result;
+}
+
+// Reading from a memory-mapped file (ReadFile) gives the same molecules as
+// reading from an istream, also with DOS line endings
+void testFormats()
+{
+  const char *files[] = { "forcefield.sdf", "nci.smi", "test3d.xyz", "1DRF.pdb",
+                          "culgi_00.mol2", NULL };
+  for (unsigned int i = 0; files[i]; ++i) {
+    ifstream ifs(OBTestUtil::GetFilename(files[i]).c_str(), ios_base::in | ios_base::binary);
+    OB_REQUIRE(ifs);
+    stringstream contents;
+    contents << ifs.rdbuf();
+
+    string ext = files[i];
+    ext = ext.substr(ext.rfind('.'));
+    for (unsigned int dos = 0; dos < 2; ++dos) {
+      string text = contents.str();
+      if (dos) {
+        string crlf;
+        for (string::size_type j = 0; j < text.size(); ++j) {
+          if (text[j] == '\n' && (j == 0 || text[j - 1] != '\r'))
+            crlf += '\r';
+          crlf += text[j];
+        }
+        text = crlf;
+      }
+      const string filename = "mappedinputtest" + ext;
+      WriteFile(filename, text);
+
+      OBConversion streamConv;
+      SetFormats(streamConv, filename);
+      OBMol mol;
+      stringstream ss(text);
+      string expected = Convert(streamConv, mol, streamConv.Read(&mol, &ss));
+
+      OBConversion fileConv;
+      SetFormats(fileConv, filename);
+      string result = Convert(fileConv, mol, fileConv.ReadFile(&mol, filename));
+      OB_ASSERT(!expected.empty());
+      OB_COMPARE(result, expected);
+
+      remove(filename.c_str());
+    }
+  }
+}
+
+int mappedinputtest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testLines();
+    break;
+  case 2:
+    testLineRef();
+    break;
+  case 3:
+    testFormats();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,524 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/forcefield.h>
+#include <openbabel/conformersearch.h>
+#include <openbabel/obutil.h>
+#include <openbabel/generic.h>
+#include <openbabel/obiter.h>
+#include <openbabel/bond.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+using namespace OpenBabel;
+
+enum Minimizer { SD, CG, LBFGS, FIRE };
+
+static void Minimize(OBForceField *pFF, Minimizer method, int steps)
+{
+  switch (method) {
+  case SD:
+    pFF->SteepestDescent(steps);
+    break;
+  case CG:
+    pFF->ConjugateGradients(steps);
+    break;
+  case LBFGS:
+    pFF->LBFGS(steps);
+    break;
+  case FIRE:
+    pFF->FIRE(steps);
+    break;
+  }
+}
+
+// Minimize the first molecules of forcefield.sdf and check that the result is
+// a minimum: a following conjugate gradient run should not lower the energy
+// significantly.
+void testMinimizerConverges(Minimizer method)
+{
+  std::ifstream ifs;
+  OB_REQUIRE(SafeOpen(ifs, OBTestUtil::GetFilename("forcefield.sdf").c_str()));
+  OBConversion conv(&ifs);
+  OB_REQUIRE(conv.SetInFormat("sdf"));
+
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+
+  OBMol mol;
+  for (int i = 0; i < 10 && conv.Read(&mol); ++i) {
+    OB_REQUIRE(pFF->Setup(mol));
+    double e0 = pFF->Energy(false);
+
+    Minimize(pFF, method, 2500);
+    double e1 = pFF->Energy(false);
+    OB_ASSERT(e1 <= e0 + 1.0e-6);
+
+    pFF->ConjugateGradients(2500);
+    double e2 = pFF->Energy(false);
+    OB_ASSERT(e1 - e2 < 0.1);
+  }
+}
+
+// The Initialize/TakeNSteps API has to respect fixed atoms
+void testMinimizerConstraints(Minimizer method)
+{
+  OBMolPtr mol = OBTestUtil::ReadFile("alanine.mol");
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+
+  OBFFConstraints constraints;
+  constraints.AddAtomConstraint(1);
+  OB_REQUIRE(pFF->Setup(*mol, constraints));
+  vector3 fixed = mol->GetAtom(1)->GetVector();
+
+  if (method == LBFGS) {
+    pFF->LBFGSInitialize(500);
+    while (pFF->LBFGSTakeNSteps(10))
+      ;
+  } else {
+    pFF->FIREInitialize(500);
+    while (pFF->FIRETakeNSteps(10))
+      ;
+  }
+  pFF->GetCoordinates(*mol);
+  OB_ASSERT(mol->GetAtom(1)->GetVector().distSq(fixed) < 1.0e-12);
+
+  // clear the static constraints for the following tests
+  OBFFConstraints empty;
+  pFF->SetConstraints(empty);
+}
+
+// EnergyBatch() has to give the same energies and forces as Energy()
+void testEnergyBatch()
+{
+  std::ifstream ifs;
+  OB_REQUIRE(SafeOpen(ifs, OBTestUtil::GetFilename("forcefield.sdf").c_str()));
+  OBConversion conv(&ifs);
+  OB_REQUIRE(conv.SetInFormat("sdf"));
+
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+
+  OBMol mol;
+  for (int i = 0; i < 10 && conv.Read(&mol); ++i) {
+    OB_REQUIRE(pFF->Setup(mol));
+    const unsigned int N = mol.NumAtoms() * 3;
+    const unsigned int K = 4;
+
+    // perturbed copies of the input coordinates
+    vector<double> coords(K * N);
+    for (unsigned int k = 0; k < K; ++k)
+      for (unsigned int c = 0; c < N; ++c)
+        coords[k * N + c] = mol.GetCoordinates()[c] + 0.05 * k * sin(1.0 + c * k);
+
+    vector<double> energies(K), forces(K * N);
+    pFF->EnergyBatch(&coords[0], K, &energies[0], &forces[0]);
+
+    for (unsigned int k = 0; k < K; ++k) {
+      OBMol copy(mol);
+      copy.SetCoordinates(&coords[k * N]);
+      OB_REQUIRE(pFF->SetCoordinates(copy));
+      double e = pFF->Energy(true);
+      OB_ASSERT(fabs(e - energies[k]) < 1.0e-6 * std::max(1.0, fabs(e)));
+      FOR_ATOMS_OF_MOL (a, copy) {
+        vector3 grad = pFF->GetGradient(&*a);
+        const double *f = &forces[k * N + (a->GetIdx() - 1) * 3];
+        OB_ASSERT(grad.distSq(vector3(f[0], f[1], f[2])) < 1.0e-8);
+      }
+    }
+  }
+}
+
+// With cut-offs, EnergyBatch() has to use the same VDW and electrostatic
+// pairs as Energy()
+void testEnergyBatchCutOff()
+{
+  OBMolPtr mol = OBTestUtil::ReadFile("forcefield.sdf");
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+  OB_REQUIRE(pFF->Setup(*mol));
+  pFF->EnableCutOff(true);
+  pFF->SetVDWCutOff(3.0);
+  pFF->SetElectrostaticCutOff(3.0);
+  pFF->UpdatePairsSimple();
+  const double inRange = pFF->Energy(false);
+  pFF->EnableCutOff(false);
+  OB_REQUIRE(fabs(pFF->Energy(false) - inRange) > 1.0e-3);
+  pFF->EnableCutOff(true);
+
+  const unsigned int N = mol->NumAtoms() * 3;
+  const unsigned int K = 3;
+  vector<double> coords(K * N);
+  for (unsigned int k = 0; k < K; ++k)
+    for (unsigned int c = 0; c < N; ++c)
+      coords[k * N + c] = mol->GetCoordinates()[c] + 0.05 * k * sin(1.0 + c * k);
+
+  vector<double> energies(K), forces(K * N), energiesOnly(K);
+  pFF->EnergyBatch(&coords[0], K, &energies[0], &forces[0]);
+  pFF->EnergyBatch(&coords[0], K, &energiesOnly[0], NULL);
+  for (unsigned int k = 0; k < K; ++k) {
+    OBMol copy(*mol);
+    copy.SetCoordinates(&coords[k * N]);
+    OB_REQUIRE(pFF->SetCoordinates(copy));
+    double e = pFF->Energy(true);
+    OB_ASSERT(fabs(e - energies[k]) < 1.0e-6 * std::max(1.0, fabs(e)));
+    OB_ASSERT(fabs(e - energiesOnly[k]) < 1.0e-6 * std::max(1.0, fabs(e)));
+    FOR_ATOMS_OF_MOL (a, copy) {
+      vector3 grad = pFF->GetGradient(&*a);
+      const double *f = &forces[k * N + (a->GetIdx() - 1) * 3];
+      OB_ASSERT(grad.distSq(vector3(f[0], f[1], f[2])) < 1.0e-8);
+    }
+  }
+  pFF->EnableCutOff(false);
+}
+
+// Minimize the conformers of a random rotor search together and check that
+// every conformer is close to a minimum.
+void testMinimizeConformers()
+{
+  OBMolPtr mol = OBTestUtil::ReadFile("alanine.mol");
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+  OB_REQUIRE(pFF->Setup(*mol));
+
+  pFF->RandomRotorSearch(10, 2500);
+  pFF->GetConformers(*mol);
+  OB_REQUIRE(mol->NumConformers() > 1);
+
+  OBConformerData *cd = (OBConformerData*) mol->GetData(OBGenericDataType::ConformerData);
+  OB_REQUIRE(cd != NULL);
+  vector<double> energies = cd->GetEnergies();
+  OB_REQUIRE(energies.size() == (unsigned int)mol->NumConformers());
+
+  for (int k = 0; k < mol->NumConformers(); ++k) {
+    mol->SetConformer(k);
+    OB_REQUIRE(pFF->Setup(*mol));
+    double e = pFF->Energy(false);
+    OB_ASSERT(fabs(e - energies[k]) < 1.0e-3);
+
+    pFF->ConjugateGradients(2500);
+    OB_ASSERT(e - pFF->Energy(false) < 0.1);
+  }
+}
+
+// Rotor searches with a fixed seed have to give the same result for any
+// number of threads
+static void RunRotorSearch(OBForceField *pTemplate, OBMol &mol, int method, int threads,
+                           vector<double> &coords, vector<double> &energies)
+{
+  // new instance: the force field keeps the conformers of the last search
+  OBForceField *pFF = pTemplate->MakeNewInstance();
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+  pFF->SetNumThreads(threads);
+  pFF->SetRandomSeed(42);
+  OB_REQUIRE(pFF->Setup(mol));
+  switch (method) {
+  case 0:
+    pFF->RandomRotorSearch(20, 50);
+    break;
+  case 1:
+    pFF->WeightedRotorSearch(20, 50);
+    break;
+  case 2:
+    pFF->FastRotorSearch(true);
+    break;
+  }
+
+  OBMol result(mol);
+  pFF->GetConformers(result);
+  pFF->GetCoordinates(result);
+  coords.assign(result.GetCoordinates(), result.GetCoordinates() + 3 * result.NumAtoms());
+  OBConformerData *cd = (OBConformerData*) result.GetData(OBGenericDataType::ConformerData);
+  energies = cd ? cd->GetEnergies() : vector<double>();
+  delete pFF;
+}
+
+void testParallelRotorSearch()
+{
+  std::ifstream ifs;
+  OB_REQUIRE(SafeOpen(ifs, OBTestUtil::GetFilename("forcefield.sdf").c_str()));
+  OBConversion conv(&ifs);
+  OB_REQUIRE(conv.SetInFormat("sdf"));
+
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+
+  OBMol mol;
+  int tested = 0;
+  while (tested < 3 && conv.Read(&mol)) {
+    if (mol.NumRotors() < 3)
+      continue;
+    ++tested;
+
+    for (int method = 0; method < 3; ++method) {
+      vector<double> coords1, energies1, coords4, energies4;
+      RunRotorSearch(pFF, mol, method, 1, coords1, energies1);
+      RunRotorSearch(pFF, mol, method, 4, coords4, energies4);
+      OB_ASSERT(coords1 == coords4);
+      OB_ASSERT(energies1 == energies4);
+    }
+  }
+  OB_ASSERT(tested == 3);
+}
+
+// The weighted rotor search has to update the weights of the rotor settings
+// while it generates conformers
+void testWeightedRotorSearchReweights()
+{
+  OBMolPtr mol = OBTestUtil::ReadFile("forcefield.sdf");
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+  pFF->SetRandomSeed(42);
+  OB_REQUIRE(mol->NumRotors() > 1);
+
+  // no conformers: only the initial weighting
+  OB_REQUIRE(pFF->Setup(*mol));
+  pFF->WeightedRotorSearch(0, 50);
+  vector<vector<double> > initial = pFF->GetRotorWeights();
+  OB_REQUIRE(initial.size() == mol->NumRotors() + 1);
+
+  OB_REQUIRE(pFF->Setup(*mol));
+  pFF->WeightedRotorSearch(20, 50);
+  vector<vector<double> > final = pFF->GetRotorWeights();
+  OB_REQUIRE(final.size() == initial.size());
+  OB_ASSERT(final != initial);
+  for (unsigned int i = 1; i < final.size(); ++i) {
+    double total = 0.0;
+    for (unsigned int j = 0; j < final[i].size(); ++j)
+      total += final[i][j];
+    OB_ASSERT(IsNear(total, 1.0, 1.0e-6));
+  }
+}
+
+// Confab and the genetic algorithm conformer search have to give the same
+// conformers for any number of threads
+static void RunConformerGeneration(OBMol &mol, int threads, vector<double> &coords,
+                                   RotorKeys &keys)
+{
+  OBMol result(mol);
+#ifdef HAVE_EIGEN
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94")->MakeNewInstance();
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+  pFF->SetNumThreads(threads);
+  OB_REQUIRE(pFF->Setup(result));
+  pFF->DiverseConfGen(0.5, 500, 50.0, false);
+  pFF->GetConformers(result);
+  delete pFF;
+  for (int c = 0; c < result.NumConformers(); ++c)
+    coords.insert(coords.end(), result.GetConformer(c),
+                  result.GetConformer(c) + 3 * result.NumAtoms());
+#endif
+
+  OBConformerSearch cs;
+  cs.SetLogStream(NULL);
+  cs.SetScore(new OBEnergyConformerScore);
+  cs.SetNumThreads(threads);
+  cs.SetRandomSeed(7);
+  OB_REQUIRE(cs.Setup(mol, 10, 3, 5, 2));
+  cs.Search();
+  keys = cs.GetRotorKeys();
+}
+
+void testParallelConformerGeneration()
+{
+  std::ifstream ifs;
+  OB_REQUIRE(SafeOpen(ifs, OBTestUtil::GetFilename("forcefield.sdf").c_str()));
+  OBConversion conv(&ifs);
+  OB_REQUIRE(conv.SetInFormat("sdf"));
+
+  OBMol mol;
+  int tested = 0;
+  while (tested < 2 && conv.Read(&mol)) {
+    if (mol.NumRotors() < 3)
+      continue;
+    ++tested;
+
+    vector<double> coords1, coords4;
+    RotorKeys keys1, keys4;
+    RunConformerGeneration(mol, 1, coords1, keys1);
+    RunConformerGeneration(mol, 4, coords4, keys4);
+#ifdef HAVE_EIGEN
+    OB_ASSERT(!coords1.empty());
+#endif
+    OB_ASSERT(coords1 == coords4);
+    OB_ASSERT(!keys1.empty());
+    OB_ASSERT(keys1 == keys4);
+  }
+  OB_ASSERT(tested == 2);
+}
+
+// The RMSD score of one conformer equals the one computed for all at once
+void testRMSDScore()
+{
+  OBMolPtr mol = OBTestUtil::ReadFile("forcefield.sdf");
+  const unsigned int n = 3 * mol->NumAtoms();
+  vector<vector<double> > storage(5, vector<double>(mol->GetCoordinates(), mol->GetCoordinates() + n));
+  vector<double*> conformers;
+  for (unsigned int c = 0; c < storage.size(); ++c) {
+    // distorted and moved copies
+    for (unsigned int k = 0; k < n; ++k)
+      storage[c][k] += 0.1 * c * sin(0.7 * k * (c + 1)) + (k % 3 == 0 ? 2.0 * c : 0.0);
+    conformers.push_back(&storage[c][0]);
+  }
+
+  OBRMSDConformerScore score;
+  RotorKeys keys(conformers.size());
+  vector<double> scores;
+  OB_REQUIRE(score.ScoreAll(*mol, keys, conformers, scores, 2));
+  OB_REQUIRE(scores.size() == conformers.size());
+  for (unsigned int i = 0; i < conformers.size(); ++i) {
+    double single = score.Score(*mol, i, keys, conformers);
+    OB_ASSERT(single > 0.0);
+    OB_ASSERT(fabs(single - scores[i]) < 1.0e-8);
+  }
+}
+
+// A velocity Verlet run without thermostat has to conserve the total energy
+// (first molecule of forcefield.sdf)
+void testVelocityVerletNVE()
+{
+  OBMolPtr mol = OBTestUtil::ReadFile("forcefield.sdf");
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+  pFF->SetRandomSeed(42);
+  OB_REQUIRE(pFF->Setup(*mol));
+  pFF->ConjugateGradients(500);
+
+  pFF->VelocityVerletInitialize(300.0, 0.0005, 0.0);
+  OB_ASSERT(fabs(pFF->GetTemperature() - 300.0) < 1.0e-6);
+  double e0 = pFF->Energy(false) + pFF->GetKineticEnergy();
+  for (int i = 0; i < 10; ++i) {
+    OB_REQUIRE(pFF->VelocityVerletTakeNSteps(100));
+    double e = pFF->Energy(false) + pFF->GetKineticEnergy();
+    OB_ASSERT(fabs(e - e0) < 0.5);
+  }
+  pFF->SetRandomSeed(0);
+}
+
+// Bonds to hydrogen stay at their length, the thermostat keeps the
+// temperature and the frames are written to the trajectory writer
+void testVelocityVerletConstraints()
+{
+  OBMolPtr mol = OBTestUtil::ReadFile("forcefield.sdf");
+  OBForceField *pFF = OBForceField::FindForceField("MMFF94");
+  OB_REQUIRE(pFF != NULL);
+  pFF->SetLogLevel(OBFF_LOGLVL_NONE);
+  OB_REQUIRE(pFF->Setup(*mol));
+
+  vector<double> lengths;
+  FOR_BONDS_OF_MOL (b, *mol)
+    if (b->GetBeginAtom()->GetAtomicNum() == 1 || b->GetEndAtom()->GetAtomicNum() == 1)
+      lengths.push_back(b->GetLength());
+
+  stringstream ss;
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("xyz"));
+  conv.SetOutStream(&ss);
+  OBFFTrajectoryWriter writer(&conv);
+
+  pFF->VelocityVerletInitialize(300.0, 0.002, 0.05, true);
+  pFF->SetTrajectoryWriter(&writer, 50);
+  OB_REQUIRE(pFF->VelocityVerletTakeNSteps(1000));
+  pFF->SetTrajectoryWriter(NULL);
+  OB_ASSERT(writer.GetNumFrames() == 20);
+
+  // 20 frames of NumAtoms() + 2 lines
+  string out = ss.str();
+  unsigned int lines = std::count(out.begin(), out.end(), '\n');
+  OB_ASSERT(lines == 20 * (mol->NumAtoms() + 2));
+
+  double T = 0.0;
+  for (int i = 0; i < 10; ++i) {
+    OB_REQUIRE(pFF->VelocityVerletTakeNSteps(10));
+    T += 0.1 * pFF->GetTemperature();
+  }
+  OB_ASSERT(T > 200.0 && T < 400.0);
+
+  pFF->GetCoordinates(*mol);
+  unsigned int i = 0;
+  FOR_BONDS_OF_MOL (b, *mol)
+    if (b->GetBeginAtom()->GetAtomicNum() == 1 || b->GetEndAtom()->GetAtomicNum() == 1)
+      OB_ASSERT(fabs(b->GetLength() - lengths[i++]) < 1.0e-4);
+}
+
+int minimizertest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testMinimizerConverges(LBFGS);
+    break;
+  case 2:
+    testMinimizerConverges(FIRE);
+    break;
+  case 3:
+    testMinimizerConstraints(LBFGS);
+    break;
+  case 4:
+    testMinimizerConstraints(FIRE);
+    break;
+  case 5:
+    testEnergyBatch();
+    break;
+  case 6:
+    testMinimizeConformers();
+    break;
+  case 7:
+    testParallelRotorSearch();
+    break;
+  case 8:
+    testVelocityVerletNVE();
+    break;
+  case 9:
+    testVelocityVerletConstraints();
+    break;
+  case 10:
+    testParallelConformerGeneration();
+    break;
+  case 11:
+    testWeightedRotorSearchReweights();
+    break;
+  case 12:
+    testEnergyBatchCutOff();
+    break;
+  case 13:
+    testRMSDScore();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
@@ -1,37 +1,153 @@
-#ifdef WIN32
-  #include <Windows.h> // QueryPerformanceFrequency & QueryPerformanceCounter
-#else
-  #include <sys/timeb.h> // Linux and MacOSX
-#endif
-
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <ctime>
+#include <string>
+#include <vector>
+#include <utility>
 
 #include "obtest.h"
 
 static bool headerWritten = false;
 
-class BenchmarkLoop 
+/**
+ * Machine readable benchmark results. Every named benchmark adds a result,
+ * together with the labels (e.g. "forcefield" = "MMFF94") set at that time.
+ * The results can be written as JSON or CSV to track regressions.
+ */
+class BenchmarkResults
 {
   public:
-    BenchmarkLoop(const std::string &name = std::string())
+    struct Result
+    {
+      std::string name;
+      std::vector<std::pair<std::string, std::string> > labels;
+      unsigned int loops;
+      double secondsPerIter;
+    };
+
+    static BenchmarkResults& instance()
+    {
+      static BenchmarkResults results;
+      return results;
+    }
+
+    //! Attach a label to the following results
+    void setLabel(const std::string &key, const std::string &value)
     {
-#ifdef WIN32
-      QueryPerformanceFrequency(&m_frequency); // counts per second
-#endif
-      m_time = 0;
+      for (std::size_t i = 0; i < m_labels.size(); ++i)
+        if (m_labels[i].first == key) {
+          m_labels[i].second = value;
+          return;
+        }
+      m_labels.push_back(std::make_pair(key, value));
+    }
+    void clearLabels()
+    {
+      m_labels.clear();
+    }
+    void add(const std::string &name, unsigned int loops, double secondsPerIter)
+    {
+      Result result;
+      result.name = name;
+      result.labels = m_labels;
+      result.loops = loops;
+      result.secondsPerIter = secondsPerIter;
+      m_results.push_back(result);
+    }
+    const std::vector<Result>& results() const
+    {
+      return m_results;
+    }
+
+    void writeJSON(std::ostream &os) const
+    {
+      os << "[\n";
+      for (std::size_t i = 0; i < m_results.size(); ++i) {
+        const Result &r = m_results[i];
+        os << "  {\"name\": " << quote(r.name, '"');
+        for (std::size_t j = 0; j < r.labels.size(); ++j)
+          os << ", " << quote(r.labels[j].first, '"') << ": " << quote(r.labels[j].second, '"');
+        os << ", \"iterations\": " << r.loops
+           << ", \"seconds_per_iteration\": " << r.secondsPerIter << "}"
+           << (i + 1 < m_results.size() ? ",\n" : "\n");
+      }
+      os << "]\n";
+    }
+    void writeCSV(std::ostream &os) const
+    {
+      // the columns are the union of all labels
+      std::vector<std::string> keys;
+      for (std::size_t i = 0; i < m_results.size(); ++i)
+        for (std::size_t j = 0; j < m_results[i].labels.size(); ++j) {
+          const std::string &key = m_results[i].labels[j].first;
+          std::size_t k = 0;
+          while (k < keys.size() && keys[k] != key)
+            ++k;
+          if (k == keys.size())
+            keys.push_back(key);
+        }
+
+      os << "name";
+      for (std::size_t k = 0; k < keys.size(); ++k)
+        os << "," << quote(keys[k], ',');
+      os << ",iterations,seconds_per_iteration\n";
+      for (std::size_t i = 0; i < m_results.size(); ++i) {
+        const Result &r = m_results[i];
+        os << quote(r.name, ',');
+        for (std::size_t k = 0; k < keys.size(); ++k) {
+          os << ",";
+          for (std::size_t j = 0; j < r.labels.size(); ++j)
+            if (r.labels[j].first == keys[k])
+              os << quote(r.labels[j].second, ',');
+        }
+        os << "," << r.loops << "," << r.secondsPerIter << "\n";
+      }
+    }
+
+  private:
+    // JSON strings are always quoted, CSV fields only when needed
+    static std::string quote(const std::string &str, char separator)
+    {
+      bool json = separator == '"';
+      if (!json && str.find_first_of(",\"\n") == std::string::npos)
+        return str;
+      std::string result = "\"";
+      for (std::size_t i = 0; i < str.size(); ++i) {
+        if (str[i] == '"')
+          result += json ? "\\\"" : "\"\"";
+        else if (json && str[i] == '\\')
+          result += "\\\\";
+        else
+          result += str[i];
+      }
+      return result + "\"";
+    }
+
+    std::vector<Result> m_results;
+    std::vector<std::pair<std::string, std::string> > m_labels;
+};
+
+class BenchmarkLoop
+{
+  public:
+    BenchmarkLoop(const std::string &name = std::string(), double minTime = 0.5)
+    {
+      m_time = 0.0;
+      m_minTime = minTime;
       m_loops = 0;
-      m_start = getMilliCount();
+      m_start = std::chrono::steady_clock::now();
       m_name = name;
     }
     ~BenchmarkLoop()
     {
-      unsigned int milliSecsPerIter = m_time / m_loops;
-      
+      double secsPerIter = m_time / m_loops;
+      double milliSecsPerIter = 1000.0 * secsPerIter;
+
       if (!m_name.empty()) {
         std::cout << "Benchmark: " << m_name << std::endl;
+        BenchmarkResults::instance().add(m_name, m_loops, secsPerIter);
 
         // create header
         std::time_t now;
@@ -44,7 +160,7 @@ class BenchmarkLoop
         // write time to a file so progress can be monitored
         std::ofstream ofs;
         ofs.open("benchmark.txt.new");
- 
+
         // read the current benchmark.txt, update lines and write to .new file
         std::ifstream ifs;
         ifs.open("benchmark.txt");
@@ -58,7 +174,7 @@ class BenchmarkLoop
             headerWritten = true;
             std::stringstream ss;
             ss << line << " " << header;
-            line = ss.str();          
+            line = ss.str();
           }
           if (line.substr(0, m_name.size()) == m_name) {
             foundBenchmark = true;
@@ -66,7 +182,7 @@ class BenchmarkLoop
             ss << line << " " << milliSecsPerIter;
             line = ss.str();
           }
-          
+
           ofs << line << std::endl;
         }
         ifs.close();
@@ -87,62 +203,40 @@ class BenchmarkLoop
           ofs << ifs.rdbuf();
         }
      }
-      
-      // print out in Xms, Xs or XmYs
+
+      // print out in Xus, Xms, Xs or XmYs
       std::stringstream duration;
       if (milliSecsPerIter > 1000) {
-        unsigned int secsPerIter = milliSecsPerIter / 1000;
+        unsigned int secsPerIter = static_cast<unsigned int>(milliSecsPerIter / 1000);
         if (secsPerIter > 60) {
           unsigned int minutesPerIter = secsPerIter / 60;
-          duration << minutesPerIter << "m" << secsPerIter % 60 << "s";        
+          duration << minutesPerIter << "m" << secsPerIter % 60 << "s";
         } else {
           duration << secsPerIter << "s";
         }
+      } else if (milliSecsPerIter >= 1) {
+        duration << static_cast<unsigned int>(milliSecsPerIter) << "ms";
       } else {
-        duration << milliSecsPerIter << "ms";
+        duration << static_cast<unsigned int>(1000 * milliSecsPerIter) << "us";
       }
       std::cout << duration.str() << " per iteration (" << m_loops << " iterations total)" << std::endl;
     }
     bool done()
     {
-      if (m_time > 500) // iterate untill at least 500ms passed
+      if (m_time > m_minTime) // iterate untill at least m_minTime seconds passed
         return true;
       return false;
     }
     void next()
     {
-      m_time = getMilliSpan(m_start);
+      m_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
       ++m_loops;
     }
-    unsigned int getMilliCount()
-    {
-#ifdef WIN32
-      LARGE_INTEGER performanceCount;
-      QueryPerformanceCounter(&performanceCount); // value in counts
-      LARGE_INTEGER nCount = performanceCount / m_frequency * 1000;
-      return nCount;
-#else
-      timeb tb;
-      ftime( &tb );
-      unsigned int nCount = tb.millitm + (tb.time & 0xfffff) * 1000;
-      return nCount;
-#endif
-    }
-    unsigned int getMilliSpan(unsigned int start)
-    {
-      int nSpan = getMilliCount() - start;
-#ifndef WIN32
-      if ( nSpan < 0 ) // handle overflow...
-        nSpan += 0x100000 * 1000;
-#endif
-      return nSpan;
-    }
   private:
-    unsigned int m_time, m_start, m_loops;
+    std::chrono::steady_clock::time_point m_start;
+    double m_time, m_minTime;
+    unsigned int m_loops;
     std::string m_name;
-#ifdef WIN32
-    LARGE_INTEGER m_frequency;
-#endif
 };
 
 #define OB_BENCHMARK \
@@ -150,3 +244,7 @@ class BenchmarkLoop
 
 #define OB_NAMED_BENCHMARK(name) \
   for (BenchmarkLoop loop(#name); !loop.done(); loop.next())
+
+//! Benchmark with a name computed at run time, e.g. from a std::string
+#define OB_BENCHMARK_STR(name) \
+  for (BenchmarkLoop loop(name); !loop.done(); loop.next())
@@ -0,0 +1,277 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/residue.h>
+#include <openbabel/obiter.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/generic.h>
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace OpenBabel;
+
+static string WriteOBM(OBMol &mol)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("obm"));
+  return conv.WriteString(&mol);
+}
+
+static void ReadOBM(OBMol &mol, const string &record)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("obm"));
+  OB_REQUIRE(conv.ReadString(&mol, record));
+}
+
+static string Write(OBMol &mol, const char *format)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat(format));
+  return conv.WriteString(&mol);
+}
+
+// Canonical SMILES with stereochemistry, charges and isotopes are kept
+void testSmiles()
+{
+  const char *smiles[] = {
+    "C[C@@H](N)C(=O)O", "F/C=C/Cl", "c1ccc2[nH]ccc2c1", "[13CH3][O-].[Na+]",
+    "C[C@H]1CC[C@@H](C)CC1", "[Cu+2]", "F[Pt@SP1](Cl)(Br)I", "[CH2]C"
+  };
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("smi"));
+  for (unsigned int i = 0; i < sizeof(smiles) / sizeof(smiles[0]); ++i) {
+    OBMol mol, copy;
+    OB_REQUIRE(conv.ReadString(&mol, smiles[i]));
+    mol.SetTitle("title");
+    const string expected = Write(mol, "can");
+    ReadOBM(copy, WriteOBM(mol));
+    OB_COMPARE(Write(copy, "can"), expected);
+    OB_COMPARE(copy.GetFlags(), mol.GetFlags());
+    OB_COMPARE(copy.NumAtoms(), mol.NumAtoms());
+    OB_COMPARE(copy.NumBonds(), mol.NumBonds());
+    OB_COMPARE(copy.GetAllData(OBGenericDataType::StereoData).size(),
+               mol.GetAllData(OBGenericDataType::StereoData).size());
+  }
+}
+
+// Coordinates, conformers, energies, partial charges and data are kept
+void testConformers()
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("sdf"));
+  ifstream ifs(OBTestUtil::GetFilename("forcefield.sdf").c_str());
+  OB_REQUIRE(ifs);
+  OBMol mol;
+  OB_REQUIRE(conv.Read(&mol, &ifs));
+
+  // a second conformer and some data of all the kinds stored
+  const unsigned int n = mol.NumAtoms();
+  double *conformer = new double[n * 3];
+  for (unsigned int i = 0; i < n * 3; ++i)
+    conformer[i] = mol.GetCoordinates()[i] + 0.5;
+  mol.AddConformer(conformer);
+  vector<double> energies;
+  energies.push_back(-1.5);
+  energies.push_back(2.25);
+  mol.SetEnergies(energies);
+  OBPairInteger *pi = new OBPairInteger;
+  pi->SetAttribute("count");
+  pi->SetValue(7);
+  mol.SetData(pi);
+  OBPairFloatingPoint *pf = new OBPairFloatingPoint;
+  pf->SetAttribute("weight");
+  pf->SetValue(0.125);
+  mol.SetData(pf);
+  OBUnitCell *cell = new OBUnitCell;
+  cell->SetData(10.0, 11.0, 12.0, 90.0, 95.0, 90.0);
+  cell->SetSpaceGroup("P 1 21/c 1");
+  mol.SetData(cell);
+  mol.SetAutomaticPartialCharge(false);
+  mol.GetAtom(1)->SetPartialCharge(0.25);
+  OBPairData *label = new OBPairData;
+  label->SetAttribute("label");
+  label->SetValue("first");
+  mol.GetAtom(1)->SetData(label);
+
+  OBMol copy;
+  ReadOBM(copy, WriteOBM(mol));
+  OB_COMPARE(Write(copy, "sdf"), Write(mol, "sdf"));
+  OB_COMPARE(copy.NumConformers(), 2);
+  OB_COMPARE(copy.GetDimension(), 3);
+  for (unsigned int i = 0; i < n * 3; ++i)
+    OB_COMPARE(copy.GetConformer(1)[i], conformer[i]);
+  OB_COMPARE(copy.GetEnergies().size(), 2);
+  OB_COMPARE(copy.GetEnergy(1), 2.25);
+  OB_ASSERT(!copy.AutomaticPartialCharge());
+  OB_COMPARE(copy.GetAtom(1)->GetPartialCharge(), 0.25);
+  OB_COMPARE(copy.GetAtom(1)->GetData("label")->GetValue(), string("first"));
+
+  OBPairInteger *ci = dynamic_cast<OBPairInteger*>(copy.GetData("count"));
+  OB_REQUIRE(ci);
+  OB_COMPARE(ci->GetGenericValue(), 7);
+  OBPairFloatingPoint *cf = dynamic_cast<OBPairFloatingPoint*>(copy.GetData("weight"));
+  OB_REQUIRE(cf);
+  OB_COMPARE(cf->GetGenericValue(), 0.125);
+  OBUnitCell *copyCell = static_cast<OBUnitCell*>(copy.GetData(OBGenericDataType::UnitCell));
+  OB_REQUIRE(copyCell);
+  OB_ASSERT(IsNear(copyCell->GetC(), 12.0, 1e-9));
+  OB_ASSERT(IsNear(copyCell->GetBeta(), 95.0, 1e-9));
+  OB_REQUIRE(copyCell->GetSpaceGroup());
+  OB_COMPARE(copyCell->GetSpaceGroup()->GetId(), 14);
+}
+
+// Residues, chains and atom IDs are kept
+void testResidues()
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("pdb"));
+  OBMol mol, copy;
+  OB_REQUIRE(conv.ReadFile(&mol, OBTestUtil::GetFilename("1DRF.pdb")));
+  ReadOBM(copy, WriteOBM(mol));
+  OB_COMPARE(copy.NumResidues(), mol.NumResidues());
+  OB_COMPARE(Write(copy, "pdb"), Write(mol, "pdb"));
+  OB_COMPARE(Write(copy, "can"), Write(mol, "can"));
+}
+
+// Several records in a stream, and skipping records
+void testRecords()
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInAndOutFormats("sdf", "obm"));
+  ifstream ifs(OBTestUtil::GetFilename("forcefield.sdf").c_str());
+  OB_REQUIRE(ifs);
+  stringstream records;
+  vector<string> titles;
+  OBMol mol;
+  while (conv.Read(&mol, &ifs)) {
+    titles.push_back(mol.GetTitle());
+    OB_REQUIRE(conv.Write(&mol, &records));
+  }
+  OB_COMPARE(titles.size(), 18);
+
+  OBConversion reader;
+  OB_REQUIRE(reader.SetInFormat("obm"));
+  istringstream in(records.str());
+  unsigned int count = 0;
+  for (bool ok = reader.Read(&mol, &in); ok; ok = reader.Read(&mol)) {
+    OB_COMPARE(string(mol.GetTitle()), titles[count]);
+    ++count;
+  }
+  OB_COMPARE(count, titles.size());
+
+  istringstream skip(records.str());
+  reader.SetInStream(&skip);
+  OB_COMPARE(reader.GetInFormat()->SkipObjects(5, &reader), 1);
+  OB_REQUIRE(reader.Read(&mol));
+  OB_COMPARE(string(mol.GetTitle()), titles[5]);
+
+  // a truncated record is an error
+  string truncated = records.str().substr(0, 100);
+  OBMol bad;
+  OB_ASSERT(!reader.ReadString(&bad, truncated));
+
+  // so is a body longer than the rest of the stream, or implausibly long
+  string header = records.str().substr(0, 20);
+  uint64_t length = 1000000;
+  memcpy(&header[12], &length, sizeof(length));
+  OB_ASSERT(!reader.ReadString(&bad, header + records.str().substr(20, 1000)));
+  length = ~static_cast<uint64_t>(0);
+  memcpy(&header[12], &length, sizeof(length));
+  OB_ASSERT(!reader.ReadString(&bad, header));
+}
+
+// The SD header line with the program name and time
+static string WithoutSecondLine(const string &sd)
+{
+  string::size_type first = sd.find('\n');
+  string::size_type second = sd.find('\n', first + 1);
+  return sd.substr(0, first) + sd.substr(second);
+}
+
+// The neighbours of each atom are kept in their order, so that formats
+// write the same output after a round trip
+void testNeighbourOrder()
+{
+  const char *smiles[] = {
+    "C1CC(O)C(N)CC1C(=O)O", "c1ccc2c(c1)C(=O)N[C@@H]2C", "OC(=O)[C@H](Cc1c[nH]cn1)N"
+  };
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("smi"));
+  for (unsigned int i = 0; i < sizeof(smiles) / sizeof(smiles[0]); ++i) {
+    OBMol mol, copy;
+    OB_REQUIRE(conv.ReadString(&mol, smiles[i]));
+    mol.AddHydrogens();
+    // bonds of the first atom not in the order they were added
+    OBAtom *first = mol.GetAtom(1);
+    vector<OBBond*> bonds(first->BeginBonds(), first->EndBonds());
+    first->ClearBond();
+    for (unsigned int j = bonds.size(); j > 0; --j)
+      first->AddBond(bonds[j - 1]);
+
+    ReadOBM(copy, WriteOBM(mol));
+    OB_REQUIRE(copy.NumAtoms() == mol.NumAtoms());
+    FOR_ATOMS_OF_MOL (atom, mol) {
+      vector<unsigned int> expected, found;
+      FOR_NBORS_OF_ATOM (nbr, &*atom)
+        expected.push_back(nbr->GetIdx());
+      FOR_NBORS_OF_ATOM (nbr, copy.GetAtom(atom->GetIdx()))
+        found.push_back(nbr->GetIdx());
+      OB_ASSERT(found == expected);
+    }
+    OB_COMPARE(WithoutSecondLine(Write(copy, "sdf")), WithoutSecondLine(Write(mol, "sdf")));
+    OB_COMPARE(Write(copy, "smi"), Write(mol, "smi"));
+  }
+}
+
+int obmformattest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testSmiles();
+    break;
+  case 2:
+    testConformers();
+    break;
+  case 3:
+    testResidues();
+    break;
+  case 4:
+    testRecords();
+    break;
+  case 5:
+    testNeighbourOrder();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
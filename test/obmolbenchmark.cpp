@@ -42,6 +42,13 @@ void benchmarkOBMol3()
 
 int main()
 {
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
   benchmarkOBMol1();
   benchmarkOBMol2();
   benchmarkOBMol3();
@@ -0,0 +1,200 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/residue.h>
+#include <openbabel/obiter.h>
+#include <openbabel/obconversion.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+using namespace std;
+using namespace OpenBabel;
+
+static void ReadPDB(OBMol &mol, const string &filename, const char *options = "",
+                    const char *format = "pdb")
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat(format));
+  for (const char *p = options; *p; ++p)
+    conv.AddOption(string(1, *p).c_str(), OBConversion::INOPTIONS);
+  OB_REQUIRE(conv.ReadFile(&mol, OBTestUtil::GetFilename(filename)));
+}
+
+// The pairs of bonded atoms
+static set<pair<unsigned int, unsigned int> > Connections(OBMol &mol)
+{
+  set<pair<unsigned int, unsigned int> > connections;
+  FOR_BONDS_OF_MOL(bond, mol)
+    connections.insert(make_pair(min(bond->GetBeginAtomIdx(), bond->GetEndAtomIdx()),
+                                 max(bond->GetBeginAtomIdx(), bond->GetEndAtomIdx())));
+  return connections;
+}
+
+// Bonding from the residue templates connects the same atoms as
+// ConnectTheDots(), including the peptide bonds and the ligands
+void testTemplateBonds()
+{
+  const char *files[] = { "1DRF.pdb", "3G61.pdb" };
+  for (unsigned int i = 0; i < 2; ++i) {
+    OBMol dots, templates, single;
+    ReadPDB(dots, files[i]);
+    ReadPDB(templates, files[i], "r");
+    OB_COMPARE(templates.NumAtoms(), dots.NumAtoms());
+    OB_COMPARE(templates.NumBonds(), dots.NumBonds());
+    OB_ASSERT(Connections(templates) == Connections(dots));
+
+    unsigned int multiple = 0;
+    FOR_BONDS_OF_MOL(bond, templates)
+      if (bond->GetBondOrder() > 1)
+        ++multiple;
+    OB_ASSERT(multiple > 0);
+
+    ReadPDB(single, files[i], "rs");
+    OB_ASSERT(Connections(single) == Connections(dots));
+    FOR_BONDS_OF_MOL(bond, single)
+      OB_COMPARE(bond->GetBondOrder(), 1);
+  }
+}
+
+// With -aC each chain ending with TER is a molecule
+void testChains()
+{
+  OBMol whole;
+  ReadPDB(whole, "3G61.pdb");
+
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("pdb"));
+  conv.AddOption("C", OBConversion::INOPTIONS);
+  conv.AddOption("r", OBConversion::INOPTIONS);
+  OBMol mol;
+  unsigned int count = 0, atoms = 0, bonds = 0;
+  bool notFirst = conv.ReadFile(&mol, OBTestUtil::GetFilename("3G61.pdb"));
+  OB_REQUIRE(notFirst);
+  OB_ASSERT(mol.HasData("COMPND")); // the header is with the first chain
+  for (; notFirst; notFirst = conv.Read(&mol)) {
+    ++count;
+    atoms += mol.NumAtoms();
+    bonds += mol.NumBonds();
+    if (count < 3) {
+      char chain = count == 1 ? 'A' : 'B';
+      FOR_RESIDUES_OF_MOL(res, mol)
+        OB_COMPARE(res->GetChain(), chain);
+    }
+    if (count > 1)
+      OB_ASSERT(!mol.HasData("COMPND"));
+  }
+  // chains A and B, then the ligands and water after the last TER
+  OB_COMPARE(count, 3);
+  OB_COMPARE(atoms, whole.NumAtoms());
+  OB_ASSERT(bonds <= whole.NumBonds());
+
+  // A CONECT record between two chains is ignored, with a warning
+  const char *pdb =
+    "HETATM    1  C1  LIG A   1       0.000   0.000   0.000  1.00  0.00           C\n"
+    "TER       2      LIG A   1\n"
+    "HETATM    3  C1  LIG B   1       5.000   0.000   0.000  1.00  0.00           C\n"
+    "TER       4      LIG B   1\n"
+    "CONECT    1    3\n"
+    "END\n";
+  stringstream ss(pdb);
+  obErrorLog.ClearLog();
+  count = bonds = 0;
+  for (notFirst = conv.Read(&mol, &ss); notFirst; notFirst = conv.Read(&mol)) {
+    ++count;
+    bonds += mol.NumBonds();
+  }
+  OB_COMPARE(count, 2);
+  OB_COMPARE(bonds, 0);
+  OB_COMPARE(obErrorLog.GetMessagesOfLevel(obWarning).size(), 1);
+}
+
+// With -ax only the atoms are read
+void testCoordinatesOnly()
+{
+  OBMol full, coords;
+  ReadPDB(full, "1DRF.pdb");
+  ReadPDB(coords, "1DRF.pdb", "x");
+  OB_COMPARE(coords.NumAtoms(), full.NumAtoms());
+  OB_COMPARE(coords.NumBonds(), 0);
+  OB_COMPARE(coords.NumResidues(), 0);
+  OB_ASSERT(!coords.HasData("COMPND"));
+  for (unsigned int i = 1; i <= full.NumAtoms(); ++i) {
+    OB_COMPARE(coords.GetAtom(i)->GetAtomicNum(), full.GetAtom(i)->GetAtomicNum());
+    OB_ASSERT(coords.GetAtom(i)->GetVector().IsApprox(full.GetAtom(i)->GetVector(), 1e-6));
+    OB_ASSERT(!coords.GetAtom(i)->HasData("_atom_site_occupancy"));
+  }
+}
+
+// The same options for mmCIF
+void testMMCIF()
+{
+  OBMol pdb;
+  ReadPDB(pdb, "1DRF.pdb");
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("mmcif"));
+  string mmcif = conv.WriteString(&pdb);
+
+  OBMol dots, templates, coords;
+  OB_REQUIRE(conv.SetInFormat("mmcif"));
+  OB_REQUIRE(conv.ReadString(&dots, mmcif));
+  conv.AddOption("r", OBConversion::INOPTIONS);
+  OB_REQUIRE(conv.ReadString(&templates, mmcif));
+  OB_COMPARE(templates.NumAtoms(), dots.NumAtoms());
+  OB_ASSERT(templates.NumBonds() > 0);
+  OB_ASSERT(Connections(templates) == Connections(dots));
+
+  conv.RemoveOption("r", OBConversion::INOPTIONS);
+  conv.AddOption("x", OBConversion::INOPTIONS);
+  OB_REQUIRE(conv.ReadString(&coords, mmcif));
+  OB_COMPARE(coords.NumAtoms(), dots.NumAtoms());
+  OB_COMPARE(coords.NumBonds(), 0);
+  OB_COMPARE(coords.NumResidues(), 0);
+}
+
+int pdbstreamtest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testTemplateBonds();
+    break;
+  case 2:
+    testChains();
+    break;
+  case 3:
+    testCoordinatesOnly();
+    break;
+  case 4:
+    testMMCIF();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
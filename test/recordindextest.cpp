@@ -0,0 +1,263 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/recordindex.h>
+
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace OpenBabel;
+
+// Copy the test files to the working directory: the index is written next
+// to the data file
+static void CopyFiles(const vector<string> &sources, const string &dest)
+{
+  ofstream ofs(dest.c_str(), ios_base::out | ios_base::binary);
+  for (unsigned int i = 0; i < sources.size(); ++i) {
+    ifstream ifs(OBTestUtil::GetFilename(sources[i]).c_str(), ios_base::in | ios_base::binary);
+    OB_REQUIRE(ifs);
+    ofs << ifs.rdbuf();
+  }
+  remove(OBRecordIndex::IndexFilename(dest).c_str());
+}
+
+static vector<string> ReadTitles(const string &filename)
+{
+  vector<string> titles;
+  OBConversion conv;
+  OBMol mol;
+  bool ok = conv.ReadFile(&mol, filename);
+  while (ok) {
+    titles.push_back(mol.GetTitle());
+    ok = conv.Read(&mol);
+  }
+  return titles;
+}
+
+// Build the index of a copy of the test files and check that seeking to
+// each record with -f (and to the titles with --seektitle) reads the same
+// molecules as reading the file from the start
+void testRecordIndex(const vector<string> &sources, const string &filename)
+{
+  CopyFiles(sources, filename);
+  vector<string> titles = ReadTitles(filename);
+  OB_REQUIRE(titles.size() > 1);
+
+  OBConversion conv;
+  OBFormat *pFormat = conv.FormatFromExt(filename);
+  OB_REQUIRE(pFormat);
+  OBRecordIndex index;
+  OB_ASSERT(!index.Load(filename, pFormat));
+  OB_REQUIRE(index.Build(filename, pFormat));
+  OB_COMPARE(index.NumRecords(), titles.size());
+  OB_ASSERT(index.GetOffset(1) >= 0);
+  OB_ASSERT(index.GetOffset(index.NumRecords() + 2) == -1);
+
+  OBRecordIndex loaded;
+  OB_REQUIRE(loaded.Load(filename, pFormat));
+  OB_COMPARE(loaded.NumRecords(), titles.size());
+
+  for (unsigned int n = titles.size(); n > 1; n -= n / 3 + 1) {
+    OB_ASSERT(loaded.GetOffset(n) > loaded.GetOffset(n - 1));
+
+    OBConversion seekConv;
+    stringstream ss;
+    ss << n;
+    seekConv.AddOption("f", OBConversion::GENOPTIONS, ss.str().c_str());
+    seekConv.AddOption("l", OBConversion::GENOPTIONS, ss.str().c_str());
+    OBMol mol;
+    OB_REQUIRE(seekConv.ReadFile(&mol, filename));
+    OB_COMPARE(mol.GetTitle(), titles[n - 1]);
+    OB_COMPARE(seekConv.NumInputObjects(), 1);
+
+    // the first record with this title
+    unsigned int first = 0;
+    while (titles[first] != titles[n - 1])
+      ++first;
+    OB_COMPARE(loaded.FindTitle(titles[n - 1]), first + 1);
+
+    OBConversion titleConv;
+    titleConv.AddOption("seektitle", OBConversion::GENOPTIONS, titles[n - 1].c_str());
+    OB_REQUIRE(titleConv.ReadFile(&mol, filename));
+    OB_COMPARE(mol.GetTitle(), titles[n - 1]);
+    OB_ASSERT(!titleConv.Read(&mol));
+  }
+  OB_COMPARE(loaded.FindTitle("no such title"), 0);
+
+  remove(OBRecordIndex::IndexFilename(filename).c_str());
+  remove(filename.c_str());
+}
+
+// An index is not used once the data file has changed, and --index rebuilds it
+void testStaleIndex()
+{
+  const string filename = "recordindextest_stale.smi";
+  CopyFiles(vector<string>(1, "nci.smi"), filename);
+  OBConversion conv;
+  OBFormat *pFormat = conv.FindFormat("smi");
+  OBRecordIndex index;
+  OB_REQUIRE(index.Build(filename, pFormat));
+  unsigned int numRecords = index.NumRecords();
+  OB_REQUIRE(index.Load(filename, pFormat));
+  // an index is only valid for readers with the same record separators
+  OB_ASSERT(!index.Load(filename, conv.FindFormat("sdf")));
+
+  {
+    ofstream ofs(filename.c_str(), ios_base::out | ios_base::app | ios_base::binary);
+    ofs << "CCO ethanol\n";
+  }
+  OB_ASSERT(!index.Load(filename, pFormat));
+
+  OBConversion seekConv;
+  OBMol mol;
+  seekConv.AddOption("seektitle", OBConversion::GENOPTIONS, "ethanol");
+  OB_ASSERT(!seekConv.ReadFile(&mol, filename));
+
+  OBConversion indexConv;
+  indexConv.AddOption("index", OBConversion::GENOPTIONS);
+  indexConv.AddOption("seektitle", OBConversion::GENOPTIONS, "ethanol");
+  OB_REQUIRE(indexConv.ReadFile(&mol, filename));
+  OB_COMPARE(string(mol.GetTitle()), "ethanol");
+  OB_COMPARE(mol.NumAtoms(), 3);
+
+  OB_REQUIRE(index.Load(filename, pFormat));
+  OB_COMPARE(index.NumRecords(), numRecords + 1);
+
+  remove(OBRecordIndex::IndexFilename(filename).c_str());
+  remove(filename.c_str());
+}
+
+static string ConvertFile(const string &filename, const char *threads,
+                          const char *first = NULL, const char *last = NULL,
+                          const char *outFormat = "can")
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat(conv.FormatFromExt(filename)));
+  OB_REQUIRE(conv.SetOutFormat(outFormat));
+  // the cis/trans markings of ring closures are not always written the same way
+  conv.AddOption("i", OBConversion::OUTOPTIONS);
+  if (threads)
+    conv.AddOption("threads", OBConversion::GENOPTIONS, threads);
+  if (first)
+    conv.AddOption("f", OBConversion::GENOPTIONS, first);
+  if (last)
+    conv.AddOption("l", OBConversion::GENOPTIONS, last);
+  ifstream ifs(OBTestUtil::GetFilename(filename).c_str(), ios_base::in | ios_base::binary);
+  stringstream out;
+  conv.Convert(&ifs, &out);
+  return out.str();
+}
+
+// Reading with several threads gives the molecules in the same order
+void testThreadedReading()
+{
+  const char *files[] = { "forcefield.sdf", "nci.smi", "test3d.xyz", "culgi_00.mol2", NULL };
+  for (unsigned int i = 0; files[i]; ++i) {
+    string serial = ConvertFile(files[i], NULL);
+    OB_REQUIRE(!serial.empty());
+    OB_COMPARE(ConvertFile(files[i], "4"), serial);
+    OB_COMPARE(ConvertFile(files[i], ""), serial);
+  }
+  OB_COMPARE(ConvertFile("nci.smi", "3", "10", "600"), ConvertFile("nci.smi", NULL, "10", "600"));
+}
+
+// SMILES are written by the reading threads and other formats afterwards,
+// with the same result as a serial conversion
+void testThreadedWriting()
+{
+  const char *files[] = { "forcefield.sdf", "nci.smi", NULL };
+  const char *formats[] = { "smi", "can", "mol2", NULL };
+  for (unsigned int i = 0; files[i]; ++i)
+    for (unsigned int j = 0; formats[j]; ++j) {
+      string serial = ConvertFile(files[i], NULL, NULL, NULL, formats[j]);
+      OB_REQUIRE(!serial.empty());
+      OB_COMPARE(ConvertFile(files[i], "4", NULL, NULL, formats[j]), serial);
+    }
+}
+
+static void ConvertInThread(const char *filename, string *result)
+{
+  *result = ConvertFile(filename, "2");
+}
+
+// Each conversion has its own reader threads, so two threaded conversions
+// may run at the same time
+void testConcurrentConversions()
+{
+  string sdf, smi;
+  thread first(ConvertInThread, "forcefield.sdf", &sdf);
+  thread second(ConvertInThread, "nci.smi", &smi);
+  first.join();
+  second.join();
+  OB_COMPARE(sdf, ConvertFile("forcefield.sdf", NULL));
+  OB_COMPARE(smi, ConvertFile("nci.smi", NULL));
+}
+
+int recordindextest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  vector<string> sources;
+  switch(choice) {
+  case 1:
+    sources.push_back("forcefield.sdf");
+    testRecordIndex(sources, "recordindextest.sdf");
+    break;
+  case 2:
+    sources.push_back("nci.smi");
+    testRecordIndex(sources, "recordindextest.smi");
+    break;
+  case 3:
+    sources.push_back("culgi_00.mol2");
+    sources.push_back("culgi_01.mol2");
+    sources.push_back("culgi_02.mol2");
+    sources.push_back("mol24.mol2");
+    testRecordIndex(sources, "recordindextest.mol2");
+    break;
+  case 4:
+    testStaleIndex();
+    break;
+  case 5:
+    sources.push_back("test2d.xyz");
+    sources.push_back("test3d.xyz");
+    sources.push_back("test2d.xyz");
+    testRecordIndex(sources, "recordindextest.xyz");
+    break;
+  case 6:
+    testThreadedReading();
+    break;
+  case 7:
+    testThreadedWriting();
+    break;
+  case 8:
+    testConcurrentConversions();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
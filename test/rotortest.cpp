@@ -178,6 +178,47 @@ void testOBRotorListFixedBonds()
 
 }
 
+void testOBRotorListCachedPerception()
+{
+  // 1 2 3 4 5 6 7 8
+  // C-C-C-C-C-C-C-C
+  //  0 1 2 3 4 5 6
+  OBMolPtr mol = OBTestUtil::ReadFile("octane.cml");
+
+  OBRotorList rlist1;
+  rlist1.Setup(*mol);
+  OB_REQUIRE(rlist1.Size() == 5);
+  // the perception is kept on the molecule
+  OB_ASSERT(mol->HasData("OpenBabel Rotor Perception"));
+
+  // a second setup uses it and gives the same rotors
+  OBRotorList rlist2;
+  rlist2.Setup(*mol);
+  OB_REQUIRE(rlist2.Size() == 5);
+  std::vector<OBRotor*>::iterator i, j;
+  OBRotor *rotor1 = rlist1.BeginRotor(i), *rotor2 = rlist2.BeginRotor(j);
+  for (; rotor1 && rotor2; rotor1 = rlist1.NextRotor(i), rotor2 = rlist2.NextRotor(j)) {
+    OB_ASSERT(rotor1->GetBond() == rotor2->GetBond());
+    OB_ASSERT(rotor1->GetDihedralAtoms() == rotor2->GetDihedralAtoms());
+    OB_ASSERT(rotor1->GetTorsionValues() == rotor2->GetTorsionValues());
+  }
+
+  // changing a bond order invalidates it: C-C-C-C=C-C-C-C
+  mol->GetBond(3)->SetBondOrder(2);
+  rlist2.Setup(*mol);
+  OB_ASSERT(rlist2.Size() == 4);
+
+  // fixed bonds are not taken from the molecule
+  mol->GetBond(3)->SetBondOrder(1);
+  OBBitVec fixedBonds;
+  fixedBonds.SetBitOn(1);
+  rlist2.SetFixedBonds(fixedBonds);
+  rlist2.Setup(*mol);
+  OB_ASSERT(rlist2.Size() == 4);
+  rlist1.Setup(*mol);
+  OB_ASSERT(rlist1.Size() == 5);
+}
+
 
 int rotortest(int argc, char* argv[])
 {
@@ -213,6 +254,9 @@ int rotortest(int argc, char* argv[])
   case 4:
     testOBRotorListFixedBonds();
     break;
+  case 5:
+    testOBRotorListCachedPerception();
+    break;
   default:
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
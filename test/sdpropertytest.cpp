@@ -0,0 +1,232 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/generic.h>
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace OpenBabel;
+
+// Items with several lines, white space, duplicate and unusual names
+static const char *sdfile =
+  "\n"
+  "  test\n"
+  "\n"
+  "  2  1  0  0  0  0  0  0  0  0999 V2000\n"
+  "    0.0000    0.0000    0.0000 C   0  0  0  0  0  0  0  0  0  0  0  0\n"
+  "    1.5000    0.0000    0.0000 O   0  0  0  0  0  0  0  0  0  0  0  0\n"
+  "  1  2  1  0  0  0  0\n"
+  "M  END\n"
+  ">  <ID>\n"
+  "42\n"
+  "\n"
+  "> 1 <NAME> (1)\n"
+  "  methanol  \n"
+  "\n"
+  ">  <notes>\n"
+  "first line\n"
+  "  second line\t\n"
+  "\n"
+  "this line is not an item\n"
+  ">  <ID>\n"
+  "43\n"
+  "\n"
+  ">  <empty>\n"
+  "\n"
+  ">  <PartialCharges>\n"
+  "none\n"
+  "\n"
+  "$$$$\n";
+
+static OBMol ReadSD(bool lazy)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("sdf"));
+  if (lazy)
+    conv.AddOption("L", OBConversion::INOPTIONS);
+  OBMol mol;
+  OB_REQUIRE(conv.ReadString(&mol, sdfile));
+  return mol;
+}
+
+// The OBPairData read from the file
+static vector<OBGenericData*> FileItems(OBMol &mol)
+{
+  vector<OBGenericData*> items;
+  vector<OBGenericData*> pairs = mol.GetAllData(OBGenericDataType::PairData);
+  for (unsigned int i = 0; i < pairs.size(); ++i)
+    if (pairs[i]->GetOrigin() == fileformatInput)
+      items.push_back(pairs[i]);
+  return items;
+}
+
+static string WriteSD(OBMol &mol)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("sdf"));
+  return conv.WriteString(&mol);
+}
+
+// The items read with -aL are those read as OBPairData, in the same order
+void testItems()
+{
+  OBMol eager = ReadSD(false);
+  OBMol lazy = ReadSD(true);
+  OB_COMPARE(string(lazy.GetTitle()), string(eager.GetTitle()));
+
+  OBPropertyBlockData *block = dynamic_cast<OBPropertyBlockData*>(
+    lazy.GetData(OBGenericDataType::PropertyBlockData));
+  OB_REQUIRE(block);
+  vector<OBGenericData*> pairs = FileItems(eager);
+  OB_COMPARE(block->NumItems(), pairs.size());
+  for (unsigned int i = 0; i < block->NumItems() && i < pairs.size(); ++i) {
+    OB_COMPARE(block->GetItemAttribute(i), pairs[i]->GetAttribute());
+    OB_COMPARE(block->GetItemValue(i), pairs[i]->GetValue());
+    OB_ASSERT(!block->IsExtracted(i));
+  }
+
+  // listing the OBPairData turns all the items into OBPairData
+  vector<OBGenericData*> lazyPairs = FileItems(lazy);
+  OB_COMPARE(lazyPairs.size(), pairs.size());
+  for (unsigned int i = 0; i < lazyPairs.size() && i < pairs.size(); ++i) {
+    OB_COMPARE(lazyPairs[i]->GetAttribute(), pairs[i]->GetAttribute());
+    OB_COMPARE(lazyPairs[i]->GetValue(), pairs[i]->GetValue());
+  }
+  OB_ASSERT(!lazy.HasData(OBGenericDataType::PropertyBlockData));
+}
+
+// An item is parsed when it is looked up; the others stay in the text
+void testLookup()
+{
+  OBMol eager = ReadSD(false);
+  OBMol lazy = ReadSD(true);
+  const string expected = WriteSD(eager);
+  OB_COMPARE(WriteSD(lazy), expected);
+
+  OB_ASSERT(lazy.HasData("notes"));
+  OBGenericData *notes = lazy.GetData("notes");
+  OB_REQUIRE(notes);
+  OB_COMPARE(notes->GetDataType(), OBGenericDataType::PairData);
+  OB_COMPARE(notes->GetValue(), string("first line\nsecond line"));
+  OB_ASSERT(lazy.GetData("notes") == notes);
+  OB_ASSERT(!lazy.HasData("missing"));
+  OB_ASSERT(lazy.GetData("missing") == NULL);
+
+  // the first of the items with the same name, as for GetData() on OBPairData
+  OB_COMPARE(lazy.GetData("ID")->GetValue(), eager.GetData("ID")->GetValue());
+
+  OBPropertyBlockData *block = static_cast<OBPropertyBlockData*>(
+    lazy.GetData(OBGenericDataType::PropertyBlockData));
+  OB_REQUIRE(block);
+  // "notes" and the items before it
+  unsigned int extracted = 0;
+  for (unsigned int i = 0; i < block->NumItems(); ++i)
+    if (block->IsExtracted(i))
+      ++extracted;
+  OB_COMPARE(extracted, 3);
+  OB_COMPARE(WriteSD(lazy), expected);
+
+  // a changed value is written in its place
+  static_cast<OBPairData*>(notes)->SetValue("changed");
+  string written = WriteSD(lazy);
+  OB_ASSERT(written.find("changed") != string::npos);
+  OB_ASSERT(written.find("first line") == string::npos);
+  OB_ASSERT(written.find("<NAME>") < written.find("changed"));
+  OB_ASSERT(written.find("changed") < written.find("<empty>"));
+  OB_COMPARE(written.size(), expected.size() - string("first line\nsecond line").size()
+                             + string("changed").size());
+
+  OB_ASSERT(lazy.DeleteData("empty"));
+  OB_ASSERT(!lazy.HasData("empty"));
+  OB_ASSERT(WriteSD(lazy).find("<empty>") == string::npos);
+}
+
+// Copies of a molecule have their own items
+void testCopy()
+{
+  OBMol lazy = ReadSD(true);
+  const string expected = WriteSD(lazy);
+  OB_REQUIRE(lazy.GetData("notes"));
+  OBMol copy(lazy);
+  OB_ASSERT(copy.HasData(OBGenericDataType::PropertyBlockData));
+  OB_COMPARE(WriteSD(copy), WriteSD(lazy));
+  OB_COMPARE(WriteSD(copy).size(), expected.size());
+  lazy.DeleteData(OBGenericDataType::PairData);
+  OB_ASSERT(!lazy.HasData("ID"));
+  OB_COMPARE(copy.GetData("ID")->GetValue(), string("42"));
+}
+
+// Reading with -aL doesn't change the order of the items written, also when
+// an item in the middle is used by a filter
+static string ConvertSD(const string &input, bool lazy)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInAndOutFormats("sdf", "sdf"));
+  if (lazy)
+    conv.AddOption("L", OBConversion::INOPTIONS);
+  conv.AddOption("filter", OBConversion::GENOPTIONS, "C>1");
+  stringstream in(input), out;
+  conv.Convert(&in, &out);
+  return out.str();
+}
+
+void testFilterOrder()
+{
+  string input(sdfile);
+  input.replace(input.find(">  <notes>"), 0, ">  <C>\n2\n\n");
+  const string eager = ConvertSD(input, false);
+  OB_ASSERT(eager.find("<C>") != string::npos);
+  OB_ASSERT(eager.find("<NAME>") < eager.find("<C>"));
+  OB_ASSERT(eager.find("<C>") < eager.find("<notes>"));
+  OB_COMPARE(ConvertSD(input, true), eager);
+
+  // a record that doesn't pass the filter
+  input.replace(input.find("<C>\n2"), 6, "<C>\n0");
+  OB_COMPARE(ConvertSD(input + input, true), string());
+}
+
+int sdpropertytest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testItems();
+    break;
+  case 2:
+    testLookup();
+    break;
+  case 3:
+    testCopy();
+    break;
+  case 4:
+    testFilterOrder();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
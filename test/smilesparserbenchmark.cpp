@@ -0,0 +1,138 @@
+#include "obbench.h"
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+using namespace OpenBabel;
+
+template<typename T>
+static string ToString(const T &value)
+{
+  stringstream ss;
+  ss << value;
+  return ss.str();
+}
+
+static void PrintRate(const string &what, double count)
+{
+  const vector<BenchmarkResults::Result> &results = BenchmarkResults::instance().results();
+  if (!results.empty() && results.back().secondsPerIter > 0.0)
+    cout << "  " << static_cast<unsigned long>(count / results.back().secondsPerIter)
+         << " " << what << "/s" << endl;
+}
+
+static unsigned long ReadLines(const string &text, bool general)
+{
+  stringstream in(text);
+  OBConversion conv;
+  conv.SetInFormat("smi");
+  if (general)
+    conv.AddOption("g", OBConversion::INOPTIONS);
+  conv.SetInStream(&in, false);
+  OBMol mol;
+  unsigned long lines = 0;
+  while (conv.Read(&mol))
+    ++lines;
+  return lines;
+}
+
+// Lines per second read from memory by the SMILES format, with the fast
+// path of the parser and with the general parser only (the g option)
+void benchmarkFile(const string &source, size_t minSize)
+{
+  ifstream ifs(OBTestUtil::GetFilename(source).c_str(), ios_base::in | ios_base::binary);
+  stringstream contents;
+  contents << ifs.rdbuf();
+  string data = contents.str();
+  if (data.empty()) {
+    cout << source << " skipped: cannot read it" << endl;
+    return;
+  }
+  string text;
+  while (text.size() < minSize)
+    text += data;
+
+  BenchmarkResults &results = BenchmarkResults::instance();
+  results.setLabel("file", source);
+
+  ReadLines(text, true); // warms up the allocator, not timed
+  const char *modes[] = { "general", "fast" };
+  for (unsigned int i = 0; i < 2; ++i) {
+    unsigned long lines = 0;
+    OB_BENCHMARK_STR(source + " (" + modes[i] + ")")
+      lines = ReadLines(text, i == 0);
+    PrintRate("lines", lines);
+    results.setLabel("lines", ToString(lines));
+  }
+
+  results.clearLabels();
+}
+
+static void usage()
+{
+  cout << "Usage: smilesparserbenchmark [-file <name>] [-size <MB>]\n"
+       << "                             [-json <file>] [-csv <file>]\n\n"
+       << "  -file    a SMILES file in test/files (default: nci.smi and aromatics.smi)\n"
+       << "  -size    size of the input, made by repeating the file (default 4)\n"
+       << "  -json    write the results as JSON\n"
+       << "  -csv     write the results as CSV\n";
+}
+
+int main(int argc, char* argv[])
+{
+  // Define location of file formats and data files for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+  if (!getenv("BABEL_DATADIR")) {
+    static char datadir[BUFF_SIZE];
+    snprintf(datadir, BUFF_SIZE, "BABEL_DATADIR=%s../../data", TESTDATADIR);
+    putenv(datadir);
+  }
+
+  // some test molecules cannot be kekulized
+  obErrorLog.SetOutputLevel(obError);
+
+  vector<string> files;
+  string json, csv;
+  double sizeMB = 4.0;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-file"))
+      files.push_back(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-size"))
+      sizeMB = atof(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "-json"))
+      json = argv[++i];
+    else if (i + 1 < argc && !strcmp(argv[i], "-csv"))
+      csv = argv[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (files.empty()) {
+    files.push_back("nci.smi");
+    files.push_back("aromatics.smi");
+  }
+
+  const size_t minSize = static_cast<size_t>(sizeMB * 1024 * 1024);
+  for (unsigned int i = 0; i < files.size(); ++i)
+    benchmarkFile(files[i], minSize);
+
+  if (!json.empty()) {
+    ofstream ofs(json.c_str());
+    BenchmarkResults::instance().writeJSON(ofs);
+  }
+  if (!csv.empty()) {
+    ofstream ofs(csv.c_str());
+    BenchmarkResults::instance().writeCSV(ofs);
+  }
+
+  return 0;
+}
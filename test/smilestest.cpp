@@ -9,6 +9,8 @@
 #include <openbabel/graphsym.h>
 #include <openbabel/canon.h>
 #include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/obiter.h>
 
 using namespace std;
 using namespace OpenBabel;
@@ -278,6 +280,81 @@ void genericSmilesCanonicalTest(const std::string &smiles)
 }
 
 
+static void CompareMolecules(OBMol &fast, OBMol &full)
+{
+  OB_COMPARE(string(fast.GetTitle()), string(full.GetTitle()));
+  OB_REQUIRE(fast.NumAtoms() == full.NumAtoms());
+  OB_REQUIRE(fast.NumBonds() == full.NumBonds());
+  FOR_ATOMS_OF_MOL(a, fast) {
+    OBAtom *b = full.GetAtom(a->GetIdx());
+    OB_COMPARE(a->GetAtomicNum(), b->GetAtomicNum());
+    OB_COMPARE(a->GetFormalCharge(), b->GetFormalCharge());
+    OB_COMPARE(a->GetIsotope(), b->GetIsotope());
+    OB_COMPARE(a->GetImplicitHCount(), b->GetImplicitHCount());
+    OB_COMPARE(a->GetSpinMultiplicity(), b->GetSpinMultiplicity());
+    OB_COMPARE(a->IsAromatic(), b->IsAromatic());
+    // the neighbours in the same order, for stereo and SMILES output
+    OB_REQUIRE(a->GetExplicitDegree() == b->GetExplicitDegree());
+    OBBondIterator i, j;
+    OBAtom *nbrA = a->BeginNbrAtom(i), *nbrB = b->BeginNbrAtom(j);
+    for (; nbrA && nbrB; nbrA = a->NextNbrAtom(i), nbrB = b->NextNbrAtom(j))
+      OB_COMPARE(nbrA->GetIdx(), nbrB->GetIdx());
+  }
+  FOR_BONDS_OF_MOL(a, fast) {
+    OBBond *b = full.GetBond(a->GetIdx());
+    OB_COMPARE(a->GetBeginAtomIdx(), b->GetBeginAtomIdx());
+    OB_COMPARE(a->GetEndAtomIdx(), b->GetEndAtomIdx());
+    OB_COMPARE(a->GetBondOrder(), b->GetBondOrder());
+    OB_COMPARE(a->IsAromatic(), b->IsAromatic());
+  }
+  OB_COMPARE(fast.HasAromaticPerceived(), full.HasAromaticPerceived());
+  OB_COMPARE(fast.GetAllData(OBGenericDataType::StereoData).size(),
+             full.GetAllData(OBGenericDataType::StereoData).size());
+}
+
+// Molecules read by the fast path of the SMILES parser are identical to
+// those read by the general parser (the g option)
+void testFastParser()
+{
+  cout << "testFastParser()" << endl;
+  OBConversion fastConv, fullConv;
+  OB_REQUIRE( fastConv.SetInFormat("smi") );
+  OB_REQUIRE( fullConv.SetInFormat("smi") );
+  fullConv.AddOption("g", OBConversion::INOPTIONS);
+  OBMol fast, full;
+
+  const char *smiles[] = {
+    "C1CC%12CC1CC%12", "[13CH3][NH3+]", "c1cc[nH]c1", "C(C)(C)1CC1", "[Na+].[Cl-]",
+    "C=1CC1", "C1CC=1", "C1.C1", "[Fe+2]", "C12CC1C2", "c1ccccc1-c2ccccc2",
+    "[se]1cccc1", "[O-]C(=O)C", "C1CC(CC1)1CC1", "c1cc2ccccc2cc1", "[2H]C([2H])([2H])Br",
+    "OC(=O)C(N)C\r", "[Cu+++]", "[N+-]", "[*]C*", "C$C", "c1ccc:c1",
+    // invalid, or read by the general parser
+    "C(C", "C)C", "1CC", "[C", "C1CC", "C11", "C=", "C[C@H](O)N", "F/C=C/F",
+    "[CH2:1]C", "CC>>CC", "C%(100)CC%(100)", "[C.]C", "[Cn]", "[Xx]", "[C+20]", "", NULL };
+  for (unsigned int i = 0; smiles[i]; ++i) {
+    bool ok = fullConv.ReadString(&full, smiles[i]);
+    OB_COMPARE(fastConv.ReadString(&fast, smiles[i]), ok);
+    if (ok)
+      CompareMolecules(fast, full);
+  }
+
+  const char *files[] = { "nci.smi", "aromatics.smi", "cansmi-roundtrip.smi",
+                          "attype.00.smi", "FormulaTest.smi", NULL };
+  for (unsigned int i = 0; files[i]; ++i) {
+    const string filename = OBTestUtil::GetFilename(files[i]);
+    bool ok = fullConv.ReadFile(&full, filename);
+    bool fastOk = fastConv.ReadFile(&fast, filename);
+    unsigned int count = 0;
+    for (; ok && fastOk; ok = fullConv.Read(&full), fastOk = fastConv.Read(&fast)) {
+      CompareMolecules(fast, full);
+      ++count;
+    }
+    OB_COMPARE(fastOk, ok);
+    OB_ASSERT(count > 0);
+  }
+}
+
+
 int smilestest(int argc, char* argv[])
 {
   int defaultchoice = 1;
@@ -333,6 +410,9 @@ int smilestest(int argc, char* argv[])
     // FAILING: need to fix graphsymtest first!!
     // ring gets converted to aromatic ring, adding H on n (i.e. N -> [nH])
     //genericSmilesCanonicalTest("CC1=CN(C(=O)NC1=O)[C@H]2C[C@@H]([C@H](O2)CNCC3=CC=CC=C3)O");
+  case 4:
+    testFastParser();
+    break;
   default:
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
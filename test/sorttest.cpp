@@ -0,0 +1,185 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/generic.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace OpenBabel;
+
+// Alkanes and alcohols in a scrambled order; those with the same formula
+// are numbered in the order they come
+static string Molecules()
+{
+  stringstream ss;
+  for (unsigned int i = 0; i < 300; ++i) {
+    unsigned int length = 1 + (i * 37) % 23;
+    ss << string(length, 'C') << (i % 2 ? "O" : "") << '\t' << i << '\n';
+  }
+  return ss.str();
+}
+
+// Sort the molecules with --sort, holding at most sortmem MB of them in
+// memory when it is given
+static string Sort(const string &molecules, const char *desc, const char *sortmem = NULL)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInAndOutFormats("smi", "smi"));
+  conv.AddOption("sort", OBConversion::GENOPTIONS, desc);
+  if (sortmem)
+    conv.AddOption("sortmem", OBConversion::GENOPTIONS, sortmem);
+  stringstream in(molecules), out;
+  OB_COMPARE(conv.Convert(&in, &out), 300);
+  return out.str();
+}
+
+static vector<string> Lines(const string &text)
+{
+  vector<string> lines;
+  istringstream ss(text);
+  string line;
+  while (getline(ss, line))
+    lines.push_back(line);
+  return lines;
+}
+
+// Sorting in temporary files gives the same order as sorting in memory,
+// with the molecules of the same weight in the input order
+void testMW()
+{
+  const string molecules = Molecules();
+  const string inMemory = Sort(molecules, "MW+");
+  OB_COMPARE(Sort(molecules, "MW+", "0.01"), inMemory);
+
+  vector<string> lines = Lines(inMemory);
+  OB_COMPARE(lines.size(), 300);
+  double lastMW = 0.0;
+  int lastIndex = -1;
+  for (unsigned int i = 0; i < lines.size(); ++i) {
+    int index;
+    double mw;
+    istringstream fields(lines[i].substr(lines[i].find('\t') + 1));
+    OB_REQUIRE(fields >> index >> mw);
+    OB_ASSERT(mw >= lastMW);
+    if (mw == lastMW)
+      OB_ASSERT(index > lastIndex);
+    lastMW = mw;
+    lastIndex = index;
+  }
+}
+
+// The reverse order, and descriptors with string values
+void testReverseAndStrings()
+{
+  const string molecules = Molecules();
+  OB_COMPARE(Sort(molecules, "~MW", "0.01"), Sort(molecules, "~MW"));
+  const string titles = Sort(molecules, "title", "0.01");
+  OB_COMPARE(titles, Sort(molecules, "title"));
+  vector<string> lines = Lines(titles);
+  for (unsigned int i = 1; i < lines.size(); ++i)
+    OB_ASSERT(lines[i - 1].substr(lines[i - 1].find('\t')) <= lines[i].substr(lines[i].find('\t')));
+}
+
+// The molecules as SD records with a comment line and data items
+static string SDMolecules()
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInAndOutFormats("smi", "sdf"));
+  vector<string> lines = Lines(Molecules());
+  stringstream sd;
+  for (unsigned int i = 0; i < lines.size(); ++i) {
+    OBMol mol;
+    OB_REQUIRE(conv.ReadString(&mol, lines[i]));
+    OBCommentData *comment = new OBCommentData;
+    comment->SetData("comment " + lines[i].substr(lines[i].find('\t') + 1));
+    mol.SetData(comment);
+    OBPairData *item = new OBPairData;
+    item->SetAttribute("index");
+    item->SetValue(lines[i].substr(lines[i].find('\t') + 1));
+    mol.SetData(item);
+    sd << conv.WriteString(&mol);
+  }
+  return sd.str();
+}
+
+// Without the header lines with the program name and time
+static string WithoutProgramLines(const string &sd)
+{
+  vector<string> lines = Lines(sd);
+  string result;
+  for (unsigned int i = 0; i < lines.size(); ++i)
+    if (lines[i].find("OpenBabel") == string::npos)
+      result += lines[i] + '\n';
+  return result;
+}
+
+static string SortSD(const string &molecules, const char *desc, const char *sortmem,
+                     bool lazy)
+{
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInAndOutFormats("sdf", "sdf"));
+  if (lazy)
+    conv.AddOption("L", OBConversion::INOPTIONS);
+  conv.AddOption("sort", OBConversion::GENOPTIONS, desc);
+  if (sortmem)
+    conv.AddOption("sortmem", OBConversion::GENOPTIONS, sortmem);
+  stringstream in(molecules), out;
+  OB_COMPARE(conv.Convert(&in, &out), 300);
+  return WithoutProgramLines(out.str());
+}
+
+// The comments and data items of SD records are kept in temporary files
+void testSDData()
+{
+  const string molecules = SDMolecules();
+  for (int lazy = 0; lazy < 2; ++lazy) {
+    const string inMemory = SortSD(molecules, "MW", NULL, lazy != 0);
+    OB_ASSERT(inMemory.find("comment 299") != string::npos);
+    OB_ASSERT(inMemory.find("<index>") != string::npos);
+    OB_COMPARE(SortSD(molecules, "MW", "0.01", lazy != 0), inMemory);
+  }
+}
+
+int sorttest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testMW();
+    break;
+  case 2:
+    testReverseAndStrings();
+    break;
+  case 3:
+    testSDData();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
@@ -14,6 +14,8 @@ In both cases, the test file is run directly from the source folder,
 and so you can quickly develop the tests and try them out.
 """
 
+import os
+import tempfile
 import unittest
 
 from testbabel import run_exec, BaseTest
@@ -52,5 +54,34 @@ C([2H])([2H])([2H])[2H]	deuteromethane"""
                                      "obabel -ismi -osmi --unique %s" % param[0])
             self.assertConverted(error, param[1])
 
+    def testFindDupsHashed(self):
+        """Look for duplicates using --unique with --uniquehash"""
+
+        params = [("", 13), ("/nostereo", 9), ("cansmiNS", 7)]
+
+        for param in params:
+            for hashparam in ["", "verify"]:
+                output, error = run_exec(self.smiles,
+                                         "obabel -ismi -osmi --unique %s --uniquehash %s"
+                                         % (param[0], hashparam))
+                self.assertConverted(error, param[1])
+        output, error = run_exec(self.smiles,
+                                 "obabel -ismi -osmi --unique --uniquehash verify")
+        self.assertTrue("Removed DME - a duplicate of dimethyl ether" in error)
+
+    def testFindDupsThreads(self):
+        """Look for duplicates using --unique with --threads"""
+
+        fd, filename = tempfile.mkstemp(suffix=".smi")
+        with os.fdopen(fd, "w") as f:
+            f.write(self.smiles + "\n")
+        try:
+            for param in [("", 13), ("cansmiNS", 7)]:
+                output, error = run_exec(
+                    "obabel %s -osmi --unique %s --threads 2" % (filename, param[0]))
+                self.assertConverted(error, param[1])
+        finally:
+            os.remove(filename)
+
 if __name__ == "__main__":
     unittest.main()
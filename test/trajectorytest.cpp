@@ -0,0 +1,156 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/obiter.h>
+#include <openbabel/obconversion.h>
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace OpenBabel;
+
+// A small molecule with three conformers: the first one and two others
+// moved a little
+static OBMol Frames()
+{
+  OBMol mol;
+  OBMolPtr first = OBTestUtil::ReadFile("forcefield.sdf");
+  mol = *first;
+  const unsigned int n = mol.NumAtoms();
+  for (unsigned int c = 1; c <= 2; ++c) {
+    double *coords = new double[n * 3];
+    for (unsigned int i = 0; i < n * 3; ++i)
+      coords[i] = mol.GetCoordinates()[i] + 0.1 * c * (static_cast<int>(i % 3) - 1);
+    mol.AddConformer(coords);
+  }
+  return mol;
+}
+
+static bool SameCoordinates(OBMol &mol, const double *coords, double tolerance)
+{
+  for (unsigned int i = 0; i < mol.NumAtoms() * 3; ++i)
+    if (fabs(mol.GetCoordinates()[i] - coords[i]) > tolerance)
+      return false;
+  return true;
+}
+
+// With -aT, the frames of an XYZ file take the bonds of the first one
+void testXYZ()
+{
+  OBMol frames = Frames();
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("xyz"));
+  string xyz;
+  for (int c = 0; c < frames.NumConformers(); ++c) {
+    frames.SetConformer(c);
+    xyz += conv.WriteString(&frames);
+  }
+  // a frame with other atoms afterwards
+  xyz += "2\nhydrogen\nH 0 0 0\nH 0 0 0.74\n";
+
+  OBConversion reader;
+  OB_REQUIRE(reader.SetInFormat("xyz"));
+  OBMol plain;
+  OB_REQUIRE(reader.ReadString(&plain, xyz));
+
+  reader.AddOption("T", OBConversion::INOPTIONS);
+  istringstream in(xyz);
+  OBMol mol;
+  OB_REQUIRE(reader.Read(&mol, &in));
+  OB_COMPARE(mol.NumBonds(), plain.NumBonds());
+  OBAtom *firstAtom = mol.GetAtom(1);
+  for (int c = 1; c <= 2; ++c) {
+    // the molecule is reused: only the coordinates change
+    OB_REQUIRE(reader.Read(&mol));
+    OB_ASSERT(mol.GetAtom(1) == firstAtom);
+    OB_COMPARE(mol.NumBonds(), plain.NumBonds());
+    OB_ASSERT(SameCoordinates(mol, frames.GetConformer(c), 1e-4));
+  }
+  OB_REQUIRE(reader.Read(&mol));
+  OB_COMPARE(mol.NumAtoms(), 2);
+  OB_COMPARE(mol.NumBonds(), 1);
+  OB_ASSERT(!reader.Read(&mol));
+
+  // a new molecule for each frame takes the bonds of the last topology
+  istringstream again(xyz);
+  OBMol first, second;
+  OB_REQUIRE(reader.Read(&first, &again));
+  OB_REQUIRE(reader.Read(&second));
+  OB_COMPARE(second.NumBonds(), plain.NumBonds());
+  OB_ASSERT(SameCoordinates(second, frames.GetConformer(1), 1e-4));
+}
+
+// With -aT, an XTC file is read one frame at a time (0.001 nm precision).
+// Only registered when the XTC format is built (rpc/xdr.h found).
+void testXTC()
+{
+  OBMol frames = Frames();
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("xtc"));
+  string xtc = conv.WriteString(&frames);
+
+  OBConversion reader;
+  OB_REQUIRE(reader.SetInFormat("xtc"));
+  reader.AddOption("T", OBConversion::INOPTIONS);
+  istringstream in(xtc);
+  OBMol mol = *OBTestUtil::ReadFile("forcefield.sdf");
+  OBAtom *firstAtom = mol.GetAtom(1);
+  unsigned int count = 0;
+  for (bool ok = reader.Read(&mol, &in); ok; ok = reader.Read(&mol)) {
+    OB_ASSERT(mol.GetAtom(1) == firstAtom);
+    OB_ASSERT(SameCoordinates(mol, frames.GetConformer(count), 0.01));
+    ++count;
+  }
+  OB_COMPARE(count, 3);
+
+  // the atoms and bonds from a topology file, skipping a frame
+  reader.AddOption("F", OBConversion::INOPTIONS,
+                   OBTestUtil::GetFilename("forcefield.sdf").c_str());
+  istringstream skip(xtc);
+  reader.SetInStream(&skip);
+  OB_COMPARE(reader.GetInFormat()->SkipObjects(1, &reader), 1);
+  OBMol frame;
+  OB_REQUIRE(reader.Read(&frame));
+  OB_COMPARE(frame.NumAtoms(), frames.NumAtoms());
+  OB_COMPARE(frame.NumBonds(), frames.NumBonds());
+  OB_ASSERT(SameCoordinates(frame, frames.GetConformer(1), 0.01));
+}
+
+int trajectorytest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testXYZ();
+    break;
+  case 2:
+    testXTC();
+    break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
@@ -22,6 +22,7 @@ GNU General Public License for more details.
 #endif
 
 #include <cstdlib>
+#include <cstring>
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/mol.h>
@@ -44,17 +45,30 @@ OBRotorList rl;
 
 int main(int argc,char *argv[])
 {
-  if (argc != 4)
+  int numThreads = 1;
+  unsigned int seed = 0;
+  int arg = 1;
+  for (; arg < argc - 1 && argv[arg][0] == '-'; arg += 2)
     {
-      cout << "Usage: obconformer NSteps GeomSteps <file>" << endl;
+      if (strcmp(argv[arg], "-nthreads") == 0)
+        numThreads = atoi(argv[arg + 1]);
+      else if (strcmp(argv[arg], "-seed") == 0)
+        seed = strtoul(argv[arg + 1], NULL, 10);
+      else
+        break;
+    }
+
+  if (argc - arg != 3)
+    {
+      cout << "Usage: obconformer [-nthreads N] [-seed N] NSteps GeomSteps <file>" << endl;
       return(-1);
     }
 
   int weightSteps, geomSteps;
-  weightSteps = atoi(argv[1]);
-  geomSteps = atoi(argv[2]);
+  weightSteps = atoi(argv[arg]);
+  geomSteps = atoi(argv[arg + 1]);
 
-  ifstream ifs(argv[3]);
+  ifstream ifs(argv[arg + 2]);
   if (!ifs)
     {
       cerr << "Error! Cannot read input file!" << endl;
@@ -64,7 +78,7 @@ int main(int argc,char *argv[])
   OBConversion conv(&ifs, &cout);
   OBFormat* pFormat;
 
-  pFormat = conv.FormatFromExt(argv[3]);
+  pFormat = conv.FormatFromExt(argv[arg + 2]);
   if ( pFormat == NULL )
     {
       cerr << "Error! Cannot read file format!" << endl;
@@ -82,6 +96,8 @@ int main(int argc,char *argv[])
   OBForceField *pFF = OBForceField::FindForceField("MMFF94");
   pFF->SetLogFile(&cerr);
   pFF->SetLogLevel(OBFF_LOGLVL_LOW);
+  pFF->SetNumThreads(numThreads);
+  pFF->SetRandomSeed(seed);
 
   while(ifs.peek() != EOF && ifs.good())
     {
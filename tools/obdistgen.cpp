@@ -44,8 +44,15 @@ int main(int argc,char **argv)
   int c;
   string basename, filename = "";
 
+  unsigned int numConformers = 1;
+  int numThreads = 1;
+  if (argc > 2)
+    numConformers = atoi(argv[2]);
+  if (argc > 3)
+    numThreads = atoi(argv[3]);
+
   if (argc < 2) {
-    cout << "Usage: obdistgen <filename>" << endl;
+    cout << "Usage: obdistgen <filename> [conformers [threads]]" << endl;
     cout << endl;
     exit(-1);
   } else {
@@ -93,11 +100,11 @@ int main(int argc,char **argv)
 
       OBDistanceGeometry dg;
       dg.Setup(mol);
+      dg.SetNumThreads(numThreads);
 
-      for (unsigned int i = 1; i < 2; ++i) {
-        //        cout << i << endl;
+      // keep the lowest energy conformer out of several random starts
+      if (numConformers < 2 || !dg.AddConformers(numConformers))
         dg.AddConformer();
-      }
       dg.GetConformers(mol);
       //      cout << " Conformers: " << mol.NumConformers() << endl;
       // Check the energies
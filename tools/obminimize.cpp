@@ -42,6 +42,8 @@ int main(int argc,char **argv)
   int steps = 2500;
   double crit = 1e-6;
   bool sd = false;
+  bool lbfgs = false;
+  bool fire = false;
   bool cut = false;
   bool newton = false;
   bool hydrogens = false;
@@ -64,6 +66,10 @@ int main(int argc,char **argv)
     cout << endl;
     cout << "  -sd         use steepest descent algorithm" << endl;
     cout << endl;
+    cout << "  -lbfgs      use L-BFGS algorithm" << endl;
+    cout << endl;
+    cout << "  -fire       use FIRE algorithm" << endl;
+    cout << endl;
     cout << "  -newton     use Newton2Num linesearch (default=Simple)" << endl;
     cout << endl;
     cout << "  -ff ffid    select a forcefield:" << endl;
@@ -112,6 +118,16 @@ int main(int argc,char **argv)
         sd = true;
         ifile++;
       }
+      // L-BFGS
+      if (option == "-lbfgs") {
+        lbfgs = true;
+        ifile++;
+      }
+      // FIRE
+      if (option == "-fire") {
+        fire = true;
+        ifile++;
+      }
       // enable cut-off
       if (option == "-cut") {
         cut = true;
@@ -141,6 +157,8 @@ int main(int argc,char **argv)
 
       if (option == "-cg") {
         sd = false;
+        lbfgs = false;
+        fire = false;
         ifile++;
       }
 
@@ -219,6 +237,10 @@ int main(int argc,char **argv)
     timer.Start();
     if (sd) {
       pFF->SteepestDescentInitialize(steps, crit);
+    } else if (lbfgs) {
+      pFF->LBFGSInitialize(steps, crit);
+    } else if (fire) {
+      pFF->FIREInitialize(steps, crit);
     } else {
       pFF->ConjugateGradientsInitialize(steps, crit);
     }
@@ -227,6 +249,10 @@ int main(int argc,char **argv)
     while (done) {
       if (sd)
         done = pFF->SteepestDescentTakeNSteps(1);
+      else if (lbfgs)
+        done = pFF->LBFGSTakeNSteps(1);
+      else if (fire)
+        done = pFF->FIRETakeNSteps(1);
       else
         done = pFF->ConjugateGradientsTakeNSteps(1);
       totalSteps++;
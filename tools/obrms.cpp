@@ -35,6 +35,7 @@
 #include <openbabel/isomorphism.h>
 #include <openbabel/shared_ptr.h>
 #include <openbabel/obutil.h>
+#include <openbabel/math/align.h>
 
 #include "getopt.h"
 
@@ -183,6 +184,76 @@ public:
 	}
 };
 
+/* Collects the automorphisms of the first molecule as atom permutations
+ * (the identity is left out).
+ */
+class PermutationFunctor: public OBIsomorphismMapper::Functor
+{
+	OBRMSDMatrix& ensemble;
+	public:
+	PermutationFunctor(OBRMSDMatrix& e) : ensemble(e)
+	{
+	}
+
+	bool operator()(OBIsomorphismMapper::Mapping &map)
+	{
+		vector<unsigned> perm(map.size());
+		bool identity = true;
+		for (unsigned i = 0, n = map.size(); i < n; i++)
+		{
+			perm[map[i].first] = map[i].second;
+			if (map[i].first != map[i].second)
+				identity = false;
+		}
+		if (!identity)
+			ensemble.AddPermutation(perm);
+		return false;
+	}
+};
+
+/* Computes the minimized RMSD of all pairs of molecules at once when they
+ * are conformers of the first molecule. The atoms of each molecule are put
+ * in the order of the first molecule and the automorphisms of the first
+ * molecule give the other correspondences, so this gives the same RMSDs as
+ * Matcher::computeRMSD for each pair. Returns false if a molecule does not
+ * match the first one.
+ */
+static bool computeRMSDMatrix(vector<OBMol>& mols, int nthreads, vector<double>& rmsd)
+{
+	if (mols.empty())
+		return false;
+	OBMol& first = mols[0];
+	unsigned N = first.NumAtoms();
+	obsharedptr<OBQuery> query(CompileMoleculeQuery(&first));
+	obsharedptr<OBIsomorphismMapper> mapper(OBIsomorphismMapper::GetInstance(query.get()));
+
+	OBRMSDMatrix ensemble(N);
+	ensemble.SetNumThreads(nthreads);
+	vector<double> coords(3 * N);
+	for (unsigned j = 0, n = mols.size(); j < n; j++)
+	{
+		if (mols[j].NumAtoms() != N)
+			return false;
+		OBIsomorphismMapper::Mapping map;
+		mapper->MapFirst(&mols[j], map);
+		if (map.size() != N)
+			return false;
+		for (unsigned i = 0; i < N; i++)
+		{
+			OBAtom *atom = mols[j].GetAtom(map[i].second + 1);
+			for (unsigned c = 0; c < 3; c++)
+				coords[3 * map[i].first + c] = atom->GetVector()[c];
+		}
+		ensemble.AddConformer(N ? &coords[0] : NULL);
+	}
+
+	PermutationFunctor funct(ensemble);
+	mapper->MapGeneric(funct, &first);
+
+	ensemble.GetMatrix(rmsd);
+	return true;
+}
+
 //preprocess molecule into a standardized state for heavy atom rmsd computation
 static void processMol(OBMol& mol)
 {
@@ -218,6 +289,7 @@ int main(int argc, char **argv)
 	bool separate = false;
 	bool help = false;
 	bool docross = false;
+	int nthreads = 1;
 	string fileRef;
 	string fileTest;
 	string fileOut;
@@ -231,6 +303,7 @@ int main(int argc, char **argv)
 	  "\t -m, --minimize   compute minimum RMSD\n"
 	  "\t -x, --cross      compute all n^2 RMSDs between molecules of reference file\n"
 	  "\t -s, --separate   separate reference file into constituent molecules and report best RMSD\n"
+	  "\t -n, --nthreads   number of threads for --cross --minimize\n"
 	  "\t -h, --help       help message\n";
 	struct option long_options[] = {
 	    {"firstonly", no_argument, 0, 'f'},
@@ -238,11 +311,12 @@ int main(int argc, char **argv)
 	    {"cross", no_argument, 0, 'x'},
 	    {"separate", no_argument, 0, 's'},
 	    {"out", required_argument, 0, 'o'},
+	    {"nthreads", required_argument, 0, 'n'},
 	    {"help", no_argument, 0, 'h'}
 	};
 	int option_index = 0;
 	int c = 0;
-	while ((c = getopt_long(argc, argv, "hfmxso:", long_options, &option_index) ) > 0) {
+	while ((c = getopt_long(argc, argv, "hfmxso:n:", long_options, &option_index) ) > 0) {
 	  switch(c) {
 	    case 'o':
 	      fileOut = optarg;
@@ -259,6 +333,9 @@ int main(int argc, char **argv)
 	    case 's':
 	      separate = true;
 	      break;
+	    case 'n':
+	      nthreads = atoi(optarg);
+	      break;
 	    case 'h':
 	      cout << helpmsg;
 	      exit(0);
@@ -322,6 +399,20 @@ int main(int argc, char **argv)
        refmols.push_back(molref);
     }
 
+    //conformers of one molecule are aligned in one batch
+    vector<double> rmsds;
+    if(minimize && computeRMSDMatrix(refmols, nthreads, rmsds)) {
+      for(unsigned i = 0, n = refmols.size() ; i < n; i++) {
+        cout << refmols[i].GetTitle();
+        for(unsigned j = 0; j < n; j++) {
+          double rmsd = i == j ? 0.0 : rmsds[OBRMSDMatrix::CondensedIndex(n, i, j)];
+          cout << ", " << rmsd;
+        }
+        cout << "\n";
+      }
+      return (0);
+    }
+
     for(unsigned i = 0, n = refmols.size() ; i < n; i++) {
       OBMol& ref = refmols[i];
       Matcher matcher(ref);